@@ -8,38 +8,48 @@
 
 #define LAUBERHORN_CLOCK_FREQ 250000000
 
-#define LAUBERHORN_NUM_CORES (5)
+#define LAUBERHORN_NUM_CORES (6)
 #define LAUBERHORN_NUM_WORKER_CORES (4)
+#define LAUBERHORN_NUM_BYPASS_CORES (2)
 #define LAUBERHORN_MAX_CORE_ID (47)
 #define LAUBERHORN_PKT_BUF_ADDR_WIDTH (24)
 #define LAUBERHORN_PKT_BUF_LEN_WIDTH (16)
 #define LAUBERHORN_DATAPATH_WIDTH (64)
 #define LAUBERHORN_MTU (9618)
 #define LAUBERHORN_ROUNDED_MTU (9664)
+#define LAUBERHORN_ECI_TX_RING_SLOTS (4)
 #define LAUBERHORN_PKT_BUF_RX_SIZE_PER_CORE (65536)
-#define LAUBERHORN_PKT_BUF_TX_SIZE_PER_CORE (9664)
-#define LAUBERHORN_PKT_BUF_SIZE (376000)
+#define LAUBERHORN_PKT_BUF_TX_SIZE_PER_CORE (38656)
+#define LAUBERHORN_PKT_BUF_SIZE (625152)
 #define LAUBERHORN_REG_WIDTH (64)
 #define LAUBERHORN_PID_WIDTH (16)
 #define LAUBERHORN_NUM_NEIGHBOR_ENTRIES (8)
+#define LAUBERHORN_BYPASS_RSS_TBL_SIZE (16)
 #define LAUBERHORN_NUM_LISTEN_PORTS (16)
 #define LAUBERHORN_NUM_SERVICES (8)
 #define LAUBERHORN_NUM_SESSIONS (16)
+#define LAUBERHORN_NUM_CLIENTS (8)
+#define LAUBERHORN_NUM_PENDING_CALLS (16)
 #define LAUBERHORN_NUM_PROCS (16)
 #define LAUBERHORN_RX_PKTS_PER_PROC (32)
 #define LAUBERHORN_BYPASS_HDR_WIDTH (432)
 #define LAUBERHORN_NUM_THREADS (64)
 #define LAUBERHORN_ONCRPC_INLINE_BYTES (48)
-#define LAUBERHORN_PKT_BUF_TX_OFFSET (327680)
+#define LAUBERHORN_ONCRPC_ARGS_LEN_WIDTH (6)
+#define LAUBERHORN_PKT_BUF_TX_OFFSET (393216)
 #define LAUBERHORN_HOST_REQ_WIDTH (512)
 #define LAUBERHORN_PKT_BUF_ID_WIDTH (12)
 #define LAUBERHORN_ECI_CORE_OFFSET (131072)
-#define LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET (65536)
+#define LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET (98304)
 #define LAUBERHORN_PKT_DESC_TY_WIDTH (3)
 #define LAUBERHORN_HOST_REQ_TY_WIDTH (3)
 #define LAUBERHORN_ECI_RX_BASE (0)
 #define LAUBERHORN_ECI_TX_BASE (32768)
 #define LAUBERHORN_ECI_OVERFLOW_OFFSET (256)
 #define LAUBERHORN_ECI_NUM_OVERFLOW_CL (76)
+#define LAUBERHORN_ECI_TX_RING_IDX_WIDTH (16)
+#define LAUBERHORN_ECI_TX_SLOT_STRIDE (16384)
+#define LAUBERHORN_ECI_TX_DOORBELL_OFFSET (128)
+#define LAUBERHORN_ECI_TX_STATUS_OFFSET (16256)
 
 #endif // __LAUBERHORN_CONFIG_H__
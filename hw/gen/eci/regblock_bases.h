@@ -12,35 +12,41 @@
 
 #define LAUBERHORN_ECI__ONC_RPC_CALL_DECODER_BASE 0x500
 
-#define LAUBERHORN_ECI__IP_ENCODER_BASE 0x600
+#define LAUBERHORN_ECI__ONC_RPC_REPLY_DECODER_BASE 0x600
 
-#define LAUBERHORN_ECI__ONC_RPC_REPLY_ENCODER_BASE 0x700
+#define LAUBERHORN_ECI__IP_ENCODER_BASE 0x700
 
-#define LAUBERHORN_ECI_PROFILER_BASE 0x800
+#define LAUBERHORN_ECI__ONC_RPC_REPLY_ENCODER_BASE 0x800
 
-#define LAUBERHORN_ECI_SCHED_BASE 0x900
+#define LAUBERHORN_ECI__ONC_RPC_CALL_ENCODER_BASE 0x900
 
-#define LAUBERHORN_ECI_DMA_BASE 0xa00
+#define LAUBERHORN_ECI_PROFILER_BASE 0xa00
 
-#define LAUBERHORN_ECI_THREAD_ROUTER_BASE 0xb00
+#define LAUBERHORN_ECI_SCHED_BASE 0xb00
 
-#define LAUBERHORN_ECI_HOST_IF_BASE 0xc00
+#define LAUBERHORN_ECI_DMA_BASE 0xc00
+
+#define LAUBERHORN_ECI_THREAD_ROUTER_BASE 0xd00
+
+#define LAUBERHORN_ECI_HOST_IF_BASE 0xe00
 
 static uint64_t __lauberhorn_eci_worker_bases[] __attribute__((unused)) = {
-  0xd00,
   0xf00,
   0x1100,
   0x1300,
   0x1500,
+  0x1700,
+  0x1900,
 };
 #define LAUBERHORN_ECI_WORKER_BASE(blockIdx) (__lauberhorn_eci_worker_bases[blockIdx])
 
 static uint64_t __lauberhorn_eci_preempt_bases[] __attribute__((unused)) = {
-  0xe00,
   0x1000,
   0x1200,
   0x1400,
   0x1600,
+  0x1800,
+  0x1a00,
 };
 #define LAUBERHORN_ECI_PREEMPT_BASE(blockIdx) (__lauberhorn_eci_preempt_bases[blockIdx])
 
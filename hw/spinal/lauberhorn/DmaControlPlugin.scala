@@ -2,7 +2,7 @@ package lauberhorn
 
 import jsteward.blocks.misc.RegBlockAlloc
 import lauberhorn.host.{BypassCmdSink, DatapathService, HostReq, HostReqData, HostReqType}
-import lauberhorn.net.{DecoderSink, PacketDesc, PacketDescType}
+import lauberhorn.net.{DecoderSink, InetChecksum, PacketDesc, PacketDescType}
 import spinal.core._
 import spinal.lib._
 import spinal.lib.bus.misc._
@@ -19,6 +19,8 @@ import scala.language.postfixOps
 case class RxPacketDescWithSource() extends Bundle {
   val desc = PacketDesc()
   val isBypass = Bool()
+  /** bypass core to deliver to, picked by [[lauberhorn.net.DecoderSink]] from the flow hash */
+  val bypassQueue = UInt(bypassQueueWidth bits)
 }
 
 /**
@@ -27,14 +29,19 @@ case class RxPacketDescWithSource() extends Bundle {
   * For RX, sits between the decoder pipeline and scheduler.  Consumes [[PacketDesc]] from the decoder pipeline and
   * produces [[lauberhorn.host.HostReq]], among which:
   *  - requests for the normal application cores go to [[Scheduler]]
-  *  - requests for the bypass channel goes directly to the [[DatapathService]] for bypass (core 0).
+  *  - requests for the bypass channel goes directly to the [[DatapathService]] of the bypass core picked by
+  *    [[lauberhorn.net.DecoderSink]] (cores 0 until NUM_BYPASS_CORES).
   *
   * Also manages the buffer in [[PacketBuffer]] with a [[PacketAlloc]].
   *
+  * UDP checksums are verified here, once the payload is in the packet buffer: the decoders sum up the headers, the
+  * payload is summed by [[DecoderSink]].  Bypass packets carry the result to the host; ONC-RPC calls that fail the
+  * check are dropped before they reach the [[Scheduler]].
+  *
   * For TX, sits between all [[DatapathService]] instances and the encoder pipeline.  Consumes [[lauberhorn.host.HostReq]]
   * from [[DatapathService]] and emits [[PacketDesc]] to the encoder pipeline.
   *
-  * The very first core (core ID 0) handles bypass traffic to/from the bypass channel on the host.  For RX, this
+  * The first NUM_BYPASS_CORES cores handle bypass traffic to/from the bypass channel on the host.  For RX, this
   * results in all traffic being packed into [[HostReqType.bypass]]; for TX, any packet that does not carry the
   * bypass type in the host descriptor is an error.
   */
@@ -55,7 +62,7 @@ class DmaControlPlugin extends FiberPlugin {
   lazy val dps = host.list[DatapathService]
   lazy val sched = host[Scheduler]
 
-  val bypassSink = during setup host[BypassCmdSink].getSink()
+  val bypassSinks = during setup Seq.tabulate(NUM_BYPASS_CORES)(host[BypassCmdSink].getSink(_))
   val logic = during build new Area {
     val dmaConfig = pktBuf.dmaConfig
 
@@ -69,6 +76,9 @@ class DmaControlPlugin extends FiberPlugin {
 
     /** Incoming packet descriptors from decoder pipeline */
     val incomingDesc = Stream(RxPacketDescWithSource())
+    /** Internet checksum of each payload written to the packet buffer, in the order of [[incomingDesc]] */
+    val incomingPldCsum = Stream(UInt(16 bits))
+    incomingPldCsum.setBlocked()
 
     /** Outgoing packet descriptors to encoder pipeline */
     val outgoingDesc = Stream(PacketDesc())
@@ -91,6 +101,7 @@ class DmaControlPlugin extends FiberPlugin {
       val rxDmaErrorCount = Reg(UInt(REG_WIDTH bits)) init 0
       val txDmaErrorCount = Reg(UInt(REG_WIDTH bits)) init 0
       val rxAllocOccupancy = rxAlloc.io.slotOccupancy.clone
+      val rxBadCsumCount = Reg(UInt(REG_WIDTH bits)) init 0
     }
     statistics.rxAllocOccupancy := rxAlloc.io.slotOccupancy
 
@@ -98,10 +109,15 @@ class DmaControlPlugin extends FiberPlugin {
       f(statistics) := f(statistics) + 1
     }
 
-    rxAlloc.io.freeReq <-/< StreamArbiterFactory(s"${getName()}_freeReqMux").roundRobin.on(dps.map(_.hostRxAck.pipelined(FULL)))
+    // buffers of packets dropped after DMA
+    val rxDropFree = Stream(PacketBufDesc())
+    rxDropFree.setIdle()
+
+    rxAlloc.io.freeReq <-/< StreamArbiterFactory(s"${getName()}_freeReqMux").roundRobin
+      .on(dps.map(_.hostRxAck.pipelined(FULL)) :+ rxDropFree)
     rxAlloc.io.allocResp.setBlocked()
 
-    bypassSink.setIdle()
+    bypassSinks.get.foreach(_.setIdle())
     sched.logic.rxMeta.setIdle()
 
     outgoingDesc.setIdle()
@@ -111,6 +127,11 @@ class DmaControlPlugin extends FiberPlugin {
     // details of packet to enqueue
     val pktTagToEnqueue = Reg(RxDmaTag())
     val pktSizeToEnqueue = Reg(PacketLength())
+    val pktQueueToEnqueue = Reg(UInt(bypassQueueWidth bits))
+    val pktHasPld = Reg(Bool())
+    val pktDmaOk = Reg(Bool())
+    /** UDP checksum was present and correct */
+    val pktCsumOk = Reg(Bool())
 
     val rxFsm = new StateMachine {
       val idle: State = new State with EntryPoint {
@@ -125,6 +146,7 @@ class DmaControlPlugin extends FiberPlugin {
             val tag = RxDmaTag()
             tag.data.raw.assignDontCare()
             tag.addr := rxAlloc.io.allocResp.addr
+            pktQueueToEnqueue := rxPacketDescTagged.bypassQueue
             when (rxPacketDescTagged.isBypass) {
               tag.ty := HostReqType.bypass
               tag.data.bypassMeta.ty := rxPacketDescTagged.desc.ty
@@ -137,8 +159,19 @@ class DmaControlPlugin extends FiberPlugin {
                   tag.data.oncRpcCallRx.funcPtr := rxPacketDescTagged.desc.metadata.oncRpcCall.funcPtr
                   tag.data.oncRpcCallRx.pid := rxPacketDescTagged.desc.metadata.oncRpcCall.pid
                   tag.data.oncRpcCallRx.xid := rxPacketDescTagged.desc.metadata.oncRpcCall.hdr.xid
+                  tag.data.oncRpcCallRx.argsLen := rxPacketDescTagged.desc.metadata.oncRpcCall.getArgsLen
                   tag.data.oncRpcCallRx.data := rxPacketDescTagged.desc.metadata.oncRpcCall.args
                 }
+                is (PacketDescType.oncRpcReply) {
+                  // reply to a nested call: same layout as a call, scheduled to the process that made the call
+                  tag.ty := HostReqType.oncRpcReply
+
+                  tag.data.oncRpcCallRx.funcPtr := rxPacketDescTagged.desc.metadata.oncRpcReplyRx.funcPtr
+                  tag.data.oncRpcCallRx.pid := rxPacketDescTagged.desc.metadata.oncRpcReplyRx.pid
+                  tag.data.oncRpcCallRx.xid := rxPacketDescTagged.desc.metadata.oncRpcReplyRx.hdr.xid
+                  tag.data.oncRpcCallRx.argsLen := rxPacketDescTagged.desc.metadata.oncRpcReplyRx.getArgsLen
+                  tag.data.oncRpcCallRx.data := rxPacketDescTagged.desc.metadata.oncRpcReplyRx.args
+                }
                 default {
                   tag.ty := HostReqType.error
                   report("unsupported protocol metadata type on non-bypass packet", FAILURE)
@@ -152,7 +185,9 @@ class DmaControlPlugin extends FiberPlugin {
               pktTagToEnqueue.ty   := tag.ty
               pktTagToEnqueue.data := tag.data
               pktSizeToEnqueue.bits := 0
-              goto(enqueuePkt)
+              pktHasPld := False
+              pktDmaOk := True
+              goto(checkCsum)
             } otherwise {
               // issue DMA cmd
               writeDesc.tag := tag.asBits
@@ -174,21 +209,54 @@ class DmaControlPlugin extends FiberPlugin {
       val waitDma: State = new State {
         whenIsActive {
           when(writeDescStatus.fire) {
-            when(writeDescStatus.payload.error === 0) {
-              // fill host descriptor
-              val tag = RxDmaTag()
-              tag.assignFromBits(writeDescStatus.tag)
+            // fill host descriptor
+            val tag = RxDmaTag()
+            tag.assignFromBits(writeDescStatus.tag)
+
+            pktTagToEnqueue := tag
+            pktSizeToEnqueue.bits := writeDescStatus.len
+            pktHasPld := True
+            pktDmaOk := writeDescStatus.payload.error === 0
+            // payload went through DecoderSink even if the DMA failed: always collect its checksum
+            goto(checkCsum)
+          }
+        }
+      }
+      val checkCsum: State = new State {
+        whenIsActive {
+          val csum = rxPacketDescTagged.desc.getUdpCsum
+          when (!pktHasPld || incomingPldCsum.valid) {
+            incomingPldCsum.ready := pktHasPld
 
-              pktTagToEnqueue := tag
-              pktSizeToEnqueue.bits := writeDescStatus.len
-              goto(enqueuePkt)
-            } otherwise {
+            val pldSum = pktHasPld ? incomingPldCsum.payload | U(0, 16 bits)
+            val csumBad = csum.present && !InetChecksum.isValid(InetChecksum.add(csum.sum, pldSum))
+            pktCsumOk := csum.present && !csumBad
+
+            when (!pktDmaOk) {
               inc(_.rxDmaErrorCount)
               goto(idle)
+            } elsewhen (csumBad && pktTagToEnqueue.ty === HostReqType.oncRpcCall) {
+              // no point in waking up a handler for a corrupted request; the client will retransmit
+              inc(_.rxBadCsumCount)
+              goto(dropPkt)
+            } otherwise {
+              // bypass packets are delivered anyway for the host stack to account for
+              when (csumBad) { inc(_.rxBadCsumCount) }
+              goto(enqueuePkt)
             }
           }
         }
       }
+      val dropPkt: State = new State {
+        whenIsActive {
+          rxDropFree.valid := True
+          rxDropFree.addr := pktTagToEnqueue.addr
+          rxDropFree.size := pktSizeToEnqueue
+          when (rxDropFree.ready) {
+            goto(idle)
+          }
+        }
+      }
       val enqueuePkt: State = new State {
         whenIsActive {
           def assign(hostRx: Stream[HostReq]) = {
@@ -197,6 +265,9 @@ class DmaControlPlugin extends FiberPlugin {
             hostRx.buffer.size := pktSizeToEnqueue
             hostRx.ty := pktTagToEnqueue.ty
             hostRx.data := pktTagToEnqueue.data
+            when (pktTagToEnqueue.ty === HostReqType.bypass) {
+              hostRx.data.bypassMeta.csumOk := pktCsumOk
+            }
 
             when (hostRx.ready) {
               inc(_.rxPacketCount)
@@ -206,7 +277,11 @@ class DmaControlPlugin extends FiberPlugin {
 
           p.profile(p.RxEnqueueToHost -> True)
           when (pktTagToEnqueue.ty === HostReqType.bypass) {
-            assign(bypassSink.get)
+            switch (pktQueueToEnqueue) {
+              bypassSinks.get.zipWithIndex.foreach { case (sink, q) =>
+                is (q) { assign(sink) }
+              }
+            }
           } otherwise {
             assign(sched.logic.rxMeta)
           }
@@ -225,9 +300,10 @@ class DmaControlPlugin extends FiberPlugin {
       .haltWhen(!rxFsm.isActive(rxFsm.idle))
 
     // drive TX buffer information for host modules
-    // one MTU is reserved for each core for TX
+    // PKT_BUF_TX_SIZE_PER_CORE is reserved for each core for TX; this is the first
+    // MTU, the ECI TX ring places the other slots right after it
     dps.foreach { dp =>
-      dp.hostTx.addr.bits := PKT_BUF_TX_OFFSET + dp.coreID * ROUNDED_MTU
+      dp.hostTx.addr.bits := PKT_BUF_TX_OFFSET + dp.coreID * PKT_BUF_TX_SIZE_PER_CORE
       dp.hostTx.size.bits := U(ROUNDED_MTU)
       dp.hostTx.valid := True
     }
@@ -258,6 +334,11 @@ class DmaControlPlugin extends FiberPlugin {
                 txPacketDesc.metadata.assignDontCare()
                 txPacketDesc.metadata.oncRpcReply.get := txReqMuxed.data.oncRpcReplyTx
               }
+              is (HostReqType.oncRpcCall) {
+                txPacketDesc.ty := PacketDescType.oncRpcCall
+                txPacketDesc.metadata.assignDontCare()
+                txPacketDesc.metadata.oncRpcCallTx.get := txReqMuxed.data.oncRpcCallTx
+              }
               default {
                 report("unsupported host request type", FAILURE)
               }
@@ -8,7 +8,7 @@ import lauberhorn.host.pcie._
 import lauberhorn.net._
 import lauberhorn.net.ethernet.{EthernetDecoder, EthernetEncoder}
 import lauberhorn.net.ip.{IpDecoder, IpEncoder}
-import lauberhorn.net.oncrpc.{OncRpcCallDecoder, OncRpcReplyEncoder}
+import lauberhorn.net.oncrpc.{OncRpcCallDecoder, OncRpcCallEncoder, OncRpcReplyDecoder, OncRpcReplyEncoder}
 import lauberhorn.net.udp.{UdpDecoder, UdpEncoder}
 import spinal.core.{FixedFrequency, IntToBuilder}
 import spinal.lib.BinaryBuilder2
@@ -30,6 +30,7 @@ object GenEngineVerilog {
       new IpDecoder,
       new UdpDecoder,
       new OncRpcCallDecoder,
+      new OncRpcReplyDecoder,
       new DecoderSink,
 
       // packet encoder pipeline
@@ -37,6 +38,7 @@ object GenEngineVerilog {
       new IpEncoder,
       new UdpEncoder,
       new OncRpcReplyEncoder,
+      new OncRpcCallEncoder,
       new EncoderSource,
 
       // scheduler
@@ -49,8 +51,8 @@ object GenEngineVerilog {
     )
   }
 
-  def engine(nw: Int, variant: String) = {
-    val nc = nw + 1
+  def engine(nw: Int, variant: String, nb: Int = 1) = {
+    val nc = nw + nb
     val e = new NicEngine
     val plugins = e.database on {
       initDatabase(nc, nw)
@@ -58,11 +60,11 @@ object GenEngineVerilog {
       base ++ (variant match {
         case "pcie" => Seq(new PcieBridgeInterfacePlugin) ++
           Seq.tabulate(nc)(new PcieDatapathPlugin(_)) ++
-          Seq.tabulate(nw)(cid => new PciePreemptionControlPlugin(cid + 1))
+          Seq.tabulate(nw)(cid => new PciePreemptionControlPlugin(cid + nb))
         case "eci" => Seq(new EciInterfacePlugin, new EciThreadClRouter) ++
-          // TODO: only one DecoupledRxTxProtocol for bypass; numCores CoupledProtocol for RPC requests
+          // TODO: only DecoupledRxTxProtocol for bypass; numCores CoupledProtocol for RPC requests
           Seq.tabulate(nc)(new EciDecoupledRxTxProtocol(_)) ++
-          Seq.tabulate(nw)(cid => new EciPreemptionControlPlugin(cid + 1))
+          Seq.tabulate(nw)(cid => new EciPreemptionControlPlugin(cid + nb))
       })
     }
 
@@ -80,6 +82,8 @@ object GenEngineVerilog {
            printRegMap: Boolean = true,
            @arg(doc = "git version (for embedding as CSR)")
            version: Option[String],
+           @arg(doc = "number of bypass cores (queues of the bypass netdev)")
+           numBypassCores: Int = 2,
          ): Unit = {
     val gitVersion = version.map(_.asHex).getOrElse((BigInt(1) << 64) - 1)
     val genDir = os.pwd / os.RelPath(Config.outputDirectory) / name
@@ -93,7 +97,7 @@ object GenEngineVerilog {
     )
 
     val report = elabConfig.generateVerilog {
-      val e = engine(4, name)
+      val e = engine(4, name, numBypassCores)
       e.database on { Global.GIT_VERSION.set(gitVersion) }
       e
     }
@@ -12,12 +12,16 @@ import scala.collection.mutable
 object Global extends AreaRoot {
   val NUM_CORES = value[Int]
   val NUM_WORKER_CORES = value[Int]
+  val NUM_BYPASS_CORES = value[Int]
   val MAX_CORE_ID = value[Int]
 
   val NUM_NEIGHBOR_ENTRIES = value[Int]
+  val BYPASS_RSS_TBL_SIZE = value[Int]
   val NUM_LISTEN_PORTS = value[Int]
   val NUM_SERVICES = value[Int]
   val NUM_SESSIONS = value[Int]
+  val NUM_CLIENTS = value[Int]
+  val NUM_PENDING_CALLS = value[Int]
   val NUM_PROCS = value[Int]
   val NUM_THREADS = value[Int]
   val RX_PKTS_PER_PROC = value[Int]
@@ -34,6 +38,7 @@ object Global extends AreaRoot {
   val PKT_DESC_TY_WIDTH = blocking[Int]
   val BYPASS_HDR_WIDTH = value[Int]
   val ONCRPC_INLINE_BYTES = blocking[Int]
+  val ONCRPC_ARGS_LEN_WIDTH = blocking[Int]
 
   val GIT_VERSION = value[BigInt]
 
@@ -53,6 +58,15 @@ object Global extends AreaRoot {
   val ECI_PREEMPT_CTRL_OFFSET = value[Int]
   val ECI_OVERFLOW_OFFSET = value[Int]
   val ECI_NUM_OVERFLOW_CL = value[Int]
+  val ECI_TX_RING_SLOTS = value[Int]
+  val ECI_TX_RING_IDX_WIDTH = value[Int]
+  val ECI_TX_SLOT_STRIDE = value[Int]
+  val ECI_TX_DOORBELL_OFFSET = value[Int]
+  val ECI_TX_STATUS_OFFSET = value[Int]
+
+  val PCIE_TX_RING_SLOTS = value[Int]
+  val PCIE_RX_ACK_RING_SLOTS = value[Int]
+  val PCIE_RING_IDX_WIDTH = value[Int]
 
   def writeConfigs(outPath: os.Path, spinalConfig: SpinalConfig): Unit = {
     val vals = Database.storage.collect {
@@ -87,10 +101,16 @@ object Global extends AreaRoot {
 
   val ALLOC = blocking[RegAllocatorFactory]
 
+  /** width of a bypass core (queue) index; at least one bit to keep registers around with a single bypass core */
+  def bypassQueueWidth: Int = log2Up(NUM_BYPASS_CORES.get) max 1
+
   def initDatabase(nc: Int, nw: Int) = {
     // set enough parameters to get us rolling
     NUM_CORES.set(nc)
     NUM_WORKER_CORES.set(nw)
+    // cores 0 until NUM_BYPASS_CORES serve the bypass interface, the rest are workers
+    NUM_BYPASS_CORES.set(nc - nw)
+    assert(NUM_BYPASS_CORES.get >= 1, "need at least one bypass core")
 
     // ThunderX-1 in Enzian has 48 cores
     MAX_CORE_ID.set(47)
@@ -108,8 +128,13 @@ object Global extends AreaRoot {
     MTU.set(bufSizeMap.map(_._1).max)
     ROUNDED_MTU.set(roundUp(MTU.get, DATAPATH_WIDTH.get).toInt)
 
+    // one MTU per slot of the ECI or PCIe TX ring
+    ECI_TX_RING_SLOTS.set(4)
+    PCIE_TX_RING_SLOTS.set(ECI_TX_RING_SLOTS)
+    PCIE_RX_ACK_RING_SLOTS.set(16)
+    PCIE_RING_IDX_WIDTH.set(16)
     PKT_BUF_RX_SIZE_PER_CORE.set(64 * 1024)
-    PKT_BUF_TX_SIZE_PER_CORE.set(ROUNDED_MTU)
+    PKT_BUF_TX_SIZE_PER_CORE.set(ECI_TX_RING_SLOTS * ROUNDED_MTU)
     PKT_BUF_SIZE.set {
       val sz = NUM_CORES * (PKT_BUF_RX_SIZE_PER_CORE + PKT_BUF_TX_SIZE_PER_CORE)
       assert(log2Up(sz) <= PKT_BUF_ADDR_WIDTH, "not the entire packet buffer is addressable!")
@@ -119,6 +144,8 @@ object Global extends AreaRoot {
     REG_WIDTH.set(64)
     PID_WIDTH.set(16)
     NUM_NEIGHBOR_ENTRIES.set(8)
+    // flow hash buckets for steering bypass packets to bypass cores
+    BYPASS_RSS_TBL_SIZE.set(16)
     NUM_LISTEN_PORTS.set(16)
 
     // FIXME: these numbers are now ridiculously small!
@@ -126,6 +153,8 @@ object Global extends AreaRoot {
     // TODO:  implement a memory-based lookup table
     NUM_SERVICES.set(8)
     NUM_SESSIONS.set(16)
+    NUM_CLIENTS.set(8)
+    NUM_PENDING_CALLS.set(16)
     NUM_PROCS.set(16)
     RX_PKTS_PER_PROC.set(32)
     BYPASS_HDR_WIDTH.set(54 * 8) // ETH + IP + TCP
@@ -292,7 +292,9 @@ class Scheduler extends FiberPlugin {
       lk.userData := meta
     }
     when (rxMeta.valid) {
-      assert(rxMeta.ty === HostReqType.oncRpcCall, "scheduler does not support other req types yet")
+      // replies to nested calls share the layout of calls
+      assert(rxMeta.ty === HostReqType.oncRpcCall || rxMeta.ty === HostReqType.oncRpcReply,
+        "scheduler does not support other req types yet")
     }
 
     val pushResultCoreMap = corePidMap.map(_ === pushResult.idx).asBits()
@@ -1,27 +1,32 @@
 package lauberhorn.host
 
+import lauberhorn.Global._
 import spinal.core._
 import spinal.lib._
 import spinal.lib.misc.plugin.FiberPlugin
 
 import scala.collection.mutable
 
-/** Collects different sources of commands for the bypass core and muxes them
-  * to the bypass datapath service.  Currently the following sources exist:
-  *  - [[lauberhorn.DmaControlPlugin]]: for bypass packets that do not go to [[lauberhorn.Scheduler]]
-  *  - [[lauberhorn.net.ip.IpEncoder]]: to signal a pending ARP request
+/** Collects different sources of commands for the bypass cores and muxes them
+  * to the bypass datapath services, one per bypass core.  Currently the following sources exist:
+  *  - [[lauberhorn.DmaControlPlugin]]: for bypass packets that do not go to [[lauberhorn.Scheduler]], one sink for
+  *    every bypass core
+  *  - [[lauberhorn.net.ip.IpEncoder]]: to signal a pending ARP request, always to bypass core 0
   * */
 class BypassCmdSink extends FiberPlugin {
-  lazy val bypassDp = host.list[DatapathService].head
+  lazy val bypassDps = host.list[DatapathService].filter(_.coreID < NUM_BYPASS_CORES.get).sortBy(_.coreID)
 
-  val upstreams = mutable.ArrayBuffer[Stream[HostReq]]()
-  def getSink() = {
+  val upstreams = mutable.ArrayBuffer[(Int, Stream[HostReq])]()
+  def getSink(queue: Int = 0) = {
     val ret = Stream(HostReq())
-    upstreams.append(ret)
+    upstreams.append(queue -> ret)
     ret
   }
 
   val logic = during build new Area {
-    bypassDp.hostRx <-/< StreamArbiterFactory(s"${getName()}_bypassDescMux").roundRobin.on(upstreams)
+    bypassDps.zipWithIndex.foreach { case (dp, q) =>
+      dp.hostRx <-/< StreamArbiterFactory(s"${getName()}_bypassDescMux_$q").roundRobin
+        .on(upstreams.collect { case (`q`, s) => s })
+    }
   }
 }
@@ -1,8 +1,8 @@
 package lauberhorn.host.eci
 
 import jsteward.blocks.axi.RichAxi4
-import lauberhorn.Global.ECI_TX_BASE
-import lauberhorn.{Global, PacketAddr, PacketLength}
+import lauberhorn.Global._
+import lauberhorn.{PacketAddr, PacketLength}
 import lauberhorn.host.HostReq
 import spinal.core._
 import spinal.lib._
@@ -11,11 +11,19 @@ import spinal.lib.fsm._
 
 import scala.language.postfixOps
 
-/** For the decoupled RX/TX protocol, route incoming AXI request from the DCS for TX to:
-  *  - capture TX control metadata sent by the host
-  *  - write data to global packet buffer, sitting in a fixed slot
+/** For the decoupled RX/TX protocol, route incoming AXI request from the DCS for the TX ring to:
+  *  - capture TX control metadata sent by the host, one for each ring slot
+  *  - write data to global packet buffer, one MTU for each ring slot
+  *  - answer reads of the doorbell and status CLs with the ring status
   *
-  * Same address layout on the DCS AXI interface as [[DcsRxAxiRouter]].
+  * Each of the [[ECI_TX_RING_SLOTS]] slots takes [[ECI_TX_SLOT_STRIDE]] bytes:
+  *  - 0x0: control CL [ control | first data ]
+  *  - [[ECI_TX_DOORBELL_OFFSET]]: doorbell CL
+  *  - [[ECI_OVERFLOW_OFFSET]]...: rest data
+  *  - [[ECI_TX_STATUS_OFFSET]]: status CL (decoded in all slots, but only the one in
+  *    slot 0 is invalidated by the protocol; the host should only read that one)
+  *
+  * Same layout of control and data on the DCS AXI interface as [[DcsRxAxiRouter]].
   *
   * @param axiConfig AXI parameters of upstream and downstream nodes
   */
@@ -24,6 +32,10 @@ case class DcsTxAxiRouter(dcsConfig: Axi4Config,
                          ) extends Component {
   assert(dcsConfig.dataWidth == 512, "only supports 512b bus from DCS AXI interface")
 
+  val numSlots = ECI_TX_RING_SLOTS.get
+  val slotWidth = log2Up(numSlots)
+  val slotOffWidth = log2Up(ECI_TX_SLOT_STRIDE.get)
+
   /** Outgoing TX descriptors to the encoder pipeline. */
   val txDesc = master(Stream(HostReq()))
   txDesc.assertPersistence()
@@ -38,29 +50,37 @@ case class DcsTxAxiRouter(dcsConfig: Axi4Config,
   /** Forwarded requests to global packet buffer (starts at 0) */
   val pktBufAxi = master(Axi4(pktBufConfig.copy(idWidth = dcsConfig.idWidth)))
 
-  /** Current control cache line index.  Used to check if the host evicted the current
-    * cache line (e.g. due to a capacity conflict).  Responds to reloads of the current
-    * CL with the buffer captured so far.  */
-  val currCl = in UInt(1 bit)
-
   /** Whether a preemption happened.  We need to drop [[savedControl]] on preemption to
     * prevent a leak, when the new thread attempts to read back the packet sent by the
     * old thread.
     */
   val doPreempt = in Bool()
 
-  /** Address to put the outgoing packet payload in the packet buffer.  Captured
-    * from [[lauberhorn.host.DatapathPlugin.hostTx]] */
+  /** Address to put the outgoing packet payload of slot 0 in the packet buffer; the
+    * other slots follow, one MTU each.  Captured from
+    * [[lauberhorn.host.DatapathPlugin.hostTx]] */
   val txAddr = in(PacketAddr())
 
-  /** Length of the packet to send, as captured in real time */
+  /** Ring slot that the protocol is currently retiring */
+  val currSlot = in UInt(slotWidth bits)
+
+  /** Length of the packet in [[currSlot]], as captured in real time */
   val currInvLen = out(PacketLength())
 
-  /** Pulse: all dirty CLs have been flushed */
+  /** All dirty CLs of [[currSlot]] have been flushed: send its descriptor */
   val invDone = in Bool()
 
-  /** Pulse: the host just started a new request on a CL */
-  val hostReq = out(Vec(Bool(), 2)).setAsReg()
+  /** Ring status returned on reads of a doorbell or the status CL */
+  val status = in(EciTxRingStatus())
+
+  /** Pulse: the host loaded a control CL to fill it */
+  val ctrlRead = out Bool()
+
+  /** Pulse: the host read the doorbell of a slot (after the response went out) */
+  val doorbell = out(Flow(UInt(slotWidth bits)))
+
+  /** Pulse: the host read the status CL (after the response went out) */
+  val statusRead = out Bool()
 
   checkEciAxiCmd(dcsAxi)
 
@@ -68,30 +88,42 @@ case class DcsTxAxiRouter(dcsConfig: Axi4Config,
 
   val readCmd: Axi4Ar = Reg(dcsAxi.ar.payload.clone)
   val readAddr = readCmd.addr - ECI_TX_BASE.get
+  val readSlot = (readAddr >> slotOffWidth).resize(slotWidth)
+  val readOff = readAddr(slotOffWidth - 1 downto 0)
   val writeCmd: Axi4Aw = Reg(dcsAxi.aw.payload.clone)
   val writeAddr = writeCmd.addr - ECI_TX_BASE.get
+  val writeSlot = (writeAddr >> slotOffWidth).resize(slotWidth)
+  val writeOff = writeAddr(slotOffWidth - 1 downto 0)
+
+  def isCtrlCl(off: UInt) = off === 0
+  def isStatusCl(off: UInt) = off === ECI_TX_STATUS_OFFSET.get
+  def isDoorbellCl(off: UInt) = off === ECI_TX_DOORBELL_OFFSET.get
+
+  /** Packet buffer address of the first byte (inline in the control CL) of a slot */
+  def slotBufAddr(slot: UInt): UInt = txAddr.bits + (slot * U(ROUNDED_MTU.get)).resized
 
-  hostReq.foreach(_ init False)
+  /** Packet buffer address of an overflow CL.  The first half-CL of the packet is
+    * inlined in the control CL, so overflow data starts at offset 0x40 */
+  def overflowBufAddr(slot: UInt, off: UInt): UInt = slotBufAddr(slot) + (off - 0xc0).resized
 
   // initialization to avoid latches
   dcsQ.setBlocked()
   pktBufAxi.setIdle()
   txDesc.setIdle()
+  doorbell.setIdle()
+  ctrlRead := False
+  statusRead := False
+
+  // buffer to assemble an outgoing descriptor from host, for each slot
+  val savedControl = Vec.fill(numSlots)(Reg(Bits(512 bits)) init 0)
+  val currControl = EciHostCtrlInfo()
+  currControl.assignFromBits(savedControl(currSlot) >> 1)
+  currInvLen := currControl.len
 
-  // buffer to assemble an outgoing descriptor from host
-  val savedControl = Reg(Bits(512 bits)) init 0
-  val aliasedHostCtrl = EciHostCtrlInfo()
-  aliasedHostCtrl.assignFromBits(savedControl >> 1)
-  currInvLen := aliasedHostCtrl.len
-  
   when (doPreempt) {
-    savedControl.clearAll()
+    savedControl.foreach(_.clearAll())
   }
 
-  // invalidation can finish before we enter waitInv, store it here
-  val invFinished = Reg(Bool()) init False
-  invFinished.setWhen(invDone)
-
   // offset and size to read from packet buffer, to serve CL fetch
   val pktBufReadOff = Reg(pktBufAxi.ar.addr.clone)
 
@@ -116,14 +148,14 @@ case class DcsTxAxiRouter(dcsConfig: Axi4Config,
     }
     val decodeCmd: State = new State {
       whenIsActive {
-        when (writeAddr === currCl * 0x80) {
-          pktBufWriteOff := 0x0
+        when (isCtrlCl(writeOff)) {
+          pktBufWriteOff := slotBufAddr(writeSlot).resized
           pktBufWriteLen := 1
           goto(recvPartialDesc)
-        } elsewhen (writeAddr === (1 - currCl) * 0x80) {
-          report("write cannot happen on the inactive CL", FAILURE)
+        } elsewhen (isDoorbellCl(writeOff) || isStatusCl(writeOff)) {
+          report("write cannot happen on a doorbell or the status CL", FAILURE)
         } otherwise {
-          pktBufWriteOff := (writeAddr - 0xc0).resized
+          pktBufWriteOff := overflowBufAddr(writeSlot, writeOff).resized
           pktBufWriteLen := 2
           goto(writePktBufCmd)
         }
@@ -131,14 +163,18 @@ case class DcsTxAxiRouter(dcsConfig: Axi4Config,
     }
     val recvPartialDesc: State = new State {
       whenIsActive {
-        // the host is writing a control CL: capture write into control CL
+        // the host is writing a control CL: capture write into control CL of the slot
         dcsQ.w.ready := True
         when (dcsQ.w.valid) {
           assert(!dcsQ.w.last, "not receiving the last beat yet but last is set")
-          savedControl.subdivideIn(8 bits) zip
-            dcsQ.w.data.subdivideIn(8 bits) zip
-            dcsQ.w.strb.asBools foreach { case ((buf, byte), en) =>
-            when (en) { buf := byte }
+          savedControl.zipWithIndex foreach { case (ctrl, idx) =>
+            when (writeSlot === idx) {
+              ctrl.subdivideIn(8 bits) zip
+                dcsQ.w.data.subdivideIn(8 bits) zip
+                dcsQ.w.strb.asBools foreach { case ((buf, byte), en) =>
+                when (en) { buf := byte }
+              }
+            }
           }
 
           goto(writePktBufCmd)
@@ -149,7 +185,7 @@ case class DcsTxAxiRouter(dcsConfig: Axi4Config,
       whenIsActive {
         pktBufAxi.aw.valid := True
         pktBufAxi.aw.len := pktBufWriteLen - 1
-        pktBufAxi.aw.addr := pktBufWriteOff + txAddr.bits.resized
+        pktBufAxi.aw.addr := pktBufWriteOff
         pktBufAxi.aw.id := writeCmd.id
         pktBufAxi.aw.setFullSize()
         pktBufAxi.aw.setBurstINCR()
@@ -193,8 +229,6 @@ case class DcsTxAxiRouter(dcsConfig: Axi4Config,
     val idle: State = new State with EntryPoint {
       whenIsActive {
         dcsQ.ar.freeRun()
-        hostReq.foreach(_ := False)
-        invFinished.clear()
         when (dcsQ.ar.valid) {
           readCmd := dcsQ.ar.payload
           goto(decodeCmd)
@@ -203,46 +237,65 @@ case class DcsTxAxiRouter(dcsConfig: Axi4Config,
     }
     val decodeCmd: State = new State {
       whenIsActive {
-        when (readAddr === 0x0 || readAddr === 0x80) {
-          pktBufReadOff := 0x0
+        when (isCtrlCl(readOff)) {
+          // the host (re)loading a control CL, e.g. to write a new packet: serve
+          // what we have captured so far
+          ctrlRead := True
+          pktBufReadOff := slotBufAddr(readSlot).resized
           pktBufReadLen := 1
-
-          val reqCl = (readAddr === 0x80).asUInt
-          hostReq(reqCl) := True
-
-          when (reqCl === currCl) {
-            goto(sendPartialDesc)
-          } otherwise {
-            // host reading opposite cache line; protocol will invalidate all cache
-            // lines before we can send the descriptor to encoders
-            goto(waitInv)
-          }
+          goto(sendPartialDesc)
+        } elsewhen (isDoorbellCl(readOff) || isStatusCl(readOff)) {
+          // never blocks: the protocol retires slots in the background
+          goto(sendStatus)
         } otherwise {
           // accessing packet buffer via overflow cachelines
-          pktBufReadOff := (readAddr - 0xc0).resized
+          pktBufReadOff := overflowBufAddr(readSlot, readOff).resized
           pktBufReadLen := 2
-
           goto(readPktBufCmd)
         }
       }
     }
-    val waitInv: State = new State {
+    val sendPartialDesc: State = new State {
       whenIsActive {
-        when (invFinished) {
-          goto(transmitDesc)
+        dcsQ.r.data := savedControl(readSlot)
+        dcsQ.r.valid := True
+        dcsQ.r.setOKAY()
+        dcsQ.r.id := readCmd.id
+        dcsQ.r.last := False
+        when (dcsQ.r.ready) {
+          // send first half cache line length of packet buffer
+          goto(readPktBufCmd)
         }
       }
     }
-    val sendPartialDesc: State = new State {
+    val sendStatus: State = new State {
       whenIsActive {
-        dcsQ.r.data := savedControl
+        dcsQ.r.data := status.asBits.resized
         dcsQ.r.valid := True
         dcsQ.r.setOKAY()
         dcsQ.r.id := readCmd.id
         dcsQ.r.last := False
         when (dcsQ.r.ready) {
-          // send first half cache line length of packet buffer
-          goto(readPktBufCmd)
+          goto(sendStatusTail)
+        }
+      }
+    }
+    val sendStatusTail: State = new State {
+      whenIsActive {
+        dcsQ.r.data := 0
+        dcsQ.r.valid := True
+        dcsQ.r.setOKAY()
+        dcsQ.r.id := readCmd.id
+        dcsQ.r.last := True
+        when (dcsQ.r.ready) {
+          // only report after the response went out: the protocol will invalidate
+          // the CL, which must not overtake the data
+          when (isStatusCl(readOff)) {
+            statusRead := True
+          } otherwise {
+            doorbell.push(readSlot)
+          }
+          goto(idle)
         }
       }
     }
@@ -250,7 +303,7 @@ case class DcsTxAxiRouter(dcsConfig: Axi4Config,
       whenIsActive {
         pktBufAxi.ar.valid := True
         pktBufAxi.ar.len := pktBufReadLen - 1
-        pktBufAxi.ar.addr := pktBufReadOff + txAddr.bits.resized
+        pktBufAxi.ar.addr := pktBufReadOff
         pktBufAxi.ar.id := readCmd.id
         pktBufAxi.ar.setFullSize()
         pktBufAxi.ar.setBurstINCR()
@@ -274,24 +327,19 @@ case class DcsTxAxiRouter(dcsConfig: Axi4Config,
         }
       }
     }
-    val transmitDesc: State = new State {
-      whenIsActive {
-        // send assembled descriptor to encoder pipeline
-        // the packet buffer has been fully written from invalidation
-        txDesc.valid := True
-
-        // one bit reserved for valid in host side Mackerel file to allow reusing RX HostReq
-        val ctrl = EciHostCtrlInfo()
-        ctrl.assignFromBits(savedControl >> 1)
-        ctrl.unpackTo(txDesc.payload, txAddr)
-
-        when (txDesc.ready) {
-          savedControl := 0
+  }
 
-          // we are in the middle of a read for next CL -- serve read
-          goto(sendPartialDesc)
-        }
-      }
+  // send the assembled descriptor of the slot being retired to the encoder pipeline;
+  // the packet buffer has been fully written from invalidation
+  val currSlotAddr = PacketAddr()
+  currSlotAddr.bits := slotBufAddr(currSlot).resized
+
+  txDesc.valid := invDone
+  // one bit reserved for valid in host side Mackerel file to allow reusing RX HostReq
+  currControl.unpackTo(txDesc.payload, currSlotAddr)
+  when (txDesc.fire) {
+    savedControl.zipWithIndex foreach { case (ctrl, idx) =>
+      when (currSlot === idx) { ctrl.clearAll() }
     }
   }
 }
@@ -19,12 +19,12 @@ import Global._
 import spinal.lib.bus.amba4.axilite.{AxiLite4, AxiLite4SlaveFactory}
 
 class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with EciPioProtocol {
-  val isBypass = coreID == 0
+  val isBypass = coreID < NUM_BYPASS_CORES.get
 
   if (isBypass) {
-    withPrefix("proto_bypass")
+    withPrefix(s"proto_bypass_$coreID")
   } else {
-    withPrefix(s"proto_worker_${coreID - 1}")
+    withPrefix(s"proto_worker_${coreID - NUM_BYPASS_CORES.get}")
   }
 
   def driveControl(bus: AxiLite4, alloc: RegBlockAlloc) = {
@@ -36,38 +36,57 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
     busCtrl.read(logic.txFsm.stateReg, alloc("txFsmState", attr = RO,
       desc = "state of the TX state machine (raw value)"))
 
-    busCtrl.read(logic.txCurrClIdx, alloc("txCurrClIdx", attr = RW,
-      desc = "parity (next CL to write) of the TX state machine"))
+    busCtrl.read(logic.txConsumed, alloc("txRingConsumed", attr = RO,
+      desc = "number of TX ring slots retired (free-running)"))
     busCtrl.read(logic.rxCurrClIdx, alloc("rxCurrClIdx", attr = RW,
       desc = "parity (next CL to read) of the RX state machine"))
+    busCtrl.read(logic.txProduced, alloc("txRingProduced", attr = RO,
+      desc = "number of TX ring slots rung by the host (free-running)"))
 
   }
   lazy val overflowCountWidth = log2Up(numOverflowCls)
 
   // two control half CLs, one extra first word half CL, one MTU
+  // RX:
   // CL#0: [ control | first data (aliased) ]
   // CL#1: [ control | first data (aliased) ]
   // CL#2...: [ rest data ]
+  // TX, for each ring slot:
+  // CL#0: [ control | first data ]
+  // CL#1: [ doorbell ]
+  // CL#2...: [ rest data ]
+  // last CL of slot: [ ring status (aliased) ]
   lazy val sizePerMtuPerDirection = (512 / 8) * 3 + ROUNDED_MTU
   lazy val numOverflowCls = (sizePerMtuPerDirection / EciCmdDefs.ECI_CL_SIZE_BYTES - 1).toInt
 
   // map at aligned address to eliminate long comb paths
   val txOffset = 0x8000
-  val sizePerCore = 2 * txOffset
+  val txSlotStride = 0x4000
+  lazy val numTxSlots = ECI_TX_RING_SLOTS.get
+  lazy val txSize = numTxSlots * txSlotStride
+  lazy val sizePerCore: BigInt = txOffset + txSize
 
   private def packetSizeToNumOverflowCls(s: UInt): UInt = {
     val clSize = EciCmdDefs.ECI_CL_SIZE_BYTES
     ((s <= 64) ? U(0) | ((s - 64 + clSize - 1) / clSize)).resize(overflowCountWidth)
   }
 
-  private def overflowIdxToAddr(idx: UInt, isTx: Boolean = false): Bits = {
-    val offset = if (isTx) U(txOffset) else U(0)
+  private def overflowIdxToAddr(idx: UInt): Bits = {
     // two control cachelines before overflow
-    ((idx + 2) * EciCmdDefs.ECI_CL_SIZE_BYTES + offset).asBits.resize(EciCmdDefs.ECI_ADDR_WIDTH)
+    ((idx + 2) * EciCmdDefs.ECI_CL_SIZE_BYTES).asBits.resize(EciCmdDefs.ECI_ADDR_WIDTH)
+  }
+
+  private def ctrlToAddr(currIdx: UInt): Bits = {
+    (currIdx * EciCmdDefs.ECI_CL_SIZE_BYTES).asBits.resize(EciCmdDefs.ECI_ADDR_WIDTH)
   }
 
-  private def ctrlToAddr(currIdx: UInt, isTx: Boolean = false): Bits = {
-    (currIdx * EciCmdDefs.ECI_CL_SIZE_BYTES + (if (isTx) U(txOffset) else U(0))).asBits.resize(EciCmdDefs.ECI_ADDR_WIDTH)
+  private def txSlotToAddr(slot: UInt, offset: UInt): Bits = {
+    (U(txOffset, EciCmdDefs.ECI_ADDR_WIDTH bits) + slot * U(txSlotStride) + offset).asBits
+  }
+
+  private def txOverflowIdxToAddr(slot: UInt, idx: UInt): Bits = {
+    // control and doorbell cachelines before overflow
+    txSlotToAddr(slot, (idx + 2) * EciCmdDefs.ECI_CL_SIZE_BYTES)
   }
 
   def driveDcsBus(bus: Axi4, pktBufAxiNode: Axi4): Unit = new Area {
@@ -86,18 +105,21 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
     // TX router
     val txRouter = DcsTxAxiRouter(bus.config, pktBufAxiNode.config)
     txRouter.txDesc >> hostTxAck
-    txRouter.currCl := logic.txCurrClIdx.asUInt
+    txRouter.currSlot := logic.txHead
     txRouter.txAddr := logic.savedTxAddr.addr
     txRouter.invDone := logic.txInvDone
+    txRouter.status.consumed := logic.txConsumed
     txRouter.doPreempt := preemptReq.valid
     logic.txInvLen := txRouter.currInvLen
-    logic.txReqs := txRouter.hostReq
+    logic.txCtrlRead := txRouter.ctrlRead
+    logic.txDoorbell := txRouter.doorbell
+    logic.txStatusRead := txRouter.statusRead
 
     // mux RX and TX routers to DCS master
     Axi4CrossbarFactory()
       .addSlaves(
         rxRouter.dcsAxi -> SizeMapping(0, txOffset),
-        txRouter.dcsAxi -> SizeMapping(txOffset, txOffset)
+        txRouter.dcsAxi -> SizeMapping(txOffset, txSize)
       )
       .addConnection(bus, Seq(rxRouter.dcsAxi, txRouter.dcsAxi))
       .build()
@@ -126,9 +148,14 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
   def preemptReq = logic.preemptReq
 
   val logic = during setup new Area {
-    // The kernel will update these on thread resume
+    // The kernel will update this on thread resume
     val rxCurrClIdx = Reg(Bool()) init False
-    val txCurrClIdx = Reg(Bool()) init False
+
+    // TX ring state.  The ring is always drained before a preemption, so the next
+    // thread picks up from txConsumed
+    val txConsumed = Reg(UInt(ECI_TX_RING_IDX_WIDTH bits)) init 0
+    val txProduced = Reg(UInt(ECI_TX_RING_IDX_WIDTH bits)) init 0
+    val txHead = txConsumed.resize(log2Up(numTxSlots))
 
     // Preemption request from [[EciPreemptionControlPlugin]].  This will only come
     // after the thread is out of the ready/busy critical section and spinning on !ready
@@ -142,20 +169,35 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
     ECI_TX_BASE.set(txOffset)
     ECI_OVERFLOW_OFFSET.set(0x100)
     ECI_NUM_OVERFLOW_CL.set(numOverflowCls)
+    ECI_TX_RING_IDX_WIDTH.set(16)
+    ECI_TX_SLOT_STRIDE.set(txSlotStride)
+    ECI_TX_DOORBELL_OFFSET.set(0x80)
+    ECI_TX_STATUS_OFFSET.set(txSlotStride - 0x80)
 
     val irqOut = isBypass generate Stream(EciIntcInterface())
     val irqEn = isBypass generate Bool()
+    // CPU to send the bypass IRQ to; the host spreads the bypass cores over CPUs
+    val irqCoreId = isBypass generate (Reg(UInt(log2Up(MAX_CORE_ID) bits)) init coreID)
 
     awaitBuild()
 
     assert(txOffset >= sizePerMtuPerDirection, "tx offset does not allow one MTU for rx")
+    assert(isPow2(numTxSlots) && numTxSlots >= 2, "TX ring needs a power-of-two number of slots, at least two")
+    assert(txSlotStride >= sizePerMtuPerDirection - 0x40 + 0x80, "TX ring slot does not fit one MTU and the status CL")
 
     val rxReqs = Vec(Bool(), 2)
 
     // A read from the CPU to the opposite CL to fetch a new request.
     val rxTriggerNew = rxReqs(1 - rxCurrClIdx.asUInt)
 
-    val txReqs = Vec(Bool(), 2)
+    // The host loaded a TX control CL to fill it
+    val txCtrlRead = Bool()
+    // The host rang the doorbell of a TX ring slot
+    val txDoorbell = Flow(UInt(log2Up(numTxSlots) bits))
+    // The host read the TX ring status
+    val txStatusRead = Bool()
+    // Nothing left in the TX ring; a preemption can proceed
+    val txIdle = Bool()
 
     lci.setIdle()
     lci.valid.setAsReg()
@@ -223,7 +265,8 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
 
           when (preemptReq.valid) {
             assert(!rxReqs.orR, "critical section violation: no read is allowed during preemption")
-            preemptReq.ready := True
+            // let the TX ring drain first, so that the next thread starts with an empty ring
+            preemptReq.ready := txIdle
           }
         }
       }
@@ -238,7 +281,7 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
             // No packet arrived in time, the router delivered a NACK -- no state transition
             // here.  Now the host is reading a new CL, only need to invalidate that NACK
             goto(invalidateCtrl)
-          } elsewhen (preemptReq.valid) {
+          } elsewhen (preemptReq.valid && txIdle) {
             // No need to invalidate anything in L2 since all threads have separate physical
             // addresses
             preemptReq.ready := True
@@ -261,7 +304,7 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
               }
               goto(invalidatePacketData)
             }
-          } elsewhen (preemptReq.valid) {
+          } elsewhen (preemptReq.valid && txIdle) {
             // No need to invalidate anything in L2 since all threads have separate physical
             // addresses (which will be mapped separately).
             preemptReq.ready := True
@@ -325,32 +368,70 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
       }
     }
 
-    when (txReqs.reduce(_ || _)) {
+    when (txCtrlRead || txDoorbell.valid) {
       // pop hostTx to honour the protocol
       hostTx.freeRun()
     }
     val savedTxAddr = hostTx.toFlowFire.toReg()
     val txInvLen = PacketLength()
+
+    // Doorbells are cumulative: ringing slot s marks every slot from the head up to s
+    // as produced.  Remember which doorbell CLs the host has loaded, so that we only
+    // invalidate those when retiring the slot
+    val txDoorbellRead = Reg(Bits(numTxSlots bits)) init 0
+    when (txDoorbell.valid) {
+      txDoorbellRead(txDoorbell.payload) := True
+      val rung = (txDoorbell.payload - txHead).resize(ECI_TX_RING_IDX_WIDTH) + 1
+      when (rung > txProduced - txConsumed) {
+        txProduced := txConsumed + rung
+      }
+    }
+    val txStatusReadPending = Reg(Bool()) init False
+
+    // Produced slots are retired one by one, in order: pull control and overflow CLs
+    // into the packet buffer, invalidate the doorbell and send the descriptor.
+    // [[DmaControlPlugin]] only takes the next descriptor after the DMA of the previous
+    // one is done; with at least two slots, a slot is therefore never pulled into the
+    // packet buffer while its previous packet is still being sent.
     val txFsm = new StateMachine {
       val idle: State = new State with EntryPoint {
-        whenIsActive {
-          when (txReqs(txCurrClIdx.asUInt)) { goto(waitPacket) }
-        }
-      }
-      val waitPacket: State = new State {
         whenIsActive {
           txOverflowInvIssued.clear()
           txOverflowInvAcked.clear()
           txOverflowToInvalidate.clearAll()
-          when (txReqs(1 - txCurrClIdx.asUInt)) {
+          when (txStatusReadPending) {
+            // the host is waiting for a free slot; let it see the next status
+            goto(invalidateStatus)
+          } elsewhen (txProduced =/= txConsumed) {
             // invalidate control first to know how many overflows do we need to invalidate
             goto(invalidateCtrl)
           }
         }
       }
+      val invalidateStatus: State = new State {
+        whenIsActive {
+          lci.payload := txSlotToAddr(U(0), U(ECI_TX_STATUS_OFFSET.get))
+          lci.valid := True
+          when(lci.fire) {
+            lci.valid := False
+            txStatusReadPending := False
+            goto(waitStatusInvResp)
+          }
+        }
+      }
+      val waitStatusInvResp: State = new State {
+        whenIsActive {
+          lcia.freeRun()
+          when (lcia.fire) {
+            ulFlow.payload := lcia.payload
+            ulFlow.valid := True
+            goto(idle)
+          }
+        }
+      }
       val invalidateCtrl: State = new State {
         whenIsActive {
-          lci.payload := ctrlToAddr(txCurrClIdx.asUInt, isTx = true)
+          lci.payload := txSlotToAddr(txHead, U(0))
           lci.valid := True
           when(lci.fire) {
             lci.valid := False
@@ -366,13 +447,13 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
             ulFlow.payload := lcia.payload
             ulFlow.valid := True
 
-            // we should've latched tx descriptor in savedTxDesc
+            // we should've latched tx descriptor in savedControl
             val toInvalidate = packetSizeToNumOverflowCls(txInvLen.bits)
             txOverflowToInvalidate := toInvalidate
             when (toInvalidate > 0) {
               goto(invalidatePacketData)
             } otherwise {
-              goto(tx)
+              goto(invalidateDoorbell)
             }
           }
         }
@@ -380,7 +461,7 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
       val invalidatePacketData: State = new State {
         whenIsActive {
           when(txOverflowInvIssued.valueNext < txOverflowToInvalidate) {
-            lci.payload := overflowIdxToAddr(txOverflowInvIssued.valueNext, isTx = true)
+            lci.payload := txOverflowIdxToAddr(txHead, txOverflowInvIssued.valueNext)
             lci.valid := True
           }
 
@@ -398,6 +479,33 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
           }
 
           when (txOverflowInvAcked === txOverflowToInvalidate) {
+            goto(invalidateDoorbell)
+          }
+        }
+      }
+      val invalidateDoorbell: State = new State {
+        whenIsActive {
+          when (txDoorbellRead(txHead)) {
+            // so that the next doorbell on this slot reaches us again
+            lci.payload := txSlotToAddr(txHead, U(ECI_TX_DOORBELL_OFFSET.get))
+            lci.valid := True
+            when(lci.fire) {
+              lci.valid := False
+              txDoorbellRead(txHead) := False
+              goto(waitDoorbellInvResp)
+            }
+          } otherwise {
+            // slot was covered by the doorbell of a later slot
+            goto(tx)
+          }
+        }
+      }
+      val waitDoorbellInvResp: State = new State {
+        whenIsActive {
+          lcia.freeRun()
+          when (lcia.fire) {
+            ulFlow.payload := lcia.payload
+            ulFlow.valid := True
             goto(tx)
           }
         }
@@ -408,7 +516,7 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
           txInvDone := True
 
           when (hostTxAck.fire) {
-            txCurrClIdx.toggleWhen(True)
+            txConsumed := txConsumed + 1
             goto(idle)
           }
         }
@@ -419,7 +527,11 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
     rxFsm.build()
     txFsm.build()
 
-    // if this is the bypass core, emit IRQ when the RX queue is not empty
+    // after the FSM, so that a status read in the same cycle as the invalidation is kept
+    txStatusReadPending.setWhen(txStatusRead)
+    txIdle := txProduced === txConsumed && !txStatusReadPending && txFsm.isActive(txFsm.idle)
+
+    // if this is a bypass core, emit IRQ when the RX queue is not empty
     isBypass generate new Area {
       irqOut.setIdle()
       val irqFsm = new StateMachine {
@@ -433,8 +545,9 @@ class EciDecoupledRxTxProtocol(coreID: Int) extends DatapathPlugin(coreID) with
         val sendIrq: State = new State {
           whenIsActive {
             irqOut.valid   := True
-            irqOut.affLvl0 := 1   // always send to core 0
-            irqOut.affLvl1 := 0
+            // affLvl0 is a bit mask, but we only send to one at a time
+            irqOut.affLvl0 := UIntToOh(irqCoreId(3 downto 0))
+            irqOut.affLvl1 := irqCoreId(irqCoreId.getWidth - 1 downto 4).asBits.resized
             irqOut.cmd     := 0
             irqOut.intId   := 15  // use 15 for bypass interrupts
             when (irqOut.ready) {
@@ -34,31 +34,33 @@ case class EciHostCtrlInfo() extends Bundle {
   val data = new Union {
     case class BypassBundle() extends Bundle {
       val ty = PacketDescType() // [20: 23) = 3b
-      val xb9 = Bits(9 bits) /* make sure header is word aligned */   // [23: 32) = 9b
+      val csumOk = Bool()                                             // [23: 24) = 1b
+      val xb8 = Bits(8 bits) /* make sure header is word aligned */   // [24: 32) = 8b
       val hdr = Bits(BYPASS_HDR_WIDTH bits)
     }
     val bypass = newElement(BypassBundle())
 
-    /** Shared by two types of ONC-RPC flows:
+    /** Shared by all ONC-RPC flows:
       *  - receiving an RPC call
       *  - sending an RPC reply
+      *  - sending a nested RPC call: [[funcPtr]] names the client procedure, [[xid]] is picked by the host
+      *  - receiving the reply to a nested RPC call
       *
       * This is the ECI-specific version of [[lauberhorn.host.HostReqOncRpcCallRx]].
       *
-      * Note that while the reply encoder [[lauberhorn.net.oncrpc.OncRpcReplyEncoder]] requires the length of inlined
-      * data in its metadata [[lauberhorn.net.oncrpc.OncRpcReplyTxMeta]], this is passed with the generic
-      * [[EciHostCtrlInfo.len]] field and thus not separately encoded.
+      * Note that while the encoders [[lauberhorn.net.oncrpc.OncRpcReplyEncoder]] and
+      * [[lauberhorn.net.oncrpc.OncRpcCallEncoder]] require the length of inlined data in their metadata, this is
+      * passed with the generic [[EciHostCtrlInfo.len]] field and thus not separately encoded.
       */
     case class OncRpcServerBundle() extends Bundle {
-      val xb12 = Bits(12 bits) /* make sure RPC fields are aligned */ // [20: 32) = 12 b
+      val argsLen = UInt(ONCRPC_ARGS_LEN_WIDTH bits)                  // [20: 26) = 6b
+      val xb6 = Bits(6 bits) /* make sure RPC fields are aligned */   // [26: 32) = 6b
       val xid = Bits(32 bits)
       val funcPtr = Bits(64 bits)
       val data = Bits(ONCRPC_INLINE_BYTES * 8 bits)
     }
     val oncRpcServer = newElement(OncRpcServerBundle())
 
-    // TODO: client bundles for sending a nested call and receiving a reply
-
     /** ECI-specific version of [[lauberhorn.host.HostReqArpRequest]]. */
     case class ArpReqBundle() extends Bundle {
       val neighTblIdx = Bits(log2Up(NUM_NEIGHBOR_ENTRIES) bits)       // [20: 23) = 3b
@@ -88,10 +90,21 @@ case class EciHostCtrlInfo() extends Bundle {
           desc.buffer.size.bits            := 0
         }
       }
+      is (HostReqType.oncRpcCall) {
+        desc.data.oncRpcCallTx.assignSomeByName(data.oncRpcServer)
+        desc.data.oncRpcCallTx.callLen := len
+        when (len.bits > ONCRPC_INLINE_BYTES.get) {
+          desc.buffer.size.bits            := len.bits - ONCRPC_INLINE_BYTES.get
+        } otherwise {
+          desc.buffer.size.bits            := 0
+        }
+      }
     }
     desc.buffer.addr := addr
   }
 
+  assert(ONCRPC_ARGS_LEN_WIDTH.get <= 6, "ONC-RPC args length does not fit before aligned XID")
+
   // plus one for readStreamBlockCycles
   assert(getBitsWidth + 1 <= HOST_REQ_WIDTH, "host control info larger than half a cacheline")
 
@@ -118,19 +131,21 @@ case class EciHostCtrlInfo() extends Bundle {
          |  ty       ${HOST_REQ_TY_WIDTH.get} type(host_req_type) "Type of descriptor (should be bypass)";
          |  len      ${PKT_BUF_LEN_WIDTH.get} "Length of packet";
          |  hdr_ty   ${PKT_DESC_TY_WIDTH.get} type(packet_desc_type) "Type of bypass header";
-         |  _        9 rsvd;
+         |  csum_ok  1 "UDP checksum present and verified (RX only)";
+         |  _        8 rsvd;
          |  // hdr follows -- need to calculate address manually
          |  // TODO: actually define args in the datatype.  Possible approach:
          |  // - as an address-only field, so no hdr+size pointer calculation in user code
          |};
          |
-         |datatype host_ctrl_info_onc_rpc_server lsbfirst(64) "ECI Host Control Info (ONC-RPC Direct Call / Reply)" {
+         |datatype host_ctrl_info_onc_rpc_server lsbfirst(64) "ECI Host Control Info (ONC-RPC Direct Call / Reply, Nested Call / Reply)" {
          |  valid     1 "RX descriptor valid (rsvd for TX)";
          |  ty        ${HOST_REQ_TY_WIDTH.get} type(host_req_type) "Type of descriptor (should be onc_rpc_call / onc_rpc_reply)";
          |  len       ${PKT_BUF_LEN_WIDTH.get} "Length of packet (includes inlined bytes for TX, does not include inlined bytes for RX)";
-         |  _         12 rsvd;
-         |  xid       32 "XID of incoming request (big endian)";
-         |  func_ptr  64 "Function pointer for RPC call handler";
+         |  args_len  ${ONCRPC_ARGS_LEN_WIDTH.get} "Number of valid inlined argument bytes (RX only)";
+         |  _         6 rsvd;
+         |  xid       32 "XID of incoming request, or of outgoing nested call (big endian)";
+         |  func_ptr  64 "Function pointer for RPC call handler, or client procedure for nested call";
          |  // args follows -- need to calculate address manually
          |  // TODO: actually define args in the datatype.  Two possible approaches:
          |  // - as an address-only field, so no hdr+size pointer calculation in user code
@@ -146,8 +161,6 @@ case class EciHostCtrlInfo() extends Bundle {
          |  ip_addr   32 "IP address of the target host";
          |};
          |
-         |// TODO: separate datatype for making a nested RPC call (progNum, ver...)?
-         |
          |datatype host_ctrl_info_onc_rpc_reply lsbfirst(64) "ECI Host Control Info (ONC-RPC Reply)" {
          |  // TODO: this datatype does not exist yet, use host_ctrl_info_bypass to send a raw Ethernet frame
          |  valid     1 "RX descriptor valid (rsvd for TX)";
@@ -163,10 +176,25 @@ case class EciHostCtrlInfo() extends Bundle {
          |  busy      1 "the thread is in the critical section";
          |  _         6 rsvd;
          |};
+         |
+         |datatype tx_ring_status lsbfirst(64) "ECI TX Ring Status (returned on reads of a doorbell or the status CL)" {
+         |  consumed  ${ECI_TX_RING_IDX_WIDTH.get} "Number of TX ring slots consumed by the NIC (free-running)";
+         |  _         ${64 - ECI_TX_RING_IDX_WIDTH.get} rsvd;
+         |};
          """.stripMargin)
   }
 }
 
+/**
+  * Returned to the CPU on reads of a TX ring doorbell or the TX ring status CL.  The
+  * CPU may refill all slots before [[consumed]]: their descriptors have been handed to
+  * the encoder pipeline.  See [[EciDecoupledRxTxProtocol]] for why their payload is
+  * not overwritten while still being DMA'ed.
+  */
+case class EciTxRingStatus() extends Bundle {
+  val consumed = UInt(ECI_TX_RING_IDX_WIDTH bits)
+}
+
 object EciHostCtrlInfo {
   /** Convert a [[HostReq]] from the decoder pipeline into a [[EciHostCtrlInfo]] to send to a CPU core */
   def packFrom(desc: HostReq) = new Area {
@@ -176,11 +204,11 @@ object EciHostCtrlInfo {
     switch (desc.ty) {
       is (HostReqType.bypass) {
         ret.data.bypass.assignSomeByName(desc.data.bypassMeta)
-        ret.data.bypass.xb9 := 0
+        ret.data.bypass.xb8 := 0
       }
-      is (HostReqType.oncRpcCall) {
+      is (HostReqType.oncRpcCall, HostReqType.oncRpcReply) {
         ret.data.oncRpcServer.assignSomeByName(desc.data.oncRpcCallRx)
-        ret.data.oncRpcServer.xb12 := 0
+        ret.data.oncRpcServer.xb6 := 0
       }
       is (HostReqType.arpReq) {
         ret.data.arpReq.assignSomeByName(desc.data.arpReq)
@@ -13,7 +13,7 @@ import spinal.lib.bus.amba4.axilite._
 import spinal.lib.bus.misc.SizeMapping
 import Global._
 import lauberhorn.net.ip.IpEncoder
-import lauberhorn.net.oncrpc.OncRpcReplyEncoder
+import lauberhorn.net.oncrpc.{OncRpcCallEncoder, OncRpcReplyEncoder}
 import spinal.lib.bus.amba4.axilite.AxiLite4Utils.AxiLite4Rich
 import spinal.lib.misc.plugin.FiberPlugin
 
@@ -110,6 +110,7 @@ class EciInterfacePlugin extends FiberPlugin {
 
     drive(host[IpEncoder].driveControl, "IpEncoder")
     drive(host[OncRpcReplyEncoder].driveControl, "OncRpcReplyEncoder")
+    drive(host[OncRpcCallEncoder].driveControl, "OncRpcCallEncoder")
 
     drive(host[ProfilerPlugin].logic.driveControl, "profiler")
     drive(host[Scheduler].driveControl, "sched")
@@ -146,8 +147,8 @@ class EciInterfacePlugin extends FiberPlugin {
         addressWidth = log2Up(coreOffset - 1),
       )
 
-      // no preemption control node for bypass core
-      (Axi4(config), Option.when(idx != 0)(Axi4(config)))
+      // no preemption control node for bypass cores
+      (Axi4(config), Option.when(idx >= NUM_BYPASS_CORES.get)(Axi4(config)))
     }
 
     val unaliasedDcsAxi = dcsIntfs map { dcs =>
@@ -165,8 +166,10 @@ class EciInterfacePlugin extends FiberPlugin {
     Axi4CrossbarFactory()
       .addSlaves(dcsNodes.zipWithIndex flatMap { case ((dataNode, preemptNodeOption), idx) =>
         val dataPathSize = host.list[EciPioProtocol].apply(idx).sizePerCore
-        val preemptSize = if (idx != 0) {
-          host.list[EciPreemptionControlPlugin].apply(idx - 1).requiredAddrSpace
+        val preemptSize = if (idx >= NUM_BYPASS_CORES.get) {
+          val preempt = host.list[EciPreemptionControlPlugin].apply(idx - NUM_BYPASS_CORES.get)
+          assert(preempt.controlClAddr == dataPathSize, "preemption control CL not right after data path")
+          preempt.requiredAddrSpace
         } else 0
         val sizePerCore = dataPathSize + preemptSize
         assert(coreOffset >= sizePerCore, "core offset smaller than needed mem size per core (plus preempt control)")
@@ -314,10 +317,10 @@ class EciInterfacePlugin extends FiberPlugin {
       dataUl   << proto.ul
       dataLcia >> proto.lcia
 
-      if (cid != 0) {
+      if (cid >= NUM_BYPASS_CORES.get) {
         // worker cores get RX descriptors from scheduler
-        // bypass core descriptor already connected by [[DmaControlPlugin]]
-        host[Scheduler].logic.coreMeta(cid - 1) >> proto.hostRx
+        // bypass core descriptors already connected by [[BypassCmdSink]]
+        host[Scheduler].logic.coreMeta(cid - NUM_BYPASS_CORES.get) >> proto.hostRx
       }
 
       proto.driveDcsBus(dcsNode, memNode)
@@ -338,7 +341,8 @@ class EciInterfacePlugin extends FiberPlugin {
           bypassProto.irqOut >> ipiCtrl
 
           // XXX: still allocate registers for bypass core due to allocator limitation
-          drive(EciPreemptionControlPlugin.bypassDriveControl(bypassProto.irqEn), "preempt", cid)
+          drive(EciPreemptionControlPlugin.bypassDriveControl(bypassProto.irqEn, bypassProto.irqCoreId),
+            "preempt", cid)
 
         case Some(pn) =>
           preempt.driveDcsBus(pn, preemptLci, preemptLcia, preemptUl)
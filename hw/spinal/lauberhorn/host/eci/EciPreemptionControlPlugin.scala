@@ -37,11 +37,13 @@ case class IpiAckReg() extends Bundle {
 }
 
 object EciPreemptionControlPlugin {
-  // called for driving the non-existent preemption control for core#0
-  def bypassDriveControl(irqEn: Bool)(bus: AxiLite4, alloc: RegBlockAlloc) = {
+  // called for driving the non-existent preemption control for the bypass cores
+  def bypassDriveControl(irqEn: Bool, irqCoreId: UInt)(bus: AxiLite4, alloc: RegBlockAlloc) = {
     val busCtrl = AxiLite4SlaveFactory(bus)
 
-    alloc("realCoreId", desc = "Actual core ID serving requests for this context")
+    // bypass cores do not migrate; the IRQ for the non-empty queue goes to this core
+    busCtrl.readAndWrite(irqCoreId, alloc("realCoreId",
+      desc = "Actual core ID serving requests for this context"))
     alloc("ipiAck", attr = RO, readSensitive = true,
       desc = "Preemption command from hardware (read will ACK the interrupt)",
       ty =
@@ -67,7 +69,7 @@ object EciPreemptionControlPlugin {
   * We take parity flags as input, to return them inside this cacheline as well.
   */
 class EciPreemptionControlPlugin(val coreID: Int) extends PreemptionService {
-  withPrefix(s"worker_${coreID - 1}")
+  withPrefix(s"worker_${coreID - NUM_BYPASS_CORES.get}")
 
   lazy val preemptCritSecTimeout = host[EciInterfacePlugin].preemptCritSecTimeout
 
@@ -93,11 +95,12 @@ class EciPreemptionControlPlugin(val coreID: Int) extends PreemptionService {
 
   val requiredAddrSpace = 0x80
 
-  // we have same address space view as the core control (for LCI/LCIA/UL, and AXI)
-  val controlClAddr = 0x10000
+  // we have same address space view as the core control (for LCI/LCIA/UL, and AXI),
+  // mapped right after the data path of [[EciDecoupledRxTxProtocol]] (RX + TX ring)
+  val controlClAddr = 0x18000
   ECI_PREEMPT_CTRL_OFFSET.set(controlClAddr)
 
-  assert(coreID != 0, "bypass core does not need preemption control!")
+  assert(coreID >= NUM_BYPASS_CORES.get, "bypass core does not need preemption control!")
 
   val logic = during setup new Area {
     val proto = host.list[EciDecoupledRxTxProtocol].apply(coreID)
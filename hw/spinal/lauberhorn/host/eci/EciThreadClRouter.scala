@@ -20,6 +20,13 @@ import scala.language.postfixOps
   * to the actual physical addresses of the backing worker.  It translates
   * AXI requests and DCS invalidation requests.
   *
+  * Thread windows sit in an aperture after the physical core windows: thread
+  * `i` starts at `(NUM_CORES + i) * ECI_CORE_OFFSET`.  Addresses in the
+  * physical core windows are passed through untouched: bypass cores are
+  * served by the kernel, and a worker core without a routed thread may be
+  * accessed directly (by the kernel, or in simulation).  Invalidations from a
+  * worker core with a routed thread go to the thread's window.
+  *
   * This module works with UNALIASED ECI addresses.
   */
 case class ClRouterPort(config: Axi4Config) extends Bundle {
@@ -67,19 +74,24 @@ class EciThreadClRouter extends FiberPlugin {
     val coreShift = log2Up(ECI_CORE_OFFSET)
     val coreMask = ((U("1") << coreShift) - 1).asBits
 
-    def testPrefix(addr: UInt, prefix: Bits): Bool = {
-      prefix.resized === (addr >> coreShift).asBits
+    def testPrefix(addr: UInt, prefix: UInt): Bool = {
+      prefix.resized === (addr >> coreShift)
     }
-    def setPrefix(addr: UInt, prefix: Bits): UInt = {
-      ((prefix << coreShift).resized | (addr.asBits & coreMask.resized)).asUInt
+    def setPrefix(addr: UInt, prefix: UInt): UInt = {
+      ((prefix.asBits << coreShift).resized | (addr.asBits & coreMask.resized)).asUInt
     }
 
+    // window prefixes of a thread and of the worker core at a table index
+    def threadPrefix(threadIdx: Bits): UInt = threadIdx.asUInt.resize(16) + NUM_CORES.get
+    def workerPrefix(idx: UInt): UInt = idx.resize(16) + NUM_BYPASS_CORES.get
+    def isPhysical(addr: UInt): Bool = (addr >> coreShift) < NUM_CORES.get
+
     ports.zipWithIndex.foreach { case (p, pidx) =>
       def mapAx(locator: Axi4 => Stream[Axi4Ax], portName: String) = {
         val (axLookup, axResult, _) = threadDb.makePort(axiConfig.addressType, locator(p.axiFromDcs).payload,
           name = portName,
           singleMatch = true) { (v, q, _) =>
-          v.enabled && testPrefix(q, v.threadIdx)
+          v.enabled && testPrefix(q, threadPrefix(v.threadIdx))
         }
 
         axLookup.translateFrom(locator(p.axiFromDcs)) { case (lk, fd) =>
@@ -88,13 +100,13 @@ class EciThreadClRouter extends FiberPlugin {
         }
 
         axResult.translateInto(locator(p.axiToProto)) { case (tp, r) =>
-          val outPrefix = (r.idx + 1).asBits.resize(16)
+          val outPrefix = workerPrefix(r.idx)
           when (!r.matched) {
             // mangle to an unmapped prefix to use AXI interconnect's error generation
-            outPrefix := B("16'xFFFF")
+            outPrefix := U("16'xFFFF")
           }
 
-          tp := r.userData.mapElement(_.addr) { a => setPrefix(a, outPrefix) }
+          tp := r.userData.mapElement(_.addr) { a => isPhysical(a) ? a | setPrefix(a, outPrefix) }
         }
       }
 
@@ -109,7 +121,7 @@ class EciThreadClRouter extends FiberPlugin {
         val (chanLookup, chanResult, _) = threadDb.makePort(EciAddress, EciWord(),
           name = portName,
           singleMatch = true) { (v, q, _) =>
-          v.enabled && testPrefix(q.asUInt, v.threadIdx)
+          v.enabled && testPrefix(q.asUInt, threadPrefix(v.threadIdx))
         }
 
         chanLookup.translateFrom(from) { case (lk, f) =>
@@ -118,10 +130,12 @@ class EciThreadClRouter extends FiberPlugin {
         }
 
         chanResult.translateInto(to) { case (t, r) =>
-          t := r.userData.mapElement(locator) { a => setPrefix(a.asUInt, (r.idx + 1).asBits).asBits }
+          t := r.userData.mapElement(locator) { a =>
+            isPhysical(a.asUInt) ? a | setPrefix(a.asUInt, workerPrefix(r.idx)).asBits
+          }
         }
 
-        when (chanResult.valid) {
+        when (chanResult.valid && !isPhysical(locator(chanResult.userData).asUInt)) {
           assert(chanResult.matched, "non-existent map for LCIA (thread => physical)")
         }
       }
@@ -130,7 +144,7 @@ class EciThreadClRouter extends FiberPlugin {
         val (chanLookup, chanResult, _) = threadDb.makePort(EciAddress, EciWord(),
           name = portName,
           singleMatch = true) { (v, q, idx) =>
-          v.enabled && testPrefix(q.asUInt, idx)
+          v.enabled && testPrefix(q.asUInt, workerPrefix(idx))
         }
 
         chanLookup.translateFrom(from) { case (lk, f) =>
@@ -138,12 +152,11 @@ class EciThreadClRouter extends FiberPlugin {
           lk.query := locator(f)
         }
 
+        // bypass cores and worker cores without a routed thread keep their physical address
         chanResult.translateInto(to) { case (t, r) =>
-          t := r.userData.mapElement(locator) { a => setPrefix(a.asUInt, r.value.threadIdx).asBits }
-        }
-
-        when (chanResult.valid) {
-          assert(chanResult.matched, "non-existent unmap for LCI/UL (physical => thread)")
+          t := r.userData.mapElement(locator) { a =>
+            r.matched ? setPrefix(a.asUInt, threadPrefix(r.value.threadIdx)).asBits | a
+          }
         }
       }
 
@@ -3,7 +3,7 @@ package lauberhorn
 import jsteward.blocks.misc.RegAllocatorFactory
 import lauberhorn.Global._
 import lauberhorn.net.PacketDescType
-import lauberhorn.net.oncrpc.OncRpcReplyTxMeta
+import lauberhorn.net.oncrpc.{OncRpcCallTxMeta, OncRpcReplyTxMeta}
 import spinal.core._
 import spinal.lib.NoData
 
@@ -28,23 +28,26 @@ package object host {
   }
 
   /** Passed to host on an incoming ONC-RPC call.  Separate from [[lauberhorn.net.oncrpc.OncRpcReplyTxMeta]] since that
-    * needs the number of words filled in the data array.
+    * needs the number of words filled in the data array.  Also used for replies to nested calls
+    * ([[HostReqType.oncRpcReply]]): [[funcPtr]] is then the client procedure the call was made through.
     */
   case class HostReqOncRpcCallRx() extends Bundle {
     val funcPtr = Bits(64 bits)
     val pid = PID()
     val xid = Bits(32 bits)
+    /** number of valid bytes in [[data]] */
+    val argsLen = UInt(ONCRPC_ARGS_LEN_WIDTH bits)
     val data = Bits(ONCRPC_INLINE_BYTES * 8 bits)
   }
 
-  // TODO: client bundles for sending a nested call and receiving a reply
-
   /** Received by host for bypass packets.  Also used for sending bypass packets; when used
     * for sending, [[hdr]] encodes a command to the selected decoder that will get translated
     * into the respective [[lauberhorn.net.EncoderMetadata]] (by [[lauberhorn.net.PacketDesc.fromHeaders]]).
     */
   case class HostReqBypassHeaders() extends Bundle {
     val ty = PacketDescType()
+    /** RX only: UDP checksum was present and verified by the NIC */
+    val csumOk = Bool()
     val hdr = Bits(BYPASS_HDR_WIDTH bits)
   }
 
@@ -58,6 +61,7 @@ package object host {
     val bypassMeta = newElement(HostReqBypassHeaders())
     val oncRpcCallRx = newElement(HostReqOncRpcCallRx())
     val oncRpcReplyTx = newElement(OncRpcReplyTxMeta())
+    val oncRpcCallTx = newElement(OncRpcCallTxMeta())
     val arpReq = newElement(HostReqArpRequest())
   }
 
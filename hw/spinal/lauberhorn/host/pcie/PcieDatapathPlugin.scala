@@ -6,7 +6,7 @@ import lauberhorn.host.DatapathPlugin
 import spinal.core._
 import spinal.lib._
 import spinal.lib.bus.misc._
-import spinal.lib.bus.regif.AccessType.{RO, WO}
+import spinal.lib.bus.regif.AccessType.{RO, RW, WO}
 
 import lauberhorn.Global._
 
@@ -36,10 +36,42 @@ class PcieDatapathPlugin(coreID: Int) extends DatapathPlugin(coreID) {
       hostRxReq := True
     }
 
-    busCtrl.driveStream(hostRxAck.padSlave(1), alloc("hostRxAck",
+    // RX acks are posted into a ring of PacketBufDesc (padded like hostRxAck) and published
+    // with one write of the free-running produced index, so that freeing a batch of packets
+    // costs one doorbell instead of one FIFO write each
+    val numAckSlots = PCIE_RX_ACK_RING_SLOTS.get
+    val rxAckRing = Vec.fill(numAckSlots)(Reg(Bits(REG_WIDTH.get bits)))
+    val rxAckRingAddr = alloc("hostRxAckRing",
+      attr = WO,
+      size = numAckSlots * REG_WIDTH.get / 8,
+      ty = "host_pkt_buf_desc",
+      desc = s"RX ack ring ($numAckSlots slots, one packet buffer descriptor each)")
+    rxAckRing.zipWithIndex.foreach { case (slot, i) =>
+      busCtrl.write(slot, rxAckRingAddr + i * REG_WIDTH.get / 8)
+    }
+
+    val rxAckProduced = Reg(UInt(PCIE_RING_IDX_WIDTH.get bits)) init 0
+    val rxAckConsumed = Reg(UInt(PCIE_RING_IDX_WIDTH.get bits)) init 0
+    busCtrl.readAndWrite(rxAckProduced, alloc("hostRxAckProduced", attr = RW,
+      desc = "number of RX acks posted by the host (free-running); doorbell of the RX ack ring"))
+    busCtrl.read(rxAckConsumed, alloc("hostRxAckConsumed", attr = RO,
+      desc = "number of RX acks taken from the ring (free-running)"))
+
+    val rxAckRingDesc = Stream(PacketBufDesc())
+    rxAckRingDesc.valid := rxAckProduced =/= rxAckConsumed
+    rxAckRingDesc.payload.assignFromBits(
+      rxAckRing(rxAckConsumed.resize(log2Up(numAckSlots)))(1, PacketBufDesc().getBitsWidth bits))
+    when (rxAckRingDesc.fire) {
+      rxAckConsumed := rxAckConsumed + 1
+    }
+
+    // single acks are still accepted for simple clients (e.g. the sims)
+    val rxAckSingle = Stream(PacketBufDesc())
+    busCtrl.driveStream(rxAckSingle.padSlave(1), alloc("hostRxAck",
       attr = WO,
       ty = "host_pkt_buf_desc",
       desc = "Acknowledge RX packet"))
+    hostRxAck << StreamArbiterFactory().lowerFirst.noLock.onArgs(rxAckRingDesc, rxAckSingle)
 
     // should not block; only for profiling (to use ready signal)
     busCtrl.readStreamNonBlocking(hostTx, alloc("hostTx",
@@ -48,13 +80,43 @@ class PcieDatapathPlugin(coreID: Int) extends DatapathPlugin(coreID) {
       ty = "host_pkt_buf_desc",
       desc = "TX packet descriptor with buffer address filled only"))
 
-    val txHostDesc = Stream(PcieHostCtrlInfo())
-    busCtrl.driveStream(txHostDesc.padSlave(1), alloc("hostTxAck",
+    // TX descriptors go into a ring of full descriptor slots, published with one write of
+    // the free-running produced index.  The host fills slots with posted writes only; it
+    // learns the buffer of slot 0 once from hostTx, slot i uses the i-th MTU after it.
+    //
+    // [[DmaControlPlugin]] only takes the next descriptor after the DMA of the previous one
+    // is done, so the buffer of a slot is only free again once the descriptor after it was
+    // consumed: at most numTxSlots - 1 descriptors can be outstanding
+    val numTxSlots = PCIE_TX_RING_SLOTS.get
+    assert(isPow2(numTxSlots) && numTxSlots >= 2, "TX ring needs a power-of-two number of slots, at least two")
+    assert(numTxSlots * ROUNDED_MTU.get <= PKT_BUF_TX_SIZE_PER_CORE.get, "TX ring slots do not fit in the TX packet buffer")
+
+    val txRing = Vec.fill(numTxSlots)(Reg(Bits(hostDescSizeRound.toInt * 8 bits)))
+    val txRingAddr = alloc("hostTxRing",
       attr = WO,
-      size = hostDescSizeRound,
-      desc = "Full TX packet descriptor",
+      size = hostDescSizeRound * numTxSlots,
+      desc = s"TX descriptor ring ($numTxSlots slots, one full TX packet descriptor each)",
       // TODO: what's the syntax for allowing multiple aliases for datatype reg?
-      ty = "host_ctrl_info_error | host_ctrl_info_bypass | host_ctrl_info_onc_rpc_call"))
+      ty = "host_ctrl_info_error | host_ctrl_info_bypass | host_ctrl_info_onc_rpc_call")
+    txRing.zipWithIndex.foreach { case (slot, i) =>
+      busCtrl.driveMultiWord(slot, txRingAddr + hostDescSizeRound * i)
+    }
+
+    val txProduced = Reg(UInt(PCIE_RING_IDX_WIDTH.get bits)) init 0
+    val txConsumed = Reg(UInt(PCIE_RING_IDX_WIDTH.get bits)) init 0
+    busCtrl.readAndWrite(txProduced, alloc("hostTxProduced", attr = RW,
+      desc = "number of TX descriptors posted by the host (free-running); doorbell of the TX ring"))
+    busCtrl.read(txConsumed, alloc("hostTxConsumed", attr = RO,
+      desc = "number of TX descriptors taken from the ring (free-running)"))
+
+    val txHostDesc = Stream(PcieHostCtrlInfo())
+    txHostDesc.valid := txProduced =/= txConsumed
+    txHostDesc.payload.assignFromBits(
+      txRing(txConsumed.resize(log2Up(numTxSlots)))(1, PcieHostCtrlInfo().getBitsWidth bits))
+    when (txHostDesc.fire) {
+      txConsumed := txConsumed + 1
+    }
+
     hostTxAck.translateFrom(txHostDesc) { case (cc, h) =>
       h.unpackTo(cc)
     }
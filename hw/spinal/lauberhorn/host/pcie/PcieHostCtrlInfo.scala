@@ -25,13 +25,15 @@ case class PcieHostCtrlInfo() extends Bundle {
   val data = new Union {
     case class BypassBundle() extends Bundle {
       val ty = PacketDescType() // 2b
-      val xb19 = Bits(19 bits) // make sure header is word aligned
+      val csumOk = Bool()
+      val xb18 = Bits(18 bits) // make sure header is word aligned
       val hdr = Bits(BYPASS_HDR_WIDTH bits)
     }
     val bypass = newElement(BypassBundle())
 
     case class OncRpcCallBundle() extends Bundle {
-      val xb21 = Bits(21 bits)
+      val argsLen = UInt(ONCRPC_ARGS_LEN_WIDTH bits)
+      val xb15 = Bits(15 bits)
       val xid = Bits(32 bits)
       val funcPtr = Bits(64 bits)
       val args = Bits(ONCRPC_INLINE_BYTES * 8 bits)
@@ -47,7 +49,10 @@ case class PcieHostCtrlInfo() extends Bundle {
         desc.data.bypassMeta.assignSomeByName(data.bypass)
       }
       is (HostReqType.oncRpcCall) {
-        desc.data.oncRpcCallRx.assignSomeByName(data.oncRpcCall)
+        // nested call: inlined arguments plus overflow in the packet buffer
+        desc.data.oncRpcCallTx.assignSomeByName(data.oncRpcCall)
+        desc.data.oncRpcCallTx.data := data.oncRpcCall.args
+        desc.data.oncRpcCallTx.callLen.bits := buffer.size.bits + data.oncRpcCall.argsLen
       }
     }
     desc.buffer := buffer
@@ -74,7 +79,8 @@ case class PcieHostCtrlInfo() extends Bundle {
          |  size   ${PKT_BUF_LEN_WIDTH.get} "Length of packet";
          |  ty     ${HOST_REQ_TY_WIDTH.get} type(host_req_type) "Type of descriptor (should be bypass)";
          |  hdr_ty ${PKT_DESC_TY_WIDTH.get} type(packet_desc_type) "Type of bypass header";
-         |  _      19 rsvd;
+         |  csum_ok 1  "UDP checksum present and verified (RX only)";
+         |  _      18 rsvd;
          |  // hdr follows -- need to calculate address manually
          |  // TODO: actually define args in the datatype.  Possible approach:
          |  // - as an address-only field, so no hdr+size pointer calculation in user code
@@ -83,10 +89,11 @@ case class PcieHostCtrlInfo() extends Bundle {
          |  valid  1   "RX descriptor valid (rsvd for TX)";
          |  addr   ${PKT_BUF_ADDR_WIDTH.get} "Address in packet buffer";
          |  size   ${PKT_BUF_LEN_WIDTH.get} "Length of packet";
-         |  ty     ${HOST_REQ_TY_WIDTH.get} type(host_req_type) "Type of descriptor (should be onc_rpc_call)";
-         |  _      21  rsvd;
-         |  xid    32  "XID of incoming request";
-         |  func_ptr 64 "Function pointer for RPC call handler";
+         |  ty     ${HOST_REQ_TY_WIDTH.get} type(host_req_type) "Type of descriptor (should be onc_rpc_call / onc_rpc_reply)";
+         |  args_len ${ONCRPC_ARGS_LEN_WIDTH.get} "Number of valid inlined argument bytes";
+         |  _      15  rsvd;
+         |  xid    32  "XID of incoming request, or of outgoing nested call";
+         |  func_ptr 64 "Function pointer for RPC call handler, or client procedure for nested call";
          |  // args follows -- need to calculate address manually
          |  // TODO: actually define args in the datatype.  Two possible approaches:
          |  // - as an address-only field, so no hdr+size pointer calculation in user code
@@ -115,11 +122,11 @@ object PcieHostCtrlInfo {
     switch (desc.ty) {
       is (HostReqType.bypass) {
         ret.data.bypass.assignSomeByName(desc.data.bypassMeta)
-        ret.data.bypass.xb19 := 0
+        ret.data.bypass.xb18 := 0
       }
-      is (HostReqType.oncRpcCall) {
+      is (HostReqType.oncRpcCall, HostReqType.oncRpcReply) {
         ret.data.oncRpcCall.assignSomeByName(desc.data.oncRpcCallRx)
-        ret.data.oncRpcCall.xb21 := 0
+        ret.data.oncRpcCall.xb15 := 0
       }
     }
     ret.buffer := desc.buffer
@@ -3,12 +3,14 @@ package lauberhorn.net
 import jsteward.blocks.axi.AxiStreamMux
 import jsteward.blocks.misc.RegBlockAlloc
 import lauberhorn.{DmaControlPlugin, MacInterfaceService, PacketBuffer, RxPacketDescWithSource}
+import lauberhorn.Global._
 import spinal.core._
 import spinal.core.fiber.Retainer
 import spinal.lib.StreamPipe.FULL
 import spinal.lib._
 import spinal.lib.bus.amba4.axilite.{AxiLite4, AxiLite4SlaveFactory}
 import spinal.lib.bus.amba4.axis.Axi4Stream.Axi4Stream
+import spinal.lib.bus.regif.AccessType
 import spinal.lib.misc.plugin.FiberPlugin
 
 import scala.collection.mutable
@@ -36,6 +38,13 @@ trait DecoderSinkService {
   * [[PacketDesc]] from decoder stages gets muxed into a single stream, before passed to [[DmaControlPlugin]] for
   * further translation (into [[lauberhorn.host.HostReq]]).  Payload data is arbitrated into a single AXI-Stream and fed
   * into the DMA engine in [[PacketBuffer]].
+  *
+  * Bypass packets are spread over the bypass cores by flow: the flow hash ([[PacketDesc.flowHash]]) selects a bucket
+  * in an indirection table, which names the bypass core to deliver to.  The table is initialized to spread buckets
+  * evenly over all bypass cores and can be rewritten by the host, e.g. to use fewer queues.
+  *
+  * The Internet checksum of every payload written to the packet buffer is passed to [[DmaControlPlugin]], which
+  * completes the UDP checksum with the partial sum the decoders put in the metadata.
   */
 class DecoderSink extends FiberPlugin with DecoderSinkService {
   lazy val ms = host[MacInterfaceService]
@@ -58,6 +67,11 @@ class DecoderSink extends FiberPlugin with DecoderSinkService {
       ret.desc.ty := md.getType
       ret.desc.metadata := md.asUnion
       ret.isBypass := Bool(isBypass)
+      if (isBypass) {
+        ret.bypassQueue := rssTbl(ret.desc.flowHash(log2Up(BYPASS_RSS_TBL_SIZE)).asUInt)
+      } else {
+        ret.bypassQueue := 0
+      }
       ret
     }
 
@@ -68,6 +82,11 @@ class DecoderSink extends FiberPlugin with DecoderSinkService {
   override def packetSink = logic.axisMux.m_axis
 
   lazy val promisc = Bool()
+
+  /** flow hash bucket to bypass core */
+  lazy val rssTbl = Vec.tabulate(BYPASS_RSS_TBL_SIZE) { idx =>
+    Reg(UInt(bypassQueueWidth bits)) init idx % NUM_BYPASS_CORES
+  }
   val logic = during build new Area {
     retainer.await()
 
@@ -117,11 +136,51 @@ class DecoderSink extends FiberPlugin with DecoderSinkService {
     }
 
     descArbiter.io.output >> dc.incomingDesc
+
+    // payloads are packed, only the last beat can be partial: sum up whole beats and mask the last one.
+    // One register stage for the per-beat adder tree
+    val pldCsum = new Area {
+      val pld = axisMux.m_axis
+      val masked = Vec(pld.data.subdivideIn(8 bits).zip(pld.keep.asBools).map { case (b, k) =>
+        k ? b | B(0, 8 bits)
+      }).asBits
+
+      val beatSum = RegNext(InetChecksum.sum(masked))
+      val beatValid = RegNext(pld.fire) init False
+      val beatLast = RegNext(pld.lastFire) init False
+
+      val acc = Reg(UInt(16 bits)) init 0
+      when (beatValid) {
+        acc := beatLast ? U(0, 16 bits) | InetChecksum.add(acc, beatSum)
+      }
+
+      val done = Flow(UInt(16 bits))
+      done.valid := beatValid && beatLast
+      done.payload := InetChecksum.add(acc, beatSum)
+
+      // DmaControlPlugin takes the sum before accepting the next packet
+      val overflow = Bool()
+      done.toStream(overflow).stage() >> dc.incomingPldCsum
+      assert(!overflow, "payload checksum not consumed before the next payload")
+    }
   }
 
   def isPromisc: Bool = promisc
   def driveControl(bus: AxiLite4, alloc: RegBlockAlloc): Unit = {
     val busCtrl = AxiLite4SlaveFactory(bus)
     busCtrl.driveAndRead(promisc, alloc("ctrl", "Enable promiscuous mode", "promisc")) init False
+
+    val rssQueue = UInt(bypassQueueWidth bits)
+    busCtrl.drive(rssQueue, alloc("ctrl", "Bypass core for the flow hash bucket to update", "rss_queue",
+      attr = AccessType.WO))
+
+    val rssIdx = UInt(log2Up(BYPASS_RSS_TBL_SIZE) bits)
+    rssIdx := 0
+    val rssIdxAddr = alloc("ctrl", "Index of flow hash bucket to update", "rss_idx", attr = AccessType.WO)
+    busCtrl.write(rssIdx, rssIdxAddr)
+    busCtrl.onWrite(rssIdxAddr) {
+      assert(rssQueue < NUM_BYPASS_CORES.get, "flow hash bucket steered to a non-existent bypass core")
+      rssTbl(rssIdx) := rssQueue
+    }
   }
 }
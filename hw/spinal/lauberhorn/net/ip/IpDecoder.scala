@@ -3,8 +3,9 @@ package lauberhorn.net.ip
 import jsteward.blocks.axi._
 import jsteward.blocks.misc.RegBlockAlloc
 import lauberhorn._
+import lauberhorn.Global._
 import lauberhorn.net.ethernet.{EthernetDecoder, EthernetRxMeta}
-import lauberhorn.net.Decoder
+import lauberhorn.net.{Decoder, InetChecksum}
 import spinal.core._
 import spinal.lib._
 import spinal.lib.bus.amba4.axilite.{AxiLite4, AxiLite4SlaveFactory}
@@ -23,6 +24,7 @@ class IpDecoder extends Decoder[IpRxMeta] {
       busCtrl.read(stat, alloc("stat", s"Stat $name", name, attr = RO))
     }
     busCtrl.readAndWrite(logic.ipAddress, alloc("ctrl", "Our IP address", "ipAddress"))
+    busCtrl.read(logic.badHdrCsumCount, alloc("stat", "Stat badHdrCsum", "badHdrCsum", attr = RO))
   }
 
   val logic = during setup new Area {
@@ -60,16 +62,36 @@ class IpDecoder extends Decoder[IpRxMeta] {
     pldFilter.io.action.valid := decoder.io.header.fire
     pldFilter.io.action.payload := drop ? FilterAction.drop | FilterAction.pass
 
+    // header checksum only covers the fixed header when there are no options
+    // TODO: verify version, etc.
+    val hdrParsed = IpHeader()
+    hdrParsed.assignFromBits(decoder.io.header.payload)
+    val hdrCsumBad = hdrParsed.ihl === 5 && !InetChecksum.isValid(InetChecksum.sum(decoder.io.header.payload))
+
+    val badHdrCsumCount = Reg(UInt(REG_WIDTH bits)) init 0
+    when (decoder.io.header.fire && hdrCsumBad) {
+      badHdrCsumCount := badHdrCsumCount + 1
+    }
+
     ethernetPayload >> decoder.io.input
-    metadata << decoder.io.header.throwWhen(drop).map { hdr =>
+    val accepted = decoder.io.header.throwWhen(drop).map { hdr =>
       val meta = IpRxMeta()
       meta.hdr.assignFromBits(hdr)
       meta.ethMeta := lastEthMeta
+      meta.l4Ports.assignDontCare()
 
-      // TODO: verify header checksum, version, etc.
-      drop := meta.hdr.daddr =/= ipAddress && !isPromisc
+      // corrupted headers are dropped even in promiscuous mode, the host would drop them anyway
+      drop := meta.hdr.daddr =/= ipAddress && !isPromisc || hdrCsumBad
 
       meta
     }
+
+    // TCP is not decoded further: take its ports from the first payload beat, for the flow hash of bypass packets.
+    // The header is held until the beat shows up; the beat waits for the header downstream
+    metadata << accepted.m2sPipe().continueWhen(payload.valid).map { meta =>
+      val ret = CombInit(meta)
+      ret.l4Ports := payload.data(31 downto 0)
+      ret
+    }
   }
 }
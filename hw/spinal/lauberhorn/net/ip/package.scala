@@ -36,6 +36,9 @@ package object ip {
       }, (stage, level) => RegNext(stage))
       EndiannessSwap(~sum.asBits)
     }
+
+    /** More fragments follow or this is not the first fragment: the L4 header is not in every fragment */
+    def isFragment: Bool = (EndiannessSwap(flags) & B("16'x3fff")) =/= 0
   }
 
   case class IpRxMeta() extends Bundle with DecoderMetadata {
@@ -43,6 +46,11 @@ package object ip {
 
     val hdr = IpHeader()
     val ethMeta = EthernetRxMeta()
+    /** First four payload bytes, i.e. the source and destination port of TCP (network order) */
+    val l4Ports = Bits(32 bits)
+
+    /** [[l4Ports]] actually holds the ports: no IP options and not fragmented */
+    def hasL4Ports: Bool = hdr.ihl === 5 && !hdr.isFragment
 
     def getType = PacketDescType.ip
     def getPayloadSize: UInt = ethMeta.getPayloadSize - hdr.getBitsWidth / 8
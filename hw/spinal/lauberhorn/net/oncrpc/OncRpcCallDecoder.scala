@@ -5,7 +5,7 @@ import jsteward.blocks.misc.{LookupTable, RegBlockAlloc}
 import lauberhorn.Global._
 import lauberhorn._
 import lauberhorn.net._
-import lauberhorn.net.udp.{UdpDecoder, UdpNextProto, UdpRxMeta}
+import lauberhorn.net.udp.{UdpCsumState, UdpDecoder, UdpNextProto, UdpRxMeta}
 import spinal.core._
 import spinal.lib._
 import spinal.lib.bus.amba4.axilite.{AxiLite4, AxiLite4SlaveFactory}
@@ -18,6 +18,7 @@ case class OncRpcCallLookupUserData() extends Bundle {
   val hdr = OncRpcCallHeader()
   val args = Bits(ONCRPC_INLINE_BYTES * 8 bits)
   val udpPayloadSize = UInt(PKT_BUF_LEN_WIDTH bits)
+  val csum = UdpCsumState()
 
   // for sending event to encoder
   val addr = Bits(32 bits)
@@ -29,6 +30,7 @@ class OncRpcCallDecoder extends Decoder[OncRpcCallRxMeta] {
 
   // FIXME: can we fit more?
   ONCRPC_INLINE_BYTES.set(4 * 12)
+  ONCRPC_ARGS_LEN_WIDTH.set(log2Up(ONCRPC_INLINE_BYTES + 1))
 
   def driveControl(bus: AxiLite4, alloc: RegBlockAlloc): Unit = {
     val busCtrl = AxiLite4SlaveFactory(bus)
@@ -124,6 +126,15 @@ class OncRpcCallDecoder extends Decoder[OncRpcCallRxMeta] {
       lk.userData.args.assignFromBits(hdr(maxLen * 8 - 1 downto minLen * 8))
       lk.userData.udpPayloadSize := currentUdpHeader.getPayloadSize
 
+      // RPC header and the argument bytes actually present; the rest of the payload is summed on its way to the
+      // packet buffer
+      val argsAvail = currentUdpHeader.getPayloadSize - minLen
+      val argsLen = (argsAvail > ONCRPC_INLINE_BYTES.get) ? U(ONCRPC_INLINE_BYTES.get) | argsAvail
+      lk.userData.csum.present := currentUdpHeader.csum.present
+      lk.userData.csum.sum := InetChecksum.add(currentUdpHeader.csum.sum, InetChecksum.add(
+        InetChecksum.sum(hdr(minLen * 8 - 1 downto 0)),
+        InetChecksum.sumPrefix(hdr(maxLen * 8 - 1 downto minLen * 8), argsLen)))
+
       // XXX: these are passed to encoder as big endian
       lk.userData.addr := currentUdpHeader.ipMeta.hdr.saddr
       lk.userData.port := currentUdpHeader.hdr.sport
@@ -141,6 +152,7 @@ class OncRpcCallDecoder extends Decoder[OncRpcCallRxMeta] {
       md.hdr := lr.userData.hdr
       md.args := lr.userData.args
       md.udpPayloadSize := lr.userData.udpPayloadSize
+      md.csum := lr.userData.csum
       md.funcPtr := lr.value.funcPtr
       md.pid := lr.value.pid
     }
@@ -1,13 +1,252 @@
 package lauberhorn.net.oncrpc
 
-import lauberhorn.net._
+import jsteward.blocks.axi.AxiStreamInjectHeader
+import jsteward.blocks.misc.{LookupTable, RegBlockAlloc}
+import lauberhorn.Global.{NUM_CLIENTS, ONCRPC_INLINE_BYTES, REG_WIDTH}
+import lauberhorn.{MacInterfaceService, PacketLength}
+import lauberhorn.net.udp.{UdpEncoder, UdpTxMeta}
+import lauberhorn.net.{Encoder, EncoderMetadata, PacketDescType}
 import spinal.core._
+import spinal.lib._
+import spinal.lib.bus.amba4.axilite.{AxiLite4, AxiLite4SlaveFactory}
+import spinal.lib.bus.amba4.axis.Axi4Stream
+import spinal.lib.bus.regif.AccessType
+import spinal.lib.fsm.{EntryPoint, State, StateMachine}
+
+import scala.language.postfixOps
 
 case class OncRpcCallTxMeta() extends Bundle with EncoderMetadata {
-  def getType: PacketDescType.E = PacketDescType.oncRpcCall
+  /** Client procedure to call, as registered in the client table */
+  val funcPtr = Bits(64 bits)
+  /** Picked by the host; the reply is matched back to the call by this */
+  val xid = Bits(32 bits)
+  val data = Bits(ONCRPC_INLINE_BYTES * 8 bits)
+
+  /** Total length of the call arguments, including inlined bits */
+  val callLen = PacketLength()
+
+  def getType = PacketDescType.oncRpcCall
 }
 
-// TODO: for nested RPC calls (outgoing)
+/** Sends calls to remote procedures on behalf of the host (nested RPC calls).  The remote procedure is looked up
+  * from the client table by [[OncRpcCallTxMeta.funcPtr]]; the call is recorded as pending in [[OncRpcReplyDecoder]],
+  * such that the reply can be delivered to the process that made the call.  Calls that find the pending call table
+  * full are dropped (counted in pendingTblFull of the reply decoder).
+  */
 class OncRpcCallEncoder extends Encoder[OncRpcCallTxMeta] {
-  def getMetadata = ???
+  def getMetadata = OncRpcCallTxMeta()
+
+  def driveControl(bus: AxiLite4, alloc: RegBlockAlloc): Unit = {
+    val busCtrl = AxiLite4SlaveFactory(bus)
+
+    // one port for each field + index register to latch into table
+    val clientPort = OncRpcClientDef()
+    clientPort.elements.foreach { case (name, field) =>
+      busCtrl.drive(field, alloc("ctrl", s"Client table update $name", s"client_$name", attr = AccessType.WO))
+    }
+
+    logic.clientDb.update.setIdle()
+
+    val clientIdx = UInt(log2Up(NUM_CLIENTS) bits)
+    clientIdx := 0
+    val clientIdxAddr = alloc("ctrl", "Index of client procedure to update", "client_idx", attr = AccessType.WO)
+    busCtrl.write(clientIdx, clientIdxAddr)
+    busCtrl.onWrite(clientIdxAddr) {
+      // record client entry in table
+      // XXX: assumes host is LITTLE ENDIAN
+      //      we swap endianness now already to shorten critical path
+      logic.clientDb.update.valid := True
+      logic.clientDb.update.idx := clientIdx
+      (logic.clientDb.update.value.elements.toSeq ++ clientPort.elements.toSeq).groupBy(_._1).foreach {
+        case (n, Seq((_, te), (_, po))) if Seq("funcPtr", "pid").contains(n) => te := po
+        case (_, Seq((_, te), (_, po: BitVector)))                           => te := EndiannessSwap(po)
+        case (_, Seq((_, te), (_, po)))                                      => te := po
+      }
+    }
+
+    busCtrl.read(logic.dropped.value, alloc("stat", "Number of dropped calls due to missing client procedure",
+      "dropped", attr = AccessType.RO))
+  }
+
+  lazy val axisConfig = host[MacInterfaceService].axisConfig
+
+  val logic = during setup new Area {
+    val md = Stream(OncRpcCallTxMeta())
+    val pld = Axi4Stream(axisConfig)
+
+    val outMd = Stream(UdpTxMeta())
+    val outPld = Axi4Stream(axisConfig)
+    to[UdpTxMeta, UdpEncoder](outMd, outPld)
+
+    awaitBuild()
+
+    collectInto(md, pld, acceptHostPackets = true)
+
+    // record every call we send in the reply decoder
+    val pendingCallPort = host[OncRpcReplyDecoder].logic.newCallEvent
+    val pendingCallRejected = host[OncRpcReplyDecoder].logic.newCallRejected
+
+    val encoder = AxiStreamInjectHeader(axisConfig, OncRpcCallHeader().getBitsWidth / 8)
+    encoder.io.output >> outPld
+
+    // XXX: contents are in BIG ENDIAN (network)
+    val clientDb = LookupTable(OncRpcClientDef(), NUM_CLIENTS) { v =>
+      v.enabled init False
+    }
+
+    // Convert data words to AXI Stream and concatenate with the actual payload
+    // from the packet buffer.  Same as in [[OncRpcReplyEncoder]]
+    assert(ONCRPC_INLINE_BYTES <= axisConfig.dataWidth, "we assumed the inlined bytes fit inside one AXIS beat")
+
+    val segmentLenWidth = log2Up(axisConfig.dataWidth) + 1
+    val inlinedLen = U(0, segmentLenWidth bits)
+    val inlinedMaskNext = ((U(1, axisConfig.dataWidth bits) |<< inlinedLen) - 1).asBits
+    val inlinedShiftNext = axisConfig.dataWidth - inlinedLen
+
+    val inlinedMask = Reg(Bits(axisConfig.dataWidth bits))     // not yet shifted
+    val inlinedShift = Reg(UInt(segmentLenWidth bits))
+    val inlinedData = Reg(Bits(axisConfig.dataWidth * 8 bits)) // already shifted!
+    val overflowPldPresent = Reg(Bool())
+
+    // find call destination
+    val (txQ, txR, _) = clientDb.makePort(Bits(64 bits), OncRpcCallTxMeta(),
+      "txLookup", singleMatch = true) { (v, q, _) =>
+      v.funcPtr === q && v.enabled
+    }
+    txQ.translateFrom(md) { case (q, md) =>
+      q.query    := md.funcPtr
+      q.userData := md
+    }
+    txR.ready := False
+
+    val outHdr = Reg(OncRpcCallHeader())
+    encoder.io.header.payload := outHdr.asBits
+    encoder.io.header.valid := False
+
+    pendingCallPort.payload.setAsReg()
+    pendingCallPort.valid := False
+
+    outMd.payload.setAsReg()
+    outMd.valid := False
+    pld.ready := False
+    encoder.io.input.setIdle()
+
+    val dropped = Counter(REG_WIDTH bits)
+    val fsm = new StateMachine {
+      val idle: State = new State with EntryPoint {
+        whenIsActive {
+          txR.ready := True
+          when (txR.valid) {
+            // calculate shift for beat to inject into payload
+            inlinedShift := inlinedShiftNext
+            inlinedMask  := inlinedMaskNext
+            when (txR.userData.callLen.bits > ONCRPC_INLINE_BYTES.get) {
+              inlinedLen         := ONCRPC_INLINE_BYTES.get
+              overflowPldPresent := True
+            } otherwise {
+              inlinedLen         := txR.userData.callLen.bits.resized
+              overflowPldPresent := False
+            }
+
+            // store inlined bytes.  We shift it here already to shorten critical path
+            inlinedData := (txR.userData.data.asBits << (inlinedShiftNext * 8)).resized
+
+            when (txR.matched) {
+              outHdr.xid      := txR.userData.xid
+              outHdr.msgType  := 0                               // msg_type == CALL
+              outHdr.rpcVer   := EndiannessSwap(B(2, 32 bits))   // rpcvers == 2
+              outHdr.progNum  := txR.value.progNum
+              outHdr.progVer  := txR.value.progVer
+              outHdr.proc     := txR.value.proc
+              outHdr.creds    := 0                               // AUTH_NONE
+              outHdr.verifier := 0                               // AUTH_NONE
+
+              outMd.daddr     := txR.value.serverAddr
+              outMd.dport     := txR.value.serverPort
+              outMd.sport     := txR.value.clientPort
+              outMd.pldLen    := txR.userData.callLen.bits + outHdr.getBitsWidth / 8
+
+              pendingCallPort.funcPtr    := txR.value.funcPtr
+              pendingCallPort.pid        := txR.value.pid
+              pendingCallPort.xid        := txR.userData.xid
+              pendingCallPort.clientPort := txR.value.clientPort
+              pendingCallPort.active     := True
+
+              goto(recordPendingCall)
+            } otherwise {
+              // failed to find client procedure: not registered (anymore)?
+              dropped.increment()
+              when (txR.userData.callLen.bits > ONCRPC_INLINE_BYTES.get) {
+                // only need to consume payload, when there are overflow bytes
+                goto(dropPld)
+              }
+            }
+          }
+        }
+      }
+      val dropPld: State = new State {
+        whenIsActive {
+          pld.ready := True
+          when (pld.lastFire) {
+            goto(idle)
+          }
+        }
+      }
+      val recordPendingCall: State = new State {
+        whenIsActive {
+          // before the call leaves, such that the reply cannot overtake the record
+          pendingCallPort.valid := True
+          when (pendingCallPort.ready) {
+            when (!pendingCallRejected) {
+              goto(sendDownstreamMd)
+            } elsewhen (overflowPldPresent) {
+              goto(dropPld)
+            } otherwise {
+              goto(idle)
+            }
+          }
+        }
+      }
+      val sendDownstreamMd: State = new State {
+        whenIsActive {
+          outMd.valid := True
+          when (outMd.ready) {
+            goto(sendHdrToEncoder)
+          }
+        }
+      }
+      val sendHdrToEncoder: State = new State {
+        whenIsActive {
+          encoder.io.header.valid := True
+          when (encoder.io.header.ready) {
+            // send first beats (inlined beats) of payload to encoder
+            goto(sendInlinedWords)
+          }
+        }
+      }
+      val sendInlinedWords: State = new State {
+        whenIsActive {
+          encoder.io.input.valid := True
+          encoder.io.input.keep := inlinedMask |<< inlinedShift
+          encoder.io.input.data := inlinedData
+          encoder.io.input.last := !overflowPldPresent
+          when (encoder.io.input.ready) {
+            when (overflowPldPresent) {
+              goto(passthrough)
+            } otherwise {
+              goto(idle)
+            }
+          }
+        }
+      }
+      val passthrough: State = new State {
+        whenIsActive {
+          encoder.io.input << pld
+          when (pld.lastFire) {
+            goto(idle)
+          }
+        }
+      }
+    }
+  }
 }
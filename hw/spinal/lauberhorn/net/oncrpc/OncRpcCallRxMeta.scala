@@ -1,8 +1,9 @@
 package lauberhorn.net.oncrpc
 
-import lauberhorn.Global.{ONCRPC_INLINE_BYTES, PKT_BUF_LEN_WIDTH}
+import lauberhorn.Global.{ONCRPC_ARGS_LEN_WIDTH, ONCRPC_INLINE_BYTES, PKT_BUF_LEN_WIDTH}
 import lauberhorn.PID
 import lauberhorn.net.{DecoderMetadata, PacketDescData, PacketDescType}
+import lauberhorn.net.udp.UdpCsumState
 import spinal.core._
 
 import scala.language.postfixOps
@@ -16,9 +17,18 @@ case class OncRpcCallRxMeta() extends Bundle with DecoderMetadata {
   val args = Bits(ONCRPC_INLINE_BYTES * 8 bits)
   val hdr = OncRpcCallHeader()
   val udpPayloadSize = UInt(PKT_BUF_LEN_WIDTH bits)
+  /** UDP checksum up to the end of [[args]]; finished over the payload in [[lauberhorn.DmaControlPlugin]] */
+  val csum = UdpCsumState()
 
   def getType = PacketDescType.oncRpcCall
 
+  /** Number of argument bytes actually present in [[args]]; the rest is garbage */
+  def getArgsLen: UInt = {
+    val inlineLen = ONCRPC_INLINE_BYTES.get
+    val payloadLen = udpPayloadSize - hdr.getBitsWidth / 8
+    ((payloadLen > inlineLen) ? U(inlineLen) | payloadLen).resize(ONCRPC_ARGS_LEN_WIDTH.get)
+  }
+
   def getPayloadSize: UInt = {
     val inlineLen = ONCRPC_INLINE_BYTES.get
     val payloadLen = udpPayloadSize - hdr.getBitsWidth / 8
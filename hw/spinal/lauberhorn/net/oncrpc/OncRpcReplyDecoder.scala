@@ -1,15 +1,208 @@
 package lauberhorn.net.oncrpc
 
-import jsteward.blocks.misc.RegBlockAlloc
-import lauberhorn.net.{PacketDescData, Decoder, Encoder, DecoderMetadata}
+import jsteward.blocks.axi._
+import jsteward.blocks.misc.{LookupTable, RegBlockAlloc}
+import lauberhorn.Global._
+import lauberhorn._
+import lauberhorn.net._
+import lauberhorn.net.udp.{UdpDecoder, UdpNextProto, UdpRxMeta}
 import spinal.core._
-import spinal.lib.bus.amba4.axilite.AxiLite4
-import spinal.lib.bus.misc.BusSlaveFactory
+import spinal.lib._
+import spinal.lib.bus.amba4.axilite.{AxiLite4, AxiLite4SlaveFactory}
+import spinal.lib.bus.amba4.axis.Axi4Stream
+import spinal.lib.bus.regif.AccessType
 
-/*
-// TODO: used for nested RPC replies (incoming)
-class OncRpcReplyDecoder extends Decoder[OncRpcReplyRxMeta] {
-  def driveControl(bus: AxiLite4, alloc: RegBlockAlloc): Unit = ???
+import scala.language.postfixOps
+
+/** Passed to the host on a reply to a nested call.  Same shape as [[OncRpcCallRxMeta]]: [[funcPtr]] is the client
+  * procedure the call was made through, [[pid]] the process that made it.
+  */
+case class OncRpcReplyRxMeta() extends Bundle with DecoderMetadata {
+  override def clone = OncRpcReplyRxMeta()
+
+  val funcPtr = Bits(64 bits)
+  val pid = PID()
+  // first fields in the XDR payload
+  val args = Bits(ONCRPC_INLINE_BYTES * 8 bits)
+  val hdr = OncRpcReplyHeader()
+  val udpPayloadSize = UInt(PKT_BUF_LEN_WIDTH bits)
+
+  def getType = PacketDescType.oncRpcReply
+
+  /** Number of result bytes actually present in [[args]]; the rest is garbage */
+  def getArgsLen: UInt = {
+    val inlineLen = ONCRPC_INLINE_BYTES.get
+    val payloadLen = udpPayloadSize - hdr.getBitsWidth / 8
+    ((payloadLen > inlineLen) ? U(inlineLen) | payloadLen).resize(ONCRPC_ARGS_LEN_WIDTH.get)
+  }
+
+  def getPayloadSize: UInt = {
+    val inlineLen = ONCRPC_INLINE_BYTES.get
+    val payloadLen = udpPayloadSize - hdr.getBitsWidth / 8
+    (payloadLen > inlineLen) ? (payloadLen - inlineLen) | U(0)
+  }
+
+  def collectHeaders: Bits = ??? // never collected
+
+  def asUnion: PacketDescData = {
+    val ret = PacketDescData() setCompositeName(this, "union")
+    ret.oncRpcReplyRx.get := this
+    ret
+  }
+}
+
+case class OncRpcReplyLookupUserData() extends Bundle {
+  val hdr = OncRpcReplyHeader()
+  val args = Bits(ONCRPC_INLINE_BYTES * 8 bits)
+  val udpPayloadSize = UInt(PKT_BUF_LEN_WIDTH bits)
 }
- */
 
+/** Decodes replies to calls made through [[OncRpcCallEncoder]] (nested RPC replies), on ports listened to as
+  * [[UdpNextProto.oncRpcReply]].  A reply is matched against the pending calls by (xid, port) and delivered to the
+  * process that made the call; the pending call is freed.  Replies without a pending call are dropped, as are
+  * replies that were not accepted successfully: [[OncRpcReplyHeader]] only covers MSG_ACCEPTED / SUCCESS.
+  *
+  * The pending call table is shared by all processes.  When it is full, a new call is rejected
+  * ([[logic.newCallRejected]]): [[OncRpcCallEncoder]] drops it instead of sending it.
+  */
+class OncRpcReplyDecoder extends Decoder[OncRpcReplyRxMeta] {
+  lazy val macIf = host[MacInterfaceService]
+
+  def driveControl(bus: AxiLite4, alloc: RegBlockAlloc): Unit = {
+    val busCtrl = AxiLite4SlaveFactory(bus)
+    logic.decoder.io.statistics.elements.foreach { case (name, stat) =>
+      busCtrl.read(stat, alloc("stat", s"Stat $name", name, attr = AccessType.RO))
+    }
+
+    busCtrl.read(logic.pendingTblFull.value, alloc("stat", "Number of calls rejected since the pending call table was full",
+      "pendingTblFull", attr = AccessType.RO))
+    busCtrl.read(logic.dropped.value, alloc("stat", "Number of dropped replies due to missing pending call",
+      "dropped", attr = AccessType.RO))
+    busCtrl.read(logic.rejected.value, alloc("stat", "Number of dropped replies that were not accepted successfully",
+      "rejected", attr = AccessType.RO))
+  }
+
+  val logic = during setup new Area {
+    val udpHeader = Stream(UdpRxMeta())
+    val udpPayload = Axi4Stream(macIf.axisConfig)
+
+    // accept calls from the RPC call encoder to record in the pending call DB
+    val newCallEvent = Stream(OncRpcPendingCallDef())
+    // valid with newCallEvent: no free entry, the call was not recorded and must not be sent
+    val newCallRejected = Bool()
+
+    from[UdpRxMeta, UdpDecoder](_.nextProto === UdpNextProto.oncRpcReply, udpHeader, udpPayload)
+
+    val payload = Axi4Stream(macIf.axisConfig)
+    val metadata = Stream(OncRpcReplyRxMeta())
+
+    // we do not invoke produce: there should be no downstream decoders
+    produceFinal(metadata, payload)
+    produceDone()
+
+    awaitBuild()
+    val minLen = OncRpcReplyHeader().getBitsWidth / 8
+    val maxLen = minLen + ONCRPC_INLINE_BYTES
+    val decoder = AxiStreamExtractHeader(macIf.axisConfig, maxLen)(minLen)
+
+    val currentUdpHeader = udpHeader.toFlowFire.toReg()
+    udpHeader.ready.setAsReg().init(True)
+      .clearWhen(udpHeader.fire)
+      .setWhen(decoder.io.header.fire)
+
+    udpPayload >> decoder.io.input
+
+    // XXX: contents are in BIG ENDIAN (network)
+    val pendingDb = LookupTable(OncRpcPendingCallDef(), NUM_PENDING_CALLS) { v =>
+      v.active init False
+    }
+    pendingDb.update.setIdle()
+
+    // find a slot to record an outgoing call
+    val pendingTblFull = Counter(REG_WIDTH bits)
+    val (callFreeQ, callFreeR, _) = pendingDb.makePort(NoData(), NoData(), "callLookupFree") { (v, _, _) =>
+      !v.active
+    }
+    callFreeQ.valid := True
+    callFreeR.ready := True
+
+    case class ReplyQuery() extends Bundle {
+      val xid = Bits(32 bits)
+      val clientPort = Bits(16 bits)
+    }
+
+    val (dbLookup, dbResult, dbLat) = pendingDb.makePort(ReplyQuery(), OncRpcReplyLookupUserData(),
+      "rxLookup", singleMatch = true) { (v, q, _) =>
+      v.active && v.xid === q.xid && v.clientPort === q.clientPort
+    }
+
+    val hdrParsed = OncRpcReplyHeader()
+    dbLookup.translateFrom(decoder.io.header) { case (lk, hdr) =>
+      hdrParsed.assignFromBits(hdr(minLen * 8 - 1 downto 0))
+      lk.query.xid := hdrParsed.xid
+      lk.query.clientPort := currentUdpHeader.hdr.dport
+
+      lk.userData.hdr := hdrParsed
+      // TODO: endianness swap for host: these are in BIG ENDIAN
+      lk.userData.args.assignFromBits(hdr(maxLen * 8 - 1 downto minLen * 8))
+      lk.userData.udpPayloadSize := currentUdpHeader.getPayloadSize
+    }
+
+    when (decoder.io.header.fire) {
+      assert(EndiannessSwap(hdrParsed.msgType) === 1, "msg_type must be 1 for REPLY (see RFC 5331)")
+
+      assert(currentUdpHeader.nextProto === UdpNextProto.oncRpcReply, "no valid UDP header stored, did a payload leak through?")
+    }
+
+    // reply_stat == MSG_ACCEPTED and accept_stat == SUCCESS
+    val accepted = dbResult.userData.hdr.replyStat === 0 && dbResult.userData.hdr.acceptStat === 0
+    val drop = !dbResult.matched || !accepted
+    val pldFilter = AxiStreamFilter(macIf.axisConfig)
+
+    pldFilter.io.input << decoder.io.output
+    pldFilter.io.output >> payload
+    pldFilter.io.action.valid := dbResult.fire && dbResult.userData.udpPayloadSize > maxLen
+    pldFilter.io.action.payload := drop ? FilterAction.drop | FilterAction.pass
+
+    metadata.translateFrom(dbResult.throwWhen(drop)) { case (md, lr) =>
+      md.hdr := lr.userData.hdr
+      md.args := lr.userData.args
+      md.udpPayloadSize := lr.userData.udpPayloadSize
+      md.funcPtr := lr.value.funcPtr
+      md.pid := lr.value.pid
+    }
+
+    // the table has one update port: freeing an entry on a reply takes priority over recording a new call
+    val dropped = Counter(REG_WIDTH bits)
+    val rejected = Counter(REG_WIDTH bits)
+    newCallEvent.ready := True
+    when (dbResult.fire) {
+      when (dbResult.matched) {
+        pendingDb.update.valid := True
+        pendingDb.update.idx := dbResult.idx
+        pendingDb.update.value := dbResult.value
+        pendingDb.update.value.active := False
+        newCallEvent.ready := False
+
+        when (!accepted) {
+          rejected.increment()
+        }
+      } otherwise {
+        // no call waiting for this reply: timed out on the host and overridden?
+        dropped.increment()
+      }
+    }
+
+    // never recycle an entry: it may hold the call of another process
+    newCallRejected := !callFreeR.matched
+    when (newCallEvent.fire) {
+      when (newCallRejected) {
+        pendingTblFull.increment()
+      } otherwise {
+        pendingDb.update.valid := True
+        pendingDb.update.idx := callFreeR.idx
+        pendingDb.update.value := newCallEvent.payload
+      }
+    }
+  }
+}
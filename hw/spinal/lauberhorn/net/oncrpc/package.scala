@@ -57,6 +57,36 @@ package object oncrpc {
       listenPort.asBits === q.port
   }
 
+  /** Remote procedure that the host calls through [[OncRpcCallEncoder]] (nested RPC calls).  Registered per procedure
+    * like [[OncRpcCallServiceDef]]; [[funcPtr]] is picked by the host to name the procedure in its TX descriptors and
+    * comes back with the reply, which arrives on [[clientPort]].
+    */
+  // XXX: this is in big endian
+  case class OncRpcClientDef() extends Bundle {
+    val enabled = Bool()
+
+    val progNum = Bits(32 bits)
+    val progVer = Bits(32 bits)
+    val proc = Bits(32 bits)
+    val serverAddr = Bits(32 bits)
+    val serverPort = Bits(16 bits)
+    val clientPort = Bits(16 bits)
+
+    val funcPtr = Bits(64 bits)
+    val pid = PID()
+  }
+
+  /** One outgoing call waiting for its reply.  Filled in by [[OncRpcCallEncoder]] and used by [[OncRpcReplyDecoder]]
+    * to complete the (xid, clientPort) -> (pid, funcPtr) lookup.
+    */
+  case class OncRpcPendingCallDef() extends Bundle {
+    val funcPtr = Bits(64 bits)
+    val pid = PID()
+    val xid = Bits(32 bits)
+    val clientPort = Bits(16 bits)
+    val active = Bool()
+  }
+
   /** Definition for a session with a specific client.  Filled in by [[OncRpcCallDecoder]] and used by
     * [[OncRpcReplyEncoder]] to complete the (funcPtr, xid) -> (dest IP, dest port) lookup.
     */
@@ -1,6 +1,7 @@
 package lauberhorn
 
 import spinal.core._
+import spinal.lib._
 import jsteward.blocks.misc.RegAllocatorFactory
 import lauberhorn.host.{HostReq, HostReqBypassHeaders}
 import lauberhorn.net.ethernet.{EthernetRxMeta, EthernetTxMeta}
@@ -8,8 +9,8 @@ import lauberhorn.net.ethernet.{EthernetRxMeta, EthernetTxMeta}
 import scala.language.postfixOps
 import Global._
 import lauberhorn.net.ip.{IpRxMeta, IpTxMeta}
-import lauberhorn.net.oncrpc.{OncRpcCallRxMeta, OncRpcReplyTxMeta}
-import lauberhorn.net.udp.{UdpRxMeta, UdpTxMeta}
+import lauberhorn.net.oncrpc.{OncRpcCallRxMeta, OncRpcCallTxMeta, OncRpcReplyRxMeta, OncRpcReplyTxMeta}
+import lauberhorn.net.udp.{UdpCsumState, UdpRxMeta, UdpTxMeta}
 
 package object net {
   /**
@@ -25,7 +26,7 @@ package object net {
         case `ethernet` => data.ethernetTx.get().asInstanceOf[T]
         case `ip` => data.ipTx.get().asInstanceOf[T]
         case `udp` => data.udpTx.get().asInstanceOf[T]
-        // case `oncRpcCall` => data.oncRpcCall.get().asInstanceOf[T]
+        case `oncRpcCall` => data.oncRpcCallTx.get().asInstanceOf[T]
         case `oncRpcReply` => data.oncRpcReply.get().asInstanceOf[T]
       }
     }
@@ -43,6 +44,33 @@ package object net {
     }
   }
 
+  /**
+    * Internet checksum (RFC 1071) arithmetic on data in wire order, i.e. the first byte on the wire in the LSBs as
+    * stored in the header bundles.  Sums are plain ones' complement sums of the big endian 16-bit words, not inverted;
+    * data covered by a correct checksum (including the checksum field itself) sums up to 0xffff.
+    */
+  object InetChecksum {
+    def add(a: UInt, b: UInt): UInt = {
+      val sum = a.resize(16) +^ b.resize(16)
+      (sum(15 downto 0) + sum.msb.asUInt).resize(16)
+    }
+
+    def sum(data: Bits): UInt = {
+      assert(data.getBitsWidth % 16 == 0, s"checksummed data must be whole 16-bit words, got ${data.getBitsWidth} bits")
+      data.subdivideIn(16 bits).map(w => EndiannessSwap(w).asUInt).reduceBalancedTree(add)
+    }
+
+    /** Sum of the first [[len]] bytes of [[data]]; an odd trailing byte is padded with zero */
+    def sumPrefix(data: Bits, len: UInt): UInt = {
+      val bytes = data.subdivideIn(8 bits).zipWithIndex.map { case (b, idx) =>
+        (len > idx) ? b | B(0, 8 bits)
+      }
+      sum(Vec(bytes).asBits)
+    }
+
+    def isValid(sum: UInt): Bool = sum === 0xffff
+  }
+
   /**
    * Protocol metadata passed along in the decoder pipeline.  Should provide all information needed to reconstruct the
    * entire packet for exceptional delivery to the bypass interface.  [[DmaControlPlugin]] will translate this to a
@@ -76,12 +104,14 @@ package object net {
     val ipRx = newElement(IpRxMeta())
     val udpRx = newElement(UdpRxMeta())
     val oncRpcCall = newElement(OncRpcCallRxMeta())
+    val oncRpcReplyRx = newElement(OncRpcReplyRxMeta())
 
     // Used by encoder pipeline
     val ethernetTx = newElement(EthernetTxMeta())
     val ipTx = newElement(IpTxMeta())
     val udpTx = newElement(UdpTxMeta())
     val oncRpcReply = newElement(OncRpcReplyTxMeta())
+    val oncRpcCallTx = newElement(OncRpcCallTxMeta())
   }
 
   /**
@@ -102,10 +132,24 @@ package object net {
         is (ip) { ret := metadata.ipRx.getPayloadSize }
         is (udp) { ret := metadata.udpRx.getPayloadSize }
         is (oncRpcCall) { ret := metadata.oncRpcCall.getPayloadSize }
+        is (oncRpcReply) { ret := metadata.oncRpcReplyRx.getPayloadSize }
         default { report("packet desc type not supported yet", FAILURE) }
       }
     }.ret
 
+    /** Partial UDP checksum from the decoders; only present for UDP datagrams (and the protocols on top) */
+    def getUdpCsum: UdpCsumState = new Composite(this, "getUdpCsum") {
+      val ret = UdpCsumState()
+      ret.present := False
+      ret.sum.assignDontCare()
+      switch (ty) {
+        import PacketDescType._
+        is (udp) { ret := metadata.udpRx.csum }
+        is (oncRpcCall) { ret := metadata.oncRpcCall.csum }
+        default { }
+      }
+    }.ret
+
     /**
       * Collect all headers to generate [[lauberhorn.host.HostReqBypassHeaders]].  Called by [[DmaControlPlugin]] to pack
       * incoming request into a bypass [[HostReq]] to pass to host.
@@ -125,6 +169,42 @@ package object net {
       ret
     }
 
+    /**
+      * Hash of the flow this packet belongs to, for [[DecoderSink]] to steer bypass packets to one of the bypass
+      * cores.  Covers the MAC addresses, IP addresses or IP addresses and L4 ports (UDP, and TCP which is passed as
+      * IP), depending on how far the packet was decoded.  Source and destination are folded together, such that both
+      * directions of a flow hash the same.
+      */
+    def flowHash(width: Int): Bits = new Composite(this, "flowHash") {
+      def fold(b: Bits): Bits = b.subdivideIn(width bits, strict = false).map(_.resize(width)).reduce(_ ^ _)
+
+      val ret = CombInit(B(0, width bits))
+      switch (ty) {
+        import PacketDescType._
+        is (ethernet) {
+          val eth = metadata.ethernetRx.hdr
+          ret := fold(eth.src ^ eth.dst)
+        }
+        is (ip) {
+          val ipMeta = metadata.ipRx
+          val ip = ipMeta.hdr
+          ret := fold(ip.saddr ^ ip.daddr) ^ fold(ip.proto)
+          // TCP is passed as IP: spread its connections by port as well
+          when (ip.proto === B(6, 8 bits) && ipMeta.hasL4Ports) {
+            ret := fold(ip.saddr ^ ip.daddr) ^ fold(ip.proto) ^ fold(ipMeta.l4Ports(15 downto 0) ^ ipMeta.l4Ports(31 downto 16))
+          }
+        }
+        is (udp) {
+          val ip = metadata.udpRx.ipMeta.hdr
+          val udp = metadata.udpRx.hdr
+          ret := fold(ip.saddr ^ ip.daddr) ^ fold(udp.sport ^ udp.dport)
+        }
+        default {
+          // not a bypass packet; steered by the scheduler instead
+        }
+      }
+    }.ret
+
     /**
       * Take header bits in [[HostReqBypassHeaders]] passed by host and fill out relevant fields in this
       * [[PacketDesc]].  Called by [[DmaControlPlugin]] to pass an outgoing packet on the bypass interface to the
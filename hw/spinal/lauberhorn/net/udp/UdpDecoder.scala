@@ -5,7 +5,7 @@ import jsteward.blocks.misc.{LookupTable, RegBlockAlloc}
 import lauberhorn.Global._
 import lauberhorn._
 import lauberhorn.net.ip.{IpDecoder, IpRxMeta}
-import lauberhorn.net.{Decoder, DecoderMetadata, PacketDescData, PacketDescType}
+import lauberhorn.net.{Decoder, DecoderMetadata, InetChecksum, PacketDescData, PacketDescType}
 import spinal.core._
 import spinal.lib._
 import spinal.lib.bus.amba4.axilite.{AxiLite4, AxiLite4SlaveFactory}
@@ -38,6 +38,7 @@ case class UdpListenDef() extends Bundle {
 case class UdpListenLookupUserData() extends Bundle {
   val hdr = UdpHeader()
   val ipMeta = IpRxMeta()
+  val csum = UdpCsumState()
 }
 
 case class UdpRxMeta() extends Bundle with DecoderMetadata {
@@ -46,6 +47,7 @@ case class UdpRxMeta() extends Bundle with DecoderMetadata {
   val nextProto = UdpNextProto()
   val hdr = UdpHeader()
   val ipMeta = IpRxMeta()
+  val csum = UdpCsumState()
 
   def getType = PacketDescType.udp
   def getPayloadSize: UInt = ipMeta.getPayloadSize - hdr.getBitsWidth / 8
@@ -139,11 +141,17 @@ class UdpDecoder extends Decoder[UdpRxMeta] {
       lk.query := hdrParsed.dport
       lk.userData.hdr := hdrParsed
       lk.userData.ipMeta := currentIpHeader
+
+      // pseudo header and UDP header; the length field is part of both
+      val ip = currentIpHeader.hdr
+      lk.userData.csum.present := hdrParsed.csum =/= 0
+      lk.userData.csum.sum := InetChecksum.sum(ip.saddr ## ip.daddr ## ip.proto ## B(0, 8 bits) ## hdrParsed.len ## hdr)
     }
 
     metadata.translateFrom(dbResult) { case (md, lr) =>
       md.hdr := lr.userData.hdr
       md.ipMeta := lr.userData.ipMeta
+      md.csum := lr.userData.csum
 
       when (lr.matched) {
         md.nextProto := lr.value.nextProto
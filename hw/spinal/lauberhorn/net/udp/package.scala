@@ -11,4 +11,15 @@ package object udp {
     val len = Bits(16 bits)
     val csum = Bits(16 bits)
   }
+
+  /**
+    * UDP checksum of an incoming datagram, summed over the parts decoded so far (pseudo header, UDP header and
+    * headers of the next protocol).  The sum over the payload is only known once it streamed into the packet buffer,
+    * so [[lauberhorn.DmaControlPlugin]] finishes the check.
+    */
+  case class UdpCsumState() extends Bundle {
+    /** sender filled in the checksum; a zero checksum field means no checksum for UDP over IPv4 */
+    val present = Bool()
+    val sum = UInt(16 bits)
+  }
 }
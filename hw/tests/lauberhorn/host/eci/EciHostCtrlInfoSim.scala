@@ -40,7 +40,8 @@ object EciHostCtrlInfoSim {
         RxBypassCtrlInfoSim(
           len.toInt,
           dp.pop(PKT_DESC_TY_WIDTH),
-          dp.pop(BYPASS_HDR_WIDTH, skip = 9))
+          dp.pop(1) != 0,
+          dp.pop(BYPASS_HDR_WIDTH, skip = 8))
       case 2 =>
         assert(len == 0, "ARP request should not carry extra data")
         TxArpReqSim(
@@ -48,13 +49,23 @@ object EciHostCtrlInfoSim {
           dp.pop(32, skip = 9).toInt
         )
       case 3 =>
-        val xid = dp.pop(32, skip = 12)
+        val argsLen = dp.pop(ONCRPC_ARGS_LEN_WIDTH).toInt
+        val xid = dp.pop(32, skip = 12 - ONCRPC_ARGS_LEN_WIDTH.get)
         RxOncRpcCallSim(
           len.toInt,
           dp.pop(64),
           xid,
+          argsLen,
+          dp.pop(ONCRPC_INLINE_BYTES*8))
+      case 4 =>
+        val argsLen = dp.pop(ONCRPC_ARGS_LEN_WIDTH).toInt
+        val xid = dp.pop(32, skip = 12 - ONCRPC_ARGS_LEN_WIDTH.get)
+        RxOncRpcReplySim(
+          len.toInt,
+          dp.pop(64),
+          xid,
+          argsLen,
           dp.pop(ONCRPC_INLINE_BYTES*8))
-      case 4 => throw new RuntimeException("not expecting a onc_rpc_reply")
     }
   }
 }
@@ -76,7 +87,7 @@ trait BypassCtrlInfoSim extends EciHostCtrlInfoSim with BypassPacketDescSim {
   }
 }
 
-case class RxBypassCtrlInfoSim(len: Int, packetType: BigInt, packetHdr: BigInt) extends BypassCtrlInfoSim
+case class RxBypassCtrlInfoSim(len: Int, packetType: BigInt, csumOk: Boolean, packetHdr: BigInt) extends BypassCtrlInfoSim
 
 case class TxArpReqSim(neighTblIdx: Int, ipAddr: Int) extends EciHostCtrlInfoSim with ArpReqPacketDescSim {
   /** not implemented due to ARP request descriptor never sent out */
@@ -103,6 +114,9 @@ case class TxIpCmdSim(len: Int, dst: Inet4Address, proto: Int) extends BypassCtr
 }
 
 case class TxOncRpcReplySim(len: Int, funcPtr: BigInt, xid: BigInt, args: BigInt) extends EciHostCtrlInfoSim with OncRpcReplyTxPacketDescSim {
+  /** not encoded for TX: the reply encoder only takes the total length */
+  def argsLen = len min ONCRPC_INLINE_BYTES
+
   override def encode: BigInt = {
     (new BigIntBuilder)
       .push(32, xid, skip = 12)
@@ -117,7 +131,30 @@ case class TxOncRpcReplySim(len: Int, funcPtr: BigInt, xid: BigInt, args: BigInt
   }
 }
 
-case class RxOncRpcCallSim(len: Int, funcPtr: BigInt, xid: BigInt, args: BigInt) extends EciHostCtrlInfoSim with OncRpcCallRxPacketDescSim {
+case class RxOncRpcCallSim(len: Int, funcPtr: BigInt, xid: BigInt, argsLen: Int, args: BigInt) extends EciHostCtrlInfoSim with OncRpcCallRxPacketDescSim {
   /** not implemented due to call Rx descriptor never sent out */
   override def encode = ???
-}
\ No newline at end of file
+}
+
+case class RxOncRpcReplySim(len: Int, funcPtr: BigInt, xid: BigInt, argsLen: Int, args: BigInt) extends EciHostCtrlInfoSim with OncRpcReplyRxPacketDescSim {
+  /** not implemented due to reply Rx descriptor never sent out */
+  override def encode = ???
+}
+
+case class TxOncRpcCallSim(len: Int, funcPtr: BigInt, xid: BigInt, args: BigInt) extends EciHostCtrlInfoSim with OncRpcCallRxPacketDescSim {
+  /** not encoded for TX: the call encoder only takes the total length */
+  def argsLen = len min ONCRPC_INLINE_BYTES
+
+  override def encode: BigInt = {
+    (new BigIntBuilder)
+      .push(32, xid, skip = 12)
+      .push(64, funcPtr)
+      .push(ONCRPC_INLINE_BYTES * 8, args)
+      .toBigInt
+  }
+
+  override def toString = {
+    val argsMask = (BigInt(1) << (ONCRPC_INLINE_BYTES * 8)) - 1
+    f"OncRpcCall (xid $xid%x), $len bytes total, inlined args: ${args & argsMask}%x"
+  }
+}
@@ -0,0 +1,207 @@
+package lauberhorn.host.eci
+
+import jsteward.blocks.eci.sim.{DcsAppMaster, IpiSlave}
+import jsteward.blocks.DutSimFunSuite
+import jsteward.blocks.misc.sim.IntRicherEndianAware
+import org.pcap4j.packet.{IpV4Packet, Packet}
+import org.pcap4j.packet.namednumber.IpNumber
+import lauberhorn._
+import lauberhorn.Global._
+import lauberhorn.sim._
+import spinal.core.{BigIntToSInt => _, BigIntToUInt => _, _}
+import spinal.core.sim._
+import spinal.lib._
+import spinal.lib.bus.amba4.axilite.sim.AxiLite4Master
+import spinal.lib.bus.amba4.axis.sim.Axi4StreamMaster
+
+import scala.collection.mutable
+import scala.language.postfixOps
+import scala.util._
+
+/** Engine with more than one bypass core: bypass packets are spread over the bypass cores by flow hash, through the
+  * indirection table in [[lauberhorn.net.DecoderSink]] (ctrl_rss_queue / ctrl_rss_idx).
+  */
+class NicMultiBypassSim extends DutSimFunSuite[NicEngine] with DbFactory {
+  val numWorkerCores = 1
+  val numBypassCores = 2
+
+  val dut = Config.sim
+    // verilog-axi flags
+    .addSimulatorFlag("-Wno-SELRANGE -Wno-WIDTH -Wno-CASEINCOMPLETE -Wno-LATCH")
+    .addSimulatorFlag("-Wwarn-ZEROREPL -Wno-ZEROREPL")
+    // wb2axip flags
+    .addSimulatorFlag("-Wno-SIDEEFFECT")
+    .workspaceName("eci-multi-bypass")
+    .compile(lauberhorn.GenEngineVerilog.engine(numWorkerCores, "eci", nb = numBypassCores))
+
+  val irqPending = mutable.ArrayBuffer.fill(numBypassCores)(false)
+  val rxNextCl = mutable.ArrayBuffer.fill(numBypassCores)(0)
+
+  def dutSetup(rxBlockCycles: Int)(implicit dut: NicEngine) = {
+    val eciIf = dut.host[EciInterfacePlugin].logic.get
+    val csrMaster = AxiLite4Master(eciIf.s_axil_ctrl, dut.clockDomain)
+    val dcsMaster = DcsAppMaster(eciIf.dcsEven, eciIf.dcsOdd, dut.clockDomain)
+
+    for (i <- irqPending.indices) { irqPending(i) = false }
+    for (i <- rxNextCl.indices) { rxNextCl(i) = 0 }
+
+    // the IRQ of each bypass core goes to the CPU of the same index by default
+    IpiSlave(eciIf.ipiToIntc, dut.clockDomain) { case (coreId, intId) =>
+      println(s"Received IRQ #$intId for core $coreId")
+      assert(coreId < numBypassCores, s"no worker core should be preempted, got IRQ for core $coreId")
+      assert(intId == 15, "IRQ for bypass core should always be 15")
+      irqPending(coreId) = true
+    }
+
+    val (axisMaster, _) = XilinxCmacSim.cmacDutSetup
+
+    dut.clockDomain.forkStimulus(frequency = 250 MHz)
+
+    0 until NUM_BYPASS_CORES foreach { cid =>
+      csrMaster.write(ALLOC.readBack("preempt", cid)("irqEn"), 1.toBytesLE)
+    }
+    CSRSim.csrSanityChecks(csrMaster, rxBlockCycles)
+
+    csrMaster.write(ALLOC.readBack("decoderSink")("ctrl", "promisc"), 1.toBytesLE)
+
+    (csrMaster, axisMaster, dcsMaster)
+  }
+
+  /** Read one descriptor from bypass core [[cid]]; bypass cores have no critical section to enter */
+  def tryReadBypass(dcsMaster: DcsAppMaster, cid: Int, maxTries: Int): Option[EciHostCtrlInfoSim] = {
+    val coreBase = ECI_RX_BASE.get + ECI_CORE_OFFSET.get * cid
+    var ret: Option[EciHostCtrlInfoSim] = None
+    var tries = 0
+    while (ret.isEmpty && tries < maxTries) {
+      val clAddr = rxNextCl(cid) * 0x80 + coreBase
+      val control = dcsMaster.read(clAddr, 64, doInvIdemptCheck = false).bytesToBigInt
+      // always toggle cacheline
+      rxNextCl(cid) = 1 - rxNextCl(cid)
+      if ((control & 1) != 0) {
+        ret = Some(EciHostCtrlInfoSim.fromBigInt(control >> 1))
+      } else {
+        sleepCycles(20)
+      }
+      tries += 1
+    }
+    ret
+  }
+
+  /** Point every flow hash bucket at a bypass core */
+  def steer(csrMaster: AxiLite4Master)(queueOf: Int => Int): Unit = {
+    0 until BYPASS_RSS_TBL_SIZE foreach { idx =>
+      csrMaster.write(ALLOC.readBack("decoderSink")("ctrl", "rss_queue"), queueOf(idx).toBytesLE)
+      csrMaster.write(ALLOC.readBack("decoderSink")("ctrl", "rss_idx"), idx.toBytesLE)
+    }
+  }
+
+  /** Model of [[lauberhorn.net.PacketDesc.flowHash]]: with 4-bit buckets, every field folds to the XOR of its
+    * nibbles, so the hash is the XOR of all nibbles of the fields covered
+    */
+  def flowHash(fields: Array[Byte]*): Int = {
+    assert(BYPASS_RSS_TBL_SIZE.get == 16, "model assumes 4-bit hash buckets")
+    fields.flatten.foldLeft(0) { (h, b) => h ^ (b & 0xf) ^ ((b >> 4) & 0xf) }
+  }
+
+  def portBytes(port: Int) = Array((port >> 8).toByte, port.toByte)
+
+  def addrs(packet: Packet) = {
+    val hdr = packet.get(classOf[IpV4Packet]).getHeader
+    (hdr.getSrcAddr.getAddress, hdr.getDstAddr.getAddress)
+  }
+
+  /** UDP to a port nobody listens on: passed to the host as UDP */
+  def udpFlow(sport: Int, dport: Int) = {
+    val packet = udpPacket(sport, dport, rawPayloadBuilder(Random.nextBytes(64)))
+    val (saddr, daddr) = addrs(packet)
+    (packet, PacketType.Udp, flowHash(saddr, daddr, portBytes(sport), portBytes(dport)))
+  }
+
+  /** TCP is not decoded: passed to the host as IP, the hash covers the ports nevertheless */
+  def tcpFlow(sport: Int, dport: Int) = {
+    val ports = portBytes(sport) ++ portBytes(dport)
+    val packet = ipPacket(IpNumber.TCP, rawPayloadBuilder(ports ++ Random.nextBytes(64)))
+    val (saddr, daddr) = addrs(packet)
+    (packet, PacketType.Ip, flowHash(saddr, daddr, Array(IpNumber.TCP.value.toByte), ports))
+  }
+
+  /** Send one packet and check that it arrives on bypass core [[cid]] only */
+  def rxOnCore(axisMaster: Axi4StreamMaster, dcsMaster: DcsAppMaster, packet: Packet, proto: PacketType.Value, cid: Int): Unit = {
+    axisMaster.send(packet.getRawData.toList)
+    waitUntil(irqPending(cid))
+    irqPending(cid) = false
+
+    val desc = tryReadBypass(dcsMaster, cid, maxTries = 5)
+    assert(desc.nonEmpty, s"packet did not arrive on bypass core $cid")
+    assert(desc.get.isInstanceOf[BypassCtrlInfoSim], s"unexpected descriptor ${desc.get}")
+    assert(desc.get.asInstanceOf[BypassCtrlInfoSim].packetType == proto.id, s"expected $proto on bypass core $cid")
+
+    0 until NUM_BYPASS_CORES filter (_ != cid) foreach { other =>
+      assert(!irqPending(other) && tryReadBypass(dcsMaster, other, maxTries = 1).isEmpty,
+        s"packet for bypass core $cid arrived on bypass core $other")
+    }
+  }
+
+  testWithDB("rx-bypass-rss-default", Rx) { implicit dut =>
+    val (_, axisMaster, dcsMaster) = dutSetup(500)
+
+    // initial table spreads buckets round-robin over the bypass cores
+    val seen = mutable.Set[Int]()
+    0 until 16 foreach { _ =>
+      val (packet, proto, hash) = if (Random.nextBoolean()) {
+        udpFlow(Random.nextInt(65536), Random.nextInt(65536))
+      } else {
+        tcpFlow(Random.nextInt(65536), Random.nextInt(65536))
+      }
+      val cid = hash % NUM_BYPASS_CORES
+      println(s"Flow hash $hash -> bypass core $cid")
+      rxOnCore(axisMaster, dcsMaster, packet, proto, cid)
+      seen += cid
+    }
+    assert(seen.size == NUM_BYPASS_CORES.get, s"flows not spread over all bypass cores, only used $seen")
+  }
+
+  testWithDB("rx-bypass-rss-tcp-ports", Rx) { implicit dut =>
+    val (_, axisMaster, dcsMaster) = dutSetup(500)
+
+    // same addresses for all connections: only the ports tell them apart
+    val template = ipPacket(IpNumber.TCP, rawPayloadBuilder(Array()))
+    val hdr = template.get(classOf[IpV4Packet]).getHeader
+    def conn(sport: Int, dport: Int) = {
+      val ports = portBytes(sport) ++ portBytes(dport)
+      val ipBuilder = template.get(classOf[IpV4Packet]).getBuilder
+        .correctLengthAtBuild(true)
+        .correctChecksumAtBuild(true)
+        .payloadBuilder(rawPayloadBuilder(ports ++ Random.nextBytes(64)))
+      val packet = template.getBuilder.paddingAtBuild(true).payloadBuilder(ipBuilder).build()
+      (packet, flowHash(hdr.getSrcAddr.getAddress, hdr.getDstAddr.getAddress, Array(IpNumber.TCP.value.toByte), ports))
+    }
+
+    // ports that hash to either bypass core
+    val dport = Random.nextInt(65536)
+    val conns = Iterator.continually(conn(Random.nextInt(65536), dport))
+    val toCore0 = conns.find(_._2 % NUM_BYPASS_CORES == 0).get
+    val toCore1 = conns.find(_._2 % NUM_BYPASS_CORES == 1).get
+
+    rxOnCore(axisMaster, dcsMaster, toCore0._1, PacketType.Ip, 0)
+    rxOnCore(axisMaster, dcsMaster, toCore1._1, PacketType.Ip, 1)
+  }
+
+  testWithDB("rx-bypass-rss-steer", Rx) { implicit dut =>
+    val (csrMaster, axisMaster, dcsMaster) = dutSetup(500)
+
+    // narrow down to one queue, like ethtool -L
+    steer(csrMaster)(_ => 1)
+    0 until 8 foreach { _ =>
+      val (packet, proto, _) = udpFlow(Random.nextInt(65536), Random.nextInt(65536))
+      rxOnCore(axisMaster, dcsMaster, packet, proto, 1)
+    }
+
+    // reverse the default spread
+    steer(csrMaster)(idx => (idx + 1) % NUM_BYPASS_CORES)
+    0 until 8 foreach { _ =>
+      val (packet, proto, hash) = tcpFlow(Random.nextInt(65536), Random.nextInt(65536))
+      rxOnCore(axisMaster, dcsMaster, packet, proto, (hash + 1) % NUM_BYPASS_CORES)
+    }
+  }
+}
@@ -7,6 +7,7 @@ import jsteward.blocks.misc.sim.{BigIntParser, IntRicherEndianAware, isSorted}
 import org.pcap4j.core.{PcapDumper, Pcaps}
 import org.pcap4j.packet.{EthernetPacket, IpV4Packet, Packet, UdpPacket}
 import org.pcap4j.packet.namednumber.DataLinkType
+import org.pcap4j.util.MacAddress
 import org.scalatest.exceptions.TestFailedException
 import lauberhorn._
 import lauberhorn.Global._
@@ -25,7 +26,7 @@ import scala.util.control.TailCalls._
 import org.scalatest.tagobjects.Slow
 import lauberhorn.host.eci.NicSim._
 
-import java.net.InetAddress
+import java.net.{Inet4Address, InetAddress}
 
 object NicSim {
   type IrqCb = (AxiLite4Master, DcsAppMaster, Int, Int) => Unit
@@ -96,14 +97,14 @@ class NicSim extends DutSimFunSuite[NicEngine] with DbFactory with OncRpcSuiteFa
 
   def txDutSetup()(implicit dut: NicEngine) = {
     val (csrMaster, _, axisSlave, dcsMaster) = commonDutSetup(10000) // arbitrary rxBlockCycles
-    for (i <- txNextCl.indices) { txNextCl(i) = 0 }
+    for (i <- txProduced.indices) { txProduced(i) = 0 }
 
     (csrMaster, axisSlave, dcsMaster)
   }
 
   def rxtxDutSetup(rxBlockCycles: Int, irqCb: IrqCb = BypassIrqCb)(implicit dut: NicEngine) = {
     for (i <- rxNextCl.indices) { rxNextCl(i) = 0 }
-    for (i <- txNextCl.indices) { txNextCl(i) = 0 }
+    for (i <- txProduced.indices) { txProduced(i) = 0 }
 
     commonDutSetup(rxBlockCycles, irqCb)
   }
@@ -269,7 +270,7 @@ class NicSim extends DutSimFunSuite[NicEngine] with DbFactory with OncRpcSuiteFa
   }
 
   /** test reading one bypass packet; when called multiple times, this checks in a blockign fashion */
-  def rxTestSimple(dcsMaster: DcsAppMaster, axisMaster: Axi4StreamMaster, packet: Packet, proto: PacketType, maxRetries: Int)(implicit dut: NicEngine): Unit = {
+  def rxTestSimple(dcsMaster: DcsAppMaster, axisMaster: Axi4StreamMaster, packet: Packet, proto: PacketType, maxRetries: Int)(implicit dut: NicEngine): RxBypassCtrlInfoSim = {
     fork {
       sleepCycles(Random.nextInt(200))
 
@@ -292,6 +293,7 @@ class NicSim extends DutSimFunSuite[NicEngine] with DbFactory with OncRpcSuiteFa
     println(s"Successfully received packet")
 
     // packet will be acknowledged by reading next packet
+    desc.asInstanceOf[RxBypassCtrlInfoSim]
   }
 
   /** test scanning a range of lengths of packets to send and check */
@@ -332,6 +334,81 @@ class NicSim extends DutSimFunSuite[NicEngine] with DbFactory with OncRpcSuiteFa
     rxTestRange(csrMaster, axisMaster, dcsMaster, 64, 256, 64, maxRetries = 5)
   }
 
+  def readStat(csrMaster: AxiLite4Master, addr: BigInt) = csrMaster.read(addr, 8).bytesToBigInt
+
+  testWithDB("rx-bypass-bad-ip-csum", Rx) { implicit dut =>
+    val (csrMaster, axisMaster, dcsMaster) = rxDutSetup(1000)
+    // enable promisc mode
+    csrMaster.write(ALLOC.readBack("decoderSink")("ctrl", "promisc"), 1.toBytesLE)
+
+    // dropped by the IP decoder: no descriptor, no IRQ
+    val (bad, _) = randomPacket(256, randomizeLen = false)(Udp)
+    axisMaster.send(corruptIpHdrCsum(bad).getRawData.toList)
+    sleepCycles(500)
+    assert(!bypassIrqPending, "packet with bad IP header checksum reached the bypass core")
+    assert(readStat(csrMaster, ALLOC.readBack("IpDecoder")("stat", "badHdrCsum")) == 1,
+      "bad IP header checksum not counted")
+
+    // the next good packet is the first one to arrive
+    val (good, proto) = randomPacket(256, randomizeLen = false)(Udp)
+    rxTestSimple(dcsMaster, axisMaster, good, proto, maxRetries = 5)
+  }
+
+  testWithDB("rx-bypass-udp-csum", Rx) { implicit dut =>
+    val (csrMaster, axisMaster, dcsMaster) = rxDutSetup(1000)
+    // enable promisc mode
+    csrMaster.write(ALLOC.readBack("decoderSink")("ctrl", "promisc"), 1.toBytesLE)
+
+    def rxUdp(packet: Packet) = rxTestSimple(dcsMaster, axisMaster, packet, Udp, maxRetries = 5)
+    def udp() = randomPacket(256, randomizeLen = false)(Udp)._1
+
+    assert(rxUdp(udp()).csumOk, "valid UDP checksum not reported as verified")
+
+    // nothing to verify without a checksum
+    assert(!rxUdp(zeroUdpCsum(udp())).csumOk, "absent UDP checksum reported as verified")
+
+    // bypass packets are delivered anyway, for the host stack to drop and account for
+    assert(!rxUdp(corruptUdpPayload(udp())).csumOk, "bad UDP checksum reported as verified")
+    assert(readStat(csrMaster, ALLOC.readBack("dma")("rxBadCsumCount")) == 1, "bad UDP checksum not counted")
+  }
+
+  testWithDB("rx-oncrpc-bad-csum", Rx) { implicit dut =>
+    val irqReceived = mutable.ArrayBuffer.fill(NUM_CORES)(false)
+
+    val (csrMaster, axisMaster, dcsMaster) = rxDutSetup(1000, { case (_, _, coreId, intId) =>
+      assert(intId == 8, s"expecting interrupt ID 8 for a normal preemption")
+      irqReceived(coreId) = true
+    })
+
+    // one thread: the first call delivered goes to the core we read from
+    val (funcPtr, getPacket, pid) = oncRpcCallPacketFactory(csrMaster,
+      Seq(ProcDef.mkRandom(1) -> Seq(RpcSrvDef.mkRandom)),
+      packetDumpWorkspace = Some("rx-oncrpc-bad-csum")
+    ).head
+
+    // corrupted call: dropped before the scheduler, buffer freed again
+    val (bad, _, badXid) = getPacket()
+    axisMaster.send(corruptUdpPayload(bad).getRawData.toList)
+    // call without a checksum: nothing to verify, delivered
+    val (good, goodPld, goodXid) = getPacket()
+    axisMaster.send(zeroUdpCsum(good).getRawData.toList)
+
+    waitUntil(irqReceived.contains(true))
+    val cid = irqReceived.indexOf(true)
+    val (pidToSched, _, _, _) = ackIrq(csrMaster, ALLOC.readBack("preempt", blockIdx = cid))
+    assert(pidToSched == pid, "requested PID does not match what we programmed")
+    pollReady(dcsMaster, cid)
+
+    val (desc, overflowAddr) = tryReadPacketDesc(dcsMaster, cid, exitCS = false).result.get
+    val xid = Integer.reverseBytes(desc.asInstanceOf[OncRpcCallRxPacketDescSim].xid.toInt)
+    assert(xid != badXid, "call with bad UDP checksum was delivered")
+    assert(xid == goodXid, f"unexpected call with XID $xid%#x")
+    checkOncRpcCall(desc, desc.len, funcPtr, goodPld, dcsMaster.read(overflowAddr, desc.len))
+    exitCriticalSection(dcsMaster, cid)
+
+    assert(readStat(csrMaster, ALLOC.readBack("dma")("rxBadCsumCount")) == 1, "bad UDP checksum not counted")
+  }
+
   testWithDB("rx-oncrpc-allcores", Rx) { implicit dut =>
     // test routine:
     // - all cores start in PID 0 (IDLE)
@@ -434,28 +511,41 @@ class NicSim extends DutSimFunSuite[NicEngine] with DbFactory with OncRpcSuiteFa
     waitUntil(packetsReceived == totalToSend)
   }
 
-  var txNextCl = mutable.ArrayBuffer.fill(numCores)(0)
-
-  /** Send one descriptor, optionally with a tail payload. */
-  def txSendSingle(dcsMaster: DcsAppMaster, txDesc: EciHostCtrlInfoSim, toSend: List[Byte], cid: Int): Unit = {
-    def clAddr = txNextCl(cid) * 0x80 + ECI_TX_BASE.get + ECI_CORE_OFFSET * cid
+  var txProduced = mutable.ArrayBuffer.fill(numCores)(0)
 
+  /** Send one descriptor, optionally with a tail payload, in the next slot of the TX ring.  Without
+    * [[ringDoorbell]], the slot is only filled: it goes out with the doorbell of a later slot.
+    */
+  def txSendSingle(dcsMaster: DcsAppMaster, txDesc: EciHostCtrlInfoSim, toSend: List[Byte], cid: Int,
+                   ringDoorbell: Boolean = true): Unit = {
+    val numSlots = ECI_TX_RING_SLOTS.get
+    val ringBase = ECI_TX_BASE.get + ECI_CORE_OFFSET * cid
+    def slotAddr = (txProduced(cid) % numSlots) * ECI_TX_SLOT_STRIDE + ringBase
+    def readConsumed(addr: BigInt) =
+      dcsMaster.read(addr, 2, doInvIdemptCheck = false).bytesToBigInt.toInt
+
+    // wait for a free slot
+    val idxMask = (1 << ECI_TX_RING_IDX_WIDTH) - 1
+    while (((txProduced(cid) - readConsumed(ringBase + ECI_TX_STATUS_OFFSET)) & idxMask) >= numSlots) {}
+
+    val clAddr = slotAddr
     println(f"Core $cid: sending packet with desc $txDesc, writing packet desc to $clAddr%#x...")
     dcsMaster.write(clAddr, txDesc.toTxDesc)
 
     val firstWriteSize = if (toSend.size > 64) 64 else toSend.size
     dcsMaster.write(clAddr + 0x40, toSend.take(firstWriteSize))
     if (toSend.size > 64) {
-      dcsMaster.write(
-        ECI_TX_BASE.get + ECI_OVERFLOW_OFFSET + ECI_CORE_OFFSET * cid,
-        toSend.drop(firstWriteSize))
+      dcsMaster.write(clAddr + ECI_OVERFLOW_OFFSET, toSend.drop(firstWriteSize))
     }
 
-    // trigger a read on the next cacheline to actually send the packet
-    println(f"Core $cid: sent packet at $clAddr%#x")
-
-    txNextCl(cid) = 1 - txNextCl(cid)
-    dcsMaster.read(clAddr, 1)
+    txProduced(cid) += 1
+    if (ringDoorbell) {
+      // ring the doorbell of the slot to actually send the packet
+      println(f"Core $cid: sent packet at $clAddr%#x")
+      readConsumed(clAddr + ECI_TX_DOORBELL_OFFSET)
+    } else {
+      println(f"Core $cid: filled slot at $clAddr%#x without ringing the doorbell")
+    }
   }
 
   /** Test sending one single packet as bypass on a specific core.  Also checks if the expected packet appears on the
@@ -562,6 +652,49 @@ class NicSim extends DutSimFunSuite[NicEngine] with DbFactory with OncRpcSuiteFa
     }
   }
 
+  testWithDB("tx-cumulative-doorbell", Tx) { implicit dut =>
+    // test routine:
+    // - send packets one by one until the next slot is the last of the ring
+    // - fill the last slot and the first ones after the wrap, ring only the doorbell of the final one
+    // - all of them are sent in order: earlier slots are covered by the later doorbell
+    // - go around the ring once more, to check the doorbells of covered slots still reach the NIC
+    implicit val dumper = Pcaps.openDead(DataLinkType.EN10MB, 65535).dumpOpen((workspace("tx-cumulative-doorbell") / "packets-expecting.pcap").toString)
+
+    val (csrMaster, axisSlave, dcsMaster) = txDutSetup()
+    val cid = 1
+    val numSlots = ECI_TX_RING_SLOTS.get
+
+    // all packets to one destination, such that one neighbor entry covers them
+    val (srcIp, srcMac) = enzianIpMacAddrs(1)
+    val dstIp = InetAddress.getByAddress(Random.nextBytes(4)).asInstanceOf[Inet4Address]
+    val dstMac = MacAddress.getByAddress(Random.nextBytes(6))
+    def packet() = getIpPacket(srcIp, dstIp, srcMac, dstMac, Random.between(64, 512))
+
+    0 until numSlots - 1 foreach { _ => txTestSingle(dcsMaster, csrMaster, axisSlave, packet(), cid) }
+
+    val batch = Seq.fill(3 min numSlots)(packet())
+    val received = mutable.ArrayBuffer[List[Byte]]()
+    fork {
+      batch foreach { _ => received.append(axisSlave.recv()) }
+    }
+
+    batch.zipWithIndex foreach { case (p, idx) =>
+      val ipPkt = p.get(classOf[IpV4Packet])
+      val pld = ipPkt.getPayload.getRawData.toList
+      val desc = TxIpCmdSim(pld.length, dstIp, ipPkt.getHeader.getProtocol.value.toInt)
+      txSendSingle(dcsMaster, desc, pld, cid, ringDoorbell = idx == batch.length - 1)
+    }
+
+    fork {
+      sleepCycles(5000 * batch.length)
+      assert(received.length == batch.length, s"only ${received.length} of ${batch.length} packets sent")
+    }
+    waitUntil(received.length == batch.length)
+    batch zip received foreach { case (p, data) => check(p.getRawData.toList, data) }
+
+    0 until numSlots foreach { _ => txTestSingle(dcsMaster, csrMaster, axisSlave, packet(), cid) }
+  }
+
   testWithDB("tx-neighbor-resolve-request", Tx) { implicit dut =>
     implicit val dumper = Pcaps.openDead(DataLinkType.EN10MB, 65535).dumpOpen((workspace("tx-neighbor-resolve-request") / "packets-expecting.pcap").toString)
 
@@ -907,6 +1040,158 @@ class NicSim extends DutSimFunSuite[NicEngine] with DbFactory with OncRpcSuiteFa
     waitUntil(allDone)
   }
 
+  /** Set up one process with one client procedure for nested calls.  Replies go to the single thread of the process. */
+  def oncRpcClientSetup(csrMaster: AxiLite4Master)(implicit dut: NicEngine) = {
+    csrMaster.write(ALLOC.readBack("decoderSink")("ctrl", "promisc"), 1.toBytesLE)
+
+    val proc = ProcDef.mkRandom(1)
+    val clnt = RpcClntDef.mkRandom
+    enableProcess(csrMaster, proc, idx = 1) // slot 0 is for IDLE
+    enableClient(csrMaster, clnt, idx = 0, listenIdx = 0, proc.pid)
+
+    // wait for configs to take effect
+    sleepCycles(20)
+
+    (proc.pid, clnt)
+  }
+
+  /** Make one call through the client table on core [[cid]], without waiting for it on the wire. */
+  def txOncRpcCallSend(dcsMaster: DcsAppMaster, clnt: RpcClntDef, args: List[Byte], xid: Int, cid: Int): Unit = {
+    // XXX: call TX descriptor length is the entire argument length (INCLUDES inlined bytes)
+    val (inlineArgs, tail) = args.splitAt(ONCRPC_INLINE_BYTES)
+    // host writes the XID in network order
+    val desc = TxOncRpcCallSim(args.length, clnt.funcPtr, Integer.reverseBytes(xid) & 0xffffffffL, inlineArgs.bytesToBigInt)
+    txSendSingle(dcsMaster, desc, tail, cid)
+  }
+
+  /** Check one call received from the TX interface against the client procedure.  Returns the XID on the wire. */
+  def checkOncRpcCallOut(data: List[Byte], clnt: RpcClntDef, args: List[Byte]): Int = {
+    val parsed = EthernetPacket.newPacket(data.toArray, 0, data.length)
+    assert(parsed.getHeader.getDstAddr == clnt.serverMac, "call has wrong destination MAC address")
+    assert(parsed.get(classOf[IpV4Packet]).getHeader.getDstAddr == clnt.serverAddr, "call has wrong destination IP address")
+    assert(parsed.get(classOf[UdpPacket]).getHeader.getDstPort.valueAsInt == clnt.serverPort, "call has wrong destination port")
+    assert(parsed.get(classOf[UdpPacket]).getHeader.getSrcPort.valueAsInt == clnt.clientPort, "call has wrong source port")
+
+    val udpPayload = parsed.get(classOf[UdpPacket]).getPayload.getRawData.toList
+    val (rpcHdr, rpcArgs) = udpPayload.splitAt(40) // XID + msgType + rpcVer + prog + progVer + proc + creds + verifier
+    val (xid, rest) = rpcHdr.splitAt(4)
+    check(Seq(0, 2, clnt.prog, clnt.progVer, clnt.procNum).flatMap(_.toBytesBE).toList ++ List.fill(16)(0.toByte), rest)
+    check(args, rpcArgs)
+
+    xid.bytesToBigInt.toInt
+  }
+
+  /** Make one call through the client table on core [[cid]] and check that it leaves on the wire. */
+  def txOncRpcCall(dcsMaster: DcsAppMaster, axisSlave: Axi4StreamSlave, clnt: RpcClntDef, args: List[Byte], xid: Int, cid: Int): Unit = {
+    var received = false
+    fork {
+      val gotXid = Integer.reverseBytes(checkOncRpcCallOut(axisSlave.recv(), clnt, args))
+      assert(gotXid == xid, f"xid mismatch: expected $xid%#x, got $gotXid%#x")
+      received = true
+    }
+
+    txOncRpcCallSend(dcsMaster, clnt, args, xid, cid)
+
+    fork {
+      sleepCycles(5000)
+      assert(received, s"Core $cid: call receive timeout!")
+    }
+    waitUntil(received)
+  }
+
+  testWithDB("oncrpc-client-call-reply", Rx, Tx) { implicit dut =>
+    var irqCore: Option[Int] = None
+    val (csrMaster, axisMaster, axisSlave, dcsMaster) = rxtxDutSetup(1000, { case (_, _, coreId, intId) =>
+      assert(intId == 8, s"expecting interrupt ID 8 for a normal preemption")
+      assert(irqCore.isEmpty, "should only receive one interrupt")
+      irqCore = Some(coreId)
+    })
+    val (pid, clnt) = oncRpcClientSetup(csrMaster)
+
+    // call with arguments longer than inline bytes
+    val xid = Random.nextInt()
+    txOncRpcCall(dcsMaster, axisSlave, clnt, Random.nextBytes(128).toList, xid, cid = 1)
+
+    // matched reply: delivered to the process that made the call
+    val results = Random.nextBytes(100).toList
+    axisMaster.send(oncRpcReplyPacket(clnt.serverPort, clnt.clientPort, results, xid).getRawData.toList)
+
+    waitUntil(irqCore.nonEmpty)
+    val cid = irqCore.get
+    val (pidToSched, _, _, _) = ackIrq(csrMaster, ALLOC.readBack("preempt", blockIdx = cid))
+    assert(pidToSched == pid, "requested PID does not match the process that made the call")
+    pollReady(dcsMaster, cid)
+
+    val (desc, overflowAddr) = tryReadPacketDesc(dcsMaster, cid, exitCS = false).result.get
+    assert(desc.isInstanceOf[RxOncRpcReplySim], s"unexpected descriptor $desc")
+    val gotXid = Integer.reverseBytes(desc.asInstanceOf[RxOncRpcReplySim].xid.toInt)
+    assert(gotXid == xid, f"xid mismatch: expected $xid%#x, got $gotXid%#x")
+    checkOncRpcCall(desc, desc.len, clnt.funcPtr, results, dcsMaster.read(overflowAddr, desc.len))
+    exitCriticalSection(dcsMaster, cid)
+
+    // the pending call is freed: the same reply again is dropped
+    axisMaster.send(oncRpcReplyPacket(clnt.serverPort, clnt.clientPort, results, xid).getRawData.toList)
+    assert(tryReadPacketDesc(dcsMaster, cid, maxTries = 3).result.isEmpty, "duplicated reply was delivered")
+    assert(readStat(csrMaster, ALLOC.readBack("OncRpcReplyDecoder")("dropped")) == 1, "duplicated reply not counted as dropped")
+  }
+
+  testWithDB("oncrpc-client-reply-dropped", Rx, Tx) { implicit dut =>
+    // no reply in this test should reach the host
+    val (csrMaster, axisMaster, axisSlave, dcsMaster) = rxtxDutSetup(1000, { case (_, _, coreId, intId) =>
+      fail(s"unexpected IRQ #$intId for core $coreId: reply was delivered")
+    })
+    val (_, clnt) = oncRpcClientSetup(csrMaster)
+
+    // reply without a call
+    axisMaster.send(oncRpcReplyPacket(clnt.serverPort, clnt.clientPort, Random.nextBytes(16).toList, Random.nextInt()).getRawData.toList)
+    sleepCycles(500)
+    assert(readStat(csrMaster, ALLOC.readBack("OncRpcReplyDecoder")("dropped")) == 1, "unmatched reply not counted as dropped")
+
+    // reply to a call that was not accepted (PROG_UNAVAIL), with results longer than inline bytes to be dropped as well
+    val xid = Random.nextInt()
+    txOncRpcCall(dcsMaster, axisSlave, clnt, Random.nextBytes(16).toList, xid, cid = 1)
+    axisMaster.send(oncRpcReplyPacket(clnt.serverPort, clnt.clientPort, Random.nextBytes(128).toList, xid, acceptStat = 1).getRawData.toList)
+    sleepCycles(500)
+    assert(readStat(csrMaster, ALLOC.readBack("OncRpcReplyDecoder")("rejected")) == 1, "rejected reply not counted")
+    assert(readStat(csrMaster, ALLOC.readBack("OncRpcReplyDecoder")("dropped")) == 1, "rejected reply counted as unmatched")
+  }
+
+  testWithDB("oncrpc-client-pending-full", Rx, Tx) { implicit dut =>
+    // no reply in this test should reach the host
+    val (csrMaster, axisMaster, axisSlave, dcsMaster) = rxtxDutSetup(1000, { case (_, _, coreId, intId) =>
+      fail(s"unexpected IRQ #$intId for core $coreId: reply was delivered")
+    })
+    val (_, clnt) = oncRpcClientSetup(csrMaster)
+
+    // fill up the pending call table
+    val xids = Seq.fill(NUM_PENDING_CALLS)(Random.nextInt())
+    xids foreach { xid =>
+      txOncRpcCall(dcsMaster, axisSlave, clnt, Random.nextBytes(16).toList, xid, cid = 1)
+    }
+
+    var received: Option[List[Byte]] = None
+    fork { received = Some(axisSlave.recv()) }
+
+    // one call too many: rejected and never sent, the calls in the table are kept
+    txOncRpcCallSend(dcsMaster, clnt, Random.nextBytes(16).toList, Random.nextInt(), cid = 1)
+    sleepCycles(5000)
+    assert(received.isEmpty, "call was sent with the pending call table full")
+    assert(readStat(csrMaster, ALLOC.readBack("OncRpcReplyDecoder")("pendingTblFull")) == 1, "rejected call not counted")
+
+    // a rejected reply matches and frees its entry: the next call goes out again
+    axisMaster.send(oncRpcReplyPacket(clnt.serverPort, clnt.clientPort, List(), xids.head, replyStat = 1).getRawData.toList)
+    sleepCycles(500)
+    assert(readStat(csrMaster, ALLOC.readBack("OncRpcReplyDecoder")("rejected")) == 1, "rejected reply not matched")
+    assert(readStat(csrMaster, ALLOC.readBack("OncRpcReplyDecoder")("dropped")) == 0, "rejected reply did not find its call")
+
+    val args = Random.nextBytes(16).toList
+    val xid = Random.nextInt()
+    txOncRpcCallSend(dcsMaster, clnt, args, xid, cid = 1)
+    waitUntil(received.nonEmpty)
+    assert(Integer.reverseBytes(checkOncRpcCallOut(received.get, clnt, args)) == xid, "rejected call was sent after an entry was freed")
+    assert(readStat(csrMaster, ALLOC.readBack("OncRpcReplyDecoder")("pendingTblFull")) == 1, "call counted as rejected after an entry was freed")
+  }
+
   // checks if a core has an IRQ pending.  Checked before and after critical section
   object CoreState {
     val pidIdle = 0xffff
@@ -947,9 +1232,8 @@ class NicSim extends DutSimFunSuite[NicEngine] with DbFactory with OncRpcSuiteFa
     assert(pidMaxThrCountMap(pid) > coreStates.count(_.currPid == pid), "trying to schedule more cores than max threads")
     cs.setPid(pid)
 
-    // reset parity
+    // reset parity; the TX ring is drained before the preemption, so txProduced carries over
     rxNextCl(coreId) = rxParity.toInt
-    txNextCl(coreId) = txParity.toInt
 
     pollReady(dcsMaster, coreId)
 
@@ -165,13 +165,79 @@ class NicSim extends DutSimFunSuite[NicEngine] with DbFactory with OncRpcSuiteFa
       check(toSend, data)
       checkDone = true
     }
-    // write tx commit -- make sure axis have a chance to catch the first beat
+    // post into the tx ring -- make sure axis have a chance to catch the first beat
     println(s"Sending ${toSend.length} bytes")
-    master.write(coreBlock("hostTxAck"), desc.copy(size = toSend.length).toTxDesc)
+    txRingPost(master, coreBlock, Seq(desc.copy(size = toSend.length).toTxDesc))
 
     dut.clockDomain.waitActiveEdgeWhere(checkDone)
   }
 
+  testWithDB("tx-ring-batched") { implicit dut =>
+    // fill the tx ring and publish each batch with a single doorbell
+    val coreBlock = ALLOC.readBack("core")
+    val pktBufAddr = ALLOC.readBack("pkt")("buffer")
+
+    val (master, axisSlave) = txDutSetup()
+
+    val base = readTxBufDesc(master, coreBlock).get
+    var produced = 0
+
+    0 until 10 foreach { _ =>
+      val batch = Seq.fill(PCIE_TX_RING_SLOTS.get - 1)(Random.nextBytes(64 + Random.nextInt(1024)).toList)
+      val descs = batch.map { toSend =>
+        val desc = txRingSlotDesc(base, produced, toSend.length)
+        master.write(pktBufAddr + desc.addr, toSend)
+        produced += 1
+        desc.toTxDesc
+      }
+
+      println(s"Sending ${batch.length} packets with one doorbell")
+      txRingPost(master, coreBlock, descs)
+
+      batch.foreach { toSend => check(toSend, axisSlave.recv()) }
+    }
+
+    assert(readRingIdx(master, coreBlock, "hostTxConsumed") == produced, "tx ring not drained")
+  }
+
+  testWithDB("rx-ack-batched") { implicit dut =>
+    // receive more packets than the ack ring holds, then free all of them with as few doorbells as possible
+    val globalBlock = ALLOC.readBack("global")
+    val coreBlock = ALLOC.readBack("core", blockIdx = 0)
+    val (master, axisMaster) = rxDutSetup(10000)
+
+    master.write(globalBlock("promisc"), 1.toBytesLE)
+
+    // reset packet allocator
+    master.write(globalBlock("dmaCtrl", "allocReset"), 1.toBytesLE);
+    sleepCycles(200)
+    master.write(globalBlock("dmaCtrl", "allocReset"), 0.toBytesLE);
+
+    val batchSize = PCIE_RX_ACK_RING_SLOTS.get + 3
+    val counterBefore = master.read(coreBlock("rxPacketCount"), 8).bytesToBigInt
+
+    import PacketType._
+    val acks = 0 until batchSize map { _ =>
+      // small packets, so that all of them fit into the rx packet buffer at once
+      val (packet, _) = randomPacket(128)(Ethernet, Ip, Udp)
+      axisMaster.send(packet.getRawData.toList)
+
+      val desc = tryReadRxPacketDesc(master, coreBlock).result.get
+      assert(desc.isInstanceOf[BypassPacketDescSimPcie], "should only receive bypass packet!")
+      desc.toRxAck
+    }
+
+    val counter = master.read(coreBlock("rxPacketCount"), 8).bytesToBigInt
+    assert(counter == counterBefore + batchSize, s"received packet count mismatch: expected ${counterBefore + batchSize}, got $counter")
+
+    rxAckRingPost(master, coreBlock, acks)
+    sleepCycles(200)
+    assert(readRingIdx(master, coreBlock, "hostRxAckConsumed") == batchSize, "rx ack ring not drained")
+
+    // freed buffers are handed out again
+    0 until 200 foreach { _ => rxTestBypass(master, axisMaster) }
+  }
+
   /** test enabling a ONCRPC service */
   testWithDB("rx-oncrpc-roundrobin") { implicit dut =>
     val cmacIf = dut.host[XilinxCmacPlugin].logic.get
@@ -296,7 +362,7 @@ class NicSim extends DutSimFunSuite[NicEngine] with DbFactory with OncRpcSuiteFa
     // insert delay
     fork {
       sleepCycles(delayed)
-      master.write(coreBlock("hostTxAck"), desc.copy(size = toSend.length).toTxDesc)
+      txRingPost(master, coreBlock, Seq(desc.copy(size = toSend.length).toTxDesc))
     }
 
     // receive packet, check timestamps
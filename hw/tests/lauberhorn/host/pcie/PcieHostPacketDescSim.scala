@@ -46,10 +46,12 @@ object PcieHostPacketDescSim {
           dp.pop(PKT_DESC_TY_WIDTH),
           dp.pop(BYPASS_HDR_WIDTH, skip = 19))
       case 2 =>
-        val xid = dp.pop(32, skip = 21)
+        val argsLen = dp.pop(ONCRPC_ARGS_LEN_WIDTH).toInt
+        val xid = dp.pop(32, skip = 21 - ONCRPC_ARGS_LEN_WIDTH.get)
         OncRpcCallRxPacketDescSimPcie(addr, size,
           dp.pop(64),
           xid,
+          argsLen,
           dp.pop(ONCRPC_INLINE_BYTES*8))
       case 3 => ???
     }
@@ -68,10 +70,11 @@ case class BypassPacketDescSimPcie(addr: BigInt, size: BigInt, packetType: BigIn
       .toBigInt
   }
 }
-case class OncRpcCallRxPacketDescSimPcie(addr: BigInt, size: BigInt, funcPtr: BigInt, xid: BigInt, args: BigInt) extends PcieHostPacketDescSim with OncRpcCallRxPacketDescSim {
+case class OncRpcCallRxPacketDescSimPcie(addr: BigInt, size: BigInt, funcPtr: BigInt, xid: BigInt, argsLen: Int, args: BigInt) extends PcieHostPacketDescSim with OncRpcCallRxPacketDescSim {
   override def encode: BigInt = {
     (new BigIntBuilder)
-      .push(32, xid, skip = 21)
+      .push(ONCRPC_ARGS_LEN_WIDTH, argsLen)
+      .push(32, xid, skip = 21 - ONCRPC_ARGS_LEN_WIDTH.get)
       .push(64, funcPtr)
       .push(BYPASS_HDR_WIDTH, args)
       .toBigInt
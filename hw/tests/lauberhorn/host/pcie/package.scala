@@ -1,7 +1,7 @@
 package lauberhorn.host
 
 import jsteward.blocks.misc.RegBlockReadBack
-import jsteward.blocks.misc.sim.{BigIntParser, BigIntRicher}
+import jsteward.blocks.misc.sim.{BigIntParser, BigIntRicher, IntRicherEndianAware}
 import spinal.core.{IntToBuilder, roundUp}
 import spinal.lib.bus.amba4.axi.sim.Axi4Master
 import lauberhorn._
@@ -29,4 +29,50 @@ package object pcie {
       None
     }
   }
+
+  def readRingIdx(master: Axi4Master, coreBlock: RegBlockReadBack, name: String): Int =
+    master.read(coreBlock(name), 8).bytesToBigInt.toInt
+
+  /** Buffer of the TX ring slot for the idx-th descriptor: the i-th MTU after the buffer from hostTx */
+  def txRingSlotDesc(base: ErrorPacketDescSimPcie, idx: Int, size: Int): ErrorPacketDescSimPcie =
+    base.copy(addr = base.addr + (idx % PCIE_TX_RING_SLOTS.get) * ROUNDED_MTU.get, size = size)
+
+  /** Post TX descriptors into the next slots of the TX ring and publish them with one doorbell.  The
+    * buffer of a slot is only free again after the descriptor behind it was taken, so the doorbell is
+    * rung early (and we wait) whenever numSlots - 1 descriptors are outstanding.
+    */
+  def txRingPost(master: Axi4Master, coreBlock: RegBlockReadBack, descs: Seq[List[Byte]]): Unit = {
+    val numSlots = PCIE_TX_RING_SLOTS.get
+    val idxMask = (1 << PCIE_RING_IDX_WIDTH.get) - 1
+    val slotStride = HOST_REQ_WIDTH.get / 8
+
+    var produced = readRingIdx(master, coreBlock, "hostTxProduced")
+    descs.foreach { d =>
+      if (((produced - readRingIdx(master, coreBlock, "hostTxConsumed")) & idxMask) >= numSlots - 1) {
+        master.write(coreBlock("hostTxProduced"), produced.toBytesLE)
+        while (((produced - readRingIdx(master, coreBlock, "hostTxConsumed")) & idxMask) >= numSlots - 1) {}
+      }
+      // toTxDesc carries one more bit than the slot; do not spill into the next slot
+      master.write(coreBlock("hostTxRing") + (produced % numSlots) * slotStride, d.take(slotStride))
+      produced = (produced + 1) & idxMask
+    }
+    master.write(coreBlock("hostTxProduced"), produced.toBytesLE)
+  }
+
+  /** Post RX acks into the RX ack ring and publish them with one doorbell */
+  def rxAckRingPost(master: Axi4Master, coreBlock: RegBlockReadBack, acks: Seq[BigInt]): Unit = {
+    val numSlots = PCIE_RX_ACK_RING_SLOTS.get
+    val idxMask = (1 << PCIE_RING_IDX_WIDTH.get) - 1
+
+    var produced = readRingIdx(master, coreBlock, "hostRxAckProduced")
+    acks.foreach { a =>
+      if (((produced - readRingIdx(master, coreBlock, "hostRxAckConsumed")) & idxMask) >= numSlots) {
+        master.write(coreBlock("hostRxAckProduced"), produced.toBytesLE)
+        while (((produced - readRingIdx(master, coreBlock, "hostRxAckConsumed")) & idxMask) >= numSlots) {}
+      }
+      master.write(coreBlock("hostRxAckRing") + (produced % numSlots) * 8, a.toBytesLE)
+      produced = (produced + 1) & idxMask
+    }
+    master.write(coreBlock("hostRxAckProduced"), produced.toBytesLE)
+  }
 }
@@ -37,6 +37,7 @@ trait ArpReqPacketDescSim { this: HostPacketDescSim =>
 trait OncRpcCallRxPacketDescSim { this: HostPacketDescSim =>
   def funcPtr: BigInt
   def xid: BigInt
+  def argsLen: Int
   def args: BigInt
   override def ty = 3
 }
@@ -44,3 +45,8 @@ trait OncRpcCallRxPacketDescSim { this: HostPacketDescSim =>
 trait OncRpcReplyTxPacketDescSim extends OncRpcCallRxPacketDescSim { this: HostPacketDescSim =>
   override final def ty = 4
 }
+
+/** Reply to a nested call: same fields as a call, [[funcPtr]] is the client procedure */
+trait OncRpcReplyRxPacketDescSim extends OncRpcCallRxPacketDescSim { this: HostPacketDescSim =>
+  override final def ty = 4
+}
@@ -5,9 +5,11 @@ import jsteward.blocks.misc.RegBlockReadBack
 import jsteward.blocks.misc.sim.IntRicherEndianAware
 import org.pcap4j.core.{PcapDumper, Pcaps}
 import org.pcap4j.packet.namednumber.DataLinkType
+import org.pcap4j.util.MacAddress
 import lauberhorn.{AsSimBusMaster, Global, NicEngine}
 import Global.ALLOC
 
+import java.net.{Inet4Address, InetAddress}
 import scala.util.Random
 import scala.collection.mutable
 
@@ -26,6 +28,20 @@ object RpcSrvDef {
   }
 }
 
+case class RpcClntDef(serverAddr: Inet4Address, serverMac: MacAddress, serverPort: Int, clientPort: Int,
+                      prog: Int, progVer: Int, procNum: Int, funcPtr: Long)
+object RpcClntDef {
+  def mkRandom: RpcClntDef = {
+    val serverAddr = InetAddress.getByAddress(Random.nextBytes(4)).asInstanceOf[Inet4Address]
+    val serverMac = MacAddress.getByAddress(Random.nextBytes(6))
+    val serverPort, clientPort = Random.nextInt(65535)
+    val prog, progVer, procNum = Random.nextInt()
+    // 48-bit pointer; avoid generating negative number
+    val funcPtr = Random.nextLong(0x1000000000000L)
+    RpcClntDef(serverAddr, serverMac, serverPort, clientPort, prog, progVer, procNum, funcPtr)
+  }
+}
+
 trait OncRpcSuiteFactory { this: DutSimFunSuite[NicEngine] =>
   /** Enable one process in the scheduler. */
   def enableProcess[B](bus: B, procDef: ProcDef, idx: Int)(implicit asMaster: AsSimBusMaster[B]) = {
@@ -66,6 +82,42 @@ trait OncRpcSuiteFactory { this: DutSimFunSuite[NicEngine] =>
     println(f"Enabled service prog $prog%#x progVer $progVer%#x procNum $procNum%#x port $dport -> $funcPtr%#x @ table idx $idx")
   }
 
+  /** Enable one client procedure (nested calls) in the given process.  Also listens on the client port for replies
+    * and installs the neighbor entry of the server.
+    */
+  def enableClient[B](bus: B, clntDef: RpcClntDef, idx: Int, listenIdx: Int, pid: Int)(implicit asMaster: AsSimBusMaster[B]) = {
+    import clntDef._
+
+    // activate reply port
+    asMaster.write(bus, ALLOC.readBack("UdpDecoder")("ctrl", "listen_port"), clientPort.toBytesLE)
+    asMaster.write(bus, ALLOC.readBack("UdpDecoder")("ctrl", "listen_nextProto"), 2.toBytesLE) // FIXME: do not hard-code enum value
+    asMaster.write(bus, ALLOC.readBack("UdpDecoder")("ctrl", "listen_idx"), listenIdx.toBytesLE)
+    assert(listenIdx <= Global.NUM_LISTEN_PORTS, "exhausted number of listen ports")
+
+    // activate client procedure
+    // XXX: the table swaps all fields but funcPtr and pid to network order; reverse the address to cancel that out
+    asMaster.write(bus, ALLOC.readBack("OncRpcCallEncoder")("ctrl", "client_progNum"), prog.toBytesLE)
+    asMaster.write(bus, ALLOC.readBack("OncRpcCallEncoder")("ctrl", "client_progVer"), progVer.toBytesLE)
+    asMaster.write(bus, ALLOC.readBack("OncRpcCallEncoder")("ctrl", "client_proc"), procNum.toBytesLE)
+    asMaster.write(bus, ALLOC.readBack("OncRpcCallEncoder")("ctrl", "client_serverAddr"), serverAddr.getAddress.reverse.toList)
+    asMaster.write(bus, ALLOC.readBack("OncRpcCallEncoder")("ctrl", "client_serverPort"), serverPort.toBytesLE)
+    asMaster.write(bus, ALLOC.readBack("OncRpcCallEncoder")("ctrl", "client_clientPort"), clientPort.toBytesLE)
+    asMaster.write(bus, ALLOC.readBack("OncRpcCallEncoder")("ctrl", "client_funcPtr"), funcPtr.toBytesLE)
+    asMaster.write(bus, ALLOC.readBack("OncRpcCallEncoder")("ctrl", "client_enabled"), 1.toBytesLE)
+    asMaster.write(bus, ALLOC.readBack("OncRpcCallEncoder")("ctrl", "client_pid"), pid.toBytesLE)
+
+    asMaster.write(bus, ALLOC.readBack("OncRpcCallEncoder")("ctrl", "client_idx"), idx.toBytesLE)
+
+    // neighbor entry of the server
+    // XXX: this always use the first neighbor entry
+    asMaster.write(bus, ALLOC.readBack("IpEncoder")("ctrl", "neigh_ipAddr"), serverAddr.getAddress.toList)
+    asMaster.write(bus, ALLOC.readBack("IpEncoder")("ctrl", "neigh_macAddr"), serverMac.getAddress.toList)
+    asMaster.write(bus, ALLOC.readBack("IpEncoder")("ctrl", "neigh_state"), 2.toBytesLE) // reachable
+    asMaster.write(bus, ALLOC.readBack("IpEncoder")("ctrl", "neigh_idx"), 0.toBytesLE)
+
+    println(f"Enabled client prog $prog%#x progVer $progVer%#x procNum $procNum%#x -> $serverAddr:$serverPort from port $clientPort as $funcPtr%#x @ table idx $idx")
+  }
+
   val dumpers = mutable.Map[String, PcapDumper]()
   def getDumper(workspaceName: String): PcapDumper = {
     dumpers.getOrElseUpdate(workspaceName, {
@@ -131,6 +183,9 @@ trait OncRpcSuiteFactory { this: DutSimFunSuite[NicEngine] =>
 
     val inlineMaxLen = lauberhorn.Global.ONCRPC_INLINE_BYTES.get
 
+    val expectedArgsLen = payload.length min inlineMaxLen
+    assert(desc.argsLen == expectedArgsLen, s"args length mismatch: got ${desc.argsLen}, expected $expectedArgsLen")
+
     // check inline data
     // TODO: check if args is endian-swapped correctly
     // XXX: spinal.lib.LiteralRicher.toBytes adds an extra byte for positive BigInts
@@ -134,7 +134,51 @@ package object sim {
     )
   }
 
-  def rawPayloadBuilder(payload: Array[Byte]) = (new UnknownPacket.Builder).rawData(payload)
+  /** Reply to a nested call.  Non-zero [[replyStat]] or [[acceptStat]] make a reply that was not accepted
+    * successfully; the header is kept in the MSG_ACCEPTED shape nevertheless.
+    */
+  def oncRpcReplyPacket(sport: Int, dport: Int, payload: List[Byte], xid: Int, replyStat: Int = 0, acceptStat: Int = 0) = {
+    println(f"XID $xid%#x replyStat $replyStat acceptStat $acceptStat")
+
+    udpPacket(sport, dport,
+      rawPayloadBuilder(
+        Seq(
+          xid,
+          1, // message type: Reply (1)
+          replyStat,
+        ).flatMap(intToBytesBE(_)).toArray
+          // 8B verifier
+          ++ Array.fill(8)(0.toByte)
+          ++ intToBytesBE(acceptStat)
+          ++ payload
+      )
+    )
+  }
+
+  def rawPayloadBuilder(payload: Array[Byte]) =(new UnknownPacket.Builder).rawData(payload)
+
+  /** Rewrite the raw bytes of an Ethernet frame carrying IPv4 without options (and UDP, if touched) */
+  private def mangleFrame(packet: Packet)(f: Array[Byte] => Unit): EthernetPacket = {
+    val raw = packet.getRawData.clone()
+    f(raw)
+    EthernetPacket.newPacket(raw, 0, raw.length)
+  }
+
+  /** flip the high byte of the IP header checksum */
+  def corruptIpHdrCsum(packet: Packet) = mangleFrame(packet) { raw =>
+    raw(14 + 10) = (raw(14 + 10) ^ 0xff).toByte
+  }
+
+  /** flip the first byte after the UDP header: only the UDP checksum can tell */
+  def corruptUdpPayload(packet: Packet) = mangleFrame(packet) { raw =>
+    raw(14 + 20 + 8) = (raw(14 + 20 + 8) ^ 0xff).toByte
+  }
+
+  /** clear the UDP checksum, i.e. send without one */
+  def zeroUdpCsum(packet: Packet) = mangleFrame(packet) { raw =>
+    raw(14 + 20 + 6) = 0
+    raw(14 + 20 + 7) = 0
+  }
 
   def randomPacket(mtu: Int, randomizeLen: Boolean = true)(protocols: PacketType*): (Packet, PacketType) = {
     val proto = choose(protocols.iterator, Random)
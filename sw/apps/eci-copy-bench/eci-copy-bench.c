@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2025 Pengcheng Xu
+
+// Microbenchmark for the ECI copy kernels in core/eci/copy.h.
+//
+// Lays out a fake ECI RX/TX window (inline half-CL + overflow CLs) in normal
+// memory and times moving each packet size out of (RX) and into (TX) it, with
+// both the copy kernels and plain memcpy.  Sweeps the same sizes as
+// rt-eci-test; reports cycles per CL touched.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "eci/config.h"
+#include "eci/copy.h"
+
+#define INLINE_SIZE 64
+#define MAX_OVERFLOW (LAUBERHORN_ECI_NUM_OVERFLOW_CL * 128)
+
+// ThunderX-1 (CN88xx) core clock
+#define DEFAULT_CPU_MHZ 2000
+
+static double cpu_mhz = DEFAULT_CPU_MHZ;
+
+// timestamp in CPU cycles
+static inline uint64_t now_cycles(void) {
+#ifdef __aarch64__
+  // PMCCNTR_EL0 is usually not accessible from EL0; scale the generic timer
+  uint64_t cnt, frq;
+  asm volatile("isb\nmrs %0, cntvct_el0" : "=r"(cnt)::"memory");
+  asm volatile("mrs %0, cntfrq_el0" : "=r"(frq));
+  return (uint64_t)((double)cnt * cpu_mhz * 1e6 / (double)frq);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)(((double)ts.tv_sec * 1e9 + ts.tv_nsec) * cpu_mhz / 1e3);
+#endif
+}
+
+typedef struct {
+  uint8_t *ctrl_cl;  // control CL; inline data in second half
+  uint8_t *overflow; // overflow CLs
+} window_t;
+
+typedef void (*copy_fn_t)(uint8_t *buf, const window_t *w, size_t len,
+                          bool rx);
+
+static void copy_kernels(uint8_t *buf, const window_t *w, size_t len,
+                         bool rx) {
+  size_t inline_len = len < INLINE_SIZE ? len : INLINE_SIZE;
+  uint8_t *inl = w->ctrl_cl + INLINE_SIZE;
+
+  if (rx) {
+    lauberhorn_copy_inline(buf, inl, inline_len);
+    lauberhorn_copy_overflow(buf + inline_len, w->overflow, len - inline_len);
+  } else {
+    lauberhorn_copy_inline(inl, buf, inline_len);
+    lauberhorn_copy_overflow(w->overflow, buf + inline_len, len - inline_len);
+  }
+}
+
+static void copy_memcpy(uint8_t *buf, const window_t *w, size_t len, bool rx) {
+  size_t inline_len = len < INLINE_SIZE ? len : INLINE_SIZE;
+  uint8_t *inl = w->ctrl_cl + INLINE_SIZE;
+
+  if (rx) {
+    memcpy(buf, inl, inline_len);
+    memcpy(buf + inline_len, w->overflow, len - inline_len);
+  } else {
+    memcpy(inl, buf, inline_len);
+    memcpy(w->overflow, buf + inline_len, len - inline_len);
+  }
+}
+
+static bool check(copy_fn_t fn, uint8_t *buf, uint8_t *ref, const window_t *w,
+                  size_t len) {
+  for (size_t i = 0; i < len; ++i)
+    ref[i] = rand();
+  memcpy(buf, ref, len);
+  fn(buf, w, len, false);
+  memset(buf, 0, len);
+  fn(buf, w, len, true);
+  return !memcmp(buf, ref, len);
+}
+
+static double measure(copy_fn_t fn, uint8_t *buf, const window_t *w,
+                      size_t len, bool rx, int iters) {
+  // number of CLs touched on the ECI side: control CL + overflow CLs
+  size_t ncl = 1;
+  if (len > INLINE_SIZE)
+    ncl += (len - INLINE_SIZE + 127) / 128;
+
+  // warm up
+  fn(buf, w, len, rx);
+
+  uint64_t start = now_cycles();
+  for (int i = 0; i < iters; ++i) {
+    fn(buf, w, len, rx);
+    asm volatile("" ::: "memory");
+  }
+  uint64_t end = now_cycles();
+
+  return (double)(end - start) / iters / ncl;
+}
+
+int main(int argc, char *argv[]) {
+  int ret = EXIT_FAILURE;
+  int iters = 10000;
+
+  if (argc > 3) {
+    fprintf(stderr, "usage: %s [cpu MHz] [iterations]\n", argv[0]);
+    goto fail;
+  }
+  if (argc > 1)
+    cpu_mhz = atof(argv[1]);
+  if (argc > 2)
+    iters = atoi(argv[2]);
+
+  window_t w;
+  uint8_t *buf, *ref;
+  if (posix_memalign((void **)&w.ctrl_cl, 128, 128) ||
+      posix_memalign((void **)&w.overflow, 128, MAX_OVERFLOW) ||
+      posix_memalign((void **)&buf, 128, LAUBERHORN_MTU) ||
+      posix_memalign((void **)&ref, 128, LAUBERHORN_MTU)) {
+    perror("posix_memalign");
+    goto fail;
+  }
+
+  FILE *out = fopen("copy_bench.csv", "w");
+  if (!out) {
+    perror("fopen");
+    goto fail;
+  }
+  fprintf(out, "size,rx_kernel_cyc_per_cl,rx_memcpy_cyc_per_cl,"
+               "tx_kernel_cyc_per_cl,tx_memcpy_cyc_per_cl\n");
+
+  int min_pkt = 64, max_pkt = 9600, step = 64;
+
+  for (int size = min_pkt; size <= max_pkt; size += step) {
+    if (!check(copy_kernels, buf, ref, &w, size)) {
+      printf("FAIL: copy kernel data mismatch for length %d\n", size);
+      goto fini;
+    }
+
+    double rx_k = measure(copy_kernels, buf, &w, size, true, iters);
+    double rx_m = measure(copy_memcpy, buf, &w, size, true, iters);
+    double tx_k = measure(copy_kernels, buf, &w, size, false, iters);
+    double tx_m = measure(copy_memcpy, buf, &w, size, false, iters);
+
+    fprintf(out, "%d,%.2f,%.2f,%.2f,%.2f\n", size, rx_k, rx_m, tx_k, tx_m);
+    printf("%5d B: rx %6.2f (memcpy %6.2f), tx %6.2f (memcpy %6.2f) cyc/CL\n",
+           size, rx_k, rx_m, tx_k, tx_m);
+  }
+
+  ret = EXIT_SUCCESS;
+
+fini:
+  fclose(out);
+fail:
+  return ret;
+}
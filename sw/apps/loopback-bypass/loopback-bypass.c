@@ -6,8 +6,8 @@
 #include <unistd.h>
 
 #include "api.h"
-#include "common.h"
 #include "diag.h"
+#include "hexdump.h"
 #include "profile.h"
 
 // TODO: send other protocol headers
@@ -15,8 +15,8 @@ static uint8_t ethernet_hdr[] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0xaa,
                                  0xbb, 0xcc, 0xdd, 0xee, 0xff, 0xde, 0xad};
 
 typedef struct {
-  uint32_t host_got_tx_buf;
-  uint32_t host_read_complete;
+  uint64_t host_got_tx_buf;
+  uint64_t host_read_complete;
 
   pionic_core_ctrl_timestamps_t ts;
 } measure_t;
@@ -25,8 +25,6 @@ static measure_t loopback_timed(pionic_ctx_t ctx, pionic_pkt_desc_t *desc,
                                 uint8_t *tx_buf, uint32_t length) {
   int cid = 0;
 
-  pionic_tx_prepare_desc(ctx, cid, desc);
-
   // fill in Ethernet header
   desc->type = TY_BYPASS;
   desc->bypass.header_type = HDR_ETHERNET;
@@ -42,9 +40,10 @@ static measure_t loopback_timed(pionic_ctx_t ctx, pionic_pkt_desc_t *desc,
   // a host-side timestamp as substitute.
   ret.host_got_tx_buf = pionic_get_cycles(ctx);
 
+  // payload from a host buffer: the runtime copies it into the TX slot with
+  // full-burst non-temporal stores, so the copy is part of the measurement
   if (length > 0) {
-    // TODO: check desc->payload_len is enough?
-    memcpy(desc->payload_buf, tx_buf, length);
+    desc->payload_buf = tx_buf;
     desc->payload_len = length;
     pionic_tx(ctx, cid, desc);
   }
@@ -138,6 +137,12 @@ int main(int argc, char *argv[]) {
   // 20 ms
   pionic_set_rx_block_cycles(ctx, pionic_us_to_cycles(20 * 1000));
 
+  // packet buffer mapping under test, see map_pktbuf in rt/pcie.c
+  const char *force_uc = getenv("LAUBERHORN_PCIE_PKTBUF_UC");
+  const char *mapping =
+      force_uc && *force_uc && strcmp(force_uc, "0") ? "uc" : "wc";
+  char out_path[64];
+
   // estimate pcie roundtrip time
   FILE *out = fopen("pcie_lat.csv", "w");
   fprintf(out, "pcie_lat_cyc\n");
@@ -153,20 +158,27 @@ int main(int argc, char *argv[]) {
   // enable promisc mode
   pionic_set_promisc(ctx, true);
 
-  out = fopen("loopback.csv", "w");
-  fprintf(out, "size,"
-               "acquire_cyc,after_tx_commit_cyc,after_dma_read_cyc,exit_cyc,"
+  // tx_dma_read: from the TX doorbell until the NIC has read the payload out
+  // of the packet buffer.  e2e: from handing the payload to pionic_tx until it
+  // is back in rx_buf
+  snprintf(out_path, sizeof(out_path), "loopback-%s.csv", mapping);
+  out = fopen(out_path, "w");
+  fprintf(out, "size,mapping,"
+               "tx_core_acquire_cyc,tx_core_commit_cyc,tx_after_dma_read_cyc,"
+               "tx_before_cdc_queue_cyc,tx_cmac_exit_cyc,"
                "host_got_tx_buf_cyc,"
-               "entry_cyc,after_rx_queue_cyc,after_dma_write_cyc,read_start_"
-               "cyc,after_read_cyc,"
-               "after_rx_commit_cyc,host_read_complete_cyc\n");
+               "rx_cmac_entry_cyc,rx_after_cdc_queue_cyc,"
+               "rx_enqueue_to_host_cyc,rx_core_read_start_cyc,"
+               "rx_core_read_finish_cyc,rx_core_commit_cyc,"
+               "host_read_complete_cyc,"
+               "tx_dma_read_cyc,e2e_cyc\n");
 
   // send packet and check rx data
   int min_pkt = 64, max_pkt = 9600, step = 64;
 
   // allocate packet descriptor once
   pionic_pkt_desc_t *desc = pionic_alloc_pkt_desc();
-  assert(!desc);
+  assert(desc);
 
   for (int to_send = min_pkt; to_send <= max_pkt; to_send += step) {
     printf("Testing packet size %d", to_send);
@@ -177,11 +189,17 @@ int main(int argc, char *argv[]) {
 
     for (int i = 0; i < num_trials; ++i) {
       measure_t m = loopback_timed(ctx, desc, test_data, to_send);
-      fprintf(out, "%d,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", to_send,
-              m.ts.acquire, m.ts.after_tx_commit, m.ts.after_dma_read,
-              m.ts.exit, m.host_got_tx_buf, m.ts.entry, m.ts.after_rx_queue,
-              m.ts.after_dma_write, m.ts.read_start, m.ts.after_read,
-              m.ts.after_rx_commit, m.host_read_complete);
+      fprintf(out,
+              "%d,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,"
+              "%lu,%lu\n",
+              to_send, mapping, m.ts.tx_core_acquire, m.ts.tx_core_commit,
+              m.ts.tx_after_dma_read, m.ts.tx_before_cdc_queue,
+              m.ts.tx_cmac_exit, m.host_got_tx_buf, m.ts.rx_cmac_entry,
+              m.ts.rx_after_cdc_queue, m.ts.rx_enqueue_to_host,
+              m.ts.rx_core_read_start, m.ts.rx_core_read_finish,
+              m.ts.rx_core_commit, m.host_read_complete,
+              m.ts.tx_after_dma_read - m.ts.tx_core_commit,
+              m.host_read_complete - m.host_got_tx_buf);
       printf(".");
       fflush(stdout);
     }
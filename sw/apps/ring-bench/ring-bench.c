@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2025 Pengcheng Xu
+
+// Benchmark of the submission/completion rings (ring.h) against the blocking
+// pionic_rx / pionic_tx calls, on the emulated NIC.
+//
+// A wire thread offers ONC RPC calls to one worker core at a fixed rate and
+// timestamps the replies; the server echoes the arguments back, once with
+// each API.  Both server loops also take one turn of a stand-in for another
+// event source per iteration: the turn rate shows how much of the loop the NIC
+// leaves to other work at the same offered load.  Sweeps the offered load and
+// writes ring_bench.csv.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "api.h"
+#include "emu.h"
+#include "ring.h"
+
+#define RING_ENTRIES 64
+
+// latency histogram: 100 ns buckets up to 2 ms, plus one for everything above
+#define LAT_BUCKET_NS 100
+#define LAT_BUCKETS 20000
+
+// xids in flight are tracked modulo this; far above what the emulated queues
+// can hold
+#define MAX_INFLIGHT 4096
+
+typedef enum { MODE_BLOCKING, MODE_RING } bench_mode_t;
+
+typedef struct {
+  pionic_ctx_t ctx;
+  int cid;
+  size_t pld_len;
+  uint64_t rate; // calls per second
+
+  // the wire stops first, such that the server answers the calls in flight
+  bool stop_wire, stop;
+
+  // server side
+  uint64_t turns;
+
+  // wire side
+  uint64_t sent, dropped, replies;
+  uint64_t sent_ns[MAX_INFLIGHT];
+  uint64_t lat_hist[LAT_BUCKETS + 1];
+} bench_t;
+
+static inline uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static inline bool stopped(bool *flag) {
+  return __atomic_load_n(flag, __ATOMIC_RELAXED);
+}
+
+// another event source sharing the loop, e.g. a timer or a socket
+static inline void other_event_source(bench_t *b) {
+  ++b->turns;
+  asm volatile("" ::: "memory");
+}
+
+// turn a received call into its reply in place: same xid and handle, the
+// arguments echoed back in the payload
+static inline void make_reply(pionic_pkt_desc_t *desc) {
+  desc->type = TY_ONCRPC_REPLY;
+  desc->oncrpc_server.tx_inline_words = 0;
+}
+
+static void serve_blocking(bench_t *b) {
+  pionic_pkt_desc_t desc;
+
+  while (!stopped(&b->stop)) {
+    if (pionic_rx(b->ctx, b->cid, &desc)) {
+      make_reply(&desc);
+      pionic_tx(b->ctx, b->cid, &desc);
+    }
+    other_event_source(b);
+  }
+}
+
+static int serve_ring(bench_t *b) {
+  static uint8_t bufs[RING_ENTRIES][LAUBERHORN_MTU]
+      __attribute__((aligned(128)));
+  pionic_ring_t ring;
+  pionic_cqe_t *cqe;
+
+  if (pionic_ring_init(&ring, b->ctx, b->cid, RING_ENTRIES)) {
+    fprintf(stderr, "pionic_ring_init failed\n");
+    return -1;
+  }
+
+  // each buffer has at most one SQ or CQ entry at any time: RX_BUF until a call
+  // arrives, then TX with the reply until that is sent
+  for (int i = 0; i < RING_ENTRIES; ++i)
+    pionic_ring_prep_rx_buf(pionic_ring_get_sqe(ring), bufs[i],
+                            sizeof(bufs[i]), i);
+
+  while (!stopped(&b->stop)) {
+    pionic_ring_submit(ring);
+    pionic_ring_poll(ring);
+
+    while ((cqe = pionic_ring_peek_cqe(ring))) {
+      uint64_t i = cqe->user_data;
+
+      if (cqe->op == PIONIC_OP_RX_BUF) {
+        make_reply(&cqe->desc);
+        pionic_ring_prep_tx(pionic_ring_get_sqe(ring), &cqe->desc, i);
+      } else {
+        pionic_ring_prep_rx_buf(pionic_ring_get_sqe(ring), bufs[i],
+                                sizeof(bufs[i]), i);
+      }
+      pionic_ring_cqe_seen(ring);
+    }
+
+    other_event_source(b);
+  }
+
+  pionic_ring_fini(&ring);
+  return 0;
+}
+
+static void record_reply(bench_t *b, const pionic_emu_pkt_t *pkt,
+                         uint64_t now) {
+  uint32_t xid = pkt->desc.oncrpc_server.xid;
+  uint64_t lat = now - b->sent_ns[xid % MAX_INFLIGHT];
+  uint64_t bucket = lat / LAT_BUCKET_NS;
+
+  ++b->lat_hist[bucket < LAT_BUCKETS ? bucket : LAT_BUCKETS];
+  ++b->replies;
+}
+
+// open-loop load: calls leave on schedule whether or not replies came back
+static void *wire_thread(void *arg) {
+  bench_t *b = arg;
+  pionic_emu_pkt_t *call = calloc(1, sizeof(*call));
+  pionic_emu_pkt_t *reply = malloc(sizeof(*reply));
+  uint64_t gap_ns = 1000000000UL / b->rate;
+  uint64_t next = now_ns();
+
+  call->desc.type = TY_ONCRPC_CALL;
+  call->desc.oncrpc_server.func_ptr = (void *)0x1;
+  call->desc.payload_buf = call->data;
+  call->desc.payload_len = b->pld_len;
+  for (size_t i = 0; i < b->pld_len; ++i)
+    call->data[i] = rand();
+
+  while (!stopped(&b->stop_wire)) {
+    uint64_t now = now_ns();
+
+    while (pionic_emu_consume(b->ctx, b->cid, reply))
+      record_reply(b, reply, now);
+
+    if (now < next)
+      continue;
+    next += gap_ns;
+
+    call->desc.oncrpc_server.xid = b->sent;
+    b->sent_ns[b->sent % MAX_INFLIGHT] = now;
+    ++b->sent;
+    if (!pionic_emu_inject(b->ctx, b->cid, call))
+      ++b->dropped;
+  }
+
+  // stragglers
+  uint64_t deadline = now_ns() + 10000000UL;
+  while (b->replies + b->dropped < b->sent && now_ns() < deadline) {
+    if (pionic_emu_consume(b->ctx, b->cid, reply))
+      record_reply(b, reply, now_ns());
+  }
+
+  free(reply);
+  free(call);
+  return NULL;
+}
+
+// latency at quantile q, in us
+static double lat_quantile(const bench_t *b, double q) {
+  uint64_t want = (uint64_t)(q * b->replies), seen = 0;
+
+  for (int i = 0; i <= LAT_BUCKETS; ++i) {
+    seen += b->lat_hist[i];
+    if (seen > want)
+      return (i + 0.5) * LAT_BUCKET_NS / 1e3;
+  }
+  return 0;
+}
+
+typedef struct {
+  bench_t *b;
+  bench_mode_t mode;
+  int ret;
+} server_arg_t;
+
+static void *server_thread(void *arg) {
+  server_arg_t *s = arg;
+
+  s->ret = 0;
+  if (s->mode == MODE_BLOCKING)
+    serve_blocking(s->b);
+  else
+    s->ret = serve_ring(s->b);
+  return NULL;
+}
+
+static int run(bench_t *b, bench_mode_t mode, double seconds, FILE *out) {
+  pthread_t server, wire;
+  server_arg_t s = {.b = b, .mode = mode};
+  struct timespec dur = {
+      .tv_sec = (time_t)seconds,
+      .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9),
+  };
+  const char *name = mode == MODE_BLOCKING ? "blocking" : "ring";
+
+  b->stop_wire = b->stop = false;
+  b->turns = b->sent = b->dropped = b->replies = 0;
+  memset(b->lat_hist, 0, sizeof(b->lat_hist));
+
+  if (pthread_create(&server, NULL, server_thread, &s)) {
+    perror("pthread_create");
+    return -1;
+  }
+  if (pthread_create(&wire, NULL, wire_thread, b)) {
+    perror("pthread_create");
+    __atomic_store_n(&b->stop, true, __ATOMIC_RELAXED);
+    pthread_join(server, NULL);
+    return -1;
+  }
+
+  nanosleep(&dur, NULL);
+  __atomic_store_n(&b->stop_wire, true, __ATOMIC_RELAXED);
+  pthread_join(wire, NULL);
+  __atomic_store_n(&b->stop, true, __ATOMIC_RELAXED);
+  pthread_join(server, NULL);
+  if (s.ret)
+    return s.ret;
+
+  double achieved = b->replies / seconds;
+  double turns = b->turns / seconds;
+  double p50 = lat_quantile(b, 0.5), p99 = lat_quantile(b, 0.99);
+
+  fprintf(out, "%s,%lu,%.0f,%lu,%.2f,%.2f,%.0f\n", name, b->rate, achieved,
+          b->dropped, p50, p99, turns);
+  printf("%8s %8lu/s: %8.0f/s, %6lu dropped, p50 %7.2f us, p99 %7.2f us, "
+         "%10.0f turns/s\n",
+         name, b->rate, achieved, b->dropped, p50, p99, turns);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  static const uint64_t rates[] = {10000,  50000,  100000,
+                                   200000, 500000, 1000000};
+  int ret = EXIT_FAILURE;
+  double seconds = 1;
+  bench_t *b;
+
+  if (argc > 4) {
+    fprintf(stderr, "usage: %s [worker core] [payload bytes] [seconds]\n",
+            argv[0]);
+    goto fail;
+  }
+
+  b = calloc(1, sizeof(*b));
+  if (!b) {
+    perror("calloc");
+    goto fail;
+  }
+  b->cid = argc > 1 ? atoi(argv[1]) : LAUBERHORN_NUM_BYPASS_CORES;
+  b->pld_len = argc > 2 ? atoi(argv[2]) : 64;
+  if (argc > 3)
+    seconds = atof(argv[3]);
+
+  if (b->cid < LAUBERHORN_NUM_BYPASS_CORES || b->cid >= LAUBERHORN_NUM_CORES ||
+      b->pld_len > LAUBERHORN_MTU) {
+    fprintf(stderr, "need a worker core and at most %d payload bytes\n",
+            LAUBERHORN_MTU);
+    goto fail_free;
+  }
+
+  if (pionic_init_cores(&b->ctx, NULL, false, 1UL << b->cid)) {
+    fprintf(stderr, "pionic_init failed\n");
+    goto fail_free;
+  }
+
+  FILE *out = fopen("ring_bench.csv", "w");
+  if (!out) {
+    perror("fopen");
+    goto fini;
+  }
+  fprintf(out, "mode,offered,achieved,dropped,p50_us,p99_us,turns_per_s\n");
+
+  for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i) {
+    b->rate = rates[i];
+    if (run(b, MODE_BLOCKING, seconds, out) || run(b, MODE_RING, seconds, out))
+      goto close;
+  }
+
+  ret = EXIT_SUCCESS;
+
+close:
+  fclose(out);
+fini:
+  pionic_fini(&b->ctx);
+fail_free:
+  free(b);
+fail:
+  return ret;
+}
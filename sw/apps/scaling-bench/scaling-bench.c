@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: BSD-3-Clause
+// Copyright (c) 2025 Pengcheng Xu
+
+// Scaling benchmark of the runtime datapath over cores, on the emulated NIC.
+//
+// For 1 .. LAUBERHORN_NUM_CORES threads, each thread owns one core and one CPU
+// and runs a closed loop on it: queue a burst of packets at the wire side,
+// receive them with pionic_rx_burst, echo them with pionic_tx_burst and take
+// the echoes off the wire.  Cores share nothing but the context, so the
+// aggregate rate should grow linearly with the threads; the efficiency column
+// is the rate over n times the single-thread rate.  The bypass cores echo
+// Ethernet frames, the worker cores ONC RPC calls.  Writes scaling_bench.csv.
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "api.h"
+#include "emu.h"
+
+#define MAX_BURST 32
+
+typedef struct {
+  pionic_ctx_t ctx;
+  int cid;
+  int cpu;
+  int burst;
+  size_t pld_len;
+  bool *stop;
+
+  uint64_t ops;
+} __attribute__((aligned(128))) worker_t; // ThunderX-1 CL
+
+static inline uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void fill_pkt(pionic_emu_pkt_t *pkt, int cid, size_t len) {
+  memset(&pkt->desc, 0, sizeof(pkt->desc));
+
+  if (cid < LAUBERHORN_NUM_BYPASS_CORES) {
+    pkt->desc.type = TY_BYPASS;
+    pkt->desc.bypass.header_type = HDR_ETHERNET;
+  } else {
+    pkt->desc.type = TY_ONCRPC_CALL;
+    pkt->desc.oncrpc_server.func_ptr = (void *)0x1;
+  }
+
+  pkt->desc.payload_buf = pkt->data;
+  pkt->desc.payload_len = len;
+  for (size_t i = 0; i < len; ++i)
+    pkt->data[i] = rand();
+}
+
+static void *worker_thread(void *arg) {
+  worker_t *w = arg;
+  pionic_emu_pkt_t *pkt = malloc(sizeof(*pkt));
+  pionic_pkt_desc_t *descs = calloc(w->burst, sizeof(*descs));
+  uint8_t *bufs = malloc((size_t)w->burst * LAUBERHORN_MTU);
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET(w->cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+    fprintf(stderr, "core %d: cannot pin to CPU %d\n", w->cid, w->cpu);
+
+  fill_pkt(pkt, w->cid, w->pld_len);
+
+  while (!__atomic_load_n(w->stop, __ATOMIC_RELAXED)) {
+    int got, sent;
+
+    for (int i = 0; i < w->burst; ++i)
+      pionic_emu_inject(w->ctx, w->cid, pkt);
+
+    for (int i = 0; i < w->burst; ++i) {
+      descs[i].payload_buf = bufs + (size_t)i * LAUBERHORN_MTU;
+      descs[i].payload_len = LAUBERHORN_MTU;
+    }
+    got = pionic_rx_burst(w->ctx, w->cid, descs, w->burst);
+
+    // echo: same header / session, same payload
+    for (int i = 0; i < got; ++i) {
+      if (descs[i].type == TY_ONCRPC_CALL) {
+        descs[i].type = TY_ONCRPC_REPLY;
+        descs[i].oncrpc_server.tx_inline_words = 0;
+      } else {
+        descs[i].bypass.header_type = HDR_ETHERNET;
+      }
+    }
+    sent = pionic_tx_burst(w->ctx, w->cid, descs, got);
+
+    for (int i = 0; i < sent; ++i)
+      pionic_emu_consume(w->ctx, w->cid, pkt);
+    // consume overwrote the packet with the echo: same contents
+    pkt->desc.type =
+        w->cid < LAUBERHORN_NUM_BYPASS_CORES ? TY_BYPASS : TY_ONCRPC_CALL;
+
+    w->ops += sent;
+  }
+
+  free(bufs);
+  free(descs);
+  free(pkt);
+  return NULL;
+}
+
+static double run(pionic_ctx_t ctx, int nthreads, int burst, size_t pld_len,
+                  double seconds) {
+  static worker_t workers[LAUBERHORN_NUM_CORES];
+  int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  struct timespec dur = {
+      .tv_sec = (time_t)seconds,
+      .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9),
+  };
+  pthread_t threads[LAUBERHORN_NUM_CORES];
+  bool stop = false;
+  uint64_t start, ops = 0;
+  int started;
+
+  for (started = 0; started < nthreads; ++started) {
+    worker_t *w = &workers[started];
+
+    *w = (worker_t){
+        .ctx = ctx,
+        .cid = started,
+        .cpu = started % ncpus,
+        .burst = burst,
+        .pld_len = pld_len,
+        .stop = &stop,
+    };
+    if (pthread_create(&threads[started], NULL, worker_thread, w)) {
+      perror("pthread_create");
+      break;
+    }
+  }
+
+  start = now_ns();
+  nanosleep(&dur, NULL);
+  __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+
+  for (int i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+    ops += workers[i].ops;
+  }
+
+  if (started < nthreads)
+    return -1;
+  return ops / ((now_ns() - start) / 1e9);
+}
+
+int main(int argc, char *argv[]) {
+  int ret = EXIT_FAILURE;
+  int burst = 8;
+  size_t pld_len = 64;
+  double seconds = 1, base = 0;
+  pionic_ctx_t ctx;
+
+  if (argc > 4) {
+    fprintf(stderr, "usage: %s [burst] [payload bytes] [seconds]\n", argv[0]);
+    goto fail;
+  }
+  if (argc > 1)
+    burst = atoi(argv[1]);
+  if (argc > 2)
+    pld_len = atoi(argv[2]);
+  if (argc > 3)
+    seconds = atof(argv[3]);
+
+  if (burst < 1 || burst > MAX_BURST || pld_len > LAUBERHORN_MTU) {
+    fprintf(stderr, "need a burst of 1..%d and at most %d payload bytes\n",
+            MAX_BURST, LAUBERHORN_MTU);
+    goto fail;
+  }
+
+  if (pionic_init(&ctx, NULL, false)) {
+    fprintf(stderr, "pionic_init failed\n");
+    goto fail;
+  }
+
+  FILE *out = fopen("scaling_bench.csv", "w");
+  if (!out) {
+    perror("fopen");
+    goto fini;
+  }
+  fprintf(out, "threads,pps,pps_per_thread,efficiency\n");
+
+  for (int n = 1; n <= LAUBERHORN_NUM_CORES; ++n) {
+    double pps = run(ctx, n, burst, pld_len, seconds);
+
+    if (pps < 0)
+      goto close;
+    if (n == 1)
+      base = pps;
+
+    fprintf(out, "%d,%.0f,%.0f,%.3f\n", n, pps, pps / n, pps / (n * base));
+    printf("%d threads: %10.0f pps, %10.0f per thread, efficiency %.3f\n", n,
+           pps, pps / n, pps / (n * base));
+  }
+
+  ret = EXIT_SUCCESS;
+
+close:
+  fclose(out);
+fini:
+  pionic_fini(&ctx);
+fail:
+  return ret;
+}
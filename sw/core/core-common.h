@@ -13,7 +13,10 @@
 #include <asm/barrier.h>
 
 #define BARRIER dmb(sy)
-#define PREFETCH 
+#define BARRIER_LD dmb(ld)
+#define FENCE dmb(sy)
+#define PREFETCH(addr) prefetch(addr)
+#define CL_FETCH_HOOK(addr)
 
 // always print module name in pr_info, pr_err, etc.
 #ifdef pr_fmt
@@ -46,14 +49,36 @@
 
 #define pr_flush() fflush(stdout);
 
+#ifdef __aarch64__
 #define BARRIER asm volatile("dmb sy\nisb")
+// load-load/load-store ordering only; used between requests in a burst
+#define BARRIER_LD asm volatile("dmb ld" ::: "memory")
+// full ordering without the pipeline flush of BARRIER
+#define FENCE asm volatile("dmb sy" ::: "memory")
+#else
+// emulated NIC (rt/emu.c) on other architectures
+#define BARRIER __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define BARRIER_LD __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define FENCE __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
 
-// prototypes for critical section handling -- defined in rt/eci.c
+// prototypes for critical section handling -- defined in rt/eci.c (rt/emu.c)
 void enter_cs();
 void exit_cs();
 
-// prototype for prefetch -- defined in rt/eci.c
-void prefetchw(const void *ptr);
+// The NIC reacts to the CPU fetching a control CL (RX request, TX doorbell).
+// Real hardware sees the fetch on the interconnect; the emulated NIC needs to
+// be told explicitly
+#ifdef LAUBERHORN_EMU
+void emu_cl_fetch(void *addr);
+#define CL_FETCH_HOOK(addr) emu_cl_fetch(addr)
+#else
+#define CL_FETCH_HOOK(addr)
+#endif
+
+// same names as <linux/prefetch.h>
+#define PREFETCH(addr) __builtin_prefetch(addr, 0, 3)
+static inline void prefetchw(const void *ptr) { __builtin_prefetch(ptr, 1, 3); }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
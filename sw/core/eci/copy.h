@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: BSD-3-Clause OR GPL-2.0-only
+// Copyright (c) 2025 Pengcheng Xu
+
+// Copy kernels for moving payload in and out of the ECI cachelines.  Tuned for
+// the ThunderX-1 cache geometry: 128 B cachelines, with the first 64 B of
+// payload inlined in the second half of the control CL and the rest in whole
+// overflow CLs.
+//
+// - lauberhorn_copy_inline: up to one half-CL, with overlapping fixed-size
+//   loads/stores instead of a byte loop
+// - lauberhorn_copy_cl: whole CLs; NEON ld1/st1 in userspace, ldp/stp in the
+//   kernel (no FP/SIMD state without kernel_neon_begin)
+// - lauberhorn_copy_overflow: whole CLs followed by an exact tail
+//
+// Neither source nor destination is accessed past len bytes, so these are safe
+// for both directions (CL -> buffer for RX, buffer -> CL for TX).
+
+#ifndef LAUBERHORN_CORE_ECI_COPY_H
+#define LAUBERHORN_CORE_ECI_COPY_H
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#include <linux/types.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#endif
+
+#define LAUBERHORN_COPY_CL_SIZE 128
+#define LAUBERHORN_COPY_HALF_CL_SIZE 64
+
+// Fixed-size copies; the compiler lowers these to single (pairs of) loads and
+// stores without a call to memcpy
+#define __LAUBERHORN_COPY_N(n)                                                 \
+  static inline void __lauberhorn_copy##n(uint8_t *dst, const uint8_t *src) {  \
+    __builtin_memcpy(dst, src, n);                                             \
+  }
+__LAUBERHORN_COPY_N(4)
+__LAUBERHORN_COPY_N(8)
+__LAUBERHORN_COPY_N(16)
+__LAUBERHORN_COPY_N(32)
+#undef __LAUBERHORN_COPY_N
+
+// Copy up to 64 B (one inline half-CL)
+static inline void lauberhorn_copy_inline(void *dst, const void *src,
+                                          size_t len) {
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+
+  if (len >= 32) {
+    // 32..64: two possibly overlapping 32 B copies
+    __lauberhorn_copy32(d, s);
+    __lauberhorn_copy32(d + len - 32, s + len - 32);
+  } else if (len >= 16) {
+    __lauberhorn_copy16(d, s);
+    __lauberhorn_copy16(d + len - 16, s + len - 16);
+  } else if (len >= 8) {
+    __lauberhorn_copy8(d, s);
+    __lauberhorn_copy8(d + len - 8, s + len - 8);
+  } else if (len >= 4) {
+    __lauberhorn_copy4(d, s);
+    __lauberhorn_copy4(d + len - 4, s + len - 4);
+  } else if (len) {
+    d[0] = s[0];
+    d[len / 2] = s[len / 2];
+    d[len - 1] = s[len - 1];
+  }
+}
+
+// Copy ncl whole cachelines
+static inline void lauberhorn_copy_cl(void *dst, const void *src, size_t ncl) {
+#if defined(__aarch64__) && !defined(__KERNEL__)
+  asm volatile("cbz %[n], 2f\n"
+               "1:\n"
+               "ld1 {v0.16b-v3.16b}, [%[s]], #64\n"
+               "ld1 {v4.16b-v7.16b}, [%[s]], #64\n"
+               "subs %[n], %[n], #1\n"
+               "st1 {v0.16b-v3.16b}, [%[d]], #64\n"
+               "st1 {v4.16b-v7.16b}, [%[d]], #64\n"
+               "b.ne 1b\n"
+               "2:\n"
+               : [d] "+r"(dst), [s] "+r"(src), [n] "+r"(ncl)
+               :
+               : "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", "cc",
+                 "memory");
+#else
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+
+  for (; ncl; --ncl, d += LAUBERHORN_COPY_CL_SIZE,
+              s += LAUBERHORN_COPY_CL_SIZE) {
+    __lauberhorn_copy32(d, s);
+    __lauberhorn_copy32(d + 32, s + 32);
+    __lauberhorn_copy32(d + 64, s + 64);
+    __lauberhorn_copy32(d + 96, s + 96);
+  }
+#endif
+}
+
+// Copy len bytes to/from the overflow CLs: whole CLs first, then the tail
+static inline void lauberhorn_copy_overflow(void *dst, const void *src,
+                                            size_t len) {
+  size_t ncl = len / LAUBERHORN_COPY_CL_SIZE;
+  size_t done = ncl * LAUBERHORN_COPY_CL_SIZE;
+  uint8_t *d = (uint8_t *)dst + done;
+  const uint8_t *s = (const uint8_t *)src + done;
+  size_t tail = len - done;
+
+  lauberhorn_copy_cl(dst, src, ncl);
+
+  if (tail >= LAUBERHORN_COPY_HALF_CL_SIZE) {
+    __lauberhorn_copy32(d, s);
+    __lauberhorn_copy32(d + 32, s + 32);
+    d += LAUBERHORN_COPY_HALF_CL_SIZE;
+    s += LAUBERHORN_COPY_HALF_CL_SIZE;
+    tail -= LAUBERHORN_COPY_HALF_CL_SIZE;
+  }
+  lauberhorn_copy_inline(d, s, tail);
+}
+
+#endif // LAUBERHORN_CORE_ECI_COPY_H
@@ -10,12 +10,28 @@
 #define LAUBERHORN_CORE_ECI_CORE_H
 
 #include "core-common.h"
+#include "eci/copy.h"
 #include "eci/config.h"
 #include "lauberhorn_eci.h"
 
 #define LAUBERHORN_BYPASS_HDR_SIZE (LAUBERHORN_BYPASS_HDR_WIDTH / 8)
 #define LAUBERHORN_ONCRPC_INLINE_ARGS (LAUBERHORN_ONCRPC_INLINE_BYTES / 4)
 
+// Number of overflow CLs prefetched as soon as the payload length is known;
+// the copy streams the rest behind them.  ThunderX-1 tracks only a handful of
+// outstanding misses per core, so more does not help
+#ifndef LAUBERHORN_ECI_PREFETCH_CL
+#define LAUBERHORN_ECI_PREFETCH_CL 8
+#endif
+
+// Number of status CL fetches before giving up on a free TX slot.  The NIC
+// frees slots as fast as the link drains them; a ring that stays full for this
+// long means the NIC is stuck (e.g. link down), and the caller must not spin on
+// it forever (in the kernel, with the TX lock held)
+#ifndef LAUBERHORN_ECI_TX_POLL_MAX
+#define LAUBERHORN_ECI_TX_POLL_MAX 100000
+#endif
+
 // TODO: @PX move this to OncRpcReply.scala
 #define LAUBERHORN_ONC_RPC_REPLY_INLINE_SIZE 60
 
@@ -27,6 +43,15 @@ typedef enum {
   TY_ONCRPC_REPLY,
 } lauberhorn_pkt_desc_type_t;
 
+// payload split over the inline half-CL and the overflow CLs.  Points directly
+// into the cache-coherent area
+typedef struct {
+  uint8_t *inline_buf;
+  size_t inline_len;
+  uint8_t *overflow_buf;
+  size_t overflow_len;
+} lauberhorn_pkt_view_t;
+
 // descriptor for one packet / transaction
 typedef struct {
   lauberhorn_pkt_desc_type_t type;
@@ -39,6 +64,8 @@ typedef struct {
         HDR_IP,
         HDR_UDP,
       } header_type;
+      // UDP checksum present and verified by the NIC
+      bool csum_ok;
 
       uint8_t header[LAUBERHORN_BYPASS_HDR_SIZE];
       // remaining payload goes to payload_buf
@@ -47,27 +74,43 @@ typedef struct {
       int neigh_tbl_idx;
       uint32_t ip_addr;
     } arp_req;
+    // also used for nested calls (TY_ONCRPC_CALL on TX) and their replies
+    // (TY_ONCRPC_REPLY on RX): func_ptr is then the client procedure handle
+    // and xid is picked by the caller
     struct {
       void *func_ptr;
       int xid;
 
       int tx_inline_words;
+      // RX: number of valid bytes in args
+      int args_len;
       uint32_t args[LAUBERHORN_ONCRPC_INLINE_ARGS];
       // remaining args go to payload_buf
     } oncrpc_server;
   };
 
-  // extra payload
+  // extra payload; on TX, NULL if the payload was serialized in place into
+  // the slot handed out by core_eci_tx_prepare_view (or if there is none)
   uint8_t *payload_buf;
   size_t payload_len;
+
+  // zero-copy view of the payload in the RX cachelines (core_eci_rx_view)
+  lauberhorn_pkt_view_t view;
 } lauberhorn_pkt_desc_t;
 
 typedef struct {
   uint8_t rx_next_cl;
+  bool rx_view_held;
   uint8_t *rx_overflow_buf;
   int rx_overflow_buf_size;
 
-  uint8_t tx_next_cl;
+  // TX ring: slots filled and slots consumed by the NIC (as last seen), both
+  // free-running
+  uint16_t tx_prod;
+  uint16_t tx_cons;
+  // the slot at tx_prod is handed out by core_eci_tx_prepare_view; only the
+  // descriptor with the view may be sent until then
+  bool tx_view_held;
   uint8_t *tx_overflow_buf;
   int tx_overflow_buf_size;
 } lauberhorn_core_state_t;
@@ -86,11 +129,13 @@ typedef struct {
 //                        + LAUBERHORN_ECI_OVERFLOW_OFFSET      RX overflow cachelines
 // (count: LAUBERHORN_ECI_NUM_OVERFLOW_CL)
 //
-// LAUBERHORN_ECI_TX_BASE                                       ECI host control info for TX - host_ctrl_info_*_t
-//                        + 0x40                                TX inline data
-//                        + 0x80                                the other TX CL
-//                        + LAUBERHORN_ECI_OVERFLOW_OFFSET      TX overflow cachelines
+// LAUBERHORN_ECI_TX_BASE                                       TX ring (count: LAUBERHORN_ECI_TX_RING_SLOTS)
+//   + slot * LAUBERHORN_ECI_TX_SLOT_STRIDE                     ECI host control info for TX - host_ctrl_info_*_t
+//          + 0x40                                              TX inline data
+//          + LAUBERHORN_ECI_TX_DOORBELL_OFFSET                 doorbell of the slot - tx_ring_status_t
+//          + LAUBERHORN_ECI_OVERFLOW_OFFSET                    TX overflow cachelines
 // (count: LAUBERHORN_ECI_NUM_OVERFLOW_CL)
+//          + LAUBERHORN_ECI_TX_STATUS_OFFSET                   TX ring status - tx_ring_status_t (slot 0 only)
 //
 // LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET                           preemption control CL (non-bypass)
 //
@@ -103,163 +148,417 @@ static_assert(LAUBERHORN_ECI_TX_BASE >=
                   LAUBERHORN_ECI_OVERFLOW_OFFSET +
                       LAUBERHORN_ECI_NUM_OVERFLOW_CL * LAUBERHORN_ECI_CL_SIZE,
               "TX control CL should not overlap with RX overflow CL");
-static_assert(LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET >=
-                  LAUBERHORN_ECI_TX_BASE + LAUBERHORN_ECI_OVERFLOW_OFFSET +
+static_assert((LAUBERHORN_ECI_TX_RING_SLOTS &
+               (LAUBERHORN_ECI_TX_RING_SLOTS - 1)) == 0,
+              "TX ring slots should be a power of two");
+static_assert(LAUBERHORN_ECI_TX_DOORBELL_OFFSET == LAUBERHORN_ECI_CL_SIZE,
+              "TX doorbell should be between control and overflow CLs");
+static_assert(LAUBERHORN_ECI_TX_STATUS_OFFSET >=
+                  LAUBERHORN_ECI_OVERFLOW_OFFSET +
                       LAUBERHORN_ECI_NUM_OVERFLOW_CL * LAUBERHORN_ECI_CL_SIZE,
-              "preempt control CL should not overlap with TX overflow CL");
+              "TX ring status CL should not overlap with TX overflow CL");
+static_assert(LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET >=
+                  LAUBERHORN_ECI_TX_BASE + LAUBERHORN_ECI_TX_RING_SLOTS *
+                                               LAUBERHORN_ECI_TX_SLOT_STRIDE,
+              "preempt control CL should not overlap with TX ring");
 static_assert(
     LAUBERHORN_ECI_CORE_OFFSET >=
         LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET + LAUBERHORN_ECI_CL_SIZE,
     "preempt control CL should not overlap with RX control CL in next core");
 
-static inline bool core_eci_rx(void *base, lauberhorn_core_state_t *ctx,
-                               lauberhorn_pkt_desc_t *desc) {
+// Decode the host control info in the current RX control CL into desc.
+// Payload pointers are left untouched; see core_eci_rx and core_eci_rx_view.
+static inline void core_eci_rx_decode(uint8_t *rx_base,
+                                      lauberhorn_pkt_desc_t *desc) {
+  lauberhorn_eci_packet_desc_type_t ty =
+      lauberhorn_eci_host_ctrl_info_error_ty_extract(rx_base);
 
-  // make sure previous RX/TX actually took effect before we attempt to RX
-  BARRIER;
+#ifdef __KERNEL__
+  BUG_ON(ty != lauberhorn_eci_bypass && ty != lauberhorn_eci_arp_req);
+#endif
 
-  enter_cs();
+  switch (ty) {
+  case lauberhorn_eci_bypass:
+    size_t bypass_hdr_len;
+
+    desc->type = TY_BYPASS;
+
+    // decode header type
+    switch (lauberhorn_eci_host_ctrl_info_bypass_hdr_ty_extract(rx_base)) {
+    case lauberhorn_eci_hdr_ethernet:
+      desc->bypass.header_type = HDR_ETHERNET;
+      bypass_hdr_len = 14;
+      break;
+    case lauberhorn_eci_hdr_ip:
+      desc->bypass.header_type = HDR_IP;
+      bypass_hdr_len = 14 + 20;
+      break;
+    case lauberhorn_eci_hdr_udp:
+      desc->bypass.header_type = HDR_UDP;
+      bypass_hdr_len = 14 + 20 + 8;
+      break;
+    default:
+      pr_err("unexpected bypass packet type: %s\n",
+             lauberhorn_eci_packet_desc_type_describe(ty));
+      desc->bypass.header_type = HDR_ERROR;
+      bypass_hdr_len = LAUBERHORN_BYPASS_HDR_SIZE;
+    }
+    desc->bypass.csum_ok =
+        lauberhorn_eci_host_ctrl_info_bypass_csum_ok_extract(rx_base);
+
+    // parsed bypass header is aligned after the descriptor header
+    memcpy(desc->bypass.header,
+           rx_base + lauberhorn_eci_host_ctrl_info_bypass_size,
+           bypass_hdr_len);
+
+    break;
+
+  case lauberhorn_eci_onc_rpc_call:
+  case lauberhorn_eci_onc_rpc_reply:
+    desc->type =
+        ty == lauberhorn_eci_onc_rpc_call ? TY_ONCRPC_CALL : TY_ONCRPC_REPLY;
+    desc->oncrpc_server.func_ptr =
+        (void *)lauberhorn_eci_host_ctrl_info_onc_rpc_server_func_ptr_extract(
+            rx_base);
+    desc->oncrpc_server.xid =
+        lauberhorn_eci_host_ctrl_info_onc_rpc_server_xid_extract(rx_base);
+
+    // parsed oncrpc arguments are aligned after the descriptor header; only
+    // copy what the decoder actually found in the packet
+    desc->oncrpc_server.args_len =
+        lauberhorn_eci_host_ctrl_info_onc_rpc_server_args_len_extract(rx_base);
+    assert(desc->oncrpc_server.args_len <= sizeof(desc->oncrpc_server.args));
+    lauberhorn_copy_inline(
+        desc->oncrpc_server.args,
+        rx_base + lauberhorn_eci_host_ctrl_info_onc_rpc_server_size,
+        desc->oncrpc_server.args_len);
+
+    break;
+
+  case lauberhorn_eci_arp_req:
+    desc->type = TY_ARP_REQ;
+    desc->arp_req.neigh_tbl_idx =
+        lauberhorn_eci_host_ctrl_info_arp_req_tbl_idx_extract(rx_base);
+    desc->arp_req.ip_addr =
+        lauberhorn_eci_host_ctrl_info_arp_req_ip_addr_extract(rx_base);
+    break;
+  default:
+    desc->type = TY_ERROR;
+  }
+}
+
+// Prefetch the first overflow CLs behind desc->view
+static inline void core_eci_rx_prefetch_overflow(lauberhorn_pkt_desc_t *desc) {
+  size_t ncl = (desc->view.overflow_len + LAUBERHORN_ECI_CL_SIZE - 1) /
+               LAUBERHORN_ECI_CL_SIZE;
+
+  if (ncl > LAUBERHORN_ECI_PREFETCH_CL)
+    ncl = LAUBERHORN_ECI_PREFETCH_CL;
+  for (size_t i = 0; i < ncl; ++i)
+    PREFETCH(desc->view.overflow_buf + i * LAUBERHORN_ECI_CL_SIZE);
+}
+
+// Prefetch the control CL of the next RX parity.  To the NIC this is the next
+// RX request: it acks the current one (the CLs must not be accessed anymore)
+// and, on worker cores, the fill may stall for the RX block cycles in the
+// memory system instead of in the next core_eci_rx.  Only pays off on cores
+// dedicated to one thread, hence opt-in with LAUBERHORN_ECI_RX_PREFETCH_NEXT.
+// Must be issued inside the critical section: no RX request may reach the NIC
+// while the thread is being preempted.
+static inline void core_eci_rx_prefetch_next(void *base,
+                                             lauberhorn_core_state_t *ctx) {
+#ifdef LAUBERHORN_ECI_RX_PREFETCH_NEXT
+  PREFETCH((uint8_t *)base + LAUBERHORN_ECI_RX_BASE +
+           ctx->rx_next_cl * LAUBERHORN_ECI_CL_SIZE);
+#endif
+}
 
+// Read the control CL of the current RX parity and toggle the parity.  If it
+// carries a request, decode it into desc and point desc->view into the RX
+// cachelines.  The caller handles the critical section and the ordering
+// against earlier accesses.
+static inline bool core_eci_rx_fetch(void *base, lauberhorn_core_state_t *ctx,
+                                     lauberhorn_pkt_desc_t *desc) {
   bool rx_parity = ctx->rx_next_cl;
   pr_debug("eci_rx: current cacheline ID: %d\n", rx_parity);
 
   uint8_t *rx_base = (uint8_t *)base + (LAUBERHORN_ECI_RX_BASE +
                                         rx_parity * LAUBERHORN_ECI_CL_SIZE);
 
+  CL_FETCH_HOOK(rx_base);
   bool valid = lauberhorn_eci_host_ctrl_info_error_valid_extract(rx_base);
-  BARRIER; // make sure the CL is actually read
+  BARRIER_LD; // make sure the CL is actually read before the payload
 
   // always toggle CL
   ctx->rx_next_cl = !rx_parity;
 
-  // decode the packet
   if (!valid) {
     pr_debug("eci_rx: did not get a packet\n");
-  } else {
+    return false;
+  }
 
-    size_t pkt_len = lauberhorn_eci_host_ctrl_info_error_len_extract(rx_base);
-    pr_debug("eci_rx: got a packet with len %#lx\n", pkt_len);
+  size_t pkt_len = lauberhorn_eci_host_ctrl_info_error_len_extract(rx_base);
+  pr_debug("eci_rx: got a packet with len %#lx\n", pkt_len);
 
-    lauberhorn_eci_packet_desc_type_t ty =
-        lauberhorn_eci_host_ctrl_info_error_ty_extract(rx_base);
+  assert(pkt_len <= LAUBERHORN_ECI_INLINE_DATA_SIZE +
+                        LAUBERHORN_ECI_NUM_OVERFLOW_CL * LAUBERHORN_ECI_CL_SIZE);
 
-#ifdef __KERNEL__
-    BUG_ON(ty != lauberhorn_eci_bypass || ty != lauberhorn_eci_arp_req);
-#endif
+  // overflow CLs are shared by both parities and sit at a fixed offset
+  // from the RX base (see overflowIdxToAddr in EciDecoupledRxTxProtocol)
+  desc->view.inline_buf = rx_base + LAUBERHORN_ECI_INLINE_DATA_OFFSET;
+  desc->view.inline_len = min(LAUBERHORN_ECI_INLINE_DATA_SIZE, pkt_len);
+  desc->view.overflow_buf = (uint8_t *)base + LAUBERHORN_ECI_RX_BASE +
+                            LAUBERHORN_ECI_OVERFLOW_OFFSET;
+  desc->view.overflow_len = pkt_len - desc->view.inline_len;
 
-    switch (ty) {
-    case lauberhorn_eci_bypass:
-      size_t bypass_hdr_len;
+  // the length tells exactly which overflow CLs the copy will touch; start
+  // the coherent fetches now, so that they overlap with the decode
+  core_eci_rx_prefetch_overflow(desc);
 
-      desc->type = TY_BYPASS;
+  core_eci_rx_decode(rx_base, desc);
 
-      // decode header type
-      switch (lauberhorn_eci_host_ctrl_info_bypass_hdr_ty_extract(rx_base)) {
-      case lauberhorn_eci_hdr_ethernet:
-        desc->bypass.header_type = HDR_ETHERNET;
-        bypass_hdr_len = 14;
-        break;
-      case lauberhorn_eci_hdr_ip:
-        desc->bypass.header_type = HDR_IP;
-        bypass_hdr_len = 14 + 20;
-        break;
-      case lauberhorn_eci_hdr_udp:
-        desc->bypass.header_type = HDR_UDP;
-        bypass_hdr_len = 14 + 20 + 8;
-        break;
-      default:
-        pr_err("unexpected bypass packet type: %s\n",
-               lauberhorn_eci_packet_desc_type_describe(ty));
-        desc->bypass.header_type = HDR_ERROR;
-        bypass_hdr_len = LAUBERHORN_BYPASS_HDR_SIZE;
-      }
+  desc->payload_buf = NULL;
+  desc->payload_len = pkt_len;
 
-      // parsed bypass header is aligned after the descriptor header
-      memcpy(desc->bypass.header,
-             rx_base + lauberhorn_eci_host_ctrl_info_bypass_size,
-             bypass_hdr_len);
+  return true;
+}
 
-      break;
+// Copy the payload behind desc->view into buf (of size bytes) and drop the view.
+static inline void core_eci_rx_copy(lauberhorn_pkt_desc_t *desc, uint8_t *buf,
+                                    size_t size) {
+  if (desc->payload_len != 0) {
+    assert(desc->payload_len <= size);
+
+    desc->payload_buf = buf;
+    lauberhorn_copy_inline(buf, desc->view.inline_buf, desc->view.inline_len);
+    if (desc->view.overflow_len) {
+      lauberhorn_copy_overflow(buf + desc->view.inline_len,
+                               desc->view.overflow_buf,
+                               desc->view.overflow_len);
+    }
+  }
 
-    case lauberhorn_eci_onc_rpc_call:
-      desc->type = TY_ONCRPC_CALL;
-      desc->oncrpc_server.func_ptr =
-          (void *)lauberhorn_eci_host_ctrl_info_onc_rpc_server_func_ptr_extract(
-              rx_base);
-      desc->oncrpc_server.xid =
-          lauberhorn_eci_host_ctrl_info_onc_rpc_server_xid_extract(rx_base);
+  desc->view.inline_buf = desc->view.overflow_buf = NULL;
+  desc->view.inline_len = desc->view.overflow_len = 0;
+}
 
-      // parsed oncrpc arguments are aligned after the descriptor header
-      // XXX: we don't have the actual count of args, copy maximum
-      memcpy(desc->oncrpc_server.args,
-             rx_base + lauberhorn_eci_host_ctrl_info_onc_rpc_server_size,
-             sizeof(desc->oncrpc_server.args));
+// Fetch the next request and point desc->view into the RX cachelines, without
+// copying the payload.  The first LAUBERHORN_ECI_INLINE_DATA_SIZE bytes live in
+// the second half of the control CL; the rest in the overflow CLs.
+//
+// The NIC only reclaims (invalidates) these cachelines once the CPU reads the
+// opposite parity CL, i.e. on the next RX on this core.  The view stays valid
+// until then; the caller must release it with core_eci_rx_ack before issuing
+// the next RX.
+static inline bool core_eci_rx_view(void *base, lauberhorn_core_state_t *ctx,
+                                    lauberhorn_pkt_desc_t *desc) {
 
-      break;
+  assert(!ctx->rx_view_held && "previous RX view not released");
 
-    case lauberhorn_eci_arp_req:
-      desc->type = TY_ARP_REQ;
-      desc->arp_req.neigh_tbl_idx =
-          lauberhorn_eci_host_ctrl_info_arp_req_tbl_idx_extract(rx_base);
-      desc->arp_req.ip_addr =
-          lauberhorn_eci_host_ctrl_info_arp_req_ip_addr_extract(rx_base);
-      break;
-    default:
-      desc->type = TY_ERROR;
-    }
+  // make sure previous RX/TX actually took effect before we attempt to RX
+  BARRIER;
 
-    if (pkt_len == 0) {
-      desc->payload_buf = NULL;
-      desc->payload_len = 0;
-    } else {
-      desc->payload_buf = ctx->rx_overflow_buf;
-      desc->payload_len = pkt_len;
-
-      assert(pkt_len <= ctx->rx_overflow_buf_size);
-
-      int first_read_size = pkt_len > LAUBERHORN_ECI_INLINE_DATA_SIZE
-                                ? LAUBERHORN_ECI_INLINE_DATA_SIZE
-                                : pkt_len;
-      memcpy(desc->payload_buf, rx_base + LAUBERHORN_ECI_INLINE_DATA_OFFSET,
-             first_read_size);
-      if (pkt_len > LAUBERHORN_ECI_INLINE_DATA_SIZE) {
-        memcpy(desc->payload_buf + LAUBERHORN_ECI_INLINE_DATA_SIZE,
-               rx_base + LAUBERHORN_ECI_OVERFLOW_OFFSET,
-               pkt_len - LAUBERHORN_ECI_INLINE_DATA_SIZE);
-      }
-    }
+  enter_cs();
+
+  bool valid = core_eci_rx_fetch(base, ctx, desc);
+  ctx->rx_view_held = valid;
+
+  BARRIER; // make sure !BUSY comes after
+
+  exit_cs();
+
+  return valid;
+}
+
+// Release a view obtained from core_eci_rx_view.  The cachelines themselves are
+// handed back to the NIC by the parity toggle on the next RX.
+static inline void core_eci_rx_ack(lauberhorn_core_state_t *ctx,
+                                   lauberhorn_pkt_desc_t *desc) {
+  ctx->rx_view_held = false;
+
+  desc->view.inline_buf = desc->view.overflow_buf = NULL;
+  desc->view.inline_len = desc->view.overflow_len = 0;
+}
+
+// Fetch the next request and copy the payload into ctx->rx_overflow_buf.
+//
+// The copy happens inside the critical section, such that the prefetch of the
+// next control CL (an RX request to the NIC) cannot land during a preemption.
+static inline bool core_eci_rx(void *base, lauberhorn_core_state_t *ctx,
+                               lauberhorn_pkt_desc_t *desc) {
+  assert(!ctx->rx_view_held && "previous RX view not released");
+
+  // make sure previous RX/TX actually took effect before we attempt to RX
+  BARRIER;
+
+  enter_cs();
 
-    // All data in software buf, good to exit the critical section
+  bool valid = core_eci_rx_fetch(base, ctx, desc);
+  if (valid) {
+    // All data in software buf, nothing refers to the CLs anymore
+    core_eci_rx_copy(desc, ctx->rx_overflow_buf, ctx->rx_overflow_buf_size);
+
+    BARRIER_LD; // the copy must be done before the NIC sees the next request
+    core_eci_rx_prefetch_next(base, ctx);
   }
 
   BARRIER; // make sure !BUSY comes after
 
   exit_cs();
 
-  // Done
   return valid;
 }
 
+// Receive up to n requests in one critical section.  Since the overflow CLs are
+// reused by the next request, each payload is copied out to descs[i].payload_buf,
+// which the caller sets up with a capacity of descs[i].payload_len bytes.
+// Stops at the first NACK; returns the number of requests received.
+//
+// Only one full barrier is issued on entry and on exit; consecutive requests
+// are ordered with load barriers.  Note that on worker cores, the NACK that
+// ends the burst still stalls for the RX block cycles.
+static inline int core_eci_rx_burst(void *base, lauberhorn_core_state_t *ctx,
+                                    lauberhorn_pkt_desc_t *descs, int n) {
+  int i;
+
+  assert(!ctx->rx_view_held && "previous RX view not released");
+
+  // make sure previous RX/TX actually took effect before we attempt to RX
+  BARRIER;
+
+  enter_cs();
+
+  for (i = 0; i < n; ++i) {
+    uint8_t *buf = descs[i].payload_buf;
+    size_t size = descs[i].payload_len;
+
+    if (!core_eci_rx_fetch(base, ctx, &descs[i]))
+      break;
+
+    core_eci_rx_copy(&descs[i], buf, size);
+
+    // the next control CL read acks this request; keep it after the copy
+    BARRIER_LD;
+  }
+
+  BARRIER; // make sure !BUSY comes after
+
+  exit_cs();
+
+  return i;
+}
+
 static inline void core_eci_tx_prepare_desc(lauberhorn_pkt_desc_t *desc,
                                             lauberhorn_core_state_t *ctx) {
   desc->payload_buf = ctx->tx_overflow_buf;
   desc->payload_len = ctx->tx_overflow_buf_size;
 }
 
-static inline void core_eci_tx(void *base, lauberhorn_core_state_t *ctx,
-                               lauberhorn_pkt_desc_t *desc) {
-  // ECI backend: do not release payload_buf
+static inline uint8_t *core_eci_tx_slot(void *base, uint16_t idx) {
+  return (uint8_t *)base + LAUBERHORN_ECI_TX_BASE +
+         (idx & (LAUBERHORN_ECI_TX_RING_SLOTS - 1)) *
+             LAUBERHORN_ECI_TX_SLOT_STRIDE;
+}
 
-  // make sure previous RX/TX actually took effect before we attempt to RX
-  BARRIER;
+// Fetch a doorbell or the status CL; the NIC answers with the number of slots
+// it has consumed so far
+static inline uint16_t core_eci_tx_read_status(uint8_t *cl) {
+  uint64_t status;
 
-  enter_cs();
+  CL_FETCH_HOOK(cl);
+  status = *(volatile uint64_t *)cl;
+  return lauberhorn_eci_tx_ring_status_consumed_extract((uint8_t *)&status);
+}
 
-  bool tx_parity = ctx->tx_next_cl;
-  pr_debug("eci_tx: current cacheline ID: %d\n", tx_parity);
+static inline bool core_eci_tx_ring_full(lauberhorn_core_state_t *ctx) {
+  return (uint16_t)(ctx->tx_prod - ctx->tx_cons) >=
+         LAUBERHORN_ECI_TX_RING_SLOTS;
+}
+
+// Fetch the status CL once and update tx_cons
+static inline void core_eci_tx_poll(void *base, lauberhorn_core_state_t *ctx) {
+  ctx->tx_cons = core_eci_tx_read_status(core_eci_tx_slot(base, 0) +
+                                         LAUBERHORN_ECI_TX_STATUS_OFFSET);
+}
+
+// Wait until the slot at tx_prod is free, for at most
+// LAUBERHORN_ECI_TX_POLL_MAX status fetches.  The status CL stays in the cache
+// until the NIC invalidates it, so spinning on it is cheap.  Returns false if
+// the ring is still full.
+static inline bool core_eci_tx_wait_slot(void *base,
+                                         lauberhorn_core_state_t *ctx) {
+  int polls = 0;
+
+  while (core_eci_tx_ring_full(ctx)) {
+    if (polls++ == LAUBERHORN_ECI_TX_POLL_MAX)
+      return false;
+    core_eci_tx_poll(base, ctx);
+  }
 
-  uint8_t *tx_base = (uint8_t *)base + LAUBERHORN_ECI_TX_BASE +
-                     tx_parity * LAUBERHORN_ECI_CL_SIZE;
+  return true;
+}
+
+// Hand out the next free TX ring slot in desc->view, so that the
+// caller can serialize the payload in place.  The view lengths are capacities
+// on return; fill the inline half-CL first and set desc->payload_len to the
+// total number of bytes written before calling core_eci_tx.  The slot stays
+// reserved for desc until then: sending another payload is refused.
+//
+// No critical section is held here: the NIC only touches a TX slot after its
+// doorbell, and each thread has its own CL window even across preemption.
+// Returns false, without a view, if no slot became free.
+static inline bool core_eci_tx_prepare_view(void *base,
+                                            lauberhorn_core_state_t *ctx,
+                                            lauberhorn_pkt_desc_t *desc) {
+  uint8_t *tx_base;
+
+  if (!core_eci_tx_wait_slot(base, ctx))
+    return false;
+  tx_base = core_eci_tx_slot(base, ctx->tx_prod);
+
+  desc->view.inline_buf = tx_base + LAUBERHORN_ECI_INLINE_DATA_OFFSET;
+  desc->view.inline_len = LAUBERHORN_ECI_INLINE_DATA_SIZE;
+  desc->view.overflow_buf = tx_base + LAUBERHORN_ECI_OVERFLOW_OFFSET;
+  desc->view.overflow_len =
+      LAUBERHORN_ECI_NUM_OVERFLOW_CL * LAUBERHORN_ECI_CL_SIZE;
+
+  desc->payload_buf = NULL;
+  desc->payload_len = 0;
+
+  ctx->tx_view_held = true;
+  return true;
+}
+
+// Write the control info (and the payload, unless it was serialized in place)
+// of desc into the free TX ring slot at tx_prod.  Returns false if desc cannot
+// be sent.  The caller handles the critical section and barriers, waits for
+// the slot to be free and advances tx_prod.
+static inline bool core_eci_tx_fill(void *base, lauberhorn_core_state_t *ctx,
+                                    lauberhorn_pkt_desc_t *desc) {
+  pr_debug("eci_tx: current ring slot: %d\n", ctx->tx_prod);
+
+  uint8_t *tx_base = core_eci_tx_slot(base, ctx->tx_prod);
+
+  // a held slot is reserved for the payload serialized into it
+  if (ctx->tx_view_held && desc->payload_buf != NULL) {
+    pr_err("eci_tx: TX slot %d is held by a view\n", ctx->tx_prod);
+    return false;
+  }
+
+  // get the overflow CLs the payload goes to in exclusive state while the
+  // control info is written
+  if (desc->payload_buf != NULL &&
+      desc->payload_len > LAUBERHORN_ECI_INLINE_DATA_SIZE) {
+    size_t ncl = (desc->payload_len - LAUBERHORN_ECI_INLINE_DATA_SIZE +
+                  LAUBERHORN_ECI_CL_SIZE - 1) /
+                 LAUBERHORN_ECI_CL_SIZE;
+    uint8_t *overflow = tx_base + LAUBERHORN_ECI_OVERFLOW_OFFSET;
+
+    if (ncl > LAUBERHORN_ECI_PREFETCH_CL)
+      ncl = LAUBERHORN_ECI_PREFETCH_CL;
+    for (size_t i = 0; i < ncl; ++i)
+      prefetchw(overflow + i * LAUBERHORN_ECI_CL_SIZE);
+  }
 
   switch (desc->type) {
   case TY_BYPASS:
@@ -267,6 +566,8 @@ static inline void core_eci_tx(void *base, lauberhorn_core_state_t *ctx,
 
     lauberhorn_eci_host_ctrl_info_error_ty_insert(tx_base,
                                                   lauberhorn_eci_bypass);
+    lauberhorn_eci_host_ctrl_info_bypass_len_insert(tx_base,
+                                                    desc->payload_len);
     switch (desc->bypass.header_type) {
     case HDR_ETHERNET:
       bypass_hdr_len = 14;
@@ -276,7 +577,7 @@ static inline void core_eci_tx(void *base, lauberhorn_core_state_t *ctx,
     default:
       pr_err("bypass TX only accepts Ethernet packets; trying to send %s\n",
              lauberhorn_eci_packet_desc_type_describe(desc->type));
-      goto out;
+      return false;
     }
 
     // inlined bypass header
@@ -284,53 +585,151 @@ static inline void core_eci_tx(void *base, lauberhorn_core_state_t *ctx,
            desc->bypass.header, bypass_hdr_len);
     break;
 
+  case TY_ONCRPC_CALL:
   case TY_ONCRPC_REPLY:
+    // only the total length goes to the NIC: it takes the inline words first
+    assert(desc->payload_len == 0 || desc->oncrpc_server.tx_inline_words ==
+                                         LAUBERHORN_ONCRPC_INLINE_ARGS);
     lauberhorn_eci_host_ctrl_info_onc_rpc_server_ty_insert(
-        tx_base, lauberhorn_eci_onc_rpc_reply);
+        tx_base, desc->type == TY_ONCRPC_CALL ? lauberhorn_eci_onc_rpc_call
+                                              : lauberhorn_eci_onc_rpc_reply);
     lauberhorn_eci_host_ctrl_info_onc_rpc_server_len_insert(
         tx_base, desc->oncrpc_server.tx_inline_words * 4 + desc->payload_len);
-
-    // inlined ONCRPC words
-    memcpy(tx_base + lauberhorn_eci_host_ctrl_info_onc_rpc_reply_size,
+    // session lookup in the reply encoder, client lookup in the call encoder
+    lauberhorn_eci_host_ctrl_info_onc_rpc_server_xid_insert(
+        tx_base, desc->oncrpc_server.xid);
+    lauberhorn_eci_host_ctrl_info_onc_rpc_server_func_ptr_insert(
+        tx_base, (uint64_t)desc->oncrpc_server.func_ptr);
+
+    // inlined ONCRPC words, at the same place as the call arguments
+    memcpy(tx_base + lauberhorn_eci_host_ctrl_info_onc_rpc_server_size,
            desc->oncrpc_server.args, desc->oncrpc_server.tx_inline_words * 4);
     break;
 
   default:
     pr_err("eci_tx: unhandled host request type %d\n", desc->type);
-    break;
+    return false;
   }
 
-  if (desc->payload_buf != NULL) {
-    assert(desc->payload_len <=
-           LAUBERHORN_ECI_INLINE_DATA_SIZE +
-               LAUBERHORN_ECI_NUM_OVERFLOW_CL * LAUBERHORN_ECI_CL_SIZE);
+  assert(desc->payload_len <=
+         LAUBERHORN_ECI_INLINE_DATA_SIZE +
+             LAUBERHORN_ECI_NUM_OVERFLOW_CL * LAUBERHORN_ECI_CL_SIZE);
 
+  if (desc->payload_buf == NULL) {
+    // payload already serialized in place (core_eci_tx_prepare_view)
+    ctx->tx_view_held = false;
+  } else {
     // fill second half-CL in control CL first
     int first_write_size =
         min(LAUBERHORN_ECI_INLINE_DATA_SIZE, desc->payload_len);
-    memcpy((void *)(tx_base + LAUBERHORN_ECI_INLINE_DATA_OFFSET),
-           desc->payload_buf, first_write_size);
+    lauberhorn_copy_inline(tx_base + LAUBERHORN_ECI_INLINE_DATA_OFFSET,
+                           desc->payload_buf, first_write_size);
 
-    // fill overflow CLs
+    // fill overflow CLs of the slot
     if (desc->payload_len > LAUBERHORN_ECI_INLINE_DATA_SIZE) {
-      memcpy(tx_base + LAUBERHORN_ECI_OVERFLOW_OFFSET,
-             desc->payload_buf + LAUBERHORN_ECI_INLINE_DATA_SIZE,
-             desc->payload_len - LAUBERHORN_ECI_INLINE_DATA_SIZE);
+      lauberhorn_copy_overflow(
+          tx_base + LAUBERHORN_ECI_OVERFLOW_OFFSET,
+          desc->payload_buf + LAUBERHORN_ECI_INLINE_DATA_SIZE,
+          desc->payload_len - LAUBERHORN_ECI_INLINE_DATA_SIZE);
     }
   }
-  BARRIER; // make sure all data is written before we ring the doorbell
 
-  // Flip the parity
-  ctx->tx_next_cl = !tx_parity;
+  return true;
+}
+
+// Ring the doorbell of the last filled slot.  Doorbells are cumulative: this
+// hands all filled slots up to it to the NIC, which sends them in the
+// background.  All writes to the TX CLs must be ordered before this.
+static inline void core_eci_tx_doorbell(void *base,
+                                        lauberhorn_core_state_t *ctx) {
+  uint8_t *doorbell = core_eci_tx_slot(base, ctx->tx_prod - 1) +
+                      LAUBERHORN_ECI_TX_DOORBELL_OFFSET;
+
+  ctx->tx_cons = core_eci_tx_read_status(doorbell);
+}
+
+// Send desc in the next ring slot.  Returns false if it was not sent: the
+// ring stayed full, or desc cannot be sent at all.  A view from
+// core_eci_tx_prepare_view always has its slot.
+static inline bool core_eci_tx(void *base, lauberhorn_core_state_t *ctx,
+                               lauberhorn_pkt_desc_t *desc) {
+  bool sent = false;
+
+  // ECI backend: do not release payload_buf
+
+  // make sure previous RX/TX actually took effect before we attempt to RX
+  BARRIER;
+
+  enter_cs();
 
-  // Ring the doorbell: read next CL to trigger send
-  (void)*(uint8_t *)(base + LAUBERHORN_ECI_TX_BASE +
-                     !tx_parity * LAUBERHORN_ECI_CL_SIZE);
+  if (core_eci_tx_wait_slot(base, ctx) && core_eci_tx_fill(base, ctx, desc)) {
+    BARRIER; // make sure all data is written before we ring the doorbell
+
+    ++ctx->tx_prod;
+    core_eci_tx_doorbell(base, ctx);
+    sent = true;
+  }
 
-out:
   BARRIER; // make sure !BUSY comes after
 
   exit_cs();
+
+  return sent;
+}
+
+// Send n packets in one critical section, in order; returns the number of
+// packets sent.  The burst stops early when the ring stays full
+// (core_eci_tx_wait_slot timed out), or at a descriptor core_eci_tx_fill does
+// not take, which is marked TY_ERROR.  Payloads must be in
+// descs[i].payload_buf: a view only covers one ring slot.
+//
+// The doorbell is rung once for the whole burst, or whenever the ring fills
+// up.  It still needs the preceding CL writes to be visible, but only as a
+// plain dmb; the full barrier is issued once on entry and on exit.
+static inline int core_eci_tx_burst(void *base, lauberhorn_core_state_t *ctx,
+                                    lauberhorn_pkt_desc_t *descs, int n) {
+  int i, sent = 0, unrung = 0;
+
+  assert(!ctx->tx_view_held && "in-place TX not supported in a burst");
+
+  // make sure previous RX/TX actually took effect before we attempt to TX
+  BARRIER;
+
+  enter_cs();
+
+  for (i = 0; i < n; ++i) {
+    if (core_eci_tx_ring_full(ctx)) {
+      // hand over what we have, so that the NIC can free up slots
+      if (unrung) {
+        FENCE; // CL writes before the doorbell read
+        core_eci_tx_doorbell(base, ctx);
+        unrung = 0;
+      }
+      if (!core_eci_tx_wait_slot(base, ctx))
+        break;
+    }
+
+    if (!core_eci_tx_fill(base, ctx, &descs[i])) {
+      // already logged; tell the caller which one
+      descs[i].type = TY_ERROR;
+      break;
+    }
+
+    ++ctx->tx_prod;
+    ++unrung;
+    ++sent;
+  }
+
+  if (unrung) {
+    FENCE; // CL writes before the doorbell read
+    core_eci_tx_doorbell(base, ctx);
+  }
+
+  BARRIER; // make sure !BUSY comes after
+
+  exit_cs();
+
+  return sent;
 }
 
 #endif // LAUBERHORN_CORE_ECI_CORE_H
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: BSD-3-Clause OR GPL-2.0-only
+// Copyright (c) 2025 Pengcheng Xu
+
+// Copy kernel for moving TX payload into the packet buffer over PCIe.  The
+// packet buffer part of the BAR is mapped write-combining (rt/pcie.c), so
+// stores are merged into posted writes instead of going out one by one.
+//
+// - lauberhorn_pcie_copy_to_wc: whole 64 B blocks with non-temporal stores
+//   (stnp of NEON registers on aarch64, movntdq on x86-64); the tail is padded
+//   to a whole block in a bounce buffer, so that every block leaves as one full
+//   burst
+//
+// The destination must be 64 B aligned and have room up to the next 64 B
+// boundary after len; TX slot buffers are ROUNDED_MTU apart, so they do.  The
+// stores are only ordered by the fence before the doorbell
+// (core_pcie_tx_doorbell).
+
+#ifndef LAUBERHORN_CORE_PCIE_COPY_H
+#define LAUBERHORN_CORE_PCIE_COPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+#define LAUBERHORN_PCIE_BURST_SIZE 64
+
+// Copy nblk whole 64 B blocks with non-temporal stores
+static inline void lauberhorn_pcie_copy_blocks(void *dst, const void *src,
+                                               size_t nblk) {
+#if defined(__aarch64__)
+  asm volatile("cbz %[n], 2f\n"
+               "1:\n"
+               "ld1 {v0.16b-v3.16b}, [%[s]], #64\n"
+               "subs %[n], %[n], #1\n"
+               "stnp q0, q1, [%[d]]\n"
+               "stnp q2, q3, [%[d], #32]\n"
+               "add %[d], %[d], #64\n"
+               "b.ne 1b\n"
+               "2:\n"
+               : [d] "+r"(dst), [s] "+r"(src), [n] "+r"(nblk)
+               :
+               : "v0", "v1", "v2", "v3", "cc", "memory");
+#elif defined(__x86_64__)
+  __m128i *d = (__m128i *)dst;
+  const __m128i *s = (const __m128i *)src;
+
+  for (; nblk; --nblk, d += 4, s += 4) {
+    _mm_stream_si128(d, _mm_loadu_si128(s));
+    _mm_stream_si128(d + 1, _mm_loadu_si128(s + 1));
+    _mm_stream_si128(d + 2, _mm_loadu_si128(s + 2));
+    _mm_stream_si128(d + 3, _mm_loadu_si128(s + 3));
+  }
+#else
+  memcpy(dst, src, nblk * LAUBERHORN_PCIE_BURST_SIZE);
+#endif
+}
+
+// Copy len bytes into the write-combining packet buffer
+static inline void lauberhorn_pcie_copy_to_wc(void *dst, const void *src,
+                                              size_t len) {
+  size_t nblk = len / LAUBERHORN_PCIE_BURST_SIZE;
+  size_t done = nblk * LAUBERHORN_PCIE_BURST_SIZE;
+  uint8_t tail[LAUBERHORN_PCIE_BURST_SIZE] __attribute__((aligned(16)));
+
+  lauberhorn_pcie_copy_blocks(dst, src, nblk);
+
+  if (len > done) {
+    memcpy(tail, (const uint8_t *)src + done, len - done);
+    memset(tail + len - done, 0, sizeof(tail) - (len - done));
+    lauberhorn_pcie_copy_blocks((uint8_t *)dst + done, tail, 1);
+  }
+}
+
+#endif // LAUBERHORN_CORE_PCIE_COPY_H
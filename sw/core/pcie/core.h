@@ -2,21 +2,25 @@
 // Hardware scheduling is NOT implemented only on the PCIe NIC.
 // All functions here operates on mapped pages and should be inlined to rt
 
-// XXX: PCIe worker (core) pages can be mapped to individual threads, but data
-//      addr can point to anywhere in bar - currently we assume the whole bar
-//      space is mapped for payload data access...
+// The packet buffer is mapped on its own (RX uncached, TX slots write-combining
+// where possible, see rt/pcie.c); functions that touch payload take its base
+// as pktbuf, and packet buffer offsets from the NIC are relative to it.
 
 #ifndef LAUBERHORN_CORE_PCIE_CORE_H
 #define LAUBERHORN_CORE_PCIE_CORE_H
 
+#include <string.h>
+
 #include "debug.h"
+#include "pcie/copy.h"
 
 #define __PIONIC_RT__
 #include "pionic.h" // get pionic_pkt_desc_t etc. (but not other usr functions)
 
 // mackerel
-// provide pionic_pcie_*, pionic_pcie_host_*, pionic_pcie_core_*,
-#include "gen/pionic_pcie.h"
+// provide lauberhorn_pcie_* (datatypes), pionic_pcie_core_*,
+// pionic_pcie_global_*
+#include "gen/lauberhorn_pcie.h"
 #include "gen/pionic_pcie_core.h"
 #include "gen/pionic_pcie_global.h"
 
@@ -24,87 +28,201 @@
 #include "config.h"
 #include "regblock_bases.h"
 
-#define PIONIC_PKTBUF_OFF_TO_ADDR(off) ((off) + PIONIC_PCIE_PKT_BASE)
-#define PIONIC_ADDR_TO_PKTBUF_OFF(addr) ((addr) - PIONIC_PCIE_PKT_BASE)
+// clang-format off
+// per-core register page layout (rings are in the BAR; the bridge has no DMA
+// master into host memory):
+//
+// PIONIC_PCIE_CORE_HOST_TX_RING_BASE                TX descriptor ring (count: LAUBERHORN_PCIE_TX_RING_SLOTS)
+//   + slot * LAUBERHORN_PCIE_HOST_DESC_SIZE         full TX descriptor - host_ctrl_info_*_t
+// PIONIC_PCIE_CORE_HOST_RX_ACK_RING_BASE            RX ack ring (count: LAUBERHORN_PCIE_RX_ACK_RING_SLOTS)
+//   + slot * 8                                      packet buffer to free - host_pkt_buf_desc_t
+//
+// host_tx_produced, host_rx_ack_produced            doorbells: free-running number of entries posted
+// host_tx_consumed, host_rx_ack_consumed            free-running number of entries taken by the NIC
+//
+// TX slot i sends from the i-th MTU after the buffer read from host_tx once.
+// [[DmaControlPlugin]] only takes the next descriptor once the DMA of the
+// previous one is done, so a slot (and its buffer) is free again only after the
+// descriptor behind it was consumed: LAUBERHORN_PCIE_TX_RING_SLOTS - 1 can be
+// outstanding.
+// clang-format on
+#define LAUBERHORN_PCIE_HOST_DESC_SIZE (LAUBERHORN_HOST_REQ_WIDTH / 8)
+#define LAUBERHORN_PCIE_TX_INFLIGHT (LAUBERHORN_PCIE_TX_RING_SLOTS - 1)
+
+// RX acks are published once this many are pending, or whenever
+// core_pcie_rx comes back empty
+#ifndef LAUBERHORN_PCIE_RX_ACK_BATCH
+#define LAUBERHORN_PCIE_RX_ACK_BATCH 8
+#endif
+
+static_assert(LAUBERHORN_PCIE_RING_IDX_WIDTH == 16,
+              "ring indices are kept in uint16_t");
+static_assert((LAUBERHORN_PCIE_TX_RING_SLOTS &
+               (LAUBERHORN_PCIE_TX_RING_SLOTS - 1)) == 0,
+              "TX ring slots should be a power of two");
+static_assert((LAUBERHORN_PCIE_RX_ACK_RING_SLOTS &
+               (LAUBERHORN_PCIE_RX_ACK_RING_SLOTS - 1)) == 0,
+              "RX ack ring slots should be a power of two");
+static_assert(LAUBERHORN_PCIE_RX_ACK_BATCH <=
+                  LAUBERHORN_PCIE_RX_ACK_RING_SLOTS,
+              "RX ack batch should fit in the RX ack ring");
+static_assert(LAUBERHORN_PCIE_HOST_DESC_SIZE % 8 == 0,
+              "host descriptors are accessed in 64-bit words");
+
+// per-core ring state on the host; all indices are free-running
+typedef struct {
+  // TX ring: descriptors posted, and taken by the NIC (as last read)
+  uint16_t tx_prod;
+  uint16_t tx_cons;
+  // buffer of TX slot 0 in the packet buffer mapping
+  uint8_t *tx_buf;
+
+  // RX ack ring: acks written, published with the doorbell, and taken by
+  // the NIC (as last read)
+  uint16_t ack_prod;
+  uint16_t ack_rung;
+  uint16_t ack_cons;
+} core_pcie_state_t;
+
+static inline void core_pcie_wr64(void *reg, uint64_t v) {
+  *(volatile uint64_t *)reg = v;
+}
 
-static bool core_pcie_rx(void *bar, pionic_pcie_core_t *core_dev,
-                         pionic_pkt_desc_t *desc) {
-  // XXX: host rx (unlike host tx) has separate FIFO pop doorbell
-  uint8_t *host_rx = (uint8_t *)core_dev->base + PIONIC_PCIE_CORE_HOST_RX_BASE;
+// Pick up the ring indices from the NIC, e.g. after init
+static inline void core_pcie_sync(void *pktbuf, pionic_pcie_core_t *core_dev,
+                                  core_pcie_state_t *st) {
+  // XXX: read tx reg in one go since this reg has FIFO semantics
+  pionic_pcie_core_host_pkt_buf_desc_t reg =
+      pionic_pcie_core_host_tx_rd(core_dev);
 
-  if (pionic_pcie_host_ctrl_info_error_valid_extract(host_rx)) {
-    // parse host control info
-    pionic_pcie_host_packet_desc_type_t ty =
-        pionic_pcie_host_ctrl_info_error_ty_extract(host_rx);
-    uint32_t read_addr = PIONIC_PKTBUF_OFF_TO_ADDR(
-        pionic_pcie_host_ctrl_info_error_addr_extract(host_rx));
-    uint32_t pkt_len = pionic_pcie_host_ctrl_info_error_size_extract(host_rx);
-
-    // fill out user-facing struct
-    desc->payload_buf = (uint8_t *)bar + read_addr;
-    desc->payload_len = pkt_len;
-    // payload_buf and payload_len will be offseted below
-
-    switch (ty) {
-    case pionic_pcie_bypass:
-      desc->type = TY_BYPASS;
-
-      // decode header type
-      switch (pionic_pcie_host_ctrl_info_bypass_hdr_ty_extract(host_rx)) {
-      case pionic_pcie_hdr_ethernet:
-        desc->bypass.header_type = HDR_ETHERNET;
-        break;
-      case pionic_pcie_hdr_ip:
-        desc->bypass.header_type = HDR_IP;
-        break;
-      case pionic_pcie_hdr_udp:
-        desc->bypass.header_type = HDR_UDP;
-        break;
-      case pionic_pcie_hdr_onc_rpc_call:
-        desc->bypass.header_type = HDR_ONCRPC_CALL;
-        break;
-      }
+  assert(pionic_pcie_core_host_pkt_buf_desc_valid_extract(reg));
+  st->tx_buf = (uint8_t *)pktbuf +
+               pionic_pcie_core_host_pkt_buf_desc_addr_extract(reg);
+
+  st->tx_prod = pionic_pcie_core_host_tx_produced_rd(core_dev);
+  st->tx_cons = pionic_pcie_core_host_tx_consumed_rd(core_dev);
+  st->ack_prod = st->ack_rung =
+      pionic_pcie_core_host_rx_ack_produced_rd(core_dev);
+  st->ack_cons = pionic_pcie_core_host_rx_ack_consumed_rd(core_dev);
+}
 
-      // parsed bypass header is aligned after the descriptor header
-      // XXX: we don't have the actual size of the header, copy maximum
-      memcpy(desc->bypass.header,
-             host_rx + pionic_pcie_host_ctrl_info_bypass_size,
-             sizeof(desc->bypass.header));
+// --- RX ---
 
-      break;
+// Publish all posted RX acks with one doorbell write
+static inline void core_pcie_rx_ack_flush(pionic_pcie_core_t *core_dev,
+                                          core_pcie_state_t *st) {
+  if (st->ack_rung == st->ack_prod)
+    return;
 
-    case pionic_pcie_onc_rpc_call:
-      desc->type = TY_ONCRPC_CALL;
-      desc->oncrpc_call.func_ptr =
-          (void *)pionic_pcie_host_ctrl_info_onc_rpc_call_func_ptr_extract(
-              host_rx);
-      desc->oncrpc_call.xid =
-          pionic_pcie_host_ctrl_info_onc_rpc_call_xid_extract(host_rx);
+  // ring entries are written in order on the same device mapping
+  pionic_pcie_core_host_rx_ack_produced_wr(core_dev, st->ack_prod);
+  st->ack_rung = st->ack_prod;
+}
 
-      // parsed oncrpc arguments are aligned after the descriptor header
-      // XXX: we don't have the actual count of args, copy maximum
-      memcpy(desc->oncrpc_call.args,
-             host_rx + pionic_pcie_host_ctrl_info_onc_rpc_call_size,
-             sizeof(desc->oncrpc_call.args));
+static bool core_pcie_rx(void *pktbuf, pionic_pcie_core_t *core_dev,
+                         core_pcie_state_t *st, pionic_pkt_desc_t *desc) {
+  // XXX: host rx (unlike host tx) has separate FIFO pop doorbell
+  uint8_t *host_rx = (uint8_t *)core_dev->base + PIONIC_PCIE_CORE_HOST_RX_BASE;
+  uint64_t info[LAUBERHORN_PCIE_HOST_DESC_SIZE / 8];
 
-      break;
+  // read every word of the register exactly once, in order: it pops on read
+  for (int i = 0; i < LAUBERHORN_PCIE_HOST_DESC_SIZE / 8; ++i)
+    info[i] = ((volatile uint64_t *)host_rx)[i];
+
+  if (!lauberhorn_pcie_host_ctrl_info_error_valid_extract((uint8_t *)info)) {
+    pr_debug("pcie_rx: did not get packet\n");
+    // idle: hand back what we have freed so far
+    core_pcie_rx_ack_flush(core_dev, st);
+    return false;
+  }
 
+  // parse host control info
+  lauberhorn_pcie_host_req_type_t ty =
+      lauberhorn_pcie_host_ctrl_info_error_ty_extract((uint8_t *)info);
+  uint32_t read_off =
+      lauberhorn_pcie_host_ctrl_info_error_addr_extract((uint8_t *)info);
+  uint32_t pkt_len =
+      lauberhorn_pcie_host_ctrl_info_error_size_extract((uint8_t *)info);
+
+  // fill out user-facing struct
+  desc->payload_buf = (uint8_t *)pktbuf + read_off;
+  desc->payload_len = pkt_len;
+
+  switch (ty) {
+  case lauberhorn_pcie_bypass:
+    desc->type = TY_BYPASS;
+
+    // decode header type
+    switch (lauberhorn_pcie_host_ctrl_info_bypass_hdr_ty_extract(
+        (uint8_t *)info)) {
+    case lauberhorn_pcie_hdr_ethernet:
+      desc->bypass.header_type = HDR_ETHERNET;
+      break;
+    case lauberhorn_pcie_hdr_ip:
+      desc->bypass.header_type = HDR_IP;
+      break;
+    case lauberhorn_pcie_hdr_udp:
+      desc->bypass.header_type = HDR_UDP;
+      break;
     default:
-      desc->type = TY_ERROR;
+      desc->bypass.header_type = HDR_ERROR;
+      break;
     }
+    desc->bypass.csum_ok =
+        lauberhorn_pcie_host_ctrl_info_bypass_csum_ok_extract((uint8_t *)info);
 
-    pr_debug("pcie_rx: got packet at pktbuf %#lx len %#lx\n",
-             PIONIC_ADDR_TO_PKTBUF_OFF(read_addr), pkt_len);
-    return true;
-  } else {
-    pr_debug("pcie_rx: did not get packet\n");
-    return false;
+    // parsed bypass header is aligned after the descriptor header
+    // XXX: we don't have the actual size of the header, copy maximum
+    memcpy(desc->bypass.header,
+           (uint8_t *)info + lauberhorn_pcie_host_ctrl_info_bypass_size,
+           sizeof(desc->bypass.header));
+    break;
+
+  case lauberhorn_pcie_onc_rpc_call:
+  case lauberhorn_pcie_onc_rpc_reply:
+    // replies to nested calls share the layout of calls
+    desc->type =
+        ty == lauberhorn_pcie_onc_rpc_call ? TY_ONCRPC_CALL : TY_ONCRPC_REPLY;
+    desc->oncrpc_server.func_ptr =
+        (void *)lauberhorn_pcie_host_ctrl_info_onc_rpc_call_func_ptr_extract(
+            (uint8_t *)info);
+    desc->oncrpc_server.xid =
+        lauberhorn_pcie_host_ctrl_info_onc_rpc_call_xid_extract(
+            (uint8_t *)info);
+
+    // parsed oncrpc arguments are aligned after the descriptor header; only
+    // copy what the decoder actually found in the packet
+    desc->oncrpc_server.args_len =
+        lauberhorn_pcie_host_ctrl_info_onc_rpc_call_args_len_extract(
+            (uint8_t *)info);
+    memcpy(desc->oncrpc_server.args,
+           (uint8_t *)info + lauberhorn_pcie_host_ctrl_info_onc_rpc_call_size,
+           desc->oncrpc_server.args_len);
+    break;
+
+  default:
+    desc->type = TY_ERROR;
   }
+
+  pr_debug("pcie_rx: got packet at pktbuf %#x len %#x\n",
+           read_off, pkt_len);
+  return true;
 }
 
-static void core_pcie_rx_ack(void *bar, pionic_pcie_core_t *core_dev,
-                             pionic_pkt_desc_t *desc) {
-  uint64_t read_addr = desc->payload_buf - (uint8_t *)bar;
+// Post the ack of desc into the RX ack ring.  It is only published once
+// LAUBERHORN_PCIE_RX_ACK_BATCH acks are pending, or when core_pcie_rx comes
+// back empty; call core_pcie_rx_ack_flush to publish right away
+static void core_pcie_rx_ack(void *pktbuf, pionic_pcie_core_t *core_dev,
+                             core_pcie_state_t *st, pionic_pkt_desc_t *desc) {
+  uint64_t read_off = desc->payload_buf - (uint8_t *)pktbuf;
+
+  if ((uint16_t)(st->ack_prod - st->ack_cons) >=
+      LAUBERHORN_PCIE_RX_ACK_RING_SLOTS) {
+    core_pcie_rx_ack_flush(core_dev, st);
+    while ((uint16_t)(st->ack_prod - st->ack_cons) >=
+           LAUBERHORN_PCIE_RX_ACK_RING_SLOTS)
+      st->ack_cons = pionic_pcie_core_host_rx_ack_consumed_rd(core_dev);
+  }
 
   // valid for host-driven descriptor doesn't actually do anything so we don't
   // bother
@@ -112,110 +230,228 @@ static void core_pcie_rx_ack(void *bar, pionic_pcie_core_t *core_dev,
       pionic_pcie_core_host_pkt_buf_desc_size_insert(
           pionic_pcie_core_host_pkt_buf_desc_addr_insert(
               pionic_pcie_core_host_pkt_buf_desc_default,
-              PIONIC_ADDR_TO_PKTBUF_OFF(read_addr)),
+              read_off),
           desc->payload_len);
 
-  // XXX: write rx ack reg in one go since this reg has FIFO semantics
-  pionic_pcie_core_host_rx_ack_wr(core_dev, reg);
+  core_pcie_wr64((uint8_t *)core_dev->base +
+                     PIONIC_PCIE_CORE_HOST_RX_ACK_RING_BASE +
+                     (st->ack_prod & (LAUBERHORN_PCIE_RX_ACK_RING_SLOTS - 1)) *
+                         sizeof(uint64_t),
+                 reg);
+  ++st->ack_prod;
+
+  if ((uint16_t)(st->ack_prod - st->ack_rung) >= LAUBERHORN_PCIE_RX_ACK_BATCH)
+    core_pcie_rx_ack_flush(core_dev, st);
 
   desc->payload_buf = NULL;
   desc->payload_len = 0;
 }
 
-static void core_pcie_tx_prepare_desc(void *bar, pionic_pcie_core_t *core_dev,
-                                      pionic_pkt_desc_t *desc) {
-  // PCIe backend: set payload_buf with the buffer requested from the NIC
+// Receive up to n packets, copying the payloads out of the packet buffer into
+// the caller's buffers (descs[i].payload_buf, at least one MTU).  The acks of
+// the whole burst go out with one doorbell
+static int core_pcie_rx_burst(void *pktbuf, pionic_pcie_core_t *core_dev,
+                              core_pcie_state_t *st, pionic_pkt_desc_t *descs,
+                              int n) {
+  int got;
 
-  // XXX: read tx reg in one go since this reg has FIFO semantics
-  pionic_pcie_core_host_pkt_buf_desc_t reg =
-      pionic_pcie_core_host_tx_rd(core_dev);
+  for (got = 0; got < n; ++got) {
+    pionic_pkt_desc_t *desc = &descs[got];
+    uint8_t *buf = desc->payload_buf;
+    size_t len;
 
-  // for now, TX desc should always be valid
-  assert(pionic_pcie_core_host_pkt_buf_desc_valid_extract(reg));
-  uint32_t off = pionic_pcie_core_host_pkt_buf_desc_addr_extract(reg);
-  uint32_t len = pionic_pcie_core_host_pkt_buf_desc_size_extract(reg);
+    if (!core_pcie_rx(pktbuf, core_dev, st, desc))
+      break;
 
-  desc->payload_buf = (uint8_t *)bar + PIONIC_PKTBUF_OFF_TO_ADDR(off);
-  desc->payload_len = len;
+    len = desc->payload_len;
+    memcpy(buf, desc->payload_buf, len);
+    core_pcie_rx_ack(pktbuf, core_dev, st, desc);
+
+    desc->payload_buf = buf;
+    desc->payload_len = len;
+  }
+
+  core_pcie_rx_ack_flush(core_dev, st);
+  return got;
 }
 
-static void core_pcie_tx(void *bar, pionic_pcie_core_t *core_dev,
-                         pionic_pkt_desc_t *desc) {
-  // PCIe backend: will give the payload_buf back to NIC
+// --- TX ---
 
-  // XXX: host tx ack (unlike host rx ack) has separate FIFO push doorbell
-  uint8_t *host_tx_ack =
-      (uint8_t *)core_dev->base + PIONIC_PCIE_CORE_HOST_TX_ACK_BASE;
+static inline uint8_t *core_pcie_tx_slot_buf(core_pcie_state_t *st,
+                                             uint16_t idx) {
+  return st->tx_buf +
+         (idx & (LAUBERHORN_PCIE_TX_RING_SLOTS - 1)) * LAUBERHORN_ROUNDED_MTU;
+}
 
-  uint64_t write_addr = desc->payload_buf - (uint8_t *)bar;
+// Publish all filled TX slots with one doorbell write.  The fence drains the
+// write-combined (and non-temporal) payload stores before it
+static inline void core_pcie_tx_doorbell(pionic_pcie_core_t *core_dev,
+                                         core_pcie_state_t *st) {
+  FENCE;
+  pionic_pcie_core_host_tx_produced_wr(core_dev, st->tx_prod);
+}
 
-  // fill out packet buffer desc
-  pionic_pcie_host_ctrl_info_error_addr_insert(
-      host_tx_ack, PIONIC_ADDR_TO_PKTBUF_OFF(write_addr));
-  pionic_pcie_host_ctrl_info_error_size_insert(host_tx_ack, desc->payload_len);
+// Wait until the slot at tx_prod (and its buffer) is free.  The caller must
+// have rung the doorbell for the filled slots, or the NIC never gets to them
+static inline void core_pcie_tx_wait_slot(pionic_pcie_core_t *core_dev,
+                                          core_pcie_state_t *st) {
+  while ((uint16_t)(st->tx_prod - st->tx_cons) >= LAUBERHORN_PCIE_TX_INFLIGHT)
+    st->tx_cons = pionic_pcie_core_host_tx_consumed_rd(core_dev);
+}
+
+// PCIe backend: set payload_buf to the buffer of the next free TX slot in the
+// packet buffer, for the caller to write the payload into.  Write it front to
+// back and in whole 64 B blocks where possible, so that the stores combine
+static void core_pcie_tx_prepare_desc(void *pktbuf,
+                                      pionic_pcie_core_t *core_dev,
+                                      core_pcie_state_t *st,
+                                      pionic_pkt_desc_t *desc) {
+  (void)pktbuf;
 
-  // valid doesn't matter, not setting
+  core_pcie_tx_wait_slot(core_dev, st);
+
+  desc->payload_buf = core_pcie_tx_slot_buf(st, st->tx_prod);
+  desc->payload_len = LAUBERHORN_ROUNDED_MTU;
+}
+
+// Write desc into the TX ring slot at tx_prod, and the payload into the slot
+// buffer unless it is already there.  The slot must be free; the caller
+// advances tx_prod and rings the doorbell.  Returns false if desc cannot be
+// sent
+static bool core_pcie_tx_fill(void *pktbuf, pionic_pcie_core_t *core_dev,
+                              core_pcie_state_t *st, pionic_pkt_desc_t *desc) {
+  uint8_t *buf = core_pcie_tx_slot_buf(st, st->tx_prod);
+  uint64_t info[LAUBERHORN_PCIE_HOST_DESC_SIZE / 8] = {0};
+  uint8_t *slot;
+
+  if (desc->payload_len > LAUBERHORN_ROUNDED_MTU) {
+    pr_err("pcie_tx: payload of %zu bytes does not fit one MTU\n",
+           desc->payload_len);
+    return false;
+  }
+
+  // fill out packet buffer desc; valid doesn't matter, not setting
+  lauberhorn_pcie_host_ctrl_info_error_addr_insert(
+      (uint8_t *)info,
+      (uint64_t)(buf - (uint8_t *)pktbuf));
+  lauberhorn_pcie_host_ctrl_info_error_size_insert((uint8_t *)info,
+                                                   desc->payload_len);
 
   switch (desc->type) {
   case TY_BYPASS:
-    pionic_pcie_host_ctrl_info_bypass_ty_insert(host_tx_ack,
-                                                pionic_pcie_bypass);
+    lauberhorn_pcie_host_ctrl_info_bypass_ty_insert((uint8_t *)info,
+                                                    lauberhorn_pcie_bypass);
 
     // encode header type
     switch (desc->bypass.header_type) {
     case HDR_ETHERNET:
-      pionic_pcie_host_ctrl_info_bypass_hdr_ty_insert(host_tx_ack,
-                                                      pionic_pcie_hdr_ethernet);
+      lauberhorn_pcie_host_ctrl_info_bypass_hdr_ty_insert(
+          (uint8_t *)info, lauberhorn_pcie_hdr_ethernet);
       break;
     case HDR_IP:
-      pionic_pcie_host_ctrl_info_bypass_hdr_ty_insert(host_tx_ack,
-                                                      pionic_pcie_hdr_ip);
+      lauberhorn_pcie_host_ctrl_info_bypass_hdr_ty_insert(
+          (uint8_t *)info, lauberhorn_pcie_hdr_ip);
       break;
     case HDR_UDP:
-      pionic_pcie_host_ctrl_info_bypass_hdr_ty_insert(host_tx_ack,
-                                                      pionic_pcie_hdr_udp);
-      break;
-    case HDR_ONCRPC_CALL:
-      pionic_pcie_host_ctrl_info_bypass_hdr_ty_insert(
-          host_tx_ack, pionic_pcie_hdr_onc_rpc_call);
+      lauberhorn_pcie_host_ctrl_info_bypass_hdr_ty_insert(
+          (uint8_t *)info, lauberhorn_pcie_hdr_udp);
       break;
+    default:
+      pr_err("pcie_tx: unsupported bypass header type %d\n",
+             desc->bypass.header_type);
+      return false;
     }
 
     // parsed bypass header is aligned after the descriptor header
     // XXX: we don't have the actual size of the header, copy maximum
-    memcpy(host_tx_ack + pionic_pcie_host_ctrl_info_bypass_size,
+    memcpy((uint8_t *)info + lauberhorn_pcie_host_ctrl_info_bypass_size,
            desc->bypass.header, sizeof(desc->bypass.header));
-
     break;
 
   case TY_ONCRPC_CALL:
-    pionic_pcie_host_ctrl_info_onc_rpc_call_ty_insert(host_tx_ack,
-                                                      pionic_pcie_onc_rpc_call);
-    pionic_pcie_host_ctrl_info_onc_rpc_call_func_ptr_insert(
-        host_tx_ack, desc->oncrpc_call.func_ptr);
-    pionic_pcie_host_ctrl_info_onc_rpc_call_xid_insert(host_tx_ack,
-                                                       desc->oncrpc_call.xid);
+    lauberhorn_pcie_host_ctrl_info_onc_rpc_call_ty_insert(
+        (uint8_t *)info, lauberhorn_pcie_onc_rpc_call);
+    lauberhorn_pcie_host_ctrl_info_onc_rpc_call_func_ptr_insert(
+        (uint8_t *)info, (uint64_t)desc->oncrpc_server.func_ptr);
+    lauberhorn_pcie_host_ctrl_info_onc_rpc_call_xid_insert(
+        (uint8_t *)info, desc->oncrpc_server.xid);
+    // the call encoder takes inlined plus packet buffer bytes as the length
+    lauberhorn_pcie_host_ctrl_info_onc_rpc_call_args_len_insert(
+        (uint8_t *)info, desc->oncrpc_server.tx_inline_words * 4);
     // parsed oncrpc arguments are aligned after the descriptor header
     // XXX: we don't have the actual count of args, copy maximum
-    memcpy(host_tx_ack + pionic_pcie_host_ctrl_info_onc_rpc_call_size,
-           desc->oncrpc_call.args, sizeof(desc->oncrpc_call.args));
-
+    memcpy((uint8_t *)info + lauberhorn_pcie_host_ctrl_info_onc_rpc_call_size,
+           desc->oncrpc_server.args, sizeof(desc->oncrpc_server.args));
     break;
 
-  case TY_ONCRPC_REPLY:
-    pionic_pcie_host_ctrl_info_onc_rpc_reply_ty_insert(
-        host_tx_ack, pionic_pcie_onc_rpc_reply);
-    memcpy(host_tx_ack + pionic_pcie_host_ctrl_info_onc_rpc_reply_size,
-           desc->oncrpc_reply.buf, sizeof(desc->oncrpc_reply.buf));
-    break;
   default:
+    // TODO: ONC-RPC replies do not exist on PCIe yet, use bypass with a raw
+    //       Ethernet frame for sending
     pr_err("pcie_tx: unsupported desc->type %d\n", desc->type);
-    break;
+    return false;
   }
 
+  // payload from a host buffer: copy into the slot buffer in full bursts
+  if (desc->payload_buf != NULL && desc->payload_buf != buf)
+    lauberhorn_pcie_copy_to_wc(buf, desc->payload_buf, desc->payload_len);
+
+  // the slot is plain registers: write it word by word, no read-modify-write
+  slot = (uint8_t *)core_dev->base + PIONIC_PCIE_CORE_HOST_TX_RING_BASE +
+         (st->tx_prod & (LAUBERHORN_PCIE_TX_RING_SLOTS - 1)) *
+             LAUBERHORN_PCIE_HOST_DESC_SIZE;
+  for (int i = 0; i < LAUBERHORN_PCIE_HOST_DESC_SIZE / 8; ++i)
+    core_pcie_wr64(slot + i * sizeof(uint64_t), info[i]);
+
+  return true;
+}
+
+static void core_pcie_tx(void *pktbuf, pionic_pcie_core_t *core_dev,
+                         core_pcie_state_t *st, pionic_pkt_desc_t *desc) {
+  // PCIe backend: will give the payload_buf back to NIC
+  core_pcie_tx_wait_slot(core_dev, st);
+  if (!core_pcie_tx_fill(pktbuf, core_dev, st, desc))
+    return;
+
   // ring doorbell: tx packet ready
-  // TODO: @PX, how?
-  ? ? ?
+  ++st->tx_prod;
+  core_pcie_tx_doorbell(core_dev, st);
+
+  desc->payload_buf = NULL;
+  desc->payload_len = 0;
+}
+
+// Send n packets with payloads in host buffers (descs[i].payload_buf); returns
+// the number of packets sent.  Stops at a descriptor core_pcie_tx_fill does not
+// take, which is marked TY_ERROR.  The doorbell is rung once for the whole
+// burst, or whenever the ring fills up
+static int core_pcie_tx_burst(void *pktbuf, pionic_pcie_core_t *core_dev,
+                              core_pcie_state_t *st, pionic_pkt_desc_t *descs,
+                              int n) {
+  int i, sent = 0, unrung = 0;
+
+  for (i = 0; i < n; ++i) {
+    if ((uint16_t)(st->tx_prod - st->tx_cons) >= LAUBERHORN_PCIE_TX_INFLIGHT) {
+      // hand over what we have, so that the NIC can free up slots
+      if (unrung) {
+        core_pcie_tx_doorbell(core_dev, st);
+        unrung = 0;
+      }
+      core_pcie_tx_wait_slot(core_dev, st);
+    }
+
+    if (!core_pcie_tx_fill(pktbuf, core_dev, st, &descs[i])) {
+      descs[i].type = TY_ERROR;
+      break;
+    }
+    ++st->tx_prod;
+    ++unrung;
+    ++sent;
+  }
+
+  if (unrung)
+    core_pcie_tx_doorbell(core_dev, st);
+
+  return sent;
 }
 
 #endif // LAUBERHORN_CORE_PCIE_CORE_H
@@ -11,18 +11,58 @@
 //   - ARP resolve request from TX pipeline: send out ARP request
 //
 // The bypass core polling loop does not delay responses.  The FPI number
-// 15 to core 0 will be used to notify the CPU that the bypass queue is
-// now non-empty, and is used to drive NAPI scheduling.
+// 15 will be used to notify the CPU that the bypass queue is now non-empty,
+// and is used to drive NAPI scheduling.
+//
+// Every bypass core on the NIC is one queue of the netdev, with its own CL
+// window, NAPI context and CPU: the FPI of bypass core i goes to CPU i, which
+// also runs its NAPI poll and (through XPS) sends on it.  The NIC steers RX
+// flows over the queues with a hash of the addresses and ports; ethtool -L
+// narrows the steering down to fewer queues.
+//
+// RX payloads are read from the CLs straight into pages of a per-queue
+// page_pool, which are attached to the skb as a frag; only the parsed header
+// is built in the (small) linear area.  Pages come back to the pool when the
+// stack frees the skb.  Short payloads are copied into the linear area
+// instead, keeping the page for the next packet.
+//
+// TX packets are serialized straight into the TX ring slots of their queue,
+// frag by frag.  The doorbell is rung once per batch from the stack
+// (xmit_more), and BQL bounds the bytes waiting in the ring.  There is no TX
+// completion interrupt: when the ring is full or BQL stops the queue, a timer
+// kicks NAPI to pick up the completions and wake the queue.
+//
+// An XDP program sees the frame rebuilt in the RX page before any skb is
+// allocated.  XDP_TX frames are sent on the bypass core of the queue they came
+// in on.  AF_XDP sockets work in copy mode on top of XDP_REDIRECT: there is no
+// DMA into host memory to make zero-copy, the CPU copies from the CLs anyway.
 //
 
 #include "common.h"
 
+#include <linux/bpf.h>
+#include <linux/bpf_trace.h>
 #include <linux/etherdevice.h>
+#include <linux/ethtool.h>
+#include <linux/filter.h>
+#include <linux/hrtimer.h>
 #include <linux/netdevice.h>
 #include <linux/inetdevice.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/version.h>
 #include <net/neighbour.h>
 #include <net/netevent.h>
 #include <net/arp.h>
+#include <net/xdp.h>
+// dev->xdp_features and friends; see README.md
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 4, 0)
+#error "Lauberhorn needs Linux 6.4 or newer"
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+#include <net/page_pool/helpers.h>
+#else
+#include <net/page_pool.h>
+#endif
 
 #include "cmac.h"
 #include "eci/config.h"
@@ -36,15 +76,80 @@
 #include "lauberhorn_eci_IpEncoder.h"
 #include "lauberhorn_eci_decoderSink.h"
 
-#define FPGA_MEM_BASE (0x10000000000UL)
 #define CMAC_BASE 0x200000UL
 
-struct netdev_priv {
+// Max number of requests to drain from the bypass core per critical section
+#define LAUBERHORN_RX_BURST 8
+
+// Pages kept in the per-queue page pool; enough for the packets in flight in
+// the stack between two NAPI polls
+#define RX_PAGE_POOL_SIZE 256
+
+// Payloads up to this size are copied into the linear area of the skb
+#define RX_COPYBREAK 256
+
+// Interval to poll for TX completions while a queue is stopped
+#define TX_REAP_INTERVAL_NS (20 * NSEC_PER_USEC)
+
+struct netdev_priv;
+
+struct bypass_queue_stats {
+	u64 packets;
+	u64 bytes;
+	u64 dropped;
+	// RX only: no page to receive into; not a drop, the packet stays on the
+	// NIC until the next poll
+	u64 alloc_fail;
+	struct u64_stats_sync syncp;
+};
+
+// One bypass core on the NIC
+struct bypass_queue {
 	struct napi_struct napi;
+	struct netdev_priv *priv;
+	int idx;
+	// CPU that takes the FPI and runs the NAPI poll
+	int cpu;
+
+	// CL window of the bypass core
+	void *base;
+	lauberhorn_eci_preempt_t reg_dev;
+
+	// Datapath state
+	lauberhorn_core_state_t ctx;
+
+	// TX slots filled but not handed to the NIC yet, while the stack has
+	// more packets for us (xmit_more)
+	int tx_unrung;
+	// Oldest TX slot not yet reported to BQL, and the bytes of each slot
+	u16 tx_done;
+	u32 tx_slot_bytes[LAUBERHORN_ECI_TX_RING_SLOTS];
+	// kicks NAPI to reap completions while the queue is stopped
+	struct hrtimer tx_timer;
+
+	// Pages to receive a burst of payloads into; refilled after being
+	// handed to the stack
+	struct page_pool *rx_pool;
+	struct page *rx_pages[LAUBERHORN_RX_BURST];
+
+	struct xdp_rxq_info xdp_rxq;
+	// frames redirected in this NAPI poll, to flush at the end
+	bool xdp_redirected;
+
+	struct bypass_queue_stats rx_stats, tx_stats;
+} __attribute__((aligned(128))); // ThunderX-1 CL
+
+struct netdev_priv {
 	struct net_device *dev;
 
+	// Queues in use, as set with ethtool -L
+	int num_queues;
+
+	// Attached XDP program, shared by all queues
+	struct bpf_prog *xdp_prog;
+	struct bypass_queue queues[LAUBERHORN_NUM_BYPASS_CORES];
+
 	// Mackerel devices
-	lauberhorn_eci_preempt_t reg_dev;
 	lauberhorn_eci_dma_t dma_dev;
 	lauberhorn_eci_EthernetDecoder_t eth_dec_dev;
 	lauberhorn_eci_IpDecoder_t ip_dec_dev;
@@ -52,34 +157,31 @@ struct netdev_priv {
 	lauberhorn_eci_decoderSink_t dec_dev;
 	cmac_t cmac_dev;
 
-	// Datapath state
-	lauberhorn_core_state_t ctx;
-
 	// Shadow table for ARP cache in HW
 	__be32 arp_cache[LAUBERHORN_NUM_NEIGHBOR_ENTRIES];
 };
 
 static u64 irq_no;
-static DEFINE_PER_CPU_READ_MOSTLY(struct net_device *, bypass_fpi_cookie);
+static DEFINE_PER_CPU_READ_MOSTLY(struct bypass_queue *, bypass_fpi_cookie);
+static struct net_device *bypass_netdev;
 
 static irqreturn_t bypass_fpi_handler(int irq, void *cookie)
 {
-	struct net_device *dev = cookie;
-	struct netdev_priv *priv = netdev_priv(dev);
+	struct bypass_queue *q = *(struct bypass_queue **)cookie;
 
-	pr_info("%s.%d[%2d]: bypass IRQ (FPI %d)\n", __func__, __LINE__,
-		smp_processor_id(), irq);
+	pr_info("%s.%d[%2d]: bypass IRQ (FPI %d) for queue %d\n", __func__,
+		__LINE__, smp_processor_id(), irq, q->idx);
 
 	// Mask interrupt and call napi_schedule
-	lauberhorn_eci_preempt_irq_en_wr(&priv->reg_dev, 0);
-	napi_schedule(&priv->napi);
+	lauberhorn_eci_preempt_irq_en_wr(&q->reg_dev, 0);
+	napi_schedule(&q->napi);
 
 	return IRQ_HANDLED;
 }
 
-static int init_bypass_fpi(struct net_device *dev)
+static int init_bypass_fpi(struct netdev_priv *priv)
 {
-	int err;
+	int err, i;
 	struct irq_data *gic_irq_data;
 	struct irq_domain *gic_domain;
 	struct fwnode_handle *fwnode;
@@ -92,9 +194,12 @@ static int init_bypass_fpi(struct net_device *dev)
 	gic_domain = gic_irq_data->domain;
 	fwnode = *(struct fwnode_handle **)(gic_domain->host_data);
 
-	// Write net_device pointer to CPU cookie
-	struct net_device **cookie_ptr = per_cpu_ptr(&bypass_fpi_cookie, 0);
-	*cookie_ptr = dev;
+	// Write queue pointers to the cookies of their CPUs
+	for (i = 0; i < LAUBERHORN_NUM_BYPASS_CORES; ++i) {
+		struct bypass_queue *q = &priv->queues[i];
+
+		*per_cpu_ptr(&bypass_fpi_cookie, q->cpu) = q;
+	}
 
 	// Allocate an IRQ number for SGI #15 for bypass core
 	fwspec_fpi.fwnode = fwnode;
@@ -116,35 +221,72 @@ static int init_bypass_fpi(struct net_device *dev)
 		return err;
 	}
 
-	// Enable SGI #15 on core 0
-	err = smp_call_on_cpu(0, do_fpi_irq_activate, (void *)irq_no, true);
-	if (err < 0) {
-		pr_warn("failed to invoke CPU 0 to activate bypass IRQ: err %d\n",
-			err);
-		return err;
+	// Enable SGI #15 on the CPUs of all bypass cores
+	for (i = 0; i < LAUBERHORN_NUM_BYPASS_CORES; ++i) {
+		int cpu = priv->queues[i].cpu;
+
+		err = smp_call_on_cpu(cpu, do_fpi_irq_activate,
+				      (void *)irq_no, true);
+		if (err < 0) {
+			pr_warn("failed to invoke CPU %d to activate bypass IRQ: err %d\n",
+				cpu, err);
+			goto fail_activate;
+		}
 	}
 
 	return 0;
+
+fail_activate:
+	while (i--)
+		smp_call_on_cpu(priv->queues[i].cpu, do_fpi_irq_deactivate,
+				(void *)irq_no, true);
+	free_percpu_irq(irq_no, &bypass_fpi_cookie);
+	irq_dispose_mapping(irq_no);
+	return err;
 }
 
-static void deinit_bypass_fpi(void)
+static void deinit_bypass_fpi(struct netdev_priv *priv)
 {
-	int err;
+	int err, i;
 
-	err = smp_call_on_cpu(0, do_fpi_irq_deactivate, (void *)irq_no, true);
-	WARN_ON(err < 0);
+	for (i = 0; i < LAUBERHORN_NUM_BYPASS_CORES; ++i) {
+		err = smp_call_on_cpu(priv->queues[i].cpu,
+				      do_fpi_irq_deactivate, (void *)irq_no,
+				      true);
+		WARN_ON(err < 0);
+	}
 	free_percpu_irq(irq_no, &bypass_fpi_cookie);
 	irq_dispose_mapping(irq_no);
 }
 
+// Steer the flow hash buckets evenly over the first num_queues bypass cores
+static void write_hw_rss_tbl(struct netdev_priv *priv, int num_queues)
+{
+	int i;
+
+	for (i = 0; i < LAUBERHORN_BYPASS_RSS_TBL_SIZE; ++i) {
+		lauberhorn_eci_decoderSink_ctrl_rss_queue_wr(&priv->dec_dev,
+							     i % num_queues);
+		lauberhorn_eci_decoderSink_ctrl_rss_idx_wr(&priv->dec_dev, i);
+	}
+}
+
 static int netdev_open(struct net_device *dev)
 {
 	struct netdev_priv *priv = netdev_priv(dev);
+	int i;
 
-	napi_enable(&priv->napi);
-	netif_start_queue(dev);
+	for (i = 0; i < priv->num_queues; ++i) {
+		struct bypass_queue *q = &priv->queues[i];
 
-	lauberhorn_eci_preempt_irq_en_wr(&priv->reg_dev, 1);
+		// slots still in flight from before are not reported to BQL
+		q->tx_done = q->ctx.tx_prod;
+		netdev_tx_reset_queue(netdev_get_tx_queue(dev, i));
+
+		napi_enable(&q->napi);
+		lauberhorn_eci_preempt_irq_en_wr(&q->reg_dev, 1);
+	}
+	netif_tx_start_all_queues(dev);
 
 	start_cmac(&priv->cmac_dev, 0);
 
@@ -216,48 +358,404 @@ static struct notifier_block inetaddr_notifier = {
 static int netdev_stop(struct net_device *dev)
 {
 	struct netdev_priv *priv = netdev_priv(dev);
+	int i;
 
 	stop_cmac(&priv->cmac_dev);
 
-	lauberhorn_eci_preempt_irq_en_wr(&priv->reg_dev, 0);
-
-	napi_disable(&priv->napi);
-	netif_stop_queue(dev);
+	for (i = 0; i < priv->num_queues; ++i) {
+		lauberhorn_eci_preempt_irq_en_wr(&priv->queues[i].reg_dev, 0);
+		hrtimer_cancel(&priv->queues[i].tx_timer);
+		napi_disable(&priv->queues[i].napi);
+	}
+	netif_tx_stop_all_queues(dev);
 
 	return 0;
 }
 
+static void queue_stats_add(struct bypass_queue_stats *stats, u64 bytes)
+{
+	u64_stats_update_begin(&stats->syncp);
+	stats->packets++;
+	stats->bytes += bytes;
+	u64_stats_update_end(&stats->syncp);
+}
+
+static void queue_stats_drop(struct bypass_queue_stats *stats)
+{
+	u64_stats_update_begin(&stats->syncp);
+	stats->dropped++;
+	u64_stats_update_end(&stats->syncp);
+}
+
+static void queue_stats_alloc_fail(struct bypass_queue_stats *stats)
+{
+	u64_stats_update_begin(&stats->syncp);
+	stats->alloc_fail++;
+	u64_stats_update_end(&stats->syncp);
+}
+
+static void queue_stats_read(struct bypass_queue_stats *stats, u64 *packets,
+			     u64 *bytes, u64 *dropped)
+{
+	unsigned int start;
+	u64 p, b, d;
+
+	do {
+		start = u64_stats_fetch_begin(&stats->syncp);
+		p = stats->packets;
+		b = stats->bytes;
+		d = stats->dropped;
+	} while (u64_stats_fetch_retry(&stats->syncp, start));
+
+	*packets += p;
+	*bytes += b;
+	*dropped += d;
+}
+
+static void netdev_get_stats64(struct net_device *dev,
+			       struct rtnl_link_stats64 *stats)
+{
+	struct netdev_priv *priv = netdev_priv(dev);
+	int i;
+
+	// all queues, also those disabled with ethtool -L
+	for (i = 0; i < LAUBERHORN_NUM_BYPASS_CORES; ++i) {
+		struct bypass_queue *q = &priv->queues[i];
+
+		queue_stats_read(&q->rx_stats, &stats->rx_packets,
+				 &stats->rx_bytes, &stats->rx_dropped);
+		queue_stats_read(&q->tx_stats, &stats->tx_packets,
+				 &stats->tx_bytes, &stats->tx_dropped);
+	}
+}
+
+// Report the TX slots the NIC consumed since the last call to BQL
+static void tx_reap(struct bypass_queue *q, struct netdev_queue *txq)
+{
+	unsigned int pkts = 0, bytes = 0;
+
+	// tx_cons may lag behind tx_done after a queue reset
+	while ((s16)(q->ctx.tx_cons - q->tx_done) > 0) {
+		bytes += q->tx_slot_bytes[q->tx_done &
+					  (LAUBERHORN_ECI_TX_RING_SLOTS - 1)];
+		++q->tx_done;
+		++pkts;
+	}
+
+	if (pkts)
+		netdev_tx_completed_queue(txq, pkts, bytes);
+}
+
+// Hand all filled TX slots to the NIC
+static void tx_ring_doorbell(struct bypass_queue *q, struct netdev_queue *txq)
+{
+	FENCE; // CL writes before the doorbell read
+	core_eci_tx_doorbell(q->base, &q->ctx);
+	q->tx_unrung = 0;
+
+	tx_reap(q, txq);
+}
+
+static void tx_arm_reap(struct bypass_queue *q)
+{
+	hrtimer_start(&q->tx_timer, ns_to_ktime(TX_REAP_INTERVAL_NS),
+		      HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart tx_reap_timer(struct hrtimer *t)
+{
+	struct bypass_queue *q = container_of(t, struct bypass_queue, tx_timer);
+
+	// completions are picked up in NAPI, which can take the TX lock
+	napi_schedule(&q->napi);
+	return HRTIMER_NORESTART;
+}
+
+// Called from NAPI: pick up TX completions of a stopped queue and wake it once
+// the ring has room again.  Keeps the timer going until then
+static void tx_poll_completions(struct bypass_queue *q)
+{
+	struct netdev_queue *txq = netdev_get_tx_queue(q->priv->dev, q->idx);
+
+	if (!netif_xmit_stopped(txq))
+		return;
+
+	// on contention, the transmitter is about to look at the ring anyway
+	if (__netif_tx_trylock(txq)) {
+		core_eci_tx_poll(q->base, &q->ctx);
+		// wakes the queue if it was BQL that stopped it
+		tx_reap(q, txq);
+		if (!core_eci_tx_ring_full(&q->ctx))
+			netif_tx_wake_queue(txq);
+		__netif_tx_unlock(txq);
+	}
+
+	if (netif_xmit_stopped(txq))
+		tx_arm_reap(q);
+}
+
+// Copy len bytes of payload to offset off of the TX slot in desc->view
+static void tx_copy_payload(lauberhorn_pkt_desc_t *desc, size_t off,
+			    const void *src, size_t len)
+{
+	if (off < desc->view.inline_len) {
+		size_t chunk = min(len, desc->view.inline_len - off);
+
+		lauberhorn_copy_inline(desc->view.inline_buf + off, src, chunk);
+		src += chunk;
+		off += chunk;
+		len -= chunk;
+	}
+
+	lauberhorn_copy_overflow(desc->view.overflow_buf + off -
+					 desc->view.inline_len,
+				 src, len);
+}
+
+// Transmitters of one queue are serialized by its TX lock (no LLTX); every
+// queue has its own bypass core and core state
 static netdev_tx_t netdev_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct netdev_priv *priv = netdev_priv(dev);
+	u16 qidx = skb_get_queue_mapping(skb);
+	struct bypass_queue *q = &priv->queues[qidx];
+	struct netdev_queue *txq = netdev_get_tx_queue(dev, qidx);
+	unsigned int bytes = skb->len;
 	lauberhorn_pkt_desc_t desc;
+	size_t len, off;
+	int i;
+
+	// the Ethernet header goes into the control info, from the linear area;
+	// AF_PACKET can hand us shorter frames
+	if (!pskb_may_pull(skb, ETH_HLEN) ||
+	    skb->len - ETH_HLEN > LAUBERHORN_ECI_INLINE_DATA_SIZE +
+					  LAUBERHORN_ECI_NUM_OVERFLOW_CL *
+						  LAUBERHORN_ECI_CL_SIZE) {
+		queue_stats_drop(&q->tx_stats);
+		dev_kfree_skb_any(skb);
+		goto out;
+	}
+	len = skb->len - ETH_HLEN;
+
+	// the ring is only full here if XDP frames filled it up; the NIC only
+	// frees slots of which it has seen the doorbell
+	if (core_eci_tx_ring_full(&q->ctx)) {
+		if (q->tx_unrung) {
+			tx_ring_doorbell(q, txq);
+		} else {
+			core_eci_tx_poll(q->base, &q->ctx);
+			tx_reap(q, txq);
+		}
 
-	core_eci_tx_prepare_desc(&desc, &priv->ctx);
+		// do not wait for the NIC here
+		if (core_eci_tx_ring_full(&q->ctx)) {
+			netif_tx_stop_queue(txq);
+			tx_arm_reap(q);
+			return NETDEV_TX_BUSY;
+		}
+	}
+
+	// serialize straight into the TX cachelines; there is a free slot, so
+	// this does not wait
+	core_eci_tx_prepare_view(q->base, &q->ctx, &desc);
 
 	// send the skb as a bypass Ethernet packet
 	desc.type = TY_BYPASS;
 	desc.bypass.header_type = HDR_ETHERNET;
-
-	BUG_ON(skb->len < ETH_HLEN);
 	memcpy(desc.bypass.header, eth_hdr(skb), ETH_HLEN);
 
-	desc.payload_len = skb->len - ETH_HLEN;
-	memcpy(desc.payload_buf, skb->data + ETH_HLEN, desc.payload_len);
+	// linear part, then the frags; no need to linearize
+	off = skb_headlen(skb) - ETH_HLEN;
+	tx_copy_payload(&desc, 0, skb->data + ETH_HLEN, off);
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; ++i) {
+		const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
 
-	core_eci_tx(phys_to_virt(FPGA_MEM_BASE), &priv->ctx, &desc);
+		tx_copy_payload(&desc, off, skb_frag_address(frag),
+				skb_frag_size(frag));
+		off += skb_frag_size(frag);
+	}
+	desc.payload_len = len;
 
-	// free skb and return
-	dev_kfree_skb(skb);
-	dev->stats.tx_packets++;
-	dev->stats.tx_bytes += skb->len;
+	if (!core_eci_tx_fill(q->base, &q->ctx, &desc)) {
+		queue_stats_drop(&q->tx_stats);
+		dev_kfree_skb_any(skb);
+		goto out;
+	}
+	q->tx_slot_bytes[q->ctx.tx_prod & (LAUBERHORN_ECI_TX_RING_SLOTS - 1)] =
+		bytes;
+	++q->ctx.tx_prod;
+	++q->tx_unrung;
+
+	queue_stats_add(&q->tx_stats, bytes);
+	dev_consume_skb_any(skb);
+
+	// stop before the ring is full, rather than failing the next packet
+	if (core_eci_tx_ring_full(&q->ctx))
+		netif_tx_stop_queue(txq);
+
+	// ring once for a batch of packets from the stack; BQL may stop the
+	// queue, in which case it needs the doorbell now
+	if (!__netdev_tx_sent_queue(txq, bytes, netdev_xmit_more()))
+		return NETDEV_TX_OK;
+
+	tx_ring_doorbell(q, txq);
+
+	// the doorbell may have freed enough already; if not, the timer picks
+	// up the completions that wake the queue
+	if (netif_tx_queue_stopped(txq) && !core_eci_tx_ring_full(&q->ctx))
+		netif_tx_wake_queue(txq);
+	if (netif_xmit_stopped(txq))
+		tx_arm_reap(q);
+
+	return NETDEV_TX_OK;
+
+out:
+	// packets of the batch before the dropped one may still wait for the
+	// doorbell
+	if (q->tx_unrung && !netdev_xmit_more())
+		tx_ring_doorbell(q, txq);
 	return NETDEV_TX_OK;
 }
 
-static bool rx_bypass_pkt(lauberhorn_pkt_desc_t *desc, struct napi_struct *n,
-			  struct net_device *dev)
+// Layout of an RX page: XDP headroom, room for the parsed header, the payload
+// as received from the CLs, and tailroom for an skb_shared_info (for XDP
+// frames turned into skbs after a redirect)
+#define RX_PAGE_HEADROOM XDP_PACKET_HEADROOM
+#define RX_PAGE_PAYLOAD_OFFSET (RX_PAGE_HEADROOM + LAUBERHORN_BYPASS_HDR_SIZE)
+#define RX_PAGE_ORDER                                                  \
+	get_order(RX_PAGE_PAYLOAD_OFFSET + LAUBERHORN_MTU +             \
+		  SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
+#define RX_PAGE_SIZE (PAGE_SIZE << RX_PAGE_ORDER)
+
+// Make sure the RX burst slot idx has a page to receive into, and point desc at
+// it
+static bool rx_prepare_slot(struct bypass_queue *q, int idx,
+			    lauberhorn_pkt_desc_t *desc)
+{
+	struct page *page = q->rx_pages[idx];
+
+	if (!page) {
+		page = page_pool_dev_alloc_pages(q->rx_pool);
+		if (!page)
+			return false;
+		q->rx_pages[idx] = page;
+	}
+
+	desc->payload_buf = page_address(page) + RX_PAGE_PAYLOAD_OFFSET;
+	desc->payload_len = LAUBERHORN_MTU;
+	return true;
+}
+
+// Send an Ethernet frame on the bypass core of q, from outside the stack's
+// xmit path (XDP).  Not accounted in BQL.  Returns false if the frame was not
+// sent, e.g. because the ring is full; the caller drops it
+static bool tx_xdp_frame(struct bypass_queue *q, void *data, u32 len)
+{
+	struct netdev_queue *txq = netdev_get_tx_queue(q->priv->dev, q->idx);
+	lauberhorn_pkt_desc_t desc;
+	bool sent;
+
+	if (len < ETH_HLEN ||
+	    len - ETH_HLEN > LAUBERHORN_ECI_INLINE_DATA_SIZE +
+				     LAUBERHORN_ECI_NUM_OVERFLOW_CL *
+					     LAUBERHORN_ECI_CL_SIZE)
+		return false;
+
+	desc.type = TY_BYPASS;
+	desc.bypass.header_type = HDR_ETHERNET;
+	memcpy(desc.bypass.header, data, ETH_HLEN);
+	desc.payload_buf = data + ETH_HLEN;
+	desc.payload_len = len - ETH_HLEN;
+
+	// shares the ring with netdev_xmit on other CPUs
+	__netif_tx_lock(txq, smp_processor_id());
+
+	// one look at the NIC for free slots; never wait for it in softirq
+	if (core_eci_tx_ring_full(&q->ctx)) {
+		if (q->tx_unrung) {
+			tx_ring_doorbell(q, txq);
+		} else {
+			core_eci_tx_poll(q->base, &q->ctx);
+			tx_reap(q, txq);
+		}
+		if (core_eci_tx_ring_full(&q->ctx)) {
+			__netif_tx_unlock(txq);
+			return false;
+		}
+	}
+
+	q->tx_slot_bytes[q->ctx.tx_prod & (LAUBERHORN_ECI_TX_RING_SLOTS - 1)] =
+		0;
+	// copies the frame and rings the doorbell, also for the slots
+	// netdev_xmit left unrung
+	sent = core_eci_tx(q->base, &q->ctx, &desc);
+	q->tx_unrung = 0;
+	tx_reap(q, txq);
+
+	__netif_tx_unlock(txq);
+
+	if (sent)
+		queue_stats_add(&q->tx_stats, len);
+	return sent;
+}
+
+// Run the XDP program on the frame in page.  Returns the verdict; on XDP_PASS,
+// data and len are updated to what the program left
+static u32 rx_run_xdp(struct bypass_queue *q, struct bpf_prog *prog,
+		      struct page *page, void **data, u32 *len)
+{
+	struct net_device *dev = q->priv->dev;
+	struct xdp_buff xdp;
+	u32 act;
+
+	xdp_init_buff(&xdp, RX_PAGE_SIZE, &q->xdp_rxq);
+	xdp_prepare_buff(&xdp, page_address(page),
+			 *data - page_address(page), *len, false);
+
+	act = bpf_prog_run_xdp(prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		*data = xdp.data;
+		*len = xdp.data_end - xdp.data;
+		break;
+	case XDP_TX:
+		if (!tx_xdp_frame(q, xdp.data, xdp.data_end - xdp.data))
+			goto fail;
+		break;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(dev, &xdp, prog))
+			goto fail;
+		q->xdp_redirected = true;
+		break;
+	default:
+		bpf_warn_invalid_xdp_action(dev, prog, act);
+		fallthrough;
+	case XDP_ABORTED:
+fail:
+		trace_xdp_exception(dev, prog, act);
+		act = XDP_DROP;
+		fallthrough;
+	case XDP_DROP:
+		queue_stats_drop(&q->rx_stats);
+		break;
+	}
+
+	return act;
+}
+
+// Handle the packet received into the page of slot idx: run XDP on it and
+// build an skb for the stack.  Takes the page out of the slot if it was handed
+// on with the packet
+static bool rx_bypass_pkt(lauberhorn_pkt_desc_t *desc, int idx,
+			  struct bypass_queue *q, struct bpf_prog *prog)
 {
+	struct net_device *dev = q->priv->dev;
+	struct page *page = q->rx_pages[idx];
 	struct sk_buff *skb;
 	int hdr_len = 0;
+	bool csum_ok = desc->bypass.csum_ok;
+	void *data;
+	u32 len, pull;
 
 	BUG_ON(desc->type != TY_BYPASS);
 	switch (desc->bypass.header_type) {
@@ -276,25 +774,68 @@ static bool rx_bypass_pkt(lauberhorn_pkt_desc_t *desc, struct napi_struct *n,
 		return false;
 	}
 
-	skb = netdev_alloc_skb(dev, hdr_len + desc->payload_len + NET_IP_ALIGN);
+	// rebuild the frame: parsed header right in front of the payload
+	data = page_address(page) + RX_PAGE_PAYLOAD_OFFSET - hdr_len;
+	len = hdr_len + desc->payload_len;
+	memcpy(data, desc->bypass.header, hdr_len);
+
+	queue_stats_add(&q->rx_stats, len);
+
+	if (prog) {
+		void *hw_data = data;
+		u32 hw_len = len;
+
+		switch (rx_run_xdp(q, prog, page, &data, &len)) {
+		case XDP_PASS:
+			break;
+		case XDP_REDIRECT:
+			// page handed on with the frame
+			q->rx_pages[idx] = NULL;
+			return true;
+		default:
+			// frame copied out or dropped: keep the page
+			return true;
+		}
+
+		if (len < ETH_HLEN) {
+			queue_stats_drop(&q->rx_stats);
+			return true;
+		}
+
+		// the hardware verdict is about the frame it received
+		if (data != hw_data || len != hw_len)
+			csum_ok = false;
+	}
+
+	// headers in the linear area, for GRO and the protocol handlers; the
+	// rest stays in the page
+	pull = len <= RX_COPYBREAK ? len : eth_get_headlen(dev, data, len);
+	skb = napi_alloc_skb(&q->napi, pull);
 	if (!skb) {
-		pr_err("failed to allocate skb\n");
-		dev->stats.rx_dropped++;
+		queue_stats_drop(&q->rx_stats);
 		return false;
 	}
-	skb_reserve(skb, NET_IP_ALIGN);
-	memcpy(skb_put(skb, hdr_len), desc->bypass.header, hdr_len);
-	memcpy(skb_put(skb, desc->payload_len), desc->payload_buf,
-	       desc->payload_len);
+
+	skb_put_data(skb, data, pull);
+	if (len > pull) {
+		skb_add_rx_frag(skb, 0, page,
+				data + pull - page_address(page), len - pull,
+				RX_PAGE_SIZE);
+		skb_mark_for_recycle(skb);
+		// page handed to the stack
+		q->rx_pages[idx] = NULL;
+	}
+
 	skb->protocol = eth_type_trans(skb, dev);
 	skb->dev = dev;
+	// for RPS / RFS
+	skb_record_rx_queue(skb, q->idx);
 
-	// we don't do checksum verification in hardware
-
-	napi_gro_receive(n, skb);
+	// UDP checksum verified in hardware; everything else is left to the stack
+	if (csum_ok)
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
 
-	dev->stats.rx_packets++;
-	dev->stats.rx_bytes += hdr_len + desc->payload_len;
+	napi_gro_receive(&q->napi, skb);
 
 	return true;
 }
@@ -347,51 +888,205 @@ static void rx_handle_arp(lauberhorn_pkt_desc_t *desc, struct netdev_priv *priv)
 
 static int napi_poll(struct napi_struct *n, int budget)
 {
-	struct netdev_priv *priv = container_of(n, struct netdev_priv, napi);
-	struct net_device *dev = priv->dev;
+	struct bypass_queue *q = container_of(n, struct bypass_queue, napi);
+	struct netdev_priv *priv = q->priv;
+	struct bpf_prog *prog = READ_ONCE(priv->xdp_prog);
 	int work_done = 0;
+	int i, want, got;
 
-	lauberhorn_pkt_desc_t desc;
+	lauberhorn_pkt_desc_t descs[LAUBERHORN_RX_BURST];
 
-	while (work_done < budget) {
-		bool got_req = core_eci_rx(phys_to_virt(FPGA_MEM_BASE),
-					   &priv->ctx, &desc);
+	q->xdp_redirected = false;
 
-		if (!got_req)
-			break;
+	tx_poll_completions(q);
 
-		switch (desc.type) {
-		case TY_BYPASS:
-			if (!rx_bypass_pkt(&desc, n, dev))
-				continue;
-			break;
-		case TY_ARP_REQ:
-			rx_handle_arp(&desc, priv);
+	while (work_done < budget) {
+		want = min(budget - work_done, LAUBERHORN_RX_BURST);
+		for (i = 0; i < want; ++i) {
+			if (!rx_prepare_slot(q, i, &descs[i])) {
+				queue_stats_alloc_fail(&q->rx_stats);
+				break;
+			}
+		}
+		want = i;
+		if (!want)
 			break;
-		default:
-			pr_err("unsupported host req type %d\n", desc.type);
-			continue;
+
+		// drain a burst of requests in one go
+		got = core_eci_rx_burst(q->base, &q->ctx, descs, want);
+
+		for (i = 0; i < got; ++i) {
+			switch (descs[i].type) {
+			case TY_BYPASS:
+				if (rx_bypass_pkt(&descs[i], i, q, prog))
+					work_done++;
+				break;
+			case TY_ARP_REQ:
+				rx_handle_arp(&descs[i], priv);
+				work_done++;
+				break;
+			default:
+				pr_err("unsupported host req type %d\n",
+				       descs[i].type);
+			}
 		}
 
-		work_done++;
+		if (got < want)
+			break;
 	}
 
+	if (q->xdp_redirected)
+		xdp_do_flush();
+
 	if (work_done < budget) {
 		// drained all packets, finish NAPI and enable interrupts
 		if (napi_complete_done(n, work_done)) {
-			lauberhorn_eci_preempt_irq_en_wr(&priv->reg_dev, 1);
+			lauberhorn_eci_preempt_irq_en_wr(&q->reg_dev, 1);
 		}
 	}
 
 	return work_done;
 }
 
+static int netdev_xdp_setup(struct net_device *dev, struct bpf_prog *prog)
+{
+	struct netdev_priv *priv = netdev_priv(dev);
+	struct bpf_prog *old;
+
+	// every frame fits one RX page, so any MTU works
+	old = xchg(&priv->xdp_prog, prog);
+	if (old)
+		bpf_prog_put(old);
+
+	return 0;
+}
+
+static int netdev_bpf(struct net_device *dev, struct netdev_bpf *bpf)
+{
+	switch (bpf->command) {
+	case XDP_SETUP_PROG:
+		return netdev_xdp_setup(dev, bpf->prog);
+	default:
+		return -EINVAL;
+	}
+}
+
+// Frames redirected to us by XDP: sent on the queue of the current CPU, or a
+// queue shared with other CPUs, under its TX lock
+static int netdev_xdp_xmit(struct net_device *dev, int n,
+			   struct xdp_frame **frames, u32 flags)
+{
+	struct netdev_priv *priv = netdev_priv(dev);
+	struct bypass_queue *q =
+		&priv->queues[smp_processor_id() % priv->num_queues];
+	int i;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+	if (unlikely(!netif_running(dev)))
+		return -ENETDOWN;
+
+	for (i = 0; i < n; ++i) {
+		if (!tx_xdp_frame(q, frames[i]->data, frames[i]->len))
+			break;
+		// copied into the TX slot already
+		xdp_return_frame(frames[i]);
+	}
+
+	return i;
+}
+
 static const struct net_device_ops netdev_ops = {
 	.ndo_open = netdev_open,
 	.ndo_stop = netdev_stop,
 	.ndo_start_xmit = netdev_xmit,
 	.ndo_set_mac_address = netdev_setaddr,
 	.ndo_set_rx_mode = netdev_rx_mode,
+	.ndo_get_stats64 = netdev_get_stats64,
+	.ndo_bpf = netdev_bpf,
+	.ndo_xdp_xmit = netdev_xdp_xmit,
+};
+
+static void ethtool_get_channels(struct net_device *dev,
+				 struct ethtool_channels *ch)
+{
+	struct netdev_priv *priv = netdev_priv(dev);
+
+	// every bypass core has one RX and one TX ring, served together
+	ch->max_combined = LAUBERHORN_NUM_BYPASS_CORES;
+	ch->combined_count = priv->num_queues;
+}
+
+static int ethtool_set_channels(struct net_device *dev,
+				struct ethtool_channels *ch)
+{
+	struct netdev_priv *priv = netdev_priv(dev);
+	int err;
+
+	if (!ch->combined_count || ch->rx_count || ch->tx_count)
+		return -EINVAL;
+
+	// the queues left out may still hold packets steered to them; only
+	// change while no NAPI is running
+	if (netif_running(dev))
+		return -EBUSY;
+
+	err = netif_set_real_num_tx_queues(dev, ch->combined_count);
+	if (err)
+		return err;
+	err = netif_set_real_num_rx_queues(dev, ch->combined_count);
+	if (err)
+		return err;
+
+	write_hw_rss_tbl(priv, ch->combined_count);
+	priv->num_queues = ch->combined_count;
+	pr_info("Using %d bypass queues\n", priv->num_queues);
+
+	return 0;
+}
+
+// ethtool -S: per-queue counters not covered by ndo_get_stats64
+static int ethtool_get_sset_count(struct net_device *dev, int sset)
+{
+	if (sset != ETH_SS_STATS)
+		return -EOPNOTSUPP;
+	return LAUBERHORN_NUM_BYPASS_CORES;
+}
+
+static void ethtool_get_strings(struct net_device *dev, u32 sset, u8 *data)
+{
+	int i;
+
+	if (sset != ETH_SS_STATS)
+		return;
+	for (i = 0; i < LAUBERHORN_NUM_BYPASS_CORES; ++i)
+		ethtool_sprintf(&data, "rx%d_alloc_fail", i);
+}
+
+static void ethtool_get_stats(struct net_device *dev,
+			      struct ethtool_stats *es, u64 *data)
+{
+	struct netdev_priv *priv = netdev_priv(dev);
+	unsigned int start;
+	int i;
+
+	for (i = 0; i < LAUBERHORN_NUM_BYPASS_CORES; ++i) {
+		struct bypass_queue_stats *stats = &priv->queues[i].rx_stats;
+
+		do {
+			start = u64_stats_fetch_begin(&stats->syncp);
+			data[i] = stats->alloc_fail;
+		} while (u64_stats_fetch_retry(&stats->syncp, start));
+	}
+}
+
+static const struct ethtool_ops ethtool_ops = {
+	.get_link = ethtool_op_get_link,
+	.get_channels = ethtool_get_channels,
+	.set_channels = ethtool_set_channels,
+	.get_sset_count = ethtool_get_sset_count,
+	.get_strings = ethtool_get_strings,
+	.get_ethtool_stats = ethtool_get_stats,
 };
 
 static int arp_event(struct notifier_block *nb, unsigned long event, void *ptr)
@@ -446,7 +1141,15 @@ static void init_netdev(struct net_device *dev)
 {
 	ether_setup(dev);
 	dev->netdev_ops = &netdev_ops;
+	dev->ethtool_ops = &ethtool_ops;
 	dev->mtu = LAUBERHORN_MTU;
+
+	// frags are copied into the TX slot one by one
+	dev->hw_features |= NETIF_F_SG;
+	dev->features |= NETIF_F_SG;
+
+	dev->xdp_features = NETDEV_XDP_ACT_BASIC | NETDEV_XDP_ACT_REDIRECT |
+			    NETDEV_XDP_ACT_NDO_XMIT;
 }
 
 static inline void cl_hit_inv(u64 phys_addr)
@@ -455,32 +1158,169 @@ static inline void cl_hit_inv(u64 phys_addr)
 	asm volatile("sys #0,c11,c1,#1,%0 \n" ::"r"(virt));
 }
 
+// Invalidate control and bypass CLs of one bypass core
+static void inv_bypass_cls(int idx)
+{
+	int cl_id, slot;
+
+	u64 rx_base = FPGA_MEM_BASE + idx * LAUBERHORN_ECI_CORE_OFFSET +
+		      LAUBERHORN_ECI_RX_BASE;
+	u64 tx_base = FPGA_MEM_BASE + idx * LAUBERHORN_ECI_CORE_OFFSET +
+		      LAUBERHORN_ECI_TX_BASE;
+
+	for (cl_id = 0; cl_id < 2; ++cl_id)
+		cl_hit_inv(rx_base + 0x80 * cl_id);
+
+	for (cl_id = 0; cl_id < LAUBERHORN_ECI_NUM_OVERFLOW_CL; ++cl_id)
+		cl_hit_inv(rx_base + LAUBERHORN_ECI_OVERFLOW_OFFSET +
+			   0x80 * cl_id);
+
+	// ... and every slot of the TX ring
+	for (slot = 0; slot < LAUBERHORN_ECI_TX_RING_SLOTS; ++slot) {
+		u64 slot_base = tx_base + slot * LAUBERHORN_ECI_TX_SLOT_STRIDE;
+
+		cl_hit_inv(slot_base);
+		cl_hit_inv(slot_base + LAUBERHORN_ECI_TX_DOORBELL_OFFSET);
+		for (cl_id = 0; cl_id < LAUBERHORN_ECI_NUM_OVERFLOW_CL; ++cl_id)
+			cl_hit_inv(slot_base + LAUBERHORN_ECI_OVERFLOW_OFFSET +
+				   0x80 * cl_id);
+	}
+	cl_hit_inv(tx_base + LAUBERHORN_ECI_TX_STATUS_OFFSET);
+}
+
+static int init_bypass_queue(struct netdev_priv *priv, int idx)
+{
+	struct bypass_queue *q = &priv->queues[idx];
+	int err;
+	struct page_pool_params pp_params = {
+		.order = RX_PAGE_ORDER,
+		.pool_size = RX_PAGE_POOL_SIZE,
+		.nid = NUMA_NO_NODE,
+	};
+
+	q->priv = priv;
+	q->idx = idx;
+	// bypass core i is served by CPU i; the workers take the last CPUs
+	q->cpu = idx;
+	q->base = phys_to_virt(FPGA_MEM_BASE +
+			       (u64)idx * LAUBERHORN_ECI_CORE_OFFSET);
+
+	// Route the FPI of this bypass core to its CPU
+	lauberhorn_eci_preempt_initialize(&q->reg_dev,
+					  LAUBERHORN_ECI_PREEMPT_BASE(idx));
+	lauberhorn_eci_preempt_irq_en_wr(&q->reg_dev, 0);
+	lauberhorn_eci_preempt_real_core_id_wr(&q->reg_dev, q->cpu);
+
+	// Initialize datapath core state.  RX is copied straight into skbs
+	// and TX is serialized in place, so no overflow buffers are needed
+	q->ctx.rx_next_cl = 0;
+	q->ctx.tx_prod = q->ctx.tx_cons = 0;
+	q->ctx.rx_view_held = q->ctx.tx_view_held = false;
+	q->ctx.rx_overflow_buf = q->ctx.tx_overflow_buf = NULL;
+	q->ctx.rx_overflow_buf_size = q->ctx.tx_overflow_buf_size = 0;
+	memset(q->rx_pages, 0, sizeof(q->rx_pages));
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&q->tx_timer, tx_reap_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&q->tx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	q->tx_timer.function = tx_reap_timer;
+#endif
+
+	u64_stats_init(&q->rx_stats.syncp);
+	u64_stats_init(&q->tx_stats.syncp);
+
+	inv_bypass_cls(idx);
+
+	// The CPU copies the payload out of the CLs: no DMA mapping needed
+	pp_params.nid = cpu_to_node(q->cpu);
+	q->rx_pool = page_pool_create(&pp_params);
+	if (IS_ERR(q->rx_pool)) {
+		err = PTR_ERR(q->rx_pool);
+
+		pr_err("failed to create page pool for queue %d: err %d\n", idx,
+		       err);
+		q->rx_pool = NULL;
+		return err;
+	}
+
+	netif_napi_add(priv->dev, &q->napi, napi_poll);
+
+	err = xdp_rxq_info_reg(&q->xdp_rxq, priv->dev, idx, q->napi.napi_id);
+	if (err < 0)
+		goto fail_rxq;
+	err = xdp_rxq_info_reg_mem_model(&q->xdp_rxq, MEM_TYPE_PAGE_POOL,
+					 q->rx_pool);
+	if (err < 0)
+		goto fail_mem_model;
+
+	return 0;
+
+fail_mem_model:
+	xdp_rxq_info_unreg(&q->xdp_rxq);
+fail_rxq:
+	pr_err("failed to register XDP RX queue %d: err %d\n", idx, err);
+	netif_napi_del(&q->napi);
+	page_pool_destroy(q->rx_pool);
+	q->rx_pool = NULL;
+	return err;
+}
+
+static void deinit_bypass_queue(struct bypass_queue *q)
+{
+	int i;
+
+	// not set up: init_bypass_queue failed before
+	if (!q->rx_pool)
+		return;
+
+	xdp_rxq_info_unreg(&q->xdp_rxq);
+	netif_napi_del(&q->napi);
+
+	// Return unused RX pages; the pool goes away once the stack has
+	// returned the rest
+	for (i = 0; i < LAUBERHORN_RX_BURST; ++i) {
+		if (q->rx_pages[i])
+			page_pool_put_full_page(q->rx_pool, q->rx_pages[i],
+						false);
+	}
+	page_pool_destroy(q->rx_pool);
+	q->rx_pool = NULL;
+}
+
 int init_bypass(void)
 {
-	int err, cl_id;
+	int err, i;
 	struct net_device *netdev;
 	struct netdev_priv *priv;
 	cmac_core_version_t ver;
 	u8 ver_maj, ver_min;
 
-	u64 rx_base = FPGA_MEM_BASE + LAUBERHORN_ECI_RX_BASE;
-	u64 tx_base = FPGA_MEM_BASE + LAUBERHORN_ECI_TX_BASE;
-
 	macaddr_cast_t mac_addr;
 
-	// Create netdev
-	netdev = alloc_netdev(sizeof(struct netdev_priv), "lauberhorn%d",
-			      NET_NAME_UNKNOWN, init_netdev);
+	if (num_online_cpus() <
+	    LAUBERHORN_NUM_BYPASS_CORES + LAUBERHORN_NUM_WORKER_CORES) {
+		pr_err("need %d CPUs for the bypass and worker cores, have %d\n",
+		       LAUBERHORN_NUM_BYPASS_CORES + LAUBERHORN_NUM_WORKER_CORES,
+		       num_online_cpus());
+		return -ENODEV;
+	}
+
+	// Create netdev, one queue per bypass core
+	netdev = alloc_netdev_mqs(sizeof(struct netdev_priv), "lauberhorn%d",
+				  NET_NAME_UNKNOWN, init_netdev,
+				  LAUBERHORN_NUM_BYPASS_CORES,
+				  LAUBERHORN_NUM_BYPASS_CORES);
 	if (!netdev) {
 		pr_err("failed to allocate netdev\n");
 		return -ENOMEM;
 	}
 	priv = netdev_priv(netdev);
 	priv->dev = netdev;
+	priv->num_queues = LAUBERHORN_NUM_BYPASS_CORES;
 
 	// Create Mackerel devices
-	lauberhorn_eci_preempt_initialize(&priv->reg_dev,
-					  LAUBERHORN_ECI_PREEMPT_BASE(0));
 	lauberhorn_eci_dma_initialize(&priv->dma_dev, LAUBERHORN_ECI_DMA_BASE);
 	lauberhorn_eci_EthernetDecoder_initialize(
 		&priv->eth_dec_dev, LAUBERHORN_ECI__ETHERNET_DECODER_BASE);
@@ -512,27 +1352,13 @@ int init_bypass(void)
 	eth_hw_addr_set(netdev, mac_addr.arr);
 	pr_info("Our MAC address: %pM\n", netdev->dev_addr);
 
-	// Initialize datapath core state
-	priv->ctx.rx_next_cl = priv->ctx.tx_next_cl = 0;
-	priv->ctx.rx_overflow_buf_size = priv->ctx.tx_overflow_buf_size =
-		LAUBERHORN_MTU;
-	priv->ctx.rx_overflow_buf =
-		kmalloc(priv->ctx.rx_overflow_buf_size, GFP_KERNEL);
-	priv->ctx.tx_overflow_buf =
-		kmalloc(priv->ctx.tx_overflow_buf_size, GFP_KERNEL);
-
-	// Invalidate control and bypass CLs
-	for (cl_id = 0; cl_id < 2; ++cl_id) {
-		cl_hit_inv(rx_base + 0x80 * cl_id);
-		cl_hit_inv(tx_base + 0x80 * cl_id);
-	}
-
-	for (cl_id = 0; cl_id < LAUBERHORN_ECI_NUM_OVERFLOW_CL; ++cl_id) {
-		cl_hit_inv(rx_base + LAUBERHORN_ECI_OVERFLOW_OFFSET +
-			   0x80 * cl_id);
-		cl_hit_inv(tx_base + LAUBERHORN_ECI_OVERFLOW_OFFSET +
-			   0x80 * cl_id);
+	// Set up the queues and spread the flows over all of them
+	for (i = 0; i < LAUBERHORN_NUM_BYPASS_CORES; ++i) {
+		err = init_bypass_queue(priv, i);
+		if (err < 0)
+			goto fail_queues;
 	}
+	write_hw_rss_tbl(priv, priv->num_queues);
 
 	// Reset packet buffer allocator
 	lauberhorn_eci_dma_ctrl_alloc_reset_wr(&priv->dma_dev, 1);
@@ -540,16 +1366,16 @@ int init_bypass(void)
 	lauberhorn_eci_dma_ctrl_alloc_reset_wr(&priv->dma_dev, 0);
 
 	// Register netdev
-	netif_napi_add(netdev, &priv->napi, napi_poll);
-
 	err = register_netdev(netdev);
 	if (err < 0) {
 		pr_err("failed to register netdev: err %d\n", err);
-		netif_napi_del(&priv->napi);
-		free_netdev(netdev);
-		return err;
+		goto fail_queues;
 	}
 
+	// Send from the CPU that receives, by default
+	for (i = 0; i < LAUBERHORN_NUM_BYPASS_CORES; ++i)
+		netif_set_xps_queue(netdev, cpumask_of(priv->queues[i].cpu), i);
+
 	// Register callback for IP address configuration
 	register_inetaddr_notifier(&inetaddr_notifier);
 
@@ -557,31 +1383,47 @@ int init_bypass(void)
 	register_netevent_notifier(&arp_notifier);
 
 	// Enable FIFO non-empty interrupt
-	err = init_bypass_fpi(netdev);
+	err = init_bypass_fpi(priv);
 	if (err < 0)
-		return err;
+		goto fail_notifiers;
 
+	bypass_netdev = netdev;
 	return 0;
+
+fail_notifiers:
+	unregister_netevent_notifier(&arp_notifier);
+	unregister_inetaddr_notifier(&inetaddr_notifier);
+	unregister_netdev(netdev);
+fail_queues:
+	for (i = 0; i < LAUBERHORN_NUM_BYPASS_CORES; ++i)
+		deinit_bypass_queue(&priv->queues[i]);
+	free_netdev(netdev);
+	return err;
 }
 
 void deinit_bypass(void)
 {
-	struct net_device **cookie_ptr = per_cpu_ptr(&bypass_fpi_cookie, 0);
-	struct net_device *netdev = *cookie_ptr;
-	struct netdev_priv *priv = netdev_priv(netdev);
+	struct net_device *netdev = bypass_netdev;
+	struct netdev_priv *priv;
+	int i;
+
+	// init_bypass cleans up after itself on failure
+	if (!netdev)
+		return;
+	priv = netdev_priv(netdev);
 
 	// Disable interrupts
-	deinit_bypass_fpi();
+	deinit_bypass_fpi(priv);
 
-	// Deregister IP addr callback
+	// Deregister IP addr and ARP callbacks
+	unregister_netevent_notifier(&arp_notifier);
 	unregister_inetaddr_notifier(&inetaddr_notifier);
 
-	// Free overflow buffers
-	kfree(priv->ctx.rx_overflow_buf);
-	kfree(priv->ctx.tx_overflow_buf);
-
 	// Destroy netdev
 	unregister_netdev(netdev);
-	netif_napi_del(&priv->napi);
+	for (i = 0; i < LAUBERHORN_NUM_BYPASS_CORES; ++i)
+		deinit_bypass_queue(&priv->queues[i]);
 	free_netdev(netdev);
+
+	bypass_netdev = NULL;
 }
\ No newline at end of file
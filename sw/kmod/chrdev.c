@@ -4,6 +4,15 @@
 #include "common.h"
 #include "ioctl.h"
 
+#include "eci/config.h"
+#include "eci/regblock_bases.h"
+
+#include "lauberhorn_eci_UdpDecoder.h"
+#include "lauberhorn_eci_OncRpcCallDecoder.h"
+#include "lauberhorn_eci_OncRpcCallEncoder.h"
+#include "lauberhorn_eci_threadRouter.h"
+#include "lauberhorn_eci_worker.h"
+
 static dev_t dev = 0;
 static struct cdev cdev;
 static struct class *dev_class;
@@ -14,10 +23,22 @@ struct thr_def {
 
 	pid_t pid;
 
-	// Used to update the per-thread CL address to core worker mapping
+	// Used to update the per-thread CL address to core worker mapping: the
+	// worker core the thread's window is routed to
 	u32 translation_tbl_idx;
 };
 
+// UDP port with a listener in the UDP decoder
+struct listen_def {
+	bool enabled;
+
+	u16 port;
+	lauberhorn_eci_udp_next_proto_t proto;
+
+	u32 proc_idx;
+};
+static struct listen_def listen_defs[LAUBERHORN_NUM_LISTEN_PORTS];
+
 struct srv_def {
 	bool enabled;
 
@@ -32,6 +53,21 @@ struct srv_def {
 };
 static struct srv_def srv_defs[LAUBERHORN_NUM_SERVICES];
 
+// Remote procedure called by an application (nested calls)
+struct clnt_def {
+	bool enabled;
+
+	u32 prog_num, prog_ver, proc_num;
+	u32 server_addr;
+	u16 server_port, client_port;
+
+	// Names the procedure in the client table of the call encoder
+	void *func_ptr;
+
+	u32 proc_idx;
+};
+static struct clnt_def clnt_defs[LAUBERHORN_NUM_CLIENTS];
+
 struct proc_def {
 	bool enabled;
 
@@ -41,54 +77,166 @@ struct proc_def {
 };
 static struct proc_def proc_defs[LAUBERHORN_NUM_PROCS];
 
-static void register_service(u16 port, u32 prog_num, u32 prog_ver, u32 proc_num,
-			     void *func_ptr, pid_t tgid)
+// Protects listen_defs, srv_defs, clnt_defs and proc_defs against concurrent
+// open / ioctl / mmap / close; also serializes the table updates in HW, which
+// take one register write per field
+static DEFINE_MUTEX(defs_lock);
+
+// Mackerel devices of the tables programmed from here
+static lauberhorn_eci_UdpDecoder_t udp_dec_dev;
+static lauberhorn_eci_OncRpcCallDecoder_t call_dec_dev;
+static lauberhorn_eci_OncRpcCallEncoder_t call_enc_dev;
+static lauberhorn_eci_threadRouter_t router_dev;
+static lauberhorn_eci_worker_t worker_devs[LAUBERHORN_NUM_WORKER_CORES];
+
+// Worker cores with a thread window routed to them
+static DECLARE_BITMAP(routed_workers, LAUBERHORN_NUM_WORKER_CORES);
+
+// All fields are in host byte order; the NIC swaps them on the index write,
+// which commits the entry
+static void program_listen(u32 idx, u16 port,
+			   lauberhorn_eci_udp_next_proto_t proto)
 {
-	int i, srv_idx, proc_idx;
+	lauberhorn_eci_UdpDecoder_ctrl_listen_port_wr(&udp_dec_dev, port);
+	lauberhorn_eci_UdpDecoder_ctrl_listen_next_proto_wr(&udp_dec_dev,
+							    proto);
+	lauberhorn_eci_UdpDecoder_ctrl_listen_idx_wr(&udp_dec_dev, idx);
+}
 
-	for (i = 0; i < LAUBERHORN_NUM_SERVICES; ++i) {
-		if (!srv_defs[i].enabled) {
-			srv_idx = i;
-			break;
-		} else if (srv_defs[i].port == port &&
-			   srv_defs[i].prog_num == prog_num &&
-			   srv_defs[i].prog_ver == prog_ver &&
-			   srv_defs[i].proc_num == proc_num) {
-			pr_err("Service prog=%d ver=%d proc=%d on UDP port %d already registered as #%d!\n",
-			       prog_num, prog_ver, proc_num, port, i);
-			return -1;
+static void program_service(u32 idx, const struct srv_def *srv, bool enabled)
+{
+	lauberhorn_eci_OncRpcCallDecoder_ctrl_service_enabled_wr(&call_dec_dev,
+								 enabled);
+	lauberhorn_eci_OncRpcCallDecoder_ctrl_service_prog_num_wr(
+		&call_dec_dev, srv->prog_num);
+	lauberhorn_eci_OncRpcCallDecoder_ctrl_service_prog_ver_wr(
+		&call_dec_dev, srv->prog_ver);
+	lauberhorn_eci_OncRpcCallDecoder_ctrl_service_proc_wr(&call_dec_dev,
+							      srv->proc_num);
+	lauberhorn_eci_OncRpcCallDecoder_ctrl_service_listen_port_wr(
+		&call_dec_dev, srv->port);
+	lauberhorn_eci_OncRpcCallDecoder_ctrl_service_func_ptr_wr(
+		&call_dec_dev, (u64)(uintptr_t)srv->func_ptr);
+	lauberhorn_eci_OncRpcCallDecoder_ctrl_service_pid_wr(
+		&call_dec_dev, proc_defs[srv->proc_idx].tgid);
+	lauberhorn_eci_OncRpcCallDecoder_ctrl_service_idx_wr(&call_dec_dev,
+							     idx);
+}
+
+static void program_client(u32 idx, const struct clnt_def *clnt, bool enabled)
+{
+	lauberhorn_eci_OncRpcCallEncoder_ctrl_client_enabled_wr(&call_enc_dev,
+								enabled);
+	lauberhorn_eci_OncRpcCallEncoder_ctrl_client_prog_num_wr(
+		&call_enc_dev, clnt->prog_num);
+	lauberhorn_eci_OncRpcCallEncoder_ctrl_client_prog_ver_wr(
+		&call_enc_dev, clnt->prog_ver);
+	lauberhorn_eci_OncRpcCallEncoder_ctrl_client_proc_wr(&call_enc_dev,
+							     clnt->proc_num);
+	lauberhorn_eci_OncRpcCallEncoder_ctrl_client_server_addr_wr(
+		&call_enc_dev, clnt->server_addr);
+	lauberhorn_eci_OncRpcCallEncoder_ctrl_client_server_port_wr(
+		&call_enc_dev, clnt->server_port);
+	lauberhorn_eci_OncRpcCallEncoder_ctrl_client_client_port_wr(
+		&call_enc_dev, clnt->client_port);
+	lauberhorn_eci_OncRpcCallEncoder_ctrl_client_func_ptr_wr(
+		&call_enc_dev, (u64)(uintptr_t)clnt->func_ptr);
+	lauberhorn_eci_OncRpcCallEncoder_ctrl_client_pid_wr(
+		&call_enc_dev, proc_defs[clnt->proc_idx].tgid);
+	lauberhorn_eci_OncRpcCallEncoder_ctrl_client_idx_wr(&call_enc_dev,
+							    idx);
+}
+
+static int open_listen_port(u16 port, lauberhorn_eci_udp_next_proto_t proto,
+			    u32 proc_idx)
+{
+	int i, listen_idx = -1;
+
+	for (i = 0; i < LAUBERHORN_NUM_LISTEN_PORTS; ++i) {
+		if (!listen_defs[i].enabled) {
+			if (listen_idx < 0)
+				listen_idx = i;
+		} else if (listen_defs[i].port == port) {
+			pr_err("UDP port %d already open as #%d!\n", port, i);
+			return -EADDRINUSE;
 		}
 	}
 
-	if (i == LAUBERHORN_NUM_SERVICES) {
-		pr_err("No more free service slots in HW: %d already registered\n",
+	if (listen_idx < 0) {
+		pr_err("No more free listen slots in HW: %d already open\n",
 		       i);
-		return -1;
+		return -ENOSPC;
 	}
 
-	for (i = 0; i < LAUBERHORN_NUM_PROCS; ++i) {
-		if (proc_defs[i].enabled && proc_defs[i].tgid == tgid) {
-			proc_idx = i;
-			break;
+	listen_defs[listen_idx].port = port;
+	listen_defs[listen_idx].proto = proto;
+	listen_defs[listen_idx].proc_idx = proc_idx;
+
+	program_listen(listen_idx, port, proto);
+
+	listen_defs[listen_idx].enabled = true;
+	pr_info("Opened UDP port %d as #%d under TGID %d\n", port, listen_idx,
+		proc_defs[proc_idx].tgid);
+	return listen_idx;
+}
+
+static int find_listen_port(u16 port)
+{
+	int i;
+
+	for (i = 0; i < LAUBERHORN_NUM_LISTEN_PORTS; ++i) {
+		if (listen_defs[i].enabled && listen_defs[i].port == port)
+			return i;
+	}
+	return -1;
+}
+
+static int register_service(const lauberhorn_reg_srv_t *req, u32 proc_idx)
+{
+	int i, listen_idx, srv_idx = -1;
+
+	listen_idx = find_listen_port(req->port);
+	if (listen_idx < 0 || listen_defs[listen_idx].proc_idx != proc_idx ||
+	    listen_defs[listen_idx].proto != lauberhorn_eci_listen_onc_rpc_call) {
+		pr_err("UDP port %d not open for calls by app #%d\n",
+		       req->port, proc_idx);
+		return -ENOENT;
+	}
+
+	for (i = 0; i < LAUBERHORN_NUM_SERVICES; ++i) {
+		if (!srv_defs[i].enabled) {
+			if (srv_idx < 0)
+				srv_idx = i;
+		} else if (srv_defs[i].port == req->port &&
+			   srv_defs[i].prog_num == req->prog_num &&
+			   srv_defs[i].prog_ver == req->prog_ver &&
+			   srv_defs[i].proc_num == req->proc_num) {
+			pr_err("Service prog=%d ver=%d proc=%d on UDP port %d already registered as #%d!\n",
+			       req->prog_num, req->prog_ver, req->proc_num,
+			       req->port, i);
+			return -EEXIST;
 		}
 	}
-	if (i == LAUBERHORN_NUM_PROCS) {
-		pr_err("Failed to find TGID %d for service, bug?\n", tgid);
-		return -1;
+
+	if (srv_idx < 0) {
+		pr_err("No more free service slots in HW: %d already registered\n",
+		       i);
+		return -ENOSPC;
 	}
 
-	srv_defs[srv_idx].port = port;
-	srv_defs[srv_idx].prog_num = prog_num;
-	srv_defs[srv_idx].prog_ver = prog_ver;
-	srv_defs[srv_idx].proc_num = proc_num;
-	srv_defs[srv_idx].func_ptr = func_ptr;
+	srv_defs[srv_idx].port = req->port;
+	srv_defs[srv_idx].prog_num = req->prog_num;
+	srv_defs[srv_idx].prog_ver = req->prog_ver;
+	srv_defs[srv_idx].proc_num = req->proc_num;
+	srv_defs[srv_idx].func_ptr = req->func_ptr;
 	srv_defs[srv_idx].proc_idx = proc_idx;
 
-	// TODO: program into HW
+	program_service(srv_idx, &srv_defs[srv_idx], true);
 
 	srv_defs[srv_idx].enabled = true;
-	pr_info("Registered service #%d under TGID %d\n", srv_idx, tgid);
-	return 0;
+	pr_info("Registered service #%d under TGID %d\n", srv_idx,
+		proc_defs[proc_idx].tgid);
+	return srv_idx;
 }
 
 static void deregister_service(u32 idx)
@@ -101,12 +249,201 @@ static void deregister_service(u32 idx)
 
 	tgid = proc_defs[srv_defs[idx].proc_idx].tgid;
 
-	// TODO: program into HW
+	program_service(idx, &srv_defs[idx], false);
 
 	srv_defs[idx].enabled = false;
 	pr_info("Deregistered service #%d (was with TGID %d)\n", idx, tgid);
 }
 
+// Services on the port go with it: the decoder would drop their calls anyway
+static void close_listen_port(u32 idx)
+{
+	int i;
+
+	if (!listen_defs[idx].enabled) {
+		pr_err("Listen port #%d not open, bug?\n", idx);
+		return;
+	}
+
+	for (i = 0; i < LAUBERHORN_NUM_SERVICES; ++i) {
+		if (srv_defs[i].enabled &&
+		    srv_defs[i].port == listen_defs[idx].port)
+			deregister_service(i);
+	}
+
+	program_listen(idx, 0, lauberhorn_eci_listen_disabled);
+
+	listen_defs[idx].enabled = false;
+	pr_info("Closed UDP port %d (was #%d with TGID %d)\n",
+		listen_defs[idx].port, idx,
+		proc_defs[listen_defs[idx].proc_idx].tgid);
+}
+
+static int register_client(const lauberhorn_reg_clnt_t *req, u32 proc_idx)
+{
+	int i, listen_idx, clnt_idx = -1;
+
+	for (i = 0; i < LAUBERHORN_NUM_CLIENTS; ++i) {
+		if (!clnt_defs[i].enabled) {
+			if (clnt_idx < 0)
+				clnt_idx = i;
+		} else if (clnt_defs[i].func_ptr == req->func_ptr) {
+			// the call encoder looks up clients by func_ptr only
+			pr_err("Client %px already registered as #%d!\n",
+			       req->func_ptr, i);
+			return -EEXIST;
+		}
+	}
+
+	if (clnt_idx < 0) {
+		pr_err("No more free client slots in HW: %d already registered\n",
+		       i);
+		return -ENOSPC;
+	}
+
+	// Clients of one app may share their reply port
+	listen_idx = find_listen_port(req->client_port);
+	if (listen_idx < 0) {
+		listen_idx = open_listen_port(req->client_port,
+					      lauberhorn_eci_listen_onc_rpc_reply,
+					      proc_idx);
+		if (listen_idx < 0)
+			return listen_idx;
+	} else if (listen_defs[listen_idx].proc_idx != proc_idx ||
+		   listen_defs[listen_idx].proto !=
+			   lauberhorn_eci_listen_onc_rpc_reply) {
+		pr_err("UDP port %d already open as #%d, not for replies to app #%d\n",
+		       req->client_port, listen_idx, proc_idx);
+		return -EADDRINUSE;
+	}
+
+	clnt_defs[clnt_idx].prog_num = req->prog_num;
+	clnt_defs[clnt_idx].prog_ver = req->prog_ver;
+	clnt_defs[clnt_idx].proc_num = req->proc_num;
+	clnt_defs[clnt_idx].server_addr = req->server_addr;
+	clnt_defs[clnt_idx].server_port = req->server_port;
+	clnt_defs[clnt_idx].client_port = req->client_port;
+	clnt_defs[clnt_idx].func_ptr = req->func_ptr;
+	clnt_defs[clnt_idx].proc_idx = proc_idx;
+
+	program_client(clnt_idx, &clnt_defs[clnt_idx], true);
+
+	clnt_defs[clnt_idx].enabled = true;
+	pr_info("Registered client #%d prog=%d ver=%d proc=%d -> %pI4h:%d under TGID %d\n",
+		clnt_idx, req->prog_num, req->prog_ver, req->proc_num,
+		&req->server_addr, req->server_port, proc_defs[proc_idx].tgid);
+	return clnt_idx;
+}
+
+static void deregister_client(u32 idx)
+{
+	pid_t tgid;
+	int i, listen_idx;
+	if (!clnt_defs[idx].enabled) {
+		pr_err("Client #%d not registered, bug?\n", idx);
+		return;
+	}
+
+	tgid = proc_defs[clnt_defs[idx].proc_idx].tgid;
+
+	program_client(idx, &clnt_defs[idx], false);
+
+	clnt_defs[idx].enabled = false;
+	pr_info("Deregistered client #%d (was with TGID %d)\n", idx, tgid);
+
+	// Close the reply port with the last client on it
+	for (i = 0; i < LAUBERHORN_NUM_CLIENTS; ++i) {
+		if (clnt_defs[i].enabled &&
+		    clnt_defs[i].client_port == clnt_defs[idx].client_port)
+			return;
+	}
+	listen_idx = find_listen_port(clnt_defs[idx].client_port);
+	if (listen_idx >= 0)
+		close_listen_port(listen_idx);
+}
+
+// Global thread index, as programmed into the thread CL router: the thread's
+// CL window starts at FPGA_MEM_THREAD_BASE(idx)
+static inline u32 thread_idx(u32 proc_idx, u32 thr_idx)
+{
+	return proc_idx * LAUBERHORN_NUM_WORKER_CORES + thr_idx;
+}
+
+// Route the window of global thread idx to a worker core, or unroute it; the
+// router translates between the thread's and the worker's CL addresses
+static void program_route(u32 worker, u32 idx, bool enabled)
+{
+	lauberhorn_eci_threadRouter_ctrl_thread_idx_wr(&router_dev, idx);
+	lauberhorn_eci_threadRouter_ctrl_enabled_wr(&router_dev, enabled);
+	lauberhorn_eci_threadRouter_ctrl_tbl_idx_wr(&router_dev, worker);
+}
+
+// Thread slots of a process; the slot index picks the thread's CL window.
+// Until threads are migrated by the scheduler, every mapped thread holds one
+// worker core: its window is routed there from mmap until the VMA goes away
+static int alloc_thread(u32 proc_idx, pid_t pid)
+{
+	int i, worker;
+
+	worker = find_first_zero_bit(routed_workers,
+				     LAUBERHORN_NUM_WORKER_CORES);
+	if (worker >= LAUBERHORN_NUM_WORKER_CORES) {
+		pr_err("No free worker core for a thread of app #%d\n",
+		       proc_idx);
+		return -1;
+	}
+
+	for (i = 0; i < LAUBERHORN_NUM_WORKER_CORES; ++i) {
+		struct thr_def *thr = &proc_defs[proc_idx].thr_defs[i];
+
+		if (!thr->enabled) {
+			thr->pid = pid;
+			thr->translation_tbl_idx = worker;
+			program_route(worker, thread_idx(proc_idx, i), true);
+			set_bit(worker, routed_workers);
+			thr->enabled = true;
+			pr_info("Allocated thread #%d of app #%d for PID %d on worker core %d\n",
+				i, proc_idx, pid, worker);
+			return i;
+		}
+	}
+
+	pr_err("No more free thread slots for app #%d: %d already mapped\n",
+	       proc_idx, i);
+	return -1;
+}
+
+static void free_thread(u32 proc_idx, u32 thr_idx)
+{
+	struct thr_def *thr = &proc_defs[proc_idx].thr_defs[thr_idx];
+
+	// Already stopped if the app went away before the VMA
+	if (!proc_defs[proc_idx].enabled || !thr->enabled)
+		return;
+
+	clean_worker_thread(proc_idx, thr_idx);
+	program_route(thr->translation_tbl_idx, thread_idx(proc_idx, thr_idx),
+		      false);
+	clear_bit(thr->translation_tbl_idx, routed_workers);
+	thr->enabled = false;
+	pr_info("Freed thread #%d of app #%d (was PID %d)\n", thr_idx,
+		proc_idx, thr->pid);
+}
+
+// Thread of the calling task in an app; NULL if it has no window mapped
+static struct thr_def *current_thread(u32 proc_idx)
+{
+	int i;
+
+	for (i = 0; i < LAUBERHORN_NUM_WORKER_CORES; ++i) {
+		struct thr_def *thr = &proc_defs[proc_idx].thr_defs[i];
+
+		if (thr->enabled && thr->pid == current->pid)
+			return thr;
+	}
+	return NULL;
+}
+
 static int register_app(pid_t tgid)
 {
 	int i, proc_idx;
@@ -128,20 +465,21 @@ static int register_app(pid_t tgid)
 	}
 
 	proc_defs[proc_idx].tgid = tgid;
-	proc_defs[proc_idx].num_threads = 0;
+	memset(proc_defs[proc_idx].thr_defs, 0,
+	       sizeof(proc_defs[proc_idx].thr_defs));
 
 	// TODO: program into HW
-	//
+
 	proc_defs[proc_idx].enabled = true;
-	pr_info("Registered application #%d with TGID %d\n", num_procs, tgid);
-	return 0;
+	pr_info("Registered application #%d with TGID %d\n", proc_idx, tgid);
+	return proc_idx;
 }
 
 static void deregister_app(pid_t tgid)
 {
 	int i, proc_idx;
 
-	for (i = 0; i < num_procs; ++i) {
+	for (i = 0; i < LAUBERHORN_NUM_PROCS; ++i) {
 		if (proc_defs[i].enabled && proc_defs[i].tgid == tgid) {
 			proc_idx = i;
 			break;
@@ -154,19 +492,31 @@ static void deregister_app(pid_t tgid)
 	}
 
 	// Stop all threads under this app
-	for (i = 0; i < LAUBERHORN_NUM_WORKER_CORES; ++i) {
-		if (proc_defs[proc_idx].thr_defs[i].enabled) {
-			clean_worker_thread(proc_idx, i);
-		}
-	}
+	for (i = 0; i < LAUBERHORN_NUM_WORKER_CORES; ++i)
+		free_thread(proc_idx, i);
 
 	// Deregister all services under this app
 	for (i = 0; i < LAUBERHORN_NUM_SERVICES; ++i) {
-		if (srv_defs[i].proc_idx == proc_idx) {
+		if (srv_defs[i].enabled && srv_defs[i].proc_idx == proc_idx) {
 			deregister_service(i);
 		}
 	}
 
+	// Deregister all clients under this app
+	for (i = 0; i < LAUBERHORN_NUM_CLIENTS; ++i) {
+		if (clnt_defs[i].enabled && clnt_defs[i].proc_idx == proc_idx) {
+			deregister_client(i);
+		}
+	}
+
+	// Close all ports of this app
+	for (i = 0; i < LAUBERHORN_NUM_LISTEN_PORTS; ++i) {
+		if (listen_defs[i].enabled &&
+		    listen_defs[i].proc_idx == proc_idx) {
+			close_listen_port(i);
+		}
+	}
+
 	// TODO: program into HW
 
 	proc_defs[proc_idx].enabled = false;
@@ -177,8 +527,123 @@ static void deregister_app(pid_t tgid)
 static long app_dev_ioctl(struct file *file, unsigned int cmd,
 			  unsigned long arg)
 {
+	u32 proc_idx = (uintptr_t)file->private_data;
+	lauberhorn_port_t port;
+	lauberhorn_reg_srv_t srv;
+	lauberhorn_srv_id_t srv_id;
+	lauberhorn_reg_clnt_t clnt;
+	lauberhorn_clnt_id_t clnt_id;
+	struct thr_def *thr;
+	u32 parity = 0;
 	pid_t pid = -1;
+	int ret;
+
 	switch (cmd) {
+	case LAUBERHORN_IOCTL_OPEN_PORT:
+		if (copy_from_user(&port, (void __user *)arg, sizeof(port)))
+			return -EFAULT;
+		mutex_lock(&defs_lock);
+		ret = open_listen_port(port, lauberhorn_eci_listen_onc_rpc_call,
+				       proc_idx);
+		mutex_unlock(&defs_lock);
+		if (ret < 0)
+			return ret;
+		break;
+
+	case LAUBERHORN_IOCTL_CLOSE_PORT:
+		if (copy_from_user(&port, (void __user *)arg, sizeof(port)))
+			return -EFAULT;
+		mutex_lock(&defs_lock);
+		ret = find_listen_port(port);
+		// only the owning application may close its ports
+		if (ret >= 0 && listen_defs[ret].proc_idx == proc_idx &&
+		    listen_defs[ret].proto == lauberhorn_eci_listen_onc_rpc_call) {
+			close_listen_port(ret);
+			ret = 0;
+		} else {
+			ret = -ENOENT;
+		}
+		mutex_unlock(&defs_lock);
+		if (ret)
+			return ret;
+		break;
+
+	case LAUBERHORN_IOCTL_REG_SRV:
+		if (copy_from_user(&srv, (void __user *)arg, sizeof(srv)))
+			return -EFAULT;
+		mutex_lock(&defs_lock);
+		ret = register_service(&srv, proc_idx);
+		mutex_unlock(&defs_lock);
+		if (ret < 0)
+			return ret;
+		srv.id = ret;
+		if (copy_to_user((void __user *)arg, &srv, sizeof(srv)))
+			return -EFAULT;
+		break;
+
+	case LAUBERHORN_IOCTL_DEREG_SRV:
+		if (copy_from_user(&srv_id, (void __user *)arg, sizeof(srv_id)))
+			return -EFAULT;
+		if (srv_id >= LAUBERHORN_NUM_SERVICES)
+			return -EINVAL;
+		ret = -ENOENT;
+		mutex_lock(&defs_lock);
+		// only the owning application may drop its services
+		if (srv_defs[srv_id].enabled &&
+		    srv_defs[srv_id].proc_idx == proc_idx) {
+			deregister_service(srv_id);
+			ret = 0;
+		}
+		mutex_unlock(&defs_lock);
+		if (ret)
+			return ret;
+		break;
+
+	case LAUBERHORN_IOCTL_REG_CLNT:
+		if (copy_from_user(&clnt, (void __user *)arg, sizeof(clnt)))
+			return -EFAULT;
+		mutex_lock(&defs_lock);
+		ret = register_client(&clnt, proc_idx);
+		mutex_unlock(&defs_lock);
+		if (ret < 0)
+			return ret;
+		clnt.id = ret;
+		if (copy_to_user((void __user *)arg, &clnt, sizeof(clnt)))
+			return -EFAULT;
+		break;
+
+	case LAUBERHORN_IOCTL_DEREG_CLNT:
+		if (copy_from_user(&clnt_id, (void __user *)arg,
+				   sizeof(clnt_id)))
+			return -EFAULT;
+		if (clnt_id >= LAUBERHORN_NUM_CLIENTS)
+			return -EINVAL;
+		ret = -ENOENT;
+		mutex_lock(&defs_lock);
+		// only the owning application may drop its clients
+		if (clnt_defs[clnt_id].enabled &&
+		    clnt_defs[clnt_id].proc_idx == proc_idx) {
+			deregister_client(clnt_id);
+			ret = 0;
+		}
+		mutex_unlock(&defs_lock);
+		if (ret)
+			return ret;
+		break;
+
+	case LAUBERHORN_IOCTL_THD_RX_PARITY:
+		mutex_lock(&defs_lock);
+		thr = current_thread(proc_idx);
+		if (thr)
+			parity = lauberhorn_eci_worker_rx_curr_cl_idx_rd(
+				&worker_devs[thr->translation_tbl_idx]);
+		mutex_unlock(&defs_lock);
+		if (!thr)
+			return -ENOENT;
+		if (copy_to_user((void __user *)arg, &parity, sizeof(parity)))
+			return -EFAULT;
+		break;
+
 	case IOCTL_YIELD:
 		pr_info("(pid %i) going to wait\n", current->pid);
 		wait_event_interruptible(wq, active_pid == current->pid);
@@ -204,30 +669,96 @@ static long app_dev_ioctl(struct file *file, unsigned int cmd,
 	return 0;
 }
 
+// private_data of the file: index into proc_defs
 static int app_dev_open(struct inode *i, struct file *f)
 {
-  // Register service
+	int proc_idx;
+
+	mutex_lock(&defs_lock);
+	proc_idx = register_app(current->tgid);
+	mutex_unlock(&defs_lock);
+
+	if (proc_idx < 0)
+		return -EBUSY;
+
+	f->private_data = (void *)(uintptr_t)proc_idx;
+	return 0;
 }
 
 static int app_dev_release(struct inode *i, struct file *f)
 {
-}
+	u32 proc_idx = (uintptr_t)f->private_data;
 
-static void close_vma(struct vm_area_struct *vma) {
+	mutex_lock(&defs_lock);
+	deregister_app(proc_defs[proc_idx].tgid);
+	mutex_unlock(&defs_lock);
 
+	return 0;
 }
 
-static const char *name_vma(struct vm_area_struct *vma) {
+// vm_private_data of the VMA: global thread index
+static void close_vma(struct vm_area_struct *vma)
+{
+	u32 idx = (uintptr_t)vma->vm_private_data;
 
+	mutex_lock(&defs_lock);
+	free_thread(idx / LAUBERHORN_NUM_WORKER_CORES,
+		    idx % LAUBERHORN_NUM_WORKER_CORES);
+	mutex_unlock(&defs_lock);
 }
 
-static const struct vm_operations vm_ops = {
-  .close = close_vma,
-  .name = name_vma,
+static const char *name_vma(struct vm_area_struct *vma)
+{
+	return "[lauberhorn]";
+}
+
+static const struct vm_operations_struct vm_ops = {
+	.close = close_vma,
+	.name = name_vma,
 };
 
-static int app_dev_mmap(struct file *f, struct vm_area_struct *vma) {
+// Map the RX / TX / preempt control CLs of one thread and route them to a
+// worker core; the CLs are mapped cacheable, since the coherence protocol is
+// the datapath.
+static int app_dev_mmap(struct file *f, struct vm_area_struct *vma)
+{
+	u32 proc_idx = (uintptr_t)f->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int thr_idx, err;
+	u32 idx;
+
+	if (size != LAUBERHORN_ECI_CORE_OFFSET || vma->vm_pgoff != 0) {
+		pr_err("Thread window must be %#x bytes at offset 0\n",
+		       LAUBERHORN_ECI_CORE_OFFSET);
+		return -EINVAL;
+	}
+
+	mutex_lock(&defs_lock);
+	thr_idx = alloc_thread(proc_idx, current->pid);
+	mutex_unlock(&defs_lock);
+	if (thr_idx < 0)
+		return -EBUSY;
+
+	idx = thread_idx(proc_idx, thr_idx);
+
+	// Only the thread itself may touch its window: not inherited on fork
+	vm_flags_set(vma, VM_IO | VM_PFNMAP | VM_DONTCOPY | VM_DONTEXPAND |
+				  VM_DONTDUMP);
+	vma->vm_private_data = (void *)(uintptr_t)idx;
+	vma->vm_ops = &vm_ops;
+
+	err = remap_pfn_range(vma, vma->vm_start,
+			      PHYS_PFN(FPGA_MEM_THREAD_BASE(idx)),
+			      size, vma->vm_page_prot);
+	if (err) {
+		pr_err("remap_pfn_range failed: err = %d\n", err);
+		mutex_lock(&defs_lock);
+		free_thread(proc_idx, thr_idx);
+		mutex_unlock(&defs_lock);
+		return err;
+	}
 
+	return 0;
 }
 
 static const struct file_operations fops = {
@@ -235,7 +766,7 @@ static const struct file_operations fops = {
 	.open = app_dev_open,
 	.release = app_dev_release,
 	.unlocked_ioctl = app_dev_ioctl,
-  .mmap = app_dev_mmap,
+	.mmap = app_dev_mmap,
 };
 
 /**
@@ -246,6 +777,23 @@ static const struct file_operations fops = {
  */
 int create_devices(void)
 {
+	int i;
+
+	lauberhorn_eci_UdpDecoder_initialize(&udp_dec_dev,
+					     LAUBERHORN_ECI__UDP_DECODER_BASE);
+	lauberhorn_eci_OncRpcCallDecoder_initialize(
+		&call_dec_dev, LAUBERHORN_ECI__ONC_RPC_CALL_DECODER_BASE);
+	lauberhorn_eci_OncRpcCallEncoder_initialize(
+		&call_enc_dev, LAUBERHORN_ECI__ONC_RPC_CALL_ENCODER_BASE);
+	lauberhorn_eci_threadRouter_initialize(
+		&router_dev, LAUBERHORN_ECI_THREAD_ROUTER_BASE);
+	// worker cores come after the bypass cores
+	for (i = 0; i < LAUBERHORN_NUM_WORKER_CORES; ++i)
+		lauberhorn_eci_worker_initialize(
+			&worker_devs[i],
+			LAUBERHORN_ECI_WORKER_BASE(LAUBERHORN_NUM_BYPASS_CORES +
+						   i));
+
 	if (alloc_chrdev_region(&dev, 0, 1, "lauberhorn") < 0) {
 		pr_err("alloc_chrdev_region failed\n");
 		return -1;
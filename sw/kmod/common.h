@@ -12,7 +12,9 @@
 #include <linux/ioctl.h>
 #include <linux/kdev_t.h>
 #include <linux/kthread.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/sched.h>
 #include <linux/slab.h>    // kmalloc
 #include <linux/uaccess.h> // copy_to/from_user
@@ -32,6 +34,17 @@
 #endif
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
+// Physical base of the cache-coherent ECI area (LAUBERHORN_ECI_CORE_OFFSET
+// bytes per core or thread)
+#define FPGA_MEM_BASE (0x10000000000UL)
+
+// Thread windows sit in an aperture after the windows of all physical cores;
+// the thread CL router routes them to worker cores and passes the physical
+// windows (e.g. of the bypass cores) through untouched
+#define FPGA_MEM_THREAD_BASE(idx)                                          \
+	(FPGA_MEM_BASE +                                                   \
+	 ((u64)LAUBERHORN_NUM_CORES + (idx)) * LAUBERHORN_ECI_CORE_OFFSET)
+
 // Print SW, shell and NIC versions
 int probe_versions(void);
 
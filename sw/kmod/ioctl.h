@@ -21,12 +21,20 @@
 
 // Define ioctl numbers properly
 // https://www.kernel.org/doc/Documentation/ioctl/ioctl-number.txt
-#define LAUBERHORN_IOCTL_MAGIC "L"
+#define LAUBERHORN_IOCTL_MAGIC 'L'
 
 // Register / deregister an application
 // These are implemented as open and close on the device
 
-// Register / deregister a service
+// Open / close a UDP port for ONC-RPC calls to the application (host byte
+// order).  The port is owned by the application and closed with it
+typedef u16 lauberhorn_port_t;
+#define LAUBERHORN_IOCTL_OPEN_PORT \
+	_IOW(LAUBERHORN_IOCTL_MAGIC, 5, lauberhorn_port_t)
+#define LAUBERHORN_IOCTL_CLOSE_PORT \
+	_IOW(LAUBERHORN_IOCTL_MAGIC, 6, lauberhorn_port_t)
+
+// Register / deregister a service, on a port the application opened before
 typedef u16 lauberhorn_srv_id_t;
 typedef struct {
 	// to kernel
@@ -43,7 +51,36 @@ typedef struct {
 #define LAUBERHORN_IOCTL_DEREG_SRV \
 	_IOW(LAUBERHORN_IOCTL_MAGIC, 2, lauberhorn_srv_id_t)
 
+// Register / deregister a client procedure, for nested calls to a remote
+// service.  func_ptr names the procedure in TX descriptors and comes back
+// with the replies; it must be unique across all registered clients
+typedef u16 lauberhorn_clnt_id_t;
+typedef struct {
+	// to kernel
+	void *func_ptr;
+	u32 prog_num;
+	u32 prog_ver;
+	u32 proc_num;
+	u32 server_addr; // host byte order
+	u16 server_port;
+	u16 client_port; // replies arrive on this port
+	// from kernel
+	lauberhorn_clnt_id_t id;
+} lauberhorn_reg_clnt_t;
+#define LAUBERHORN_IOCTL_REG_CLNT \
+	_IOWR(LAUBERHORN_IOCTL_MAGIC, 3, lauberhorn_reg_clnt_t)
+#define LAUBERHORN_IOCTL_DEREG_CLNT \
+	_IOW(LAUBERHORN_IOCTL_MAGIC, 4, lauberhorn_clnt_id_t)
+
 // Start / stop handling requests on an application thread
-// These are implemented as mmap / destroy VMA
+// These are implemented as mmap / destroy VMA: each mmap of
+// LAUBERHORN_ECI_CORE_OFFSET bytes at offset 0 allocates a thread slot, maps
+// its RX / TX / preempt control CLs and routes them to a free worker core;
+// munmap frees the slot and the worker core
+
+// RX parity (next RX control CL, 0 or 1) of the worker core the window of the
+// calling thread is routed to, to resync the RX state after mmap
+#define LAUBERHORN_IOCTL_THD_RX_PARITY \
+	_IOR(LAUBERHORN_IOCTL_MAGIC, 7, u32)
 
 #endif // LAUBERHORN_IOCTL_H
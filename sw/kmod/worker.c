@@ -32,7 +32,7 @@ static irqreturn_t worker_fpi_handler(int irq, void *data) {
  * probably FPGA peripheral interrupts.
  * 
  * The Lauberhorn NIC sends two SGI interrupts:
- * - #15  only to core 0: bypass core descriptor FIFO non-empty
+ * - #15  to the CPU of each bypass core: bypass core descriptor FIFO non-empty
  * - #8   to all worker cores: preemption interrupt for switching tasks
  * 
  * This function only handles the interrupt for the worker cores; the bypass core
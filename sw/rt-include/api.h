@@ -18,11 +18,27 @@ int pionic_get_mtu();
 
 // allocate and release ctx
 int pionic_init(pionic_ctx_t *ctx, const char *dev, bool loopback);
+// same, but only map and reset the CL windows of the cores in core_mask; the
+// other cores must not be used for RX/TX
+#define PIONIC_ALL_CORES (~0UL)
+int pionic_init_cores(pionic_ctx_t *ctx, const char *dev, bool loopback,
+                      uint64_t core_mask);
+// attach to a NIC that is already running, e.g. after a server restart: the
+// CMAC, packet buffer allocators and RX blocking time are left as they are and
+// the datapath state of each core is resynced from the NIC
+int pionic_attach(pionic_ctx_t *ctx, const char *dev, uint64_t core_mask);
 void pionic_fini(pionic_ctx_t *ctx);
 
 // global configurations
 void pionic_set_rx_block_cycles(pionic_ctx_t ctx, uint64_t cycles);
 uint64_t pionic_get_rx_block_cycles(pionic_ctx_t ctx);
+// retune rx_block_cycles online within [min_cycles, max_cycles] from the
+// observed NACK ratio and packet rate; setting the cycles by hand turns it off
+void pionic_set_rx_block_adaptive(pionic_ctx_t ctx, bool enable,
+                                  uint64_t min_cycles, uint64_t max_cycles);
+// critical section entry: spin with backoff for spin_limit rounds, then wait
+// in WFE on the preempt-control CL if wfe is set
+void pionic_set_cs_wait(pionic_ctx_t ctx, uint32_t spin_limit, bool wfe);
 // void pionic_set_core_mask(pionic_ctx_t ctx, uint64_t mask);
 void pionic_set_promisc(pionic_ctx_t ctx, bool enable);
 
@@ -44,13 +60,28 @@ void pionic_sync_core_state(pionic_core_state_t *state, pionic_core_t *core);
 
 // receive packet
 bool pionic_rx(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc);
+// receive packet without copying the payload: desc->view points into the NIC
+// buffer and stays valid until pionic_rx_ack (ECI only)
+bool pionic_rx_view(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc);
+// receive up to n packets in one go; descs[i].payload_buf/payload_len must be
+// set up by the caller to a buffer of at least pionic_get_mtu() bytes.
+// Returns the number of packets received
+int pionic_rx_burst(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *descs, int n);
 // acknowledge received packet (for NIC to free packet)
 void pionic_rx_ack(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc);
 
 // prepare TX packet descriptor (desc->type must be set to correctly set up
 // header/args pointers)
 void pionic_tx_prepare_desc(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc);
+// prepare TX packet descriptor for in-place serialization: desc->view points
+// at the TX buffer in the NIC; write the payload there and set
+// desc->payload_len (ECI only)
+void pionic_tx_prepare_view(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc);
 // send packet
 void pionic_tx(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc);
+// send n packets in one go, with payloads in descs[i].payload_buf.  Returns the
+// number of packets sent, from the front: the burst stops at a packet the NIC
+// does not take, which is marked TY_ERROR, or when the TX ring stays full
+int pionic_tx_burst(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *descs, int n);
 
 #endif // __PIONIC_API_H__
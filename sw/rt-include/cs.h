@@ -0,0 +1,57 @@
+// Critical section on the preempt-control CL
+//
+// A worker thread may only touch the RX/TX CLs of its core while BUSY is set
+// in the preempt-control CL, and may only set BUSY while READY is set.  The
+// CL is cached on the CPU until EciPreemptionControlPlugin invalidates it to
+// clear READY, so waiting on a plain load costs no interconnect traffic; only
+// the compare-and-swap needs the line exclusive.
+//
+// Entry first spins with exponential backoff for up to spin_limit rounds, then
+// (optionally) sleeps in WFE with the CL in the exclusive monitor: the
+// invalidation from the NIC clears the monitor and wakes the core.  The
+// kernel's event stream bounds each sleep, so a missed event only costs time.
+//
+// Compare-and-swap and the exit use ARMv8.1 LSE atomics when the CPU has
+// them (checked once in cs_init), and exclusives otherwise.
+
+#ifndef __PIONIC_CS_H__
+#define __PIONIC_CS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "diag.h"
+
+// default backoff rounds before falling back to WFE
+#define CS_DEFAULT_SPIN_LIMIT 16
+// longest backoff, in relax instructions
+#define CS_BACKOFF_MAX 1024
+
+typedef struct {
+  // updated only by the thread serving the core; padded to a ThunderX-1 CL
+  struct {
+    pionic_cs_stats_t stats;
+  } __attribute__((aligned(128))) core[LAUBERHORN_NUM_CORES];
+
+  uint32_t spin_limit;
+  bool wfe;
+} cs_ctrl_t;
+
+void cs_init(cs_ctrl_t *c);
+// check for LSE atomics; done by cs_init, call it once before using
+// cs_enter_with on its own
+void cs_probe(void);
+void cs_configure(cs_ctrl_t *c, uint32_t spin_limit, bool wfe);
+
+// ctrl points to the preempt-control CL of core cid
+void cs_enter(cs_ctrl_t *c, int cid, uint8_t *ctrl);
+// same, with the counters and wait policy kept by the caller (e.g. per thread)
+void cs_enter_with(pionic_cs_stats_t *s, uint32_t spin_limit, bool wfe,
+                   uint8_t *ctrl);
+void cs_exit(uint8_t *ctrl);
+
+void cs_stats(cs_ctrl_t *c, int cid, pionic_cs_stats_t *stats);
+void cs_dump(cs_ctrl_t *c);
+
+#endif // __PIONIC_CS_H__
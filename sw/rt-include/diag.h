@@ -15,4 +15,20 @@ void pionic_reset_pkt_alloc(pionic_core_t *core);
 //      determining the max latency and not in production!
 void pionic_probe_rx_block_cycles(pionic_ctx_t ctx);
 
+// one retune step of the adaptive RX blocking time
+typedef struct {
+  uint64_t time_us;
+  uint64_t rx_block_cycles; // value after the step
+  uint64_t rx_packets;      // rx_packet_count delta, worker cores
+  uint64_t hits, nacks;     // fetches on worker cores since the last step
+} pionic_rx_block_sample_t;
+
+// copy up to n most recent steps, oldest first; returns the number copied
+int pionic_get_rx_block_history(pionic_ctx_t ctx,
+                                pionic_rx_block_sample_t *samples, int n);
+void pionic_dump_rx_block_history(pionic_ctx_t ctx);
+
+void pionic_get_cs_stats(pionic_ctx_t ctx, int cid, pionic_cs_stats_t *stats);
+void pionic_dump_cs_stats(pionic_ctx_t ctx);
+
 #endif // __PIONIC_DEBUG_H__
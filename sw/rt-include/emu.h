@@ -0,0 +1,111 @@
+// Emulated ECI NIC (NIC_IMPL=emu)
+//
+// The ECI cacheline protocol is modelled in ordinary shared memory: the two
+// parity control CLs and the overflow CLs for RX, the TX ring, and the
+// preempt-control CL for each core.  The NIC reacts synchronously when the
+// datapath fetches a control CL or a TX doorbell (CL_FETCH_HOOK), just like
+// the FPGA reacts to the cacheline fill; TX slots are retired right away.
+// Packets enter and leave the NIC through per-core queues that a companion
+// "wire" thread drives with pionic_emu_inject and pionic_emu_consume.  With
+// loopback set in pionic_init, a built-in thread sends bypass TX frames back
+// to the bypass cores.
+//
+// Registers are plain structs with the same accessor names as the Mackerel
+// devices, so diag and profile code can be shared.  Only the registers used
+// by the runtime are modelled.
+
+#ifndef __PIONIC_EMU_H__
+#define __PIONIC_EMU_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "api.h"
+#include "config.h"
+
+#define PIONIC_EMU_GLOBAL_REGS(X)                                              \
+  X(version)                                                                   \
+  X(rx_block_cycles)                                                           \
+  X(rx_overflow_count)                                                         \
+  X(last_profile__rx_cmac_entry)                                               \
+  X(last_profile__rx_after_cdc_queue)                                          \
+  X(last_profile__rx_enqueue_to_host)                                          \
+  X(last_profile__rx_core_read_start)                                          \
+  X(last_profile__rx_core_read_finish)                                         \
+  X(last_profile__rx_core_commit)                                              \
+  X(last_profile__tx_core_acquire)                                             \
+  X(last_profile__tx_core_commit)                                              \
+  X(last_profile__tx_after_dma_read)                                           \
+  X(last_profile__tx_before_cdc_queue)                                         \
+  X(last_profile__tx_cmac_exit)
+
+#define PIONIC_EMU_CORE_REGS(X)                                                \
+  X(rx_packet_count)                                                           \
+  X(tx_packet_count)                                                           \
+  X(rx_dma_error_count)                                                        \
+  X(tx_dma_error_count)                                                        \
+  X(rx_bad_csum_count)                                                         \
+  X(rx_alloc_occupancy_up_to_128)                                              \
+  X(rx_alloc_occupancy_up_to_1518)                                             \
+  X(rx_alloc_occupancy_up_to_9618)                                             \
+  X(rx_fsm_state)                                                              \
+  X(rx_curr_cl_idx)                                                            \
+  X(tx_fsm_state)                                                              \
+  X(tx_ring_consumed)                                                          \
+  X(tx_ring_produced)                                                          \
+  X(alloc_reset)
+
+#define __PIONIC_EMU_REG_FIELD(name) uint64_t name;
+
+struct pionic_emu_global_t {
+  PIONIC_EMU_GLOBAL_REGS(__PIONIC_EMU_REG_FIELD)
+};
+struct pionic_emu_core_t {
+  PIONIC_EMU_CORE_REGS(__PIONIC_EMU_REG_FIELD)
+};
+
+#undef __PIONIC_EMU_REG_FIELD
+
+#define __PIONIC_EMU_REG_ACCESS(dev, name)                                     \
+  static inline uint64_t pionic_emu_##dev##_##name##_rd(                       \
+      struct pionic_emu_##dev##_t *d) {                                        \
+    return __atomic_load_n(&d->name, __ATOMIC_RELAXED);                        \
+  }                                                                            \
+  static inline void pionic_emu_##dev##_##name##_wr(                           \
+      struct pionic_emu_##dev##_t *d, uint64_t v) {                            \
+    __atomic_store_n(&d->name, v, __ATOMIC_RELAXED);                           \
+  }
+#define __PIONIC_EMU_GLOBAL_ACCESS(name) __PIONIC_EMU_REG_ACCESS(global, name)
+#define __PIONIC_EMU_CORE_ACCESS(name) __PIONIC_EMU_REG_ACCESS(core, name)
+
+PIONIC_EMU_GLOBAL_REGS(__PIONIC_EMU_GLOBAL_ACCESS)
+PIONIC_EMU_CORE_REGS(__PIONIC_EMU_CORE_ACCESS)
+
+#undef __PIONIC_EMU_GLOBAL_ACCESS
+#undef __PIONIC_EMU_CORE_ACCESS
+#undef __PIONIC_EMU_REG_ACCESS
+
+// free-running NIC clock (LAUBERHORN_CLOCK_FREQ)
+uint64_t pionic_emu_global_cycles_rd(struct pionic_emu_global_t *d);
+
+// register blocks of the emulated NIC
+pionic_global_t *pionic_emu_global(pionic_ctx_t ctx);
+pionic_core_t *pionic_emu_core(pionic_ctx_t ctx, int cid);
+
+// packet on the wire side of the emulated NIC.  desc carries the metadata the
+// decoder pipeline would produce (bypass header, RPC call fields); the payload
+// is in data, desc.payload_len bytes
+typedef struct {
+  pionic_pkt_desc_t desc;
+  uint8_t data[LAUBERHORN_MTU];
+} pionic_emu_pkt_t;
+
+// Queue pkt for core cid.  Returns false if the queue is full; the packet is
+// then dropped and counted in rx_overflow_count.  At most one thread may
+// inject per core
+bool pionic_emu_inject(pionic_ctx_t ctx, int cid, const pionic_emu_pkt_t *pkt);
+// Take the oldest packet sent by core cid.  Returns false if there is none.
+// At most one thread may consume per core
+bool pionic_emu_consume(pionic_ctx_t ctx, int cid, pionic_emu_pkt_t *pkt);
+
+#endif // __PIONIC_EMU_H__
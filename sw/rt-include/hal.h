@@ -1,12 +1,21 @@
 #ifndef __PIONIC_HAL_H__
 #define __PIONIC_HAL_H__
 
+// NIC_IMPL is passed as a bare token (eci, pcie or emu); map it to a number so
+// that it can be compared in #if
+#define PIONIC_NIC_eci 1
+#define PIONIC_NIC_pcie 2
+#define PIONIC_NIC_emu 3
+#define __PIONIC_NIC_ID(impl) PIONIC_NIC_##impl
+#define PIONIC_NIC_ID(impl) __PIONIC_NIC_ID(impl)
+#define PIONIC_NIC PIONIC_NIC_ID(NIC_IMPL)
+
 // Mackerel
 #ifndef NIC_IMPL
 
-#error "NIC_IMPL must be defined as eci or pcie"
+#error "NIC_IMPL must be defined as eci, pcie or emu"
 
-#elif NIC_IMPL == eci
+#elif PIONIC_NIC == PIONIC_NIC_eci
 
 struct pionic_eci_global_t;
 typedef struct pionic_eci_global_t pionic_global_t;
@@ -16,7 +25,7 @@ struct pionic_eci_core_t;
 typedef struct pionic_eci_core_t pionic_core_t;
 #define pionic_core(f) pionic_eci_core_##f
 
-#elif NIC_IMPL == pcie
+#elif PIONIC_NIC == PIONIC_NIC_pcie
 
 struct pionic_pcie_global_t;
 typedef struct pionic_pcie_global_t pionic_global_t;
@@ -26,6 +35,21 @@ struct pionic_pcie_core_t;
 typedef struct pionic_pcie_core_t pionic_core_t;
 #define pionic_core(f) pionic_pcie_core_##f
 
+#elif PIONIC_NIC == PIONIC_NIC_emu
+
+// ECI protocol emulated in memory; registers are plain structs (see emu.h)
+struct pionic_emu_global_t;
+typedef struct pionic_emu_global_t pionic_global_t;
+#define pionic_global(f) pionic_emu_global_##f
+
+struct pionic_emu_core_t;
+typedef struct pionic_emu_core_t pionic_core_t;
+#define pionic_core(f) pionic_emu_core_##f
+
+#else
+
+#error "unknown NIC_IMPL"
+
 #endif
 
 #endif // __PIONIC_HAL_H__
@@ -0,0 +1,108 @@
+// Asynchronous submission / completion rings over one core
+//
+// The owning thread queues work in the submission queue (SQ) and reaps the
+// results from the completion queue (CQ), in the style of io_uring:
+//
+// - PIONIC_OP_TX sends a packet.  The payload is copied into the NIC when the
+//   entry is submitted, so the buffer can be reused after its completion.
+// - PIONIC_OP_RX_BUF posts a receive buffer.  Arrivals are copied into posted
+//   buffers in the order the buffers were posted; the completion carries the
+//   buffer's user_data and the decoded descriptor.
+//
+// Both queues live in the process and belong to one thread, so queueing and
+// reaping are plain loads and stores.  The NIC is only touched in
+// pionic_ring_submit (one TX burst per run of TX entries) and pionic_ring_poll
+// (one RX burst into the posted buffers), each in one critical section.
+//
+// pionic_ring_poll never waits for packets by itself, but the RX fetch on a
+// worker core still stalls for up to the RX block cycles on a NACK.  A loop
+// that waits for other event sources as well should keep those short (see
+// pionic_set_rx_block_cycles); with no buffers posted, no fetch is issued at
+// all.
+
+#ifndef __PIONIC_RING_H__
+#define __PIONIC_RING_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "api.h"
+
+// upper bound of one TX or RX burst issued by the ring
+#define PIONIC_RING_BURST 16
+
+typedef enum {
+  PIONIC_OP_NOP,
+  PIONIC_OP_TX,
+  PIONIC_OP_RX_BUF,
+} pionic_ring_op_t;
+
+typedef struct {
+  pionic_ring_op_t op;
+  uint64_t user_data;
+  // TX: type, metadata and payload_buf / payload_len as for pionic_tx_burst.
+  // RX_BUF: payload_buf / payload_len is the buffer, of at least
+  // pionic_get_mtu() bytes
+  pionic_pkt_desc_t desc;
+} pionic_sqe_t;
+
+typedef struct {
+  pionic_ring_op_t op;
+  uint64_t user_data;
+  // TX: 0, or -EIO if the NIC does not take the descriptor (e.g. its type).
+  // RX_BUF: 0; desc is the received packet, with the payload in the posted
+  // buffer
+  int res;
+  pionic_pkt_desc_t desc;
+} pionic_cqe_t;
+
+struct pionic_ring;
+typedef struct pionic_ring *pionic_ring_t;
+
+// Set up rings of entries (a power of two) entries each for core cid.  At most
+// one ring per core; it must only be used by one thread at a time
+int pionic_ring_init(pionic_ring_t *ring, pionic_ctx_t ctx, int cid,
+                     uint32_t entries);
+// Posted buffers that never received a packet are dropped silently
+void pionic_ring_fini(pionic_ring_t *ring);
+
+// Next free SQ entry, or NULL if the SQ is full (submit first)
+pionic_sqe_t *pionic_ring_get_sqe(pionic_ring_t ring);
+
+static inline void pionic_ring_prep_tx(pionic_sqe_t *sqe,
+                                       const pionic_pkt_desc_t *desc,
+                                       uint64_t user_data) {
+  sqe->op = PIONIC_OP_TX;
+  sqe->user_data = user_data;
+  sqe->desc = *desc;
+}
+
+static inline void pionic_ring_prep_rx_buf(pionic_sqe_t *sqe, void *buf,
+                                           size_t len, uint64_t user_data) {
+  sqe->op = PIONIC_OP_RX_BUF;
+  sqe->user_data = user_data;
+  sqe->desc.payload_buf = buf;
+  sqe->desc.payload_len = len;
+}
+
+// Hand the queued SQ entries over, in order.  Stops early when the CQ has no
+// room for the TX completions, when the NIC's TX ring stays full, or when
+// entries buffers are posted already.  Returns the number of entries consumed
+int pionic_ring_submit(pionic_ring_t ring);
+// Receive up to one burst into the posted buffers.  Returns the number of
+// completions added
+int pionic_ring_poll(pionic_ring_t ring);
+// Submit, then poll until at least min_complete completions are ready (or no
+// more can arrive: no buffers posted, CQ full).  Returns the number ready
+int pionic_ring_enter(pionic_ring_t ring, uint32_t min_complete);
+
+// Oldest completion, or NULL if there is none; valid until
+// pionic_ring_cqe_seen
+pionic_cqe_t *pionic_ring_peek_cqe(pionic_ring_t ring);
+void pionic_ring_cqe_seen(pionic_ring_t ring);
+uint32_t pionic_ring_cq_ready(pionic_ring_t ring);
+
+// buffers posted and not yet filled
+uint32_t pionic_ring_rx_posted(pionic_ring_t ring);
+
+#endif // __PIONIC_RING_H__
@@ -0,0 +1,87 @@
+// Adaptive RX blocking time
+//
+// A fetch on a worker core stalls for up to rx_block_cycles before the NIC
+// NACKs it.  Too long wastes the core in a stalled load; too short burns ECI
+// round trips on NACKs.  The controller aims the blocking time at a multiple
+// of the mean packet gap (from the rx_packet_count deltas), and scales the
+// multiple up when most fetches are NACKed and down when almost none are.
+
+#ifndef __PIONIC_RX_BLOCK_H__
+#define __PIONIC_RX_BLOCK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "diag.h"
+
+// fetches on one core between retune attempts
+#define RX_BLOCK_RETUNE_INTERVAL 4096
+// samples kept for pionic_get_rx_block_history
+#define RX_BLOCK_HISTORY_LEN 64
+
+// default bounds, in NIC cycles
+#define RX_BLOCK_DEFAULT_MIN 200
+#define RX_BLOCK_DEFAULT_MAX (LAUBERHORN_CLOCK_FREQ / 1000) // 1 ms
+
+typedef struct {
+  // updated only by the thread serving the core; padded to a ThunderX-1 CL
+  struct {
+    uint64_t hits;
+    uint64_t nacks;
+    uint32_t since_retune;
+  } __attribute__((aligned(128))) core[LAUBERHORN_NUM_CORES];
+
+  bool adaptive;
+  uint64_t min_cycles, max_cycles;
+  uint64_t cycles;
+
+  // multiple of the packet gap, in quarters
+  uint32_t gap_mult_q2;
+
+  // state at the last retune
+  int busy;
+  uint64_t last_us;
+  uint64_t last_rx_packets;
+  uint64_t last_hits, last_nacks;
+
+  pionic_rx_block_sample_t history[RX_BLOCK_HISTORY_LEN];
+  uint32_t history_next;
+} rx_block_ctrl_t;
+
+void rx_block_init(rx_block_ctrl_t *c, uint64_t cycles);
+void rx_block_configure(rx_block_ctrl_t *c, bool adaptive, uint64_t min_cycles,
+                        uint64_t max_cycles);
+
+// Account for an RX attempt on core cid that got `got` requests, NACKed or
+// not.  Returns true if it is time to call rx_block_retune
+static inline bool rx_block_record(rx_block_ctrl_t *c, int cid, int got,
+                                   bool nacked) {
+  // bypass cores never block; their NACKs say nothing about the timeout
+  if (cid < LAUBERHORN_NUM_BYPASS_CORES)
+    return false;
+
+  // single writer; relaxed stores so that rx_block_retune can sum them
+  __atomic_store_n(&c->core[cid].hits, c->core[cid].hits + got,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&c->core[cid].nacks, c->core[cid].nacks + nacked,
+                   __ATOMIC_RELAXED);
+
+  if (++c->core[cid].since_retune < RX_BLOCK_RETUNE_INTERVAL)
+    return false;
+  c->core[cid].since_retune = 0;
+  return __atomic_load_n(&c->adaptive, __ATOMIC_ACQUIRE);
+}
+
+// Compute a new blocking time from the total rx_packet_count of the worker
+// cores.
+// Only one caller proceeds at a time; returns true with *cycles set if the
+// blocking time should change
+bool rx_block_retune(rx_block_ctrl_t *c, uint64_t rx_packets,
+                     uint64_t *cycles);
+
+int rx_block_history(rx_block_ctrl_t *c, pionic_rx_block_sample_t *samples,
+                     int n);
+void rx_block_dump(rx_block_ctrl_t *c);
+
+#endif // __PIONIC_RX_BLOCK_H__
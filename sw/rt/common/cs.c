@@ -0,0 +1,178 @@
+#include "cs.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __aarch64__
+#include <sys/auxv.h>
+#ifndef HWCAP_ATOMICS
+#define HWCAP_ATOMICS (1 << 8)
+#endif
+#endif
+
+#include "core-common.h"
+
+// preempt-control CL, lowest byte: lauberhorn_eci_host_worker_ctrl_t
+#define CS_READY 0b01
+#define CS_BUSY 0b10
+
+static bool have_lse;
+
+static inline void cpu_relax(void) {
+#if defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#elif defined(__x86_64__)
+  __builtin_ia32_pause();
+#endif
+}
+
+// READY -> READY | BUSY, with acquire; returns the old value
+static inline uint8_t cs_cas(uint8_t *ctrl) {
+  uint8_t old = CS_READY;
+
+#ifdef __aarch64__
+  if (have_lse) {
+    asm volatile(".arch_extension lse\n"
+                 "casab %w0, %w2, %1"
+                 : "+r"(old), "+Q"(*ctrl)
+                 : "r"((uint8_t)(CS_READY | CS_BUSY))
+                 : "memory");
+    return old;
+  }
+#endif
+
+  __atomic_compare_exchange_n(ctrl, &old, CS_READY | CS_BUSY, false,
+                              __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+  return old;
+}
+
+// clear BUSY, with release; returns the old value
+static inline uint8_t cs_clear_busy(uint8_t *ctrl) {
+#ifdef __aarch64__
+  if (have_lse) {
+    uint8_t old;
+
+    asm volatile(".arch_extension lse\n"
+                 "ldclrlb %w2, %w0, %1"
+                 : "=&r"(old), "+Q"(*ctrl)
+                 : "r"((uint8_t)CS_BUSY)
+                 : "memory");
+    return old;
+  }
+#endif
+
+  return __atomic_fetch_and(ctrl, (uint8_t)~CS_BUSY, __ATOMIC_RELEASE);
+}
+
+// Sleep until the CL changes, unless it already reads READY
+static inline void cs_wait(uint8_t *ctrl) {
+#ifdef __aarch64__
+  uint32_t v;
+
+  asm volatile("sevl\n"
+               "wfe\n"            // consume the pending event, if any
+               "ldaxrb %w0, %1\n" // put the CL into the exclusive monitor
+               "cmp %w0, %w2\n"
+               "b.eq 1f\n"
+               "wfe\n"
+               "1:"
+               : "=&r"(v)
+               : "Q"(*ctrl), "r"((uint32_t)CS_READY)
+               : "memory", "cc");
+#else
+  cpu_relax();
+#endif
+}
+
+void cs_probe(void) {
+#ifdef __aarch64__
+  have_lse = getauxval(AT_HWCAP) & HWCAP_ATOMICS;
+#endif
+}
+
+void cs_init(cs_ctrl_t *c) {
+  memset(c, 0, sizeof(*c));
+  c->spin_limit = CS_DEFAULT_SPIN_LIMIT;
+  c->wfe = true;
+
+  cs_probe();
+}
+
+void cs_configure(cs_ctrl_t *c, uint32_t spin_limit, bool wfe) {
+  c->spin_limit = spin_limit;
+  c->wfe = wfe;
+}
+
+void cs_enter(cs_ctrl_t *c, int cid, uint8_t *ctrl) {
+  cs_enter_with(&c->core[cid].stats, c->spin_limit, c->wfe, ctrl);
+}
+
+void cs_enter_with(pionic_cs_stats_t *s, uint32_t spin_limit, bool wfe,
+                   uint8_t *ctrl) {
+  uint32_t backoff = 1, rounds = 0;
+  uint64_t waits = 0, failed = 0;
+
+  pr_debug("waiting for READY and setting BUSY\n");
+  for (;;) {
+    // only ask for the line exclusive when the CAS can succeed
+    if (__atomic_load_n(ctrl, __ATOMIC_RELAXED) == CS_READY) {
+      if (cs_cas(ctrl) == CS_READY)
+        break;
+      ++failed;
+    }
+
+    if (wfe && rounds >= spin_limit) {
+      cs_wait(ctrl);
+      ++waits;
+      continue;
+    }
+
+    for (uint32_t i = 0; i < backoff; ++i)
+      cpu_relax();
+    if (backoff < CS_BACKOFF_MAX)
+      backoff *= 2;
+    ++rounds;
+  }
+
+  FENCE; // make sure BUSY took effect before touching the datapath CLs
+
+  // single writer; relaxed stores so that readers on other threads see
+  // whole values
+  __atomic_store_n(&s->entries, s->entries + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->spins, s->spins + rounds, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->waits, s->waits + waits, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->failed, s->failed + failed, __ATOMIC_RELAXED);
+
+  pr_debug("entered critical section\n");
+}
+
+void cs_exit(uint8_t *ctrl) {
+  uint8_t old = cs_clear_busy(ctrl);
+
+  assert((old & CS_BUSY) != 0 && "was not in the critical section?");
+  (void)old;
+
+  pr_debug("exited critical section\n");
+}
+
+void cs_stats(cs_ctrl_t *c, int cid, pionic_cs_stats_t *stats) {
+  pionic_cs_stats_t *s = &c->core[cid].stats;
+
+  stats->entries = __atomic_load_n(&s->entries, __ATOMIC_RELAXED);
+  stats->spins = __atomic_load_n(&s->spins, __ATOMIC_RELAXED);
+  stats->waits = __atomic_load_n(&s->waits, __ATOMIC_RELAXED);
+  stats->failed = __atomic_load_n(&s->failed, __ATOMIC_RELAXED);
+}
+
+void cs_dump(cs_ctrl_t *c) {
+  printf("critical section (%s, spin limit %u%s):\n",
+         have_lse ? "LSE atomics" : "no LSE", c->spin_limit,
+         c->wfe ? ", then WFE" : "");
+  for (int i = 0; i < LAUBERHORN_NUM_CORES; ++i) {
+    pionic_cs_stats_t s;
+
+    cs_stats(c, i, &s);
+    printf("  core %d: %lu entries, %lu spins, %lu waits, %lu failed\n", i,
+           s.entries, s.spins, s.waits, s.failed);
+  }
+}
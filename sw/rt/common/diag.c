@@ -2,8 +2,12 @@
 #include "hal.h"
 #include "profile.h"
 
+#if PIONIC_NIC == PIONIC_NIC_emu
+#include "emu.h"
+#else
 #include "gen/pionic_eci_core.h"
 #include "gen/pionic_eci_global.h"
+#endif
 
 #include <assert.h>
 #include <setjmp.h>
@@ -26,19 +30,22 @@ void pionic_dump_core_stats(pionic_core_t *core) {
   READ_PRINT(tx_packet_count);
   READ_PRINT(rx_dma_error_count);
   READ_PRINT(tx_dma_error_count);
+  READ_PRINT(rx_bad_csum_count);
   READ_PRINT(rx_alloc_occupancy_up_to_128);
   READ_PRINT(rx_alloc_occupancy_up_to_1518);
   READ_PRINT(rx_alloc_occupancy_up_to_9618);
   READ_PRINT(rx_fsm_state);
   READ_PRINT(rx_curr_cl_idx);
   READ_PRINT(tx_fsm_state);
-  READ_PRINT(tx_curr_cl_idx);
+  READ_PRINT(tx_ring_consumed);
+  READ_PRINT(tx_ring_produced);
 #undef READ_PRINT
 }
 
 void pionic_reset_pkt_alloc(pionic_core_t *core) {
   pionic_core(alloc_reset_wr)(core, 1);
-  usleep(1); // arbitrary
+  // the read only completes once the reset has reached the NIC
+  (void)pionic_core(alloc_reset_rd)(core);
   pionic_core(alloc_reset_wr)(core, 0);
 }
 
@@ -2,7 +2,11 @@
 #include "hal.h"
 
 #include "config.h"
+#if PIONIC_NIC == PIONIC_NIC_emu
+#include "emu.h"
+#else
 #include "gen/pionic_eci_global.h"
+#endif
 
 uint64_t pionic_get_cycles(pionic_global_t *dev) {
   return pionic_global(cycles_rd)(dev);
@@ -0,0 +1,232 @@
+#include "ring.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+
+// posted receive buffer
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  uint64_t user_data;
+} ring_rx_buf_t;
+
+struct pionic_ring {
+  pionic_ctx_t ctx;
+  int cid;
+  uint32_t entries;
+
+  // all indices are free-running; entry i lives at i & (entries - 1)
+  pionic_sqe_t *sq;
+  uint32_t sq_head; // next to submit
+  uint32_t sq_tail; // next to hand out
+
+  pionic_cqe_t *cq;
+  uint32_t cq_head; // next to reap
+  uint32_t cq_tail; // next to fill
+
+  ring_rx_buf_t *rx;
+  uint32_t rx_head; // next to fill
+  uint32_t rx_tail; // next to post
+
+  // descriptors of the burst in flight, contiguous as the burst calls need
+  pionic_pkt_desc_t burst[PIONIC_RING_BURST];
+};
+
+#define RING_IDX(r, i) ((i) & ((r)->entries - 1))
+
+static inline uint32_t min_u32(uint32_t a, uint32_t b) { return a < b ? a : b; }
+
+static inline uint32_t cq_room(pionic_ring_t r) {
+  return r->entries - (r->cq_tail - r->cq_head);
+}
+
+static inline pionic_cqe_t *cq_push(pionic_ring_t r, pionic_ring_op_t op,
+                                    uint64_t user_data, int res) {
+  pionic_cqe_t *cqe = &r->cq[RING_IDX(r, r->cq_tail++)];
+
+  cqe->op = op;
+  cqe->user_data = user_data;
+  cqe->res = res;
+  return cqe;
+}
+
+int pionic_ring_init(pionic_ring_t *ring, pionic_ctx_t ctx, int cid,
+                     uint32_t entries) {
+  pionic_ring_t r;
+
+  if (!entries || (entries & (entries - 1)))
+    return -EINVAL;
+
+  r = *ring = calloc(1, sizeof(*r));
+  if (!r)
+    goto fail;
+
+  r->ctx = ctx;
+  r->cid = cid;
+  r->entries = entries;
+
+  // the SQ and CQ are the hot part: keep entries off each other's CLs
+  if (posix_memalign((void **)&r->sq, 128, entries * sizeof(*r->sq)) ||
+      posix_memalign((void **)&r->cq, 128, entries * sizeof(*r->cq)))
+    goto fail_queues;
+
+  r->rx = calloc(entries, sizeof(*r->rx));
+  if (!r->rx)
+    goto fail_queues;
+
+  return 0;
+
+fail_queues:
+  free(r->cq);
+  free(r->sq);
+  free(r);
+  *ring = NULL;
+fail:
+  return -ENOMEM;
+}
+
+void pionic_ring_fini(pionic_ring_t *ring) {
+  pionic_ring_t r = *ring;
+
+  free(r->rx);
+  free(r->cq);
+  free(r->sq);
+  free(r);
+
+  *ring = NULL;
+}
+
+pionic_sqe_t *pionic_ring_get_sqe(pionic_ring_t r) {
+  pionic_sqe_t *sqe;
+
+  if (r->sq_tail - r->sq_head == r->entries)
+    return NULL;
+
+  sqe = &r->sq[RING_IDX(r, r->sq_tail++)];
+  sqe->op = PIONIC_OP_NOP;
+  return sqe;
+}
+
+// Send the run of TX entries at the SQ head in one burst, as far as the CQ has
+// room for their completions.  Returns the number of entries completed: the
+// ones sent, and the one the burst rejected.  Entries after a short burst stay
+// queued, e.g. while the TX ring is full
+static uint32_t submit_tx(pionic_ring_t r) {
+  uint32_t max = min_u32(PIONIC_RING_BURST, cq_room(r));
+  uint32_t n, done;
+
+  for (n = 0; n < max && r->sq_head + n != r->sq_tail; ++n) {
+    pionic_sqe_t *sqe = &r->sq[RING_IDX(r, r->sq_head + n)];
+
+    if (sqe->op != PIONIC_OP_TX)
+      break;
+    r->burst[n] = sqe->desc;
+  }
+  if (!n)
+    return 0;
+
+  done = pionic_tx_burst(r->ctx, r->cid, r->burst, n);
+  for (uint32_t i = 0; i < done; ++i)
+    cq_push(r, PIONIC_OP_TX, r->sq[RING_IDX(r, r->sq_head + i)].user_data, 0);
+
+  // the burst stopped at a descriptor the NIC does not take (already logged)
+  if (done < n && r->burst[done].type == TY_ERROR) {
+    cq_push(r, PIONIC_OP_TX, r->sq[RING_IDX(r, r->sq_head + done)].user_data,
+            -EIO);
+    ++done;
+  }
+
+  r->sq_head += done;
+  return done;
+}
+
+int pionic_ring_submit(pionic_ring_t r) {
+  uint32_t start = r->sq_head;
+
+  while (r->sq_head != r->sq_tail) {
+    pionic_sqe_t *sqe = &r->sq[RING_IDX(r, r->sq_head)];
+
+    switch (sqe->op) {
+    case PIONIC_OP_TX:
+      if (!submit_tx(r))
+        goto out;
+      break;
+
+    case PIONIC_OP_RX_BUF:
+      if (r->rx_tail - r->rx_head == r->entries)
+        goto out;
+      r->rx[RING_IDX(r, r->rx_tail++)] = (ring_rx_buf_t){
+          .buf = sqe->desc.payload_buf,
+          .len = sqe->desc.payload_len,
+          .user_data = sqe->user_data,
+      };
+      ++r->sq_head;
+      break;
+
+    default:
+      ++r->sq_head;
+      break;
+    }
+  }
+
+out:
+  return r->sq_head - start;
+}
+
+int pionic_ring_poll(pionic_ring_t r) {
+  uint32_t n = min_u32(PIONIC_RING_BURST,
+                       min_u32(r->rx_tail - r->rx_head, cq_room(r)));
+  int got;
+
+  // nothing to receive into: do not fetch, a NACK would stall
+  if (!n)
+    return 0;
+
+  for (uint32_t i = 0; i < n; ++i) {
+    ring_rx_buf_t *b = &r->rx[RING_IDX(r, r->rx_head + i)];
+
+    r->burst[i].payload_buf = b->buf;
+    r->burst[i].payload_len = b->len;
+  }
+
+  got = pionic_rx_burst(r->ctx, r->cid, r->burst, n);
+
+  for (int i = 0; i < got; ++i) {
+    ring_rx_buf_t *b = &r->rx[RING_IDX(r, r->rx_head + i)];
+
+    cq_push(r, PIONIC_OP_RX_BUF, b->user_data, 0)->desc = r->burst[i];
+  }
+  r->rx_head += got;
+  return got;
+}
+
+int pionic_ring_enter(pionic_ring_t r, uint32_t min_complete) {
+  pionic_ring_submit(r);
+
+  // an empty pool would never fill the CQ
+  while (pionic_ring_cq_ready(r) < min_complete &&
+         r->rx_tail != r->rx_head && cq_room(r))
+    pionic_ring_poll(r);
+
+  return pionic_ring_cq_ready(r);
+}
+
+pionic_cqe_t *pionic_ring_peek_cqe(pionic_ring_t r) {
+  if (r->cq_head == r->cq_tail)
+    return NULL;
+  return &r->cq[RING_IDX(r, r->cq_head)];
+}
+
+void pionic_ring_cqe_seen(pionic_ring_t r) {
+  assert(r->cq_head != r->cq_tail);
+  ++r->cq_head;
+}
+
+uint32_t pionic_ring_cq_ready(pionic_ring_t r) {
+  return r->cq_tail - r->cq_head;
+}
+
+uint32_t pionic_ring_rx_posted(pionic_ring_t r) {
+  return r->rx_tail - r->rx_head;
+}
@@ -0,0 +1,126 @@
+#include "rx_block.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// multiple of the packet gap: 0.25 .. 16, starting at 2
+#define GAP_MULT_MIN 1
+#define GAP_MULT_MAX 64
+#define GAP_MULT_INIT 8
+
+// NACK ratio band, in percent
+#define NACK_HI 50
+#define NACK_LO 10
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void rx_block_init(rx_block_ctrl_t *c, uint64_t cycles) {
+  memset(c, 0, sizeof(*c));
+  c->min_cycles = RX_BLOCK_DEFAULT_MIN;
+  c->max_cycles = RX_BLOCK_DEFAULT_MAX;
+  c->cycles = cycles;
+  c->gap_mult_q2 = GAP_MULT_INIT;
+  c->last_us = now_us();
+}
+
+void rx_block_configure(rx_block_ctrl_t *c, bool adaptive, uint64_t min_cycles,
+                        uint64_t max_cycles) {
+  c->min_cycles = min_cycles;
+  c->max_cycles = max_cycles < min_cycles ? min_cycles : max_cycles;
+  c->gap_mult_q2 = GAP_MULT_INIT;
+  c->last_us = now_us();
+  __atomic_store_n(&c->adaptive, adaptive, __ATOMIC_RELEASE);
+}
+
+bool rx_block_retune(rx_block_ctrl_t *c, uint64_t rx_packets,
+                     uint64_t *cycles) {
+  if (__atomic_exchange_n(&c->busy, 1, __ATOMIC_ACQUIRE))
+    return false;
+
+  uint64_t now = now_us();
+  uint64_t hits = 0, nacks = 0;
+  for (int i = 0; i < LAUBERHORN_NUM_CORES; ++i) {
+    hits += __atomic_load_n(&c->core[i].hits, __ATOMIC_RELAXED);
+    nacks += __atomic_load_n(&c->core[i].nacks, __ATOMIC_RELAXED);
+  }
+
+  uint64_t d_us = now - c->last_us;
+  uint64_t d_pkts = rx_packets - c->last_rx_packets;
+  uint64_t d_hits = hits - c->last_hits;
+  uint64_t d_nacks = nacks - c->last_nacks;
+  uint64_t nack_pct =
+      d_hits + d_nacks ? d_nacks * 100 / (d_hits + d_nacks) : 0;
+
+  // mostly NACKs: wait longer per fetch; almost none: cut the stall short
+  if (nack_pct > NACK_HI && c->gap_mult_q2 < GAP_MULT_MAX)
+    c->gap_mult_q2 *= 2;
+  else if (nack_pct < NACK_LO && c->gap_mult_q2 > GAP_MULT_MIN)
+    c->gap_mult_q2 /= 2;
+
+  // mean gap between packets on one worker core, in NIC cycles
+  uint64_t target = c->max_cycles;
+  if (d_pkts) {
+    uint64_t gap = d_us * (LAUBERHORN_CLOCK_FREQ / 1000000) *
+                   LAUBERHORN_NUM_WORKER_CORES / d_pkts;
+    target = gap * c->gap_mult_q2 / 4;
+  }
+  if (target < c->min_cycles)
+    target = c->min_cycles;
+  if (target > c->max_cycles)
+    target = c->max_cycles;
+
+  // smooth, and skip changes under 1/8 to save register writes
+  uint64_t next = (c->cycles + target) / 2;
+  uint64_t diff = next > c->cycles ? next - c->cycles : c->cycles - next;
+  bool changed = diff > c->cycles / 8;
+  if (changed)
+    c->cycles = next;
+
+  c->history[c->history_next++ % RX_BLOCK_HISTORY_LEN] =
+      (pionic_rx_block_sample_t){
+          .time_us = now,
+          .rx_block_cycles = c->cycles,
+          .rx_packets = d_pkts,
+          .hits = d_hits,
+          .nacks = d_nacks,
+      };
+
+  c->last_us = now;
+  c->last_rx_packets = rx_packets;
+  c->last_hits = hits;
+  c->last_nacks = nacks;
+  *cycles = c->cycles;
+
+  __atomic_store_n(&c->busy, 0, __ATOMIC_RELEASE);
+  return changed;
+}
+
+int rx_block_history(rx_block_ctrl_t *c, pionic_rx_block_sample_t *samples,
+                     int n) {
+  uint32_t end = c->history_next;
+  uint32_t avail = end < RX_BLOCK_HISTORY_LEN ? end : RX_BLOCK_HISTORY_LEN;
+
+  if (n > avail)
+    n = avail;
+  // oldest first
+  for (int i = 0; i < n; ++i)
+    samples[i] = c->history[(end - n + i) % RX_BLOCK_HISTORY_LEN];
+  return n;
+}
+
+void rx_block_dump(rx_block_ctrl_t *c) {
+  pionic_rx_block_sample_t samples[RX_BLOCK_HISTORY_LEN];
+  int n = rx_block_history(c, samples, RX_BLOCK_HISTORY_LEN);
+
+  printf("rx_block_cycles: %lu (%s, bounds [%lu, %lu])\n", c->cycles,
+         c->adaptive ? "adaptive" : "fixed", c->min_cycles, c->max_cycles);
+  for (int i = 0; i < n; ++i)
+    printf("  @%lu us: %lu cycles, %lu pkts, %lu hits, %lu nacks\n",
+           samples[i].time_us, samples[i].rx_block_cycles,
+           samples[i].rx_packets, samples[i].hits, samples[i].nacks);
+}
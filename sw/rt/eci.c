@@ -1,16 +1,20 @@
 #include <assert.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "api.h"
 #include "cmac.h"
+#include "cs.h"
 #include "diag.h"
 #include "hal.h"
+#include "rx_block.h"
 
 #include "config.h"
 #include "debug.h"
@@ -29,8 +33,11 @@
 #define SHELL_REGS_CSR_ADDR (0xff0)
 #define SHELL_REGS_VERSION_ADDR (0xff8)
 
-#define FPGA_MEM_BASE (0x10000000000UL)
-#define FPGA_MEM_SIZE (1UL << 40) // 1 TiB
+// per-core CL windows in /dev/fpgamem, LAUBERHORN_ECI_CORE_OFFSET bytes apart
+#define FPGA_MEM_CORES_SIZE (PIONIC_NUM_CORES * PIONIC_ECI_CORE_OFFSET)
+// the windows are placed on a PMD boundary, so that the driver can map whole
+// huge pages when a run of cores covers them
+#define FPGA_MEM_ALIGN (2UL << 20)
 
 #define BARRIER asm volatile("dmb sy\nisb");
 
@@ -42,39 +49,55 @@ struct pionic_ctx {
 
   pionic_core_t core[PIONIC_NUM_CORES];
 
+  rx_block_ctrl_t rx_block;
+  cs_ctrl_t cs;
+
+  // datapath state of each core, written on every packet by the thread
+  // serving it; padded to a ThunderX-1 CL so that neighbouring cores do not
+  // share lines
+  struct {
+    pionic_core_state_t s;
+  } __attribute__((aligned(128))) core_state[PIONIC_NUM_CORES];
+
+  // core i at mem_region + i * PIONIC_ECI_CORE_OFFSET; windows of cores not
+  // in core_mask are left inaccessible
   void *mem_region;
+  uint64_t core_mask;
   int fpgamem_fd;
 
+  // false when attached warm: the CMAC is left running on fini
+  bool cmac_started;
+
   uint32_t page_size;
 };
 
 #include "core/eci.h"
 
-#define COMPARE_AND_SWAP __sync_val_compare_and_swap
-#define FETCH_AND_AND __sync_fetch_and_and
-
-// Define enter_cs and exit_cs for using core functions in userspace
-static inline void enter_cs() {
-  uint8_t *worker_ctrl_addr =
-      (uint8_t *)base + LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET;
-
-  pr_debug("waiting for READY and setting BUSY\n");
-  while (!COMPARE_AND_SWAP(worker_ctrl_addr, (uint8_t)0b01, (uint8_t)0b11))
-    BARRIER; // make sure BUSY actually took effect
-
-  pr_debug("entered critical section\n");
+// Context and core that the calling thread is currently operating on, and its
+// ECI window; used by enter_cs and exit_cs
+static __thread pionic_ctx_t cs_ctx;
+static __thread uint8_t *cs_base;
+static __thread int cs_cid;
+
+static inline void *core_base(pionic_ctx_t ctx, int cid) {
+  assert(cid >= 0 && cid < PIONIC_NUM_CORES);
+  assert(ctx->core_mask & (1UL << cid) && "core window not mapped");
+  cs_base = (uint8_t *)ctx->mem_region + cid * PIONIC_ECI_CORE_OFFSET;
+  cs_ctx = ctx;
+  cs_cid = cid;
+  return cs_base;
 }
 
-static inline void exit_cs() {
-  assert((FETCH_AND_AND((uint8_t *)worker_ctrl_addr, (uint8_t)0b11111101) &
-          0b10) != 0 &&
-         "was not in the critical section?");
+static inline pionic_core_state_t *core_state(pionic_ctx_t ctx, int cid) {
+  return &ctx->core_state[cid].s;
+}
 
-  pr_debug("eci_rx: exited critical section\n");
+// Define enter_cs and exit_cs for using core functions in userspace
+void enter_cs() {
+  cs_enter(&cs_ctx->cs, cs_cid, cs_base + LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET);
 }
 
-// Core state structs are not mmapped but declared statically
-static pionic_core_state_t core_states[PIONIC_NUM_CORES];
+void exit_cs() { cs_exit(cs_base + LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET); }
 
 static void write64_shell(pionic_ctx_t ctx, uint64_t addr, uint64_t reg) {
 #ifdef DEBUG_REG
@@ -99,16 +122,149 @@ static void cl_hit_inv(pionic_ctx_t ctx, uint64_t phys_addr) {
   // ioctl(ctx->fpgamem_fd, 4, phys_addr + (uint64_t)ctx->mem_region);
 }
 
-int pionic_init(pionic_ctx_t *usr_ctx, const char *dev, bool loopback) {
-  int ret = -1;
+// per-core part of init, run on its own thread
+struct core_init {
+  pionic_ctx_t ctx;
+  int cid;
+  bool warm;
+
+  pthread_t thread;
+  bool started;
+  int drained;
+};
 
-  pr_info("Initializing ECI PIO NIC...\n");
+static inline uint64_t now_us(void) {
+  struct timespec ts;
 
-  pionic_ctx_t ctx = *usr_ctx = malloc(sizeof(struct pionic_ctx));
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+// Map the CL windows of the cores in ctx->core_mask from /dev/fpgamem.  The
+// virtual range for all cores is reserved first, then every run of consecutive
+// cores is mapped over it with one mmap
+static int map_core_windows(pionic_ctx_t ctx) {
+  size_t reserve = FPGA_MEM_CORES_SIZE + FPGA_MEM_ALIGN;
+  uint8_t *region, *aligned;
+  int mapped = 0;
+
+  region = mmap(NULL, reserve, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED) {
+    perror("mmap reserve fpga mem window");
+    return -1;
+  }
+
+  // trim the reservation to an aligned range
+  aligned = (uint8_t *)(((uintptr_t)region + FPGA_MEM_ALIGN - 1) &
+                        ~(FPGA_MEM_ALIGN - 1));
+  if (aligned != region)
+    munmap(region, aligned - region);
+  munmap(aligned + FPGA_MEM_CORES_SIZE,
+         region + reserve - (aligned + FPGA_MEM_CORES_SIZE));
+  ctx->mem_region = aligned;
+
+  for (int i = 0; i < PIONIC_NUM_CORES;) {
+    int first = i;
+    size_t off, len;
+
+    if (!(ctx->core_mask & (1UL << i))) {
+      ++i;
+      continue;
+    }
+    while (i < PIONIC_NUM_CORES && ctx->core_mask & (1UL << i))
+      ++i;
+
+    off = first * PIONIC_ECI_CORE_OFFSET;
+    len = (i - first) * PIONIC_ECI_CORE_OFFSET;
+    if (mmap(aligned + off, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+             ctx->fpgamem_fd, off) == MAP_FAILED) {
+      perror("mmap fpga mem core window");
+      return -1;
+    }
+    mapped += i - first;
+  }
+
+  return mapped;
+}
+
+// Bring up the CL window of one core.  Cold: the stale requests still queued
+// for the core are dropped and its packet buffer allocator is reset.  Warm:
+// the NIC keeps running; only the datapath state is picked up
+static void *core_init(void *arg) {
+  struct core_init *ci = arg;
+  pionic_ctx_t ctx = ci->ctx;
+  int i = ci->cid;
+  pionic_pkt_desc_t desc;
+
+  // clean all cachelines
+  // we need to do this first, since inv might change tx cl idx
+  uint64_t rx_base = PIONIC_ECI_RX_BASE + i * PIONIC_ECI_CORE_OFFSET;
+  uint64_t tx_base = PIONIC_ECI_TX_BASE + i * PIONIC_ECI_CORE_OFFSET;
+
+  for (int next_cl = 0; next_cl < 2; ++next_cl)
+    cl_hit_inv(ctx, rx_base + 0x80 * next_cl);
+
+  for (int overflow_cl = 0; overflow_cl < PIONIC_ECI_NUM_OVERFLOW_CL;
+       ++overflow_cl)
+    cl_hit_inv(ctx, rx_base + PIONIC_ECI_OVERFLOW_OFFSET + 0x80 * overflow_cl);
+
+  // control, doorbell and overflow CLs of every TX ring slot
+  for (int slot = 0; slot < PIONIC_ECI_TX_RING_SLOTS; ++slot) {
+    uint64_t slot_base = tx_base + slot * PIONIC_ECI_TX_SLOT_STRIDE;
+
+    cl_hit_inv(ctx, slot_base);
+    cl_hit_inv(ctx, slot_base + PIONIC_ECI_TX_DOORBELL_OFFSET);
+    for (int overflow_cl = 0; overflow_cl < PIONIC_ECI_NUM_OVERFLOW_CL;
+         ++overflow_cl)
+      cl_hit_inv(ctx,
+                 slot_base + PIONIC_ECI_OVERFLOW_OFFSET + 0x80 * overflow_cl);
+  }
+  cl_hit_inv(ctx, tx_base + PIONIC_ECI_TX_STATUS_OFFSET);
+
+  // resync RX parity and TX ring counters from the NIC
+  pionic_sync_core_state(core_state(ctx, i), &ctx->core[i]);
+
+  if (!ci->warm) {
+    // rx_block_cycles is 0 during a cold init: every fetch returns right
+    // away, and the first NACK means the core has nothing queued anymore
+    while (core_eci_rx_view(core_base(ctx, i), core_state(ctx, i), &desc)) {
+      core_eci_rx_ack(core_state(ctx, i), &desc);
+      ++ci->drained;
+    }
+
+    pionic_reset_pkt_alloc(&ctx->core[i]);
+  }
+
+  // make sure user TX does not get reordered into before the RX drain
+  BARRIER
+
+  return NULL;
+}
+
+static int init(pionic_ctx_t *usr_ctx, bool loopback, uint64_t core_mask,
+                bool warm) {
+  struct core_init cores[PIONIC_NUM_CORES] = {0};
+  uint64_t map_start, init_start;
+  int ret = -1, mapped;
+
+  pr_info("%s ECI PIO NIC...\n", warm ? "Attaching to" : "Initializing");
+
+  // the per-core state is CL-aligned inside the context
+  pionic_ctx_t ctx = *usr_ctx = aligned_alloc(
+      _Alignof(struct pionic_ctx), sizeof(struct pionic_ctx));
+  if (!ctx) {
+    perror("aligned_alloc");
+    return -1;
+  }
+  memset(ctx, 0, sizeof(*ctx));
   ctx->page_size = sysconf(_SC_PAGESIZE);
   ctx->shell_regs_region = MAP_FAILED;
   ctx->global.base = MAP_FAILED;
   ctx->mem_region = MAP_FAILED;
+  ctx->fpgamem_fd = -1;
+  ctx->core_mask = core_mask & ((1UL << PIONIC_NUM_CORES) - 1);
+  ctx->cmac_started = false;
 
   int fd = open("/dev/mem", O_RDWR);
   if (fd < 0) {
@@ -144,8 +300,6 @@ int pionic_init(pionic_ctx_t *usr_ctx, const char *dev, bool loopback) {
   pr_info("Enzian shell version: %08lx\n",
           read64_shell(ctx, SHELL_REGS_VERSION_ADDR));
 
-  // TODO: implement resync
-
   // read out NicEngine version number
   uint64_t ver = pionic_eci_global_version_rd(&ctx->global);
   uint64_t cur_time = pionic_eci_global_cycles_rd(&ctx->global);
@@ -157,89 +311,169 @@ int pionic_init(pionic_ctx_t *usr_ctx, const char *dev, bool loopback) {
     goto fail;
   }
 
-  // map the entire fpga memory region (1 TiB)
-  ctx->mem_region = mmap((void *)FPGA_MEM_BASE, FPGA_MEM_SIZE,
-                         PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-  if (ctx->mem_region == MAP_FAILED) {
-    perror("mmap fpga mem space");
+  // map only the CL windows of the cores in use
+  map_start = now_us();
+  if ((mapped = map_core_windows(ctx)) < 0)
     goto fail;
+  pr_info("Mapped %d core windows (%d KiB) at %p in %lu us\n", mapped,
+          mapped * PIONIC_ECI_CORE_OFFSET / 1024, ctx->mem_region,
+          now_us() - map_start);
+
+  cs_init(&ctx->cs);
+
+  if (warm) {
+    // the NIC and CMAC keep running with the configuration of the previous
+    // owner
+    uint64_t cycles = pionic_get_rx_block_cycles(ctx);
+
+    rx_block_init(&ctx->rx_block, cycles);
+    pr_info("Keeping rx block cycles at %ld\n", cycles);
+  } else {
+    // non-blocking fetches for the drain; the default is set once done
+    rx_block_init(&ctx->rx_block, 200);
+    pionic_set_rx_block_cycles(ctx, 0);
+    // pionic_set_core_mask(ctx, (1 << PIONIC_NUM_CORES) - 1);
+    // FIXME: @PX, what else to initialize
+
+    // configure CMAC
+    cmac_initialize(&ctx->cmac, nic_regs_region + CMAC_BASE);
+    if (start_cmac(&ctx->cmac, loopback)) {
+      pr_err("Failed to start CMAC\n");
+      goto fail;
+    }
+    ctx->cmac_started = true;
   }
 
-  // set defaults
-  pionic_set_rx_block_cycles(ctx, 200);
-  // pionic_set_core_mask(ctx, (1 << PIONIC_NUM_CORES) - 1);
-  // FIXME: @PX, what else to initialize
-
-  // verify
-  assert(pionic_get_rx_block_cycles(ctx) == 200);
-
-  // configure CMAC
-  cmac_initialize(&ctx->cmac, nic_regs_region + CMAC_BASE);
-  if (start_cmac(&ctx->cmac, loopback)) {
-    pr_err("Failed to start CMAC\n");
-    goto fail;
+  // software buffers for the copying RX/TX paths
+  for (int i = 0; i < PIONIC_NUM_CORES; ++i) {
+    pionic_core_state_t *st = core_state(ctx, i);
+
+    if (!(ctx->core_mask & (1UL << i)))
+      continue;
+
+    st->rx_overflow_buf = malloc(LAUBERHORN_MTU);
+    st->rx_overflow_buf_size = LAUBERHORN_MTU;
+    st->tx_overflow_buf = malloc(LAUBERHORN_MTU);
+    st->tx_overflow_buf_size = LAUBERHORN_MTU;
+    if (!st->rx_overflow_buf || !st->tx_overflow_buf) {
+      perror("malloc");
+      goto fail;
+    }
   }
 
-  // initialize per-core states
+  // initialize per-core states, all cores at once
+  init_start = now_us();
   for (int i = 0; i < PIONIC_NUM_CORES; ++i) {
     pionic_eci_core_initialize(&ctx->core[i],
                                nic_regs_region + PIONIC_ECI_CORE_BASE(i));
-
-    // clean all cachelines
-    // we need to do this first, since inv might change tx cl idx
-    uint64_t rx_base = PIONIC_ECI_RX_BASE + i * PIONIC_ECI_CORE_OFFSET;
-    uint64_t tx_base = PIONIC_ECI_TX_BASE + i * PIONIC_ECI_CORE_OFFSET;
-
-    for (int next_cl = 0; next_cl < 2; ++next_cl) {
-      cl_hit_inv(ctx, rx_base + 0x80 * next_cl);
-      cl_hit_inv(ctx, tx_base + 0x80 * next_cl);
+    if (!(ctx->core_mask & (1UL << i)))
+      continue;
+
+    cores[i].ctx = ctx;
+    cores[i].cid = i;
+    cores[i].warm = warm;
+    if (pthread_create(&cores[i].thread, NULL, core_init, &cores[i])) {
+      perror("pthread_create");
+      core_init(&cores[i]);
+    } else {
+      cores[i].started = true;
     }
+  }
 
-    for (int overflow_cl = 0; overflow_cl < PIONIC_ECI_NUM_OVERFLOW_CL;
-         ++overflow_cl) {
-      cl_hit_inv(ctx,
-                 rx_base + PIONIC_ECI_OVERFLOW_OFFSET + 0x80 * overflow_cl);
-      cl_hit_inv(ctx,
-                 tx_base + PIONIC_ECI_OVERFLOW_OFFSET + 0x80 * overflow_cl);
-    }
+  for (int i = 0; i < PIONIC_NUM_CORES; ++i) {
+    if (!(ctx->core_mask & (1UL << i)))
+      continue;
+    if (cores[i].started)
+      pthread_join(cores[i].thread, NULL);
+
+    pr_info("core %d: rx curr cl idx %d, tx ring slots %d/%d, drained %d "
+            "stale packets\n",
+            i, core_state(ctx, i)->rx_next_cl, core_state(ctx, i)->tx_cons,
+            core_state(ctx, i)->tx_prod, cores[i].drained);
+  }
+  pr_info("%s %d cores in %lu us\n", warm ? "Attached" : "Initialized",
+          __builtin_popcountl(ctx->core_mask), now_us() - init_start);
 
-    // read out next CL counters
-    pionic_sync_core_state(&core_states[i], &ctx->core[i]);
-    pr_info("rx curr cl idx for core %d: %d\n", i, core_states[i].rx_next_cl);
-    pr_info("tx curr cl idx for core %d: %d\n", i, core_states[i].tx_next_cl);
-
-    // drain all rx packets -- stale ones might be hanging around
-    pionic_pkt_desc_t desc;
-    bool has_left = true;
-    int drained = 0;
-    while ((has_left = pionic_rx(ctx, i, &desc))) {
-      printf("stale packet: desc + %ld B\n", desc.payload_len);
-      ++drained;
-    }
-    printf("Drained %d stale ingress packets on core %d\n", drained, i);
+  if (!warm) {
+    pionic_set_rx_block_cycles(ctx, 200);
 
-    // reset packet buffer allocator
-    pionic_reset_pkt_alloc(&ctx->core[i]);
+    // verify
+    assert(pionic_get_rx_block_cycles(ctx) == 200);
   }
 
-  // make sure user TX does not get reordered into before the RX drain
-  BARRIER
-
   ret = 0;
 
 fail:
   return ret;
 }
 
+int pionic_init(pionic_ctx_t *usr_ctx, const char *dev, bool loopback) {
+  return pionic_init_cores(usr_ctx, dev, loopback, PIONIC_ALL_CORES);
+}
+
+int pionic_init_cores(pionic_ctx_t *usr_ctx, const char *dev, bool loopback,
+                      uint64_t core_mask) {
+  return init(usr_ctx, loopback, core_mask, false);
+}
+
+int pionic_attach(pionic_ctx_t *usr_ctx, const char *dev, uint64_t core_mask) {
+  return init(usr_ctx, false, core_mask, true);
+}
+
 void pionic_set_rx_block_cycles(pionic_ctx_t ctx, uint64_t cycles) {
-  pionic_eci_global_rx_block_cycles_wr(&ctx->global, cycles)
-      pr_debug("Rx block cycles: %d\n", cycles);
+  rx_block_configure(&ctx->rx_block, false, ctx->rx_block.min_cycles,
+                     ctx->rx_block.max_cycles);
+  ctx->rx_block.cycles = cycles;
+  pionic_eci_global_rx_block_cycles_wr(&ctx->global, cycles);
+  pr_debug("Rx block cycles: %ld\n", cycles);
 }
 
 uint64_t pionic_get_rx_block_cycles(pionic_ctx_t ctx) {
   return pionic_eci_global_rx_block_cycles_rd(&ctx->global);
 }
 
+void pionic_set_rx_block_adaptive(pionic_ctx_t ctx, bool enable,
+                                  uint64_t min_cycles, uint64_t max_cycles) {
+  rx_block_configure(&ctx->rx_block, enable, min_cycles, max_cycles);
+  pr_debug("Rx block cycles: %s in [%ld, %ld]\n",
+           enable ? "adaptive" : "fixed", min_cycles, max_cycles);
+}
+
+int pionic_get_rx_block_history(pionic_ctx_t ctx,
+                                pionic_rx_block_sample_t *samples, int n) {
+  return rx_block_history(&ctx->rx_block, samples, n);
+}
+
+void pionic_dump_rx_block_history(pionic_ctx_t ctx) {
+  rx_block_dump(&ctx->rx_block);
+}
+
+void pionic_set_cs_wait(pionic_ctx_t ctx, uint32_t spin_limit, bool wfe) {
+  cs_configure(&ctx->cs, spin_limit, wfe);
+}
+
+void pionic_get_cs_stats(pionic_ctx_t ctx, int cid, pionic_cs_stats_t *stats) {
+  cs_stats(&ctx->cs, cid, stats);
+}
+
+void pionic_dump_cs_stats(pionic_ctx_t ctx) {
+  cs_dump(&ctx->cs);
+}
+
+// feed an RX attempt to the adaptive blocking time; retuning reads the packet
+// counters of all worker cores, so it only happens every
+// RX_BLOCK_RETUNE_INTERVAL fetches
+static void rx_block_account(pionic_ctx_t ctx, int cid, int got, bool nacked) {
+  if (!rx_block_record(&ctx->rx_block, cid, got, nacked))
+    return;
+
+  uint64_t rx_packets = 0, cycles;
+  for (int i = LAUBERHORN_NUM_BYPASS_CORES; i < PIONIC_NUM_CORES; ++i)
+    rx_packets += pionic_eci_core_rx_packet_count_rd(&ctx->core[i]);
+  if (rx_block_retune(&ctx->rx_block, rx_packets, &cycles))
+    pionic_eci_global_rx_block_cycles_wr(&ctx->global, cycles);
+}
+
 // void pionic_set_dispatch_mask(pionic_ctx_t ctx, uint64_t mask) {
 //   write64(ctx, PIONIC_GLOBAL_DISPATCH_MASK, mask);
 //   printf("Dispatcher mask: %#lx\n", mask);
@@ -252,46 +486,82 @@ void pionic_fini(pionic_ctx_t *usr_ctx) {
 
   *usr_ctx = NULL;
 
-  close(ctx->fpgamem_fd);
+  if (ctx->fpgamem_fd >= 0)
+    close(ctx->fpgamem_fd);
 
   if (ctx->global.base != MAP_FAILED) {
-    stop_cmac(&ctx->cmac);
+    if (ctx->cmac_started)
+      stop_cmac(&ctx->cmac);
     munmap(ctx->global.base, PIONIC_REGS_SIZE(ctx));
   }
 
   if (ctx->mem_region != MAP_FAILED)
-    munmap(ctx->mem_region, FPGA_MEM_SIZE);
+    munmap(ctx->mem_region, FPGA_MEM_CORES_SIZE);
 
   if (ctx->shell_regs_region != MAP_FAILED)
     munmap(ctx->shell_regs_region, ctx->page_size);
 
+  for (int i = 0; i < PIONIC_NUM_CORES; ++i) {
+    free(core_state(ctx, i)->rx_overflow_buf);
+    free(core_state(ctx, i)->tx_overflow_buf);
+  }
+
   free(ctx);
 }
 
 void pionic_sync_core_state(pionic_core_state_t *state, pionic_core_t *core) {
   state->rx_next_cl = pionic_eci_core_rx_curr_cl_idx_rd(core) ? 1 : 0;
-  state->tx_next_cl = pionic_eci_core_tx_curr_cl_idx_rd(core) ? 1 : 0;
+  // empty after a cold init; on a warm attach, slots rung by the previous
+  // owner may still be in flight
+  state->tx_cons = pionic_eci_core_tx_ring_consumed_rd(core);
+  state->tx_prod = pionic_eci_core_tx_ring_produced_rd(core);
 }
 
 bool pionic_rx(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
-  return core_eci_rx((uint8_t *)ctx->mem_region + cid * PIONIC_ECI_CORE_OFFSET,
-                     (volatile bool *)&core_states[cid].rx_next_cl, desc);
+  bool got = core_eci_rx(core_base(ctx, cid), core_state(ctx, cid), desc);
+  rx_block_account(ctx, cid, got, !got);
+  return got;
+}
+
+bool pionic_rx_view(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
+  bool got = core_eci_rx_view(core_base(ctx, cid), core_state(ctx, cid), desc);
+  rx_block_account(ctx, cid, got, !got);
+  return got;
+}
+
+int pionic_rx_burst(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *descs,
+                    int n) {
+  int got =
+      core_eci_rx_burst(core_base(ctx, cid), core_state(ctx, cid), descs, n);
+  rx_block_account(ctx, cid, got, got < n);
+  return got;
 }
 
 void pionic_rx_ack(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
-  (void)ctx;
-  (void)cid;
-  core_eci_rx_ack(desc);
+  core_eci_rx_ack(core_state(ctx, cid), desc);
 }
 
 void pionic_tx_prepare_desc(pionic_ctx_t ctx, int cid,
                             pionic_pkt_desc_t *desc) {
-  (void)ctx;
-  (void)cid;
-  core_eci_tx_prepare_desc(desc);
+  core_eci_tx_prepare_desc(desc, core_state(ctx, cid));
+}
+
+// Application threads have nothing better to do than to wait for the NIC to
+// free a TX slot; keep polling in bounded rounds
+void pionic_tx_prepare_view(pionic_ctx_t ctx, int cid,
+                            pionic_pkt_desc_t *desc) {
+  while (!core_eci_tx_prepare_view(core_base(ctx, cid), core_state(ctx, cid),
+                                   desc))
+    ;
 }
 
 void pionic_tx(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
-  core_eci_tx((uint8_t *)ctx->mem_region + cid * PIONIC_ECI_CORE_OFFSET,
-              (volatile bool *)&core_states[cid].tx_next_cl, desc);
+  while (!core_eci_tx_wait_slot(core_base(ctx, cid), core_state(ctx, cid)))
+    ;
+  core_eci_tx(core_base(ctx, cid), core_state(ctx, cid), desc);
+}
+
+int pionic_tx_burst(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *descs,
+                    int n) {
+  return core_eci_tx_burst(core_base(ctx, cid), core_state(ctx, cid), descs, n);
 }
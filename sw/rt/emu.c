@@ -0,0 +1,653 @@
+// Emulated ECI NIC backend (NIC_IMPL=emu).  See emu.h for the model.
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "api.h"
+#include "cs.h"
+#include "diag.h"
+#include "emu.h"
+#include "hal.h"
+#include "rx_block.h"
+
+#include "config.h"
+
+#include "eci/core.h"
+
+// emulated ECI window: same per-core layout as the FPGA memory
+#define EMU_MEM_SIZE (LAUBERHORN_NUM_CORES * LAUBERHORN_ECI_CORE_OFFSET)
+
+// packets queued per core and direction
+#define EMU_RING_SIZE 32
+
+typedef struct {
+  pionic_emu_pkt_t slots[EMU_RING_SIZE];
+  uint32_t head; // next to consume; written by consumer
+  uint32_t tail; // next to produce; written by producer
+} emu_ring_t;
+
+// NIC side of one core.  The wire side and the thread serving the core both
+// write here on every packet; keep neighbouring cores apart
+typedef struct {
+  struct pionic_emu_core_t regs;
+
+  // parity of the RX CL holding a request not yet acked, or -1
+  int rx_held_cl;
+  // TX ring slots rung by the host and retired, both free-running
+  uint16_t tx_produced;
+  uint16_t tx_consumed;
+
+  emu_ring_t rx_ring; // wire -> host
+  emu_ring_t tx_ring; // host -> wire
+} __attribute__((aligned(128))) emu_core_t;
+
+struct pionic_ctx {
+  struct pionic_emu_global_t global;
+  emu_core_t core[LAUBERHORN_NUM_CORES];
+
+  rx_block_ctrl_t rx_block;
+  cs_ctrl_t cs;
+
+  // datapath state of each core, as in rt/eci.c
+  struct {
+    lauberhorn_core_state_t s;
+  } __attribute__((aligned(128))) core_state[LAUBERHORN_NUM_CORES];
+
+  void *mem_region;
+  uint64_t core_mask;
+
+  bool loopback;
+  bool nic_stop;
+  pthread_t nic_thread;
+};
+
+// Context and core that the calling thread is currently operating on, and its
+// ECI window; used by enter_cs and exit_cs, and by emu_cl_fetch to find the
+// NIC the fetch goes to
+static __thread pionic_ctx_t cs_ctx;
+static __thread uint8_t *cs_base;
+static __thread int cs_cid;
+
+static inline void *core_base(pionic_ctx_t ctx, int cid) {
+  assert(cid >= 0 && cid < LAUBERHORN_NUM_CORES);
+  assert(ctx->core_mask & (1UL << cid) && "core window not mapped");
+  cs_base = (uint8_t *)ctx->mem_region + cid * LAUBERHORN_ECI_CORE_OFFSET;
+  cs_ctx = ctx;
+  cs_cid = cid;
+  return cs_base;
+}
+
+static inline lauberhorn_core_state_t *core_state(pionic_ctx_t ctx, int cid) {
+  return &ctx->core_state[cid].s;
+}
+
+// Define enter_cs and exit_cs for using core functions in userspace
+void enter_cs() {
+  cs_enter(&cs_ctx->cs, cs_cid, cs_base + LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET);
+}
+
+void exit_cs() { cs_exit(cs_base + LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET); }
+
+uint64_t pionic_emu_global_cycles_rd(struct pionic_emu_global_t *d) {
+  struct timespec ts;
+  (void)d;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * LAUBERHORN_CLOCK_FREQ +
+         (uint64_t)ts.tv_nsec * (LAUBERHORN_CLOCK_FREQ / 1000000) / 1000;
+}
+
+pionic_global_t *pionic_emu_global(pionic_ctx_t ctx) { return &ctx->global; }
+
+pionic_core_t *pionic_emu_core(pionic_ctx_t ctx, int cid) {
+  return &ctx->core[cid].regs;
+}
+
+#define EMU_NOW(ctx) pionic_emu_global_cycles_rd(&(ctx)->global)
+#define EMU_PROFILE(ctx, ev)                                                   \
+  pionic_emu_global_last_profile__##ev##_wr(&(ctx)->global, EMU_NOW(ctx))
+#define EMU_COUNT(core, reg)                                                   \
+  __atomic_fetch_add(&(core)->regs.reg, 1, __ATOMIC_RELAXED)
+
+// single-producer single-consumer packet queues
+
+static pionic_emu_pkt_t *ring_peek(emu_ring_t *r) {
+  uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+  return r->head == tail ? NULL : &r->slots[r->head % EMU_RING_SIZE];
+}
+
+static void ring_pop(emu_ring_t *r) {
+  __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+static pionic_emu_pkt_t *ring_reserve(emu_ring_t *r) {
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  return r->tail - head == EMU_RING_SIZE ? NULL
+                                         : &r->slots[r->tail % EMU_RING_SIZE];
+}
+
+static void ring_push(emu_ring_t *r) {
+  __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
+
+static void pkt_copy(pionic_emu_pkt_t *dst, const pionic_emu_pkt_t *src) {
+  dst->desc = src->desc;
+  dst->desc.payload_buf = dst->data;
+  memcpy(dst->data, src->data, src->desc.payload_len);
+}
+
+bool pionic_emu_inject(pionic_ctx_t ctx, int cid, const pionic_emu_pkt_t *pkt) {
+  pionic_emu_pkt_t *slot = ring_reserve(&ctx->core[cid].rx_ring);
+
+  assert(pkt->desc.payload_len <=
+         LAUBERHORN_ECI_INLINE_DATA_SIZE +
+             LAUBERHORN_ECI_NUM_OVERFLOW_CL * LAUBERHORN_ECI_CL_SIZE);
+
+  EMU_PROFILE(ctx, rx_cmac_entry);
+  if (!slot) {
+    __atomic_fetch_add(&ctx->global.rx_overflow_count, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  pkt_copy(slot, pkt);
+  ring_push(&ctx->core[cid].rx_ring);
+  EMU_PROFILE(ctx, rx_enqueue_to_host);
+  return true;
+}
+
+bool pionic_emu_consume(pionic_ctx_t ctx, int cid, pionic_emu_pkt_t *pkt) {
+  pionic_emu_pkt_t *slot = ring_peek(&ctx->core[cid].tx_ring);
+
+  if (!slot)
+    return false;
+
+  pkt_copy(pkt, slot);
+  ring_pop(&ctx->core[cid].tx_ring);
+  EMU_PROFILE(ctx, tx_cmac_exit);
+  return true;
+}
+
+// Host fetched RX control CL cl: ack the request in the other CL, then fill
+// this one with the next packet (waiting up to rx_block_cycles on worker
+// cores, as the FPGA holds the fill).  Mirrors the RX FSM in
+// EciDecoupledRxTxProtocol
+static void emu_rx_fetch(pionic_ctx_t ctx, int cid, uint8_t *base, int cl) {
+  emu_core_t *core = &ctx->core[cid];
+  uint8_t *ctrl = base + LAUBERHORN_ECI_RX_BASE + cl * LAUBERHORN_ECI_CL_SIZE;
+  uint8_t *other =
+      base + LAUBERHORN_ECI_RX_BASE + !cl * LAUBERHORN_ECI_CL_SIZE;
+  pionic_emu_pkt_t *pkt;
+
+  if (core->rx_held_cl == !cl) {
+    // previous request acked; the NIC invalidates the CL
+    lauberhorn_eci_host_ctrl_info_error_valid_insert(other, 0);
+    core->rx_held_cl = -1;
+    EMU_PROFILE(ctx, rx_core_commit);
+  } else if (core->rx_held_cl == cl) {
+    // refetch of a request still held, e.g. after an eviction
+    return;
+  }
+
+  EMU_PROFILE(ctx, rx_core_read_start);
+
+  pkt = ring_peek(&core->rx_ring);
+  // bypass cores never block
+  if (!pkt && cid >= LAUBERHORN_NUM_BYPASS_CORES) {
+    uint64_t deadline =
+        EMU_NOW(ctx) + pionic_emu_global_rx_block_cycles_rd(&ctx->global);
+    while (!(pkt = ring_peek(&core->rx_ring)) && EMU_NOW(ctx) < deadline)
+      ;
+  }
+
+  pionic_emu_core_rx_curr_cl_idx_wr(&core->regs, !cl);
+
+  memset(ctrl, 0, LAUBERHORN_ECI_INLINE_DATA_OFFSET);
+  if (!pkt) {
+    EMU_PROFILE(ctx, rx_core_read_finish);
+    return;
+  }
+
+  pionic_pkt_desc_t *desc = &pkt->desc;
+  size_t len = desc->payload_len;
+
+  switch (desc->type) {
+  case TY_BYPASS:
+    lauberhorn_eci_host_ctrl_info_error_ty_insert(ctrl, lauberhorn_eci_bypass);
+    switch (desc->bypass.header_type) {
+    case HDR_ETHERNET:
+      lauberhorn_eci_host_ctrl_info_bypass_hdr_ty_insert(
+          ctrl, lauberhorn_eci_hdr_ethernet);
+      break;
+    case HDR_IP:
+      lauberhorn_eci_host_ctrl_info_bypass_hdr_ty_insert(ctrl,
+                                                         lauberhorn_eci_hdr_ip);
+      break;
+    case HDR_UDP:
+      lauberhorn_eci_host_ctrl_info_bypass_hdr_ty_insert(
+          ctrl, lauberhorn_eci_hdr_udp);
+      break;
+    default:
+      lauberhorn_eci_host_ctrl_info_bypass_hdr_ty_insert(
+          ctrl, lauberhorn_eci_hdr_onc_rpc_call);
+    }
+    lauberhorn_eci_host_ctrl_info_bypass_csum_ok_insert(ctrl,
+                                                         desc->bypass.csum_ok);
+    memcpy(ctrl + lauberhorn_eci_host_ctrl_info_bypass_size,
+           desc->bypass.header, sizeof(desc->bypass.header));
+    break;
+
+  case TY_ONCRPC_CALL:
+    lauberhorn_eci_host_ctrl_info_error_ty_insert(ctrl,
+                                                  lauberhorn_eci_onc_rpc_call);
+    lauberhorn_eci_host_ctrl_info_onc_rpc_server_xid_insert(
+        ctrl, desc->oncrpc_server.xid);
+    lauberhorn_eci_host_ctrl_info_onc_rpc_server_func_ptr_insert(
+        ctrl, (uint64_t)desc->oncrpc_server.func_ptr);
+    lauberhorn_eci_host_ctrl_info_onc_rpc_server_args_len_insert(
+        ctrl, desc->oncrpc_server.args_len);
+    memcpy(ctrl + lauberhorn_eci_host_ctrl_info_onc_rpc_server_size,
+           desc->oncrpc_server.args, desc->oncrpc_server.args_len);
+    break;
+
+  case TY_ARP_REQ:
+    lauberhorn_eci_host_ctrl_info_error_ty_insert(ctrl, lauberhorn_eci_arp_req);
+    lauberhorn_eci_host_ctrl_info_arp_req_tbl_idx_insert(
+        ctrl, desc->arp_req.neigh_tbl_idx);
+    lauberhorn_eci_host_ctrl_info_arp_req_ip_addr_insert(ctrl,
+                                                         desc->arp_req.ip_addr);
+    len = 0;
+    break;
+
+  default:
+    pr_err("emu: cannot deliver packet of type %d\n", desc->type);
+    EMU_COUNT(core, rx_dma_error_count);
+    ring_pop(&core->rx_ring);
+    return;
+  }
+
+  // payload: inline half-CL, then the overflow CLs shared by both parities
+  size_t inline_len = min(len, LAUBERHORN_ECI_INLINE_DATA_SIZE);
+  lauberhorn_copy_inline(ctrl + LAUBERHORN_ECI_INLINE_DATA_OFFSET, pkt->data,
+                         inline_len);
+  lauberhorn_copy_overflow(base + LAUBERHORN_ECI_RX_BASE +
+                               LAUBERHORN_ECI_OVERFLOW_OFFSET,
+                           pkt->data + inline_len, len - inline_len);
+
+  lauberhorn_eci_host_ctrl_info_error_len_insert(ctrl, len);
+  lauberhorn_eci_host_ctrl_info_error_valid_insert(ctrl, 1);
+
+  ring_pop(&core->rx_ring);
+  core->rx_held_cl = cl;
+  EMU_COUNT(core, rx_packet_count);
+  EMU_PROFILE(ctx, rx_core_read_finish);
+}
+
+// Take the packet out of TX ring slot `slot`.  Mirrors the TX FSM in
+// EciDecoupledRxTxProtocol
+static void emu_tx_retire(pionic_ctx_t ctx, int cid, uint8_t *base,
+                          uint16_t slot) {
+  emu_core_t *core = &ctx->core[cid];
+  uint8_t *ctrl = core_eci_tx_slot(base, slot);
+  uint8_t *inline_buf = ctrl + LAUBERHORN_ECI_INLINE_DATA_OFFSET;
+  uint8_t *overflow_buf = ctrl + LAUBERHORN_ECI_OVERFLOW_OFFSET;
+
+  pionic_emu_pkt_t *pkt = ring_reserve(&core->tx_ring);
+  if (!pkt) {
+    pr_debug("emu: TX queue of core %d full, dropping\n", cid);
+    EMU_COUNT(core, tx_dma_error_count);
+    return;
+  }
+
+  pionic_pkt_desc_t *desc = &pkt->desc;
+  size_t len = lauberhorn_eci_host_ctrl_info_error_len_extract(ctrl);
+
+  memset(desc, 0, sizeof(*desc));
+  switch (lauberhorn_eci_host_ctrl_info_error_ty_extract(ctrl)) {
+  case lauberhorn_eci_bypass:
+    desc->type = TY_BYPASS;
+    desc->bypass.header_type = HDR_ETHERNET;
+    memcpy(desc->bypass.header,
+           ctrl + lauberhorn_eci_host_ctrl_info_bypass_size,
+           sizeof(desc->bypass.header));
+    break;
+
+  case lauberhorn_eci_onc_rpc_reply: {
+    // len covers the inlined words and the payload.  A reply with a payload
+    // always fills all inline words (see serve.h), so the split is the same
+    // as in the NIC
+    size_t inline_words =
+        min(len, (size_t)LAUBERHORN_ONCRPC_INLINE_BYTES) / sizeof(uint32_t);
+
+    desc->type = TY_ONCRPC_REPLY;
+    desc->oncrpc_server.xid =
+        lauberhorn_eci_host_ctrl_info_onc_rpc_server_xid_extract(ctrl);
+    desc->oncrpc_server.func_ptr =
+        (void *)lauberhorn_eci_host_ctrl_info_onc_rpc_server_func_ptr_extract(
+            ctrl);
+    desc->oncrpc_server.tx_inline_words = inline_words;
+    memcpy(desc->oncrpc_server.args,
+           ctrl + lauberhorn_eci_host_ctrl_info_onc_rpc_server_size,
+           inline_words * sizeof(uint32_t));
+    len -= inline_words * sizeof(uint32_t);
+    break;
+  }
+
+  default:
+    pr_err("emu: unexpected TX request type %ld on core %d\n",
+           (long)lauberhorn_eci_host_ctrl_info_error_ty_extract(ctrl), cid);
+    EMU_COUNT(core, tx_dma_error_count);
+    return;
+  }
+
+  size_t inline_len = min(len, LAUBERHORN_ECI_INLINE_DATA_SIZE);
+  lauberhorn_copy_inline(pkt->data, inline_buf, inline_len);
+  lauberhorn_copy_overflow(pkt->data + inline_len, overflow_buf,
+                           len - inline_len);
+  desc->payload_buf = pkt->data;
+  desc->payload_len = len;
+
+  ring_push(&core->tx_ring);
+  EMU_COUNT(core, tx_packet_count);
+  EMU_PROFILE(ctx, tx_core_commit);
+}
+
+// Host fetched the doorbell of TX ring slot `slot`: all slots up to it are
+// produced.  The emulated NIC retires them right away, before answering with
+// the ring status
+static void emu_tx_doorbell(pionic_ctx_t ctx, int cid, uint8_t *base,
+                            uint16_t slot, uint8_t *cl) {
+  emu_core_t *core = &ctx->core[cid];
+  uint16_t rung =
+      ((slot - core->tx_consumed) & (LAUBERHORN_ECI_TX_RING_SLOTS - 1)) + 1;
+
+  EMU_PROFILE(ctx, tx_core_acquire);
+
+  if ((uint16_t)(core->tx_produced - core->tx_consumed) < rung)
+    core->tx_produced = core->tx_consumed + rung;
+  pionic_emu_core_tx_ring_produced_wr(&core->regs, core->tx_produced);
+
+  while (core->tx_consumed != core->tx_produced)
+    emu_tx_retire(ctx, cid, base, core->tx_consumed++);
+  pionic_emu_core_tx_ring_consumed_wr(&core->regs, core->tx_consumed);
+
+  lauberhorn_eci_tx_ring_status_consumed_insert(cl, core->tx_consumed);
+}
+
+// Called by the datapath right after core_base(), on the same thread
+void emu_cl_fetch(void *addr) {
+  pionic_ctx_t ctx = cs_ctx;
+  size_t off = (uint8_t *)addr - (uint8_t *)ctx->mem_region;
+  int cid = off / LAUBERHORN_ECI_CORE_OFFSET;
+  uint8_t *base =
+      (uint8_t *)ctx->mem_region + cid * LAUBERHORN_ECI_CORE_OFFSET;
+
+  off %= LAUBERHORN_ECI_CORE_OFFSET;
+
+  if (off >= LAUBERHORN_ECI_RX_BASE &&
+      off < LAUBERHORN_ECI_RX_BASE + LAUBERHORN_ECI_OVERFLOW_OFFSET)
+    emu_rx_fetch(ctx, cid, base,
+                 (off - LAUBERHORN_ECI_RX_BASE) / LAUBERHORN_ECI_CL_SIZE);
+  else if (off >= LAUBERHORN_ECI_TX_BASE &&
+           off < LAUBERHORN_ECI_TX_BASE + LAUBERHORN_ECI_TX_RING_SLOTS *
+                                              LAUBERHORN_ECI_TX_SLOT_STRIDE) {
+    uint16_t slot = (off - LAUBERHORN_ECI_TX_BASE) / LAUBERHORN_ECI_TX_SLOT_STRIDE;
+    size_t slot_off = (off - LAUBERHORN_ECI_TX_BASE) % LAUBERHORN_ECI_TX_SLOT_STRIDE;
+
+    if (slot_off == LAUBERHORN_ECI_TX_DOORBELL_OFFSET)
+      emu_tx_doorbell(ctx, cid, base, slot, addr);
+    else if (slot_off == LAUBERHORN_ECI_TX_STATUS_OFFSET)
+      lauberhorn_eci_tx_ring_status_consumed_insert(
+          addr, ctx->core[cid].tx_consumed);
+  }
+}
+
+// CMAC loopback: bypass frames sent by any core come back to a bypass core.
+// There is no flow hash in the emulation: frames from a bypass core come back
+// to the same core, those from a worker core to bypass core 0
+static void *emu_loopback_thread(void *arg) {
+  pionic_ctx_t ctx = arg;
+  pionic_emu_pkt_t *pkt = malloc(sizeof(*pkt));
+
+  while (!__atomic_load_n(&ctx->nic_stop, __ATOMIC_RELAXED)) {
+    for (int i = 0; i < LAUBERHORN_NUM_CORES; ++i) {
+      if (!pionic_emu_consume(ctx, i, pkt))
+        continue;
+
+      if (pkt->desc.type != TY_BYPASS) {
+        pr_debug("emu: loopback dropping non-bypass packet from core %d\n", i);
+        continue;
+      }
+      int to = i < LAUBERHORN_NUM_BYPASS_CORES ? i : 0;
+      while (!pionic_emu_inject(ctx, to, pkt) &&
+             !__atomic_load_n(&ctx->nic_stop, __ATOMIC_RELAXED))
+        ;
+    }
+  }
+
+  free(pkt);
+  return NULL;
+}
+
+int pionic_init(pionic_ctx_t *usr_ctx, const char *dev, bool loopback) {
+  return pionic_init_cores(usr_ctx, dev, loopback, PIONIC_ALL_CORES);
+}
+
+int pionic_init_cores(pionic_ctx_t *usr_ctx, const char *dev, bool loopback,
+                      uint64_t core_mask) {
+  int ret = -1;
+  (void)dev;
+
+  pr_info("Initializing emulated ECI NIC...\n");
+
+  // the per-core state is CL-aligned inside the context
+  pionic_ctx_t ctx = *usr_ctx = aligned_alloc(
+      _Alignof(struct pionic_ctx), sizeof(struct pionic_ctx));
+  if (!ctx) {
+    perror("aligned_alloc");
+    goto fail;
+  }
+  memset(ctx, 0, sizeof(*ctx));
+  // the emulated window is plain memory and always mapped whole; the mask only
+  // catches use of cores the caller did not ask for
+  ctx->core_mask = core_mask & ((1UL << LAUBERHORN_NUM_CORES) - 1);
+
+  // private to this process, like the rings in ctx: the wire side is a thread
+  // that goes through pionic_emu_inject
+  ctx->mem_region = mmap(NULL, EMU_MEM_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ctx->mem_region == MAP_FAILED) {
+    perror("mmap emulated ECI window");
+    goto fail;
+  }
+  pr_info("Emulated ECI window at %p (%#x B)\n", ctx->mem_region,
+          EMU_MEM_SIZE);
+
+  for (int i = 0; i < LAUBERHORN_NUM_CORES; ++i) {
+    lauberhorn_core_state_t *st = core_state(ctx, i);
+
+    ctx->core[i].rx_held_cl = -1;
+
+    // software buffers for the copying RX/TX paths
+    st->rx_overflow_buf = malloc(LAUBERHORN_MTU);
+    st->rx_overflow_buf_size = LAUBERHORN_MTU;
+    st->tx_overflow_buf = malloc(LAUBERHORN_MTU);
+    st->tx_overflow_buf_size = LAUBERHORN_MTU;
+    if (!st->rx_overflow_buf || !st->tx_overflow_buf) {
+      perror("malloc");
+      goto fail;
+    }
+
+    // the emulated scheduler always lets the thread in
+    *((uint8_t *)ctx->mem_region + i * LAUBERHORN_ECI_CORE_OFFSET +
+      LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET) = 0b01;
+  }
+
+  // set defaults
+  cs_init(&ctx->cs);
+  rx_block_init(&ctx->rx_block, 200);
+  pionic_set_rx_block_cycles(ctx, 200);
+  assert(pionic_get_rx_block_cycles(ctx) == 200);
+
+  ctx->loopback = loopback;
+  if (loopback && pthread_create(&ctx->nic_thread, NULL, emu_loopback_thread,
+                                 ctx)) {
+    perror("pthread_create");
+    ctx->loopback = false;
+    goto fail;
+  }
+
+  ret = 0;
+
+fail:
+  return ret;
+}
+
+int pionic_attach(pionic_ctx_t *usr_ctx, const char *dev, uint64_t core_mask) {
+  (void)usr_ctx;
+  (void)dev;
+  (void)core_mask;
+
+  // the emulated NIC lives and dies with the process that created it
+  pr_err("cannot attach to a running emulated NIC\n");
+  return -1;
+}
+
+void pionic_fini(pionic_ctx_t *usr_ctx) {
+  pr_info("Uninitializing emulated ECI NIC...\n");
+
+  pionic_ctx_t ctx = *usr_ctx;
+
+  *usr_ctx = NULL;
+  if (!ctx)
+    return;
+
+  if (ctx->loopback) {
+    __atomic_store_n(&ctx->nic_stop, true, __ATOMIC_RELAXED);
+    pthread_join(ctx->nic_thread, NULL);
+  }
+
+  if (ctx->mem_region && ctx->mem_region != MAP_FAILED)
+    munmap(ctx->mem_region, EMU_MEM_SIZE);
+
+  for (int i = 0; i < LAUBERHORN_NUM_CORES; ++i) {
+    free(core_state(ctx, i)->rx_overflow_buf);
+    free(core_state(ctx, i)->tx_overflow_buf);
+  }
+
+  free(ctx);
+}
+
+void pionic_set_rx_block_cycles(pionic_ctx_t ctx, uint64_t cycles) {
+  rx_block_configure(&ctx->rx_block, false, ctx->rx_block.min_cycles,
+                     ctx->rx_block.max_cycles);
+  ctx->rx_block.cycles = cycles;
+  pionic_emu_global_rx_block_cycles_wr(&ctx->global, cycles);
+  pr_debug("Rx block cycles: %ld\n", cycles);
+}
+
+uint64_t pionic_get_rx_block_cycles(pionic_ctx_t ctx) {
+  return pionic_emu_global_rx_block_cycles_rd(&ctx->global);
+}
+
+void pionic_set_rx_block_adaptive(pionic_ctx_t ctx, bool enable,
+                                  uint64_t min_cycles, uint64_t max_cycles) {
+  rx_block_configure(&ctx->rx_block, enable, min_cycles, max_cycles);
+  pr_debug("Rx block cycles: %s in [%ld, %ld]\n",
+           enable ? "adaptive" : "fixed", min_cycles, max_cycles);
+}
+
+int pionic_get_rx_block_history(pionic_ctx_t ctx,
+                                pionic_rx_block_sample_t *samples, int n) {
+  return rx_block_history(&ctx->rx_block, samples, n);
+}
+
+void pionic_dump_rx_block_history(pionic_ctx_t ctx) {
+  rx_block_dump(&ctx->rx_block);
+}
+
+void pionic_set_cs_wait(pionic_ctx_t ctx, uint32_t spin_limit, bool wfe) {
+  cs_configure(&ctx->cs, spin_limit, wfe);
+}
+
+void pionic_get_cs_stats(pionic_ctx_t ctx, int cid, pionic_cs_stats_t *stats) {
+  cs_stats(&ctx->cs, cid, stats);
+}
+
+void pionic_dump_cs_stats(pionic_ctx_t ctx) {
+  cs_dump(&ctx->cs);
+}
+
+// feed an RX attempt to the adaptive blocking time; retuning reads the packet
+// counters of all worker cores, so it only happens every
+// RX_BLOCK_RETUNE_INTERVAL fetches
+static void rx_block_account(pionic_ctx_t ctx, int cid, int got, bool nacked) {
+  if (!rx_block_record(&ctx->rx_block, cid, got, nacked))
+    return;
+
+  uint64_t rx_packets = 0, cycles;
+  for (int i = LAUBERHORN_NUM_BYPASS_CORES; i < LAUBERHORN_NUM_CORES; ++i)
+    rx_packets += pionic_emu_core_rx_packet_count_rd(&ctx->core[i].regs);
+  if (rx_block_retune(&ctx->rx_block, rx_packets, &cycles))
+    pionic_emu_global_rx_block_cycles_wr(&ctx->global, cycles);
+}
+
+void pionic_sync_core_state(pionic_core_state_t *state, pionic_core_t *core) {
+  state->rx_next_cl = pionic_emu_core_rx_curr_cl_idx_rd(core) ? 1 : 0;
+  // empty after a cold init; on a warm attach, slots rung by the previous
+  // owner may still be in flight
+  state->tx_cons = pionic_emu_core_tx_ring_consumed_rd(core);
+  state->tx_prod = pionic_emu_core_tx_ring_produced_rd(core);
+}
+
+bool pionic_rx(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
+  bool got = core_eci_rx(core_base(ctx, cid), core_state(ctx, cid), desc);
+  rx_block_account(ctx, cid, got, !got);
+  return got;
+}
+
+bool pionic_rx_view(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
+  bool got = core_eci_rx_view(core_base(ctx, cid), core_state(ctx, cid), desc);
+  rx_block_account(ctx, cid, got, !got);
+  return got;
+}
+
+int pionic_rx_burst(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *descs,
+                    int n) {
+  int got = core_eci_rx_burst(core_base(ctx, cid), core_state(ctx, cid), descs, n);
+  rx_block_account(ctx, cid, got, got < n);
+  return got;
+}
+
+void pionic_rx_ack(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
+  core_eci_rx_ack(core_state(ctx, cid), desc);
+}
+
+void pionic_tx_prepare_desc(pionic_ctx_t ctx, int cid,
+                            pionic_pkt_desc_t *desc) {
+  core_eci_tx_prepare_desc(desc, core_state(ctx, cid));
+}
+
+// Application threads have nothing better to do than to wait for the NIC to
+// free a TX slot; keep polling in bounded rounds
+void pionic_tx_prepare_view(pionic_ctx_t ctx, int cid,
+                            pionic_pkt_desc_t *desc) {
+  while (!core_eci_tx_prepare_view(core_base(ctx, cid), core_state(ctx, cid),
+                                   desc))
+    ;
+}
+
+void pionic_tx(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
+  while (!core_eci_tx_wait_slot(core_base(ctx, cid), core_state(ctx, cid)))
+    ;
+  core_eci_tx(core_base(ctx, cid), core_state(ctx, cid), desc);
+}
+
+int pionic_tx_burst(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *descs,
+                    int n) {
+  return core_eci_tx_burst(core_base(ctx, cid), core_state(ctx, cid), descs, n);
+}
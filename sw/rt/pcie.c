@@ -11,24 +11,37 @@
 #include "diag.h"
 #include "hal.h"
 
-#include "core-pcie.h"
 #include "debug.h"
+#include "pcie/core.h"
 
 #ifdef __KERNEL__
 #error "PCIe rt is not ready for the kernel module
 #endif
 
 struct pionic_ctx {
-  void *bar;
+  void *bar;    // registers: [0, PIONIC_PCIE_PKT_BASE), uncached
+  void *pktbuf; // packet buffer window: RX uncached, TX slots write-combining
+                // if possible
+  void *cmac_regs;
+  bool pktbuf_wc; // TX slots are write-combining
   pionic_pcie_global_t glb_dev;
   pionic_pcie_core_t core_dev[PIONIC_NUM_CORES];
+  core_pcie_state_t core_state[PIONIC_NUM_CORES];
+  cmac_t cmac;
 };
 
 #define PIONIC_CMAC_BASE 0x200000UL
 #define PIONIC_MMAP_END 0x300000UL
 
+#define PIONIC_PKTBUF_WINDOW (PIONIC_CMAC_BASE - PIONIC_PCIE_PKT_BASE)
+#define PIONIC_CMAC_WINDOW (PIONIC_MMAP_END - PIONIC_CMAC_BASE)
+
+// The NIC places the TX slots of all cores after the RX buffers
+#define PIONIC_PKTBUF_TX_WINDOW                                                \
+  (PIONIC_PKTBUF_WINDOW - LAUBERHORN_PKT_BUF_TX_OFFSET)
+
 // TODO: these MMIO functions are to be removed after migrating everthing (e.g.
-// cmac) to Mackerel
+// cmac) to Mackerel.  They only reach the register window
 
 void write64(pionic_ctx_t ctx, uint64_t addr, uint64_t reg) {
 #ifdef DEBUG_REG
@@ -68,11 +81,76 @@ uint32_t read32(pionic_ctx_t ctx, uint64_t addr) {
   return reg;
 }
 
+// Map the packet buffer window in one piece of address space, so that NIC
+// offsets stay relative to one base.  The RX buffers stay uncached: the host
+// reads them, and WC reads would be speculative and may return stale data.
+// Only the TX slots go through the write-combining alias of the BAR, so that
+// payload stores leave in full bursts instead of one TLP per store.  The kernel
+// only offers resource0_wc for prefetchable BARs; fall back to the uncached
+// mapping then, or if LAUBERHORN_PCIE_PKTBUF_UC is set (for comparison)
+static void *map_pktbuf(pionic_ctx_t ctx, const char *dev, int fd_uc) {
+  const char *force_uc = getenv("LAUBERHORN_PCIE_PKTBUF_UC");
+  void *p, *rx, *tx = MAP_FAILED;
+
+  static_assert(LAUBERHORN_PKT_BUF_TX_OFFSET % 4096 == 0,
+                "TX slots should start on their own page");
+
+  ctx->pktbuf_wc = false;
+
+  // reserve the window, then map the two parts over it
+  p = mmap(NULL, PIONIC_PKTBUF_WINDOW, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+           -1, 0);
+  if (p == MAP_FAILED)
+    return p;
+
+  rx = mmap(p, LAUBERHORN_PKT_BUF_TX_OFFSET, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED, fd_uc, PIONIC_PCIE_PKT_BASE);
+  if (rx == MAP_FAILED)
+    goto fail;
+
+  if (!force_uc || !*force_uc || !strcmp(force_uc, "0")) {
+    char wc_path[64];
+    snprintf(wc_path, sizeof(wc_path),
+             "/sys/bus/pci/devices/%s/resource0_wc", dev);
+
+    int fd = open(wc_path, O_RDWR);
+    if (fd >= 0) {
+      tx = mmap(p + LAUBERHORN_PKT_BUF_TX_OFFSET, PIONIC_PKTBUF_TX_WINDOW,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+                PIONIC_PCIE_PKT_BASE + LAUBERHORN_PKT_BUF_TX_OFFSET);
+      close(fd);
+      if (tx != MAP_FAILED)
+        ctx->pktbuf_wc = true;
+      else
+        perror("mmap resource0_wc");
+    }
+  }
+
+  if (tx == MAP_FAILED) {
+    tx = mmap(p + LAUBERHORN_PKT_BUF_TX_OFFSET, PIONIC_PKTBUF_TX_WINDOW,
+              PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd_uc,
+              PIONIC_PCIE_PKT_BASE + LAUBERHORN_PKT_BUF_TX_OFFSET);
+    if (tx == MAP_FAILED)
+      goto fail;
+  }
+
+  printf("Packet buffer: RX uncached, TX %s\n",
+         ctx->pktbuf_wc ? "write-combining" : "uncached");
+  return p;
+
+fail:
+  munmap(p, PIONIC_PKTBUF_WINDOW);
+  return MAP_FAILED;
+}
+
 int pionic_init(pionic_ctx_t *usr_ctx, const char *dev, bool loopback) {
   int ret = -1;
 
   pionic_ctx_t ctx = *usr_ctx = malloc(sizeof(struct pionic_ctx));
 
+  static_assert(LAUBERHORN_PKT_BUF_SIZE <= PIONIC_PKTBUF_WINDOW,
+                "packet buffer should fit below the CMAC");
+
   char bar_path[64];
   snprintf(bar_path, sizeof(bar_path), "/sys/bus/pci/devices/%s/resource0",
            dev);
@@ -83,14 +161,30 @@ int pionic_init(pionic_ctx_t *usr_ctx, const char *dev, bool loopback) {
     goto fail;
   }
 
-  ctx->bar =
-      mmap(NULL, PIONIC_MMAP_END, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  // registers, packet buffer and CMAC are mapped separately: the same pages
+  // must not be mapped with different memory types at the same time
+  ctx->bar = mmap(NULL, PIONIC_PCIE_PKT_BASE, PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0);
   if (ctx->bar == MAP_FAILED) {
     perror("mmap resource");
     goto fail_mmap;
   }
 
+  ctx->pktbuf = map_pktbuf(ctx, dev, fd);
+  if (ctx->pktbuf == MAP_FAILED) {
+    perror("mmap packet buffer");
+    goto fail_mmap_pktbuf;
+  }
+
+  ctx->cmac_regs = mmap(NULL, PIONIC_CMAC_WINDOW, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, PIONIC_CMAC_BASE);
+  if (ctx->cmac_regs == MAP_FAILED) {
+    perror("mmap cmac");
+    goto fail_mmap_cmac;
+  }
+
   close(fd);
+  fd = -1;
 
   // initialize Mackerel devices
   pionic_pcie_global_initialize(&ctx->glb_dev,
@@ -113,7 +207,8 @@ int pionic_init(pionic_ctx_t *usr_ctx, const char *dev, bool loopback) {
   fclose(fp);
 
   // configure CMAC
-  if (start_cmac(ctx, PIONIC_CMAC_BASE, loopback)) {
+  cmac_initialize(&ctx->cmac, ctx->cmac_regs);
+  if (start_cmac(&ctx->cmac, loopback)) {
     printf("Failed to start CMAC\n");
     goto fail_start_cmac;
   }
@@ -122,53 +217,83 @@ int pionic_init(pionic_ctx_t *usr_ctx, const char *dev, bool loopback) {
   pionic_set_rx_block_cycles(ctx, 200);
   pionic_oncrpc_set_core_mask(ctx, (1 << PIONIC_NUM_CORES) - 1);
 
-  // reset packet buffer allocator
+  // reset packet buffer allocator, pick up the ring indices
   for (int i = 0; i < PIONIC_NUM_CORES; ++i) {
-    pionic_reset_pkt_alloc(ctx, i);
+    pionic_reset_pkt_alloc(&ctx->core_dev[i]);
+    core_pcie_sync(ctx->pktbuf, &ctx->core_dev[i], &ctx->core_state[i]);
   }
 
   ret = 0;
   return ret;
 
   // error handling
-  stop_cmac(ctx, PIONIC_CMAC_BASE);
+  stop_cmac(&ctx->cmac);
 fail_start_cmac:
 fail_enable:
-  munmap(ctx->bar, PIONIC_MMAP_END);
+  munmap(ctx->cmac_regs, PIONIC_CMAC_WINDOW);
+fail_mmap_cmac:
+  munmap(ctx->pktbuf, PIONIC_PKTBUF_WINDOW);
+fail_mmap_pktbuf:
+  munmap(ctx->bar, PIONIC_PCIE_PKT_BASE);
 fail_mmap:
+  if (fd >= 0)
+    close(fd);
+fail:
   return ret;
 }
 
-void pionic_set_rx_block_cycles(pionic_ctx_t ctx, int cycles) {
+void pionic_set_rx_block_cycles(pionic_ctx_t ctx, uint64_t cycles) {
   pionic_pcie_global_rx_block_cycles_wr(&ctx->glb_dev, cycles);
 
-  printf("Rx block cycles: %d\n", cycles);
+  printf("Rx block cycles: %lu\n", cycles);
 }
 
 void pionic_fini(pionic_ctx_t *usr_ctx) {
   pionic_ctx_t ctx = *usr_ctx;
 
+  // hand back pending RX acks
+  for (int i = 0; i < PIONIC_NUM_CORES; ++i) {
+    core_pcie_rx_ack_flush(&ctx->core_dev[i], &ctx->core_state[i]);
+  }
+
   // disable CMAC
-  stop_cmac(ctx, PIONIC_CMAC_BASE);
+  stop_cmac(&ctx->cmac);
 
-  munmap(ctx->bar, PIONIC_MMAP_END);
+  munmap(ctx->cmac_regs, PIONIC_CMAC_WINDOW);
+  munmap(ctx->pktbuf, PIONIC_PKTBUF_WINDOW);
+  munmap(ctx->bar, PIONIC_PCIE_PKT_BASE);
 
   *usr_ctx = NULL;
 }
 
 bool pionic_rx(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
-  return core_pcie_rx(ctx->bar, &ctx->core_dev[cid], desc);
+  return core_pcie_rx(ctx->pktbuf, &ctx->core_dev[cid], &ctx->core_state[cid],
+                      desc);
+}
+
+int pionic_rx_burst(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *descs,
+                    int n) {
+  return core_pcie_rx_burst(ctx->pktbuf, &ctx->core_dev[cid],
+                            &ctx->core_state[cid], descs, n);
 }
 
 void pionic_rx_ack(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
-  core_pcie_rx_ack(ctx->bar, &ctx->core_dev[cid], desc);
+  core_pcie_rx_ack(ctx->pktbuf, &ctx->core_dev[cid], &ctx->core_state[cid],
+                   desc);
 }
 
 void pionic_tx_prepare_desc(pionic_ctx_t ctx, int cid,
                             pionic_pkt_desc_t *desc) {
-  core_pcie_tx_prepare_desc(ctx->bar, &ctx->core_dev[cid], desc);
+  core_pcie_tx_prepare_desc(ctx->pktbuf, &ctx->core_dev[cid],
+                            &ctx->core_state[cid], desc);
 }
 
 void pionic_tx(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *desc) {
-  core_pcie_tx(ctx->bar, &ctx->core_dev[cid], desc);
+  core_pcie_tx(ctx->pktbuf, &ctx->core_dev[cid], &ctx->core_state[cid], desc);
+}
+
+int pionic_tx_burst(pionic_ctx_t ctx, int cid, pionic_pkt_desc_t *descs,
+                    int n) {
+  return core_pcie_tx_burst(ctx->pktbuf, &ctx->core_dev[cid],
+                            &ctx->core_state[cid], descs, n);
 }
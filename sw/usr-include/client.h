@@ -0,0 +1,150 @@
+// ONC RPC client: nested calls to remote services through the NIC
+//
+// A client names one remote procedure (program, version, procedure on a
+// server).  Calls are encoded by the NIC (OncRpcCallEncoder) from a TX
+// descriptor carrying the client handle and an xid; the reply decoder matches
+// the reply back by xid and hands it to this process as a TY_ONCRPC_REPLY
+// descriptor, on whichever of its threads the scheduler picks.
+//
+// Calls are asynchronous.  The xid indexes a process-wide completion table in
+// pionic_dev, so any thread that receives the reply (lauberhorn_serve or
+// lauberhorn_clnt_poll) completes the call.  The issuing thread then sees the
+// future become ready, or runs its callback the next time it polls: callbacks
+// always run on the issuing thread.  Any number of calls may be in flight per
+// thread, up to LAUBERHORN_NUM_PENDING_CALLS per process (the size of the
+// pending call table in the NIC).
+//
+// The NIC frees a pending call only when its reply arrives; there is no way to
+// drop one from the host.  A cancelled call therefore keeps its slot until the
+// late reply comes in, or for LAUBERHORN_CLNT_CANCEL_HOLD_NS at most: cancels
+// never let a process have more calls in the NIC than it has slots.  Past the
+// hold time the NIC entry may still be there; once the table (shared by all
+// processes) is full, the NIC drops new calls and counts them in
+// stat_pending_tbl_full of OncRpcReplyDecoder.  Pick timeouts well above the
+// reply time of the server to keep that from happening.
+//
+// To fan out from a handler, issue the calls, drop the original call
+// (return negative) and send the reply as a TY_ONCRPC_REPLY with the saved xid
+// and func_ptr from the last callback; the NIC keeps the session until then.
+// Handlers may only issue calls in the batched serving loop (batch > 1): in
+// place, the next TX slot holds the reply being written.  Handlers must never
+// block in lauberhorn_rpc_wait, which would receive (and drop) the calls
+// meant for the serving loop; use callbacks.
+
+#ifndef __LAUBERHORN_CLIENT_H__
+#define __LAUBERHORN_CLIENT_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pionic.h"
+
+// one remote procedure; its address is the func_ptr the NIC knows it by
+typedef struct lauberhorn_clnt {
+  pionic_dev_t dev;
+  int id; // slot in the kernel
+} lauberhorn_clnt_t;
+
+enum {
+  LAUBERHORN_RPC_IDLE,
+  LAUBERHORN_RPC_PENDING,
+  LAUBERHORN_RPC_DONE,
+};
+
+struct lauberhorn_rpc_future;
+typedef void (*lauberhorn_rpc_cb_t)(struct lauberhorn_rpc_future *f,
+                                    void *arg);
+
+// One call in flight.  Owned by the caller until it is done or cancelled
+typedef struct lauberhorn_rpc_future {
+  _Atomic int state;
+  uint32_t xid;
+
+  // reply: results in XDR, copied here by the thread that received them
+  void *reply_buf;
+  size_t reply_cap;
+  size_t reply_len;
+  int status; // 0, or -EMSGSIZE if the reply was truncated to reply_cap
+
+  // NULL: poll with lauberhorn_rpc_ready / lauberhorn_rpc_wait instead
+  lauberhorn_rpc_cb_t cb;
+  void *cb_arg;
+
+  // private
+  struct lauberhorn_rpc_future *next; // issuing thread's callback list
+  pionic_dev_t dev;
+  int slot;
+} lauberhorn_rpc_future_t;
+
+// How long the slot of a cancelled call stays taken without a late reply
+#ifndef LAUBERHORN_CLNT_CANCEL_HOLD_NS
+#define LAUBERHORN_CLNT_CANCEL_HOLD_NS 1000000000UL
+#endif
+
+// Register the procedure prog_num.prog_ver.proc_num on server_addr:server_port
+// (host byte order).  Replies come back on client_port, which the kernel opens
+// for replies; clients of the process may share it, services may not.
+// Returns 0 on success
+int lauberhorn_clnt_register(pionic_dev_t d, lauberhorn_clnt_t *c,
+                             uint32_t prog_num, uint32_t prog_ver,
+                             uint32_t proc_num, uint32_t server_addr,
+                             uint16_t server_port, uint16_t client_port);
+void lauberhorn_clnt_deregister(lauberhorn_clnt_t *c);
+
+static inline void lauberhorn_rpc_future_init(lauberhorn_rpc_future_t *f,
+                                              void *reply_buf,
+                                              size_t reply_cap,
+                                              lauberhorn_rpc_cb_t cb,
+                                              void *cb_arg) {
+  atomic_init(&f->state, LAUBERHORN_RPC_IDLE);
+  f->reply_buf = reply_buf;
+  f->reply_cap = reply_cap;
+  f->reply_len = 0;
+  f->status = 0;
+  f->cb = cb;
+  f->cb_arg = cb_arg;
+  f->next = NULL;
+  f->dev = NULL;
+  f->slot = -1;
+}
+
+// Send a call with args_len bytes of XDR arguments (a multiple of 4) from
+// thread t, which must be owned by the calling thread.  f must be idle.
+// Returns 0, -EBUSY if LAUBERHORN_NUM_PENDING_CALLS calls are in flight or
+// held by cancelled calls, or -EINPROGRESS from a handler serving in place
+int lauberhorn_clnt_call(pionic_thd_t t, lauberhorn_clnt_t *c,
+                         const void *args, size_t args_len,
+                         lauberhorn_rpc_future_t *f);
+
+static inline bool lauberhorn_rpc_ready(lauberhorn_rpc_future_t *f) {
+  return atomic_load_explicit(&f->state, memory_order_acquire) ==
+         LAUBERHORN_RPC_DONE;
+}
+
+// Give up on a call, from the issuing thread; a late reply is dropped.  The
+// slot stays taken until then, see above.  Returns false if the reply arrived
+// first, in which case f is done
+bool lauberhorn_rpc_cancel(lauberhorn_rpc_future_t *f);
+
+// Poll t until f is done or timeout_ns (0: forever) passed; the call is
+// cancelled then.  Not from a handler, see above.  Returns 0 or -ETIMEDOUT
+int lauberhorn_rpc_wait(pionic_thd_t t, lauberhorn_rpc_future_t *f,
+                        uint64_t timeout_ns);
+
+// Receive up to max replies on t and run the callbacks of the calling thread.
+// For threads that do not serve calls: anything else is dropped.  Returns the
+// number of descriptors received
+int lauberhorn_clnt_poll(pionic_thd_t t, int max);
+
+// Used by the serving loop
+// Complete the call of a TY_ONCRPC_REPLY descriptor with the results in
+// rep->oncrpc_server.args and pld; false if no call is waiting for it
+bool lauberhorn_clnt_complete(pionic_dev_t d, const pionic_pkt_desc_t *rep,
+                              const lauberhorn_pkt_view_t *pld);
+// Run the callbacks of done calls issued by the calling thread; returns the
+// number run
+int lauberhorn_clnt_run_callbacks(void);
+
+#endif // __LAUBERHORN_CLIENT_H__
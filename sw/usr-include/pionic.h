@@ -10,6 +10,20 @@
 // generated hw header
 #include "config.h"
 
+// packet descriptor and per-core datapath state, shared with the kernel
+#include "eci/core.h"
+
+typedef lauberhorn_pkt_desc_t pionic_pkt_desc_t;
+typedef lauberhorn_core_state_t pionic_core_state_t;
+
+// critical section entries on one core (or thread), cumulative
+typedef struct {
+  uint64_t entries;
+  uint64_t spins;  // backoff rounds
+  uint64_t waits;  // WFE sleeps on the preempt-control CL
+  uint64_t failed; // compare-and-swap attempts that lost
+} pionic_cs_stats_t;
+
 #ifndef __PIONIC_RT__
 
 // --- deprecated for now ---
@@ -19,12 +33,21 @@
 // void pionic_free_pkt_desc(pionic_pkt_desc_t *desc);
 
 // open/close device
+// One per process: opening /dev/lauberhorn registers the process with the NIC
 struct pionic_dev {
-  size_t page_len;
-
-  char *page_1;
-  char *page_2;
-  uint64_t fake_struct;
+  int fd;
+
+  // critical section entry policy, copied into threads on creation
+  uint32_t cs_spin_limit;
+  bool cs_wfe;
+
+  // nested calls in flight, indexed by the xid modulo the table size; see
+  // client.h
+  struct {
+    struct lauberhorn_rpc_future *_Atomic f;
+    _Atomic uint32_t gen;
+    _Atomic uint64_t hold_until; // cancelled: reusable from then on (ns)
+  } clnt_pending[LAUBERHORN_NUM_PENDING_CALLS];
 };
 typedef struct pionic_dev *pionic_dev_t;
 
@@ -41,39 +64,52 @@ void pionic_dev_set_promisc(pionic_dev_t d, bool enable);
 void pionic_dev_set_mac_addr(pionic_dev_t d, uint8_t *mac_addr);
 void pionic_dev_set_ip_addr(pionic_dev_t d, uint8_t *ip_addr);
 
-// enable port
+// enable port for ONC-RPC calls to this process
 // return true on success
 bool pionic_oncrpc_listen_port_open(pionic_dev_t d, int port);
-// disable port
+// disable port, deregistering the services on it
 void pionic_oncrpc_listen_port_close(pionic_dev_t d, int port);
 
-// register service
+// register service on a port opened with pionic_oncrpc_listen_port_open
 // returns an index on success or negative number on failure
 int pionic_oncrpc_service_register(pionic_dev_t d, int prog_num, int ver,
-                                   int proc, void *func_ptr);
+                                   int proc, void *func_ptr, int listen_port);
 // deregister service by index
 void pionic_oncrpc_service_deregister(pionic_dev_t d, int idx);
 
 // create/destroy threads
-// XXX: threads... how to name this... actually the only thread (excluding
-// non-RPC-serving threads) in the process.
-// struct pionic_thd;
+// An RPC-serving thread maps its own RX/TX/preempt-control CL window from
+// /dev/lauberhorn; the kernel routes the window to whichever worker core the
+// thread is scheduled on.  All datapath state lives in the handle, so RX and TX
+// are plain loads and stores with nothing shared with other threads.
+//
+// The handle must be created, used and destroyed on the serving thread itself;
+// keep it in thread-local storage or on the thread's stack.
 typedef struct pionic_thd {
-  uint64_t fake_struct;
-  void *pionic_base;
-  bool tx_parity;
-  bool rx_parity;
-} pionic_thd;
+  // RX parity and TX ring counters; first, so that they start on their own CL
+  pionic_core_state_t state;
+
+  // this thread's window, LAUBERHORN_ECI_CORE_OFFSET bytes
+  uint8_t *base;
+  pionic_dev_t dev;
+
+  uint32_t cs_spin_limit;
+  bool cs_wfe;
+  pionic_cs_stats_t cs_stats;
+} __attribute__((aligned(128))) pionic_thd; // ThunderX-1 CL
 typedef struct pionic_thd *pionic_thd_t;
+typedef struct pionic_thd lauberhorn_thd_t;
 
+// Routes the thread to a free worker core; fails if every worker core is held
+// by another thread
 int pionic_thd_create(pionic_dev_t d, pionic_thd *t);
 void pionic_thd_destroy(pionic_thd *t);
 
 // receive packet
 // return true on success, false on no packet
-bool pionic_thd_rx(pionic_thd t, pionic_pkt_desc_t *desc);
+bool pionic_thd_rx(pionic_thd_t t, pionic_pkt_desc_t *desc);
 // acknowledge received packet (for NIC to free packet)
-void pionic_thd_rx_ack(pionic_thd t, pionic_pkt_desc_t *desc);
+void pionic_thd_rx_ack(pionic_thd_t t, pionic_pkt_desc_t *desc);
 
 // prepare TX packet descriptor
 // desc->payload_buf must be NULL and payload_len must be 0 when calling the
@@ -82,9 +118,9 @@ void pionic_thd_rx_ack(pionic_thd t, pionic_pkt_desc_t *desc);
 //   released on tx) if returned desc->payload_buf is NULL, the user can
 //   attached a buffer before tx but should also free the buffer (tx does
 //   nothing)
-void pionic_thd_tx_prepare_desc(pionic_thd t, pionic_pkt_desc_t *desc);
+void pionic_thd_tx_prepare_desc(pionic_thd_t t, pionic_pkt_desc_t *desc);
 // send packet
-void pionic_thd_tx(pionic_thd t, pionic_pkt_desc_t *desc);
+void pionic_thd_tx(pionic_thd_t t, pionic_pkt_desc_t *desc);
 
 #endif // __PIONIC_RT__
 
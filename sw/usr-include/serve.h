@@ -0,0 +1,91 @@
+// Run-to-completion ONC RPC serving loop
+//
+// The NIC decodes each call down to the handler it was registered with
+// (pionic_oncrpc_service_register) and its xid, so the loop only has to call
+// desc->oncrpc_server.func_ptr and turn the result into a TY_ONCRPC_REPLY on
+// the same thread.
+//
+// Unbatched (batch <= 1), nothing is copied: the handler reads the arguments
+// from the RX cachelines and writes the reply into the TX ring slot in place.
+// Batched, up to batch calls are received in one critical section and the
+// replies are sent with one doorbell; since the overflow CLs are reused by the
+// next call, arguments and replies then go through per-thread buffers.
+//
+// Replies to nested calls (client.h) received by the loop complete their call;
+// the callbacks of calls issued on this thread run between calls.  Handlers
+// can only issue nested calls when batched: in place, the reply holds the next
+// TX slot.
+
+#ifndef __LAUBERHORN_SERVE_H__
+#define __LAUBERHORN_SERVE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pionic.h"
+
+#define LAUBERHORN_SERVE_MAX_BATCH 16
+// log2 buckets of the service time in ns
+#define LAUBERHORN_SERVE_HIST_BUCKETS 32
+
+typedef struct {
+  int xid;
+
+  // arguments decoded by the NIC: args_len bytes in args, the rest in req
+  const uint32_t *args;
+  int args_len;
+  lauberhorn_pkt_view_t req;
+
+  // reply: the first reply_inline_words (at most
+  // LAUBERHORN_ONCRPC_INLINE_ARGS) words go to reply_args, the following
+  // reply_len bytes to rep; on the wire they follow the words directly.  The
+  // view lengths are capacities on entry; fill the inline half-CL first.
+  // The TX descriptor only carries the word count and the payload length, so
+  // a reply with reply_len > 0 must fill all LAUBERHORN_ONCRPC_INLINE_ARGS
+  // words: the NIC (and the emulator) places the payload after the full
+  // inline words
+  uint32_t *reply_args;
+  int reply_inline_words;
+  lauberhorn_pkt_view_t rep;
+  size_t reply_len;
+} lauberhorn_rpc_call_t;
+
+// Returns 0 to send the reply, or negative to drop the call without one
+typedef int (*lauberhorn_rpc_handler_t)(lauberhorn_rpc_call_t *call,
+                                        void *arg);
+
+// One handler (func_ptr) as seen by one thread
+typedef struct {
+  void *func_ptr; // NULL: unused
+  uint64_t calls;
+  uint64_t dropped;
+  // time from the handler call until the reply is handed to the NIC; bucket i
+  // counts [2^(i-1), 2^i) ns
+  uint64_t hist[LAUBERHORN_SERVE_HIST_BUCKETS];
+} lauberhorn_serve_proc_stats_t;
+
+typedef struct {
+  uint64_t polls; // RX attempts, including NACKs
+  uint64_t calls;
+  uint64_t errors; // non-RPC descriptors or calls without a handler
+  lauberhorn_serve_proc_stats_t procs[LAUBERHORN_NUM_SERVICES];
+} lauberhorn_serve_stats_t;
+
+typedef struct {
+  int batch;            // calls per critical section; <= 1 for zero-copy
+  uint64_t max_calls;   // return after this many calls; 0: no limit
+  volatile bool *stop;  // return once set, if not NULL
+  void *handler_arg;    // passed to every handler
+  lauberhorn_serve_stats_t *stats; // per-thread; NULL: no accounting
+} lauberhorn_serve_opts_t;
+
+// Serve calls on the calling thread, which must own t.  Returns the number of
+// calls served, or -1 if the loop could not be set up
+int64_t lauberhorn_serve(pionic_thd_t t, const lauberhorn_serve_opts_t *opts);
+
+// Upper bound of the q-th quantile (0 < q <= 1) of the service time, in ns
+uint64_t lauberhorn_serve_quantile(const lauberhorn_serve_proc_stats_t *p,
+                                   double q);
+void lauberhorn_serve_dump_stats(const lauberhorn_serve_stats_t *s);
+
+#endif // __LAUBERHORN_SERVE_H__
@@ -0,0 +1,304 @@
+// XDR (RFC 4506) marshaling over the split ONC RPC argument layout
+//
+// The NIC hands the arguments of a call over in two parts: the first args_len
+// bytes (at most LAUBERHORN_ONCRPC_INLINE_BYTES) as big-endian words in the
+// control CL, the rest in the payload view -- the inline half-CL, then the
+// overflow CLs.  Replies take the same shape: reply_args words, then the reply
+// view.  Both are one XDR stream to the stubs.
+//
+// Stubs generated by utils/xdrgen.py address everything up to the first
+// variable-length field by constant word index (lauberhorn_xdr_word and
+// friends), which folds to a plain load from args for the inline words.  The
+// cursors below take over behind it.  Variable-length opaque and string fields
+// decode to views into the RX cachelines; only views that straddle two parts
+// are copied, into the scratch buffer of the cursor.
+
+#ifndef __LAUBERHORN_XDR_H__
+#define __LAUBERHORN_XDR_H__
+
+#include <endian.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "serve.h"
+
+#define LAUBERHORN_XDR_UNIT 4
+#define LAUBERHORN_XDR_PAD(len) (((len) + 3) & ~(size_t)3)
+
+// Variable-length opaque or string.  Decoded views point into the RX
+// cachelines (or the scratch buffer) and are only valid during the call;
+// strings are not NUL-terminated
+typedef struct {
+  const uint8_t *buf;
+  uint32_t len;
+} lauberhorn_xdr_view_t;
+
+typedef struct {
+  const lauberhorn_rpc_call_t *call;
+  size_t pos;
+  size_t len; // args_len plus the payload
+  uint8_t *scratch;
+  size_t scratch_len;
+} lauberhorn_xdr_in_t;
+
+typedef struct {
+  lauberhorn_rpc_call_t *call;
+  size_t pos;
+  size_t cap; // inline words plus the reply view
+} lauberhorn_xdr_out_t;
+
+static inline size_t lauberhorn_xdr_view_len(const lauberhorn_pkt_view_t *v) {
+  return v->inline_len + v->overflow_len;
+}
+
+// Byte off of the payload view, and how many bytes follow it contiguously
+static inline uint8_t *lauberhorn_xdr_view_at(const lauberhorn_pkt_view_t *v,
+                                              size_t off, size_t *avail) {
+  if (off < v->inline_len) {
+    *avail = v->inline_len - off;
+    return v->inline_buf + off;
+  }
+  off -= v->inline_len;
+  *avail = v->overflow_len - off;
+  return v->overflow_buf + off;
+}
+
+// Returns false if the call does not carry the layout the stubs expect: the
+// payload only follows completely filled inline words
+static inline bool lauberhorn_xdr_in_init(lauberhorn_xdr_in_t *in,
+                                          const lauberhorn_rpc_call_t *call,
+                                          uint8_t *scratch,
+                                          size_t scratch_len) {
+  size_t payload = lauberhorn_xdr_view_len(&call->req);
+
+  in->call = call;
+  in->pos = 0;
+  in->len = call->args_len + payload;
+  in->scratch = scratch;
+  in->scratch_len = scratch_len;
+
+  return call->args_len % LAUBERHORN_XDR_UNIT == 0 &&
+         (!payload || call->args_len == LAUBERHORN_ONCRPC_INLINE_BYTES);
+}
+
+static inline void lauberhorn_xdr_out_init(lauberhorn_xdr_out_t *out,
+                                           lauberhorn_rpc_call_t *call) {
+  out->call = call;
+  out->pos = 0;
+  out->cap = LAUBERHORN_ONCRPC_INLINE_BYTES + lauberhorn_xdr_view_len(&call->rep);
+}
+
+// Hand the reply written so far over to the serving loop
+static inline void lauberhorn_xdr_out_finish(lauberhorn_xdr_out_t *out) {
+  lauberhorn_rpc_call_t *call = out->call;
+
+  if (out->pos <= LAUBERHORN_ONCRPC_INLINE_BYTES) {
+    call->reply_inline_words = out->pos / LAUBERHORN_XDR_UNIT;
+    call->reply_len = 0;
+  } else {
+    call->reply_inline_words = LAUBERHORN_ONCRPC_INLINE_ARGS;
+    call->reply_len = out->pos - LAUBERHORN_ONCRPC_INLINE_BYTES;
+  }
+}
+
+// --- fixed offsets, for the stubs: k is a compile-time constant ---
+// Bounds are checked once by the caller for the whole fixed-size prefix
+
+static inline uint32_t lauberhorn_xdr_word(const lauberhorn_rpc_call_t *call,
+                                           size_t k) {
+  const uint8_t *p;
+  size_t avail;
+
+  if (k < LAUBERHORN_ONCRPC_INLINE_ARGS)
+    return be32toh(call->args[k]);
+
+  // parts are multiples of a word long: words never straddle them
+  p = lauberhorn_xdr_view_at(&call->req,
+                             (k - LAUBERHORN_ONCRPC_INLINE_ARGS) *
+                                 LAUBERHORN_XDR_UNIT,
+                             &avail);
+  return be32toh(*(const uint32_t *)p);
+}
+
+static inline uint64_t lauberhorn_xdr_word64(const lauberhorn_rpc_call_t *call,
+                                             size_t k) {
+  return (uint64_t)lauberhorn_xdr_word(call, k) << 32 |
+         lauberhorn_xdr_word(call, k + 1);
+}
+
+static inline void lauberhorn_xdr_put_word(lauberhorn_rpc_call_t *call,
+                                           size_t k, uint32_t v) {
+  uint8_t *p;
+  size_t avail;
+
+  if (k < LAUBERHORN_ONCRPC_INLINE_ARGS) {
+    call->reply_args[k] = htobe32(v);
+    return;
+  }
+
+  p = lauberhorn_xdr_view_at(&call->rep,
+                             (k - LAUBERHORN_ONCRPC_INLINE_ARGS) *
+                                 LAUBERHORN_XDR_UNIT,
+                             &avail);
+  *(uint32_t *)p = htobe32(v);
+}
+
+static inline void lauberhorn_xdr_put_word64(lauberhorn_rpc_call_t *call,
+                                             size_t k, uint64_t v) {
+  lauberhorn_xdr_put_word(call, k, v >> 32);
+  lauberhorn_xdr_put_word(call, k + 1, v);
+}
+
+// --- cursors ---
+
+static inline bool lauberhorn_xdr_get_u32(lauberhorn_xdr_in_t *in,
+                                          uint32_t *v) {
+  if (in->len - in->pos < LAUBERHORN_XDR_UNIT)
+    return false;
+
+  *v = lauberhorn_xdr_word(in->call, in->pos / LAUBERHORN_XDR_UNIT);
+  in->pos += LAUBERHORN_XDR_UNIT;
+  return true;
+}
+
+static inline bool lauberhorn_xdr_get_u64(lauberhorn_xdr_in_t *in,
+                                          uint64_t *v) {
+  uint32_t hi, lo;
+
+  if (!lauberhorn_xdr_get_u32(in, &hi) || !lauberhorn_xdr_get_u32(in, &lo))
+    return false;
+
+  *v = (uint64_t)hi << 32 | lo;
+  return true;
+}
+
+// len bytes at the cursor, followed by the XDR padding.  Points into the call
+// if the bytes are contiguous there, or else copies them into the scratch
+static inline bool lauberhorn_xdr_get_view(lauberhorn_xdr_in_t *in,
+                                           uint32_t len,
+                                           lauberhorn_xdr_view_t *v) {
+  const lauberhorn_rpc_call_t *call = in->call;
+  size_t padded = LAUBERHORN_XDR_PAD((size_t)len);
+  size_t pos = in->pos, avail, done;
+  const uint8_t *p;
+
+  if (in->len - pos < padded)
+    return false;
+  in->pos += padded;
+  v->len = len;
+
+  if (pos < (size_t)call->args_len) {
+    p = (const uint8_t *)call->args + pos;
+    avail = call->args_len - pos;
+  } else {
+    p = lauberhorn_xdr_view_at(&call->req, pos - call->args_len, &avail);
+  }
+  if (len <= avail) {
+    v->buf = p;
+    return true;
+  }
+
+  if (in->scratch_len < len)
+    return false;
+  v->buf = in->scratch;
+  in->scratch += len;
+  in->scratch_len -= len;
+
+  for (done = 0; done < len; done += avail) {
+    if (pos + done < (size_t)call->args_len) {
+      p = (const uint8_t *)call->args + pos + done;
+      avail = call->args_len - pos - done;
+    } else {
+      p = lauberhorn_xdr_view_at(&call->req, pos + done - call->args_len,
+                                 &avail);
+    }
+    if (avail > len - done)
+      avail = len - done;
+    memcpy((uint8_t *)v->buf + done, p, avail);
+  }
+  return true;
+}
+
+static inline bool lauberhorn_xdr_put_u32(lauberhorn_xdr_out_t *out,
+                                          uint32_t v) {
+  if (out->cap - out->pos < LAUBERHORN_XDR_UNIT)
+    return false;
+
+  lauberhorn_xdr_put_word(out->call, out->pos / LAUBERHORN_XDR_UNIT, v);
+  out->pos += LAUBERHORN_XDR_UNIT;
+  return true;
+}
+
+static inline bool lauberhorn_xdr_put_u64(lauberhorn_xdr_out_t *out,
+                                          uint64_t v) {
+  return lauberhorn_xdr_put_u32(out, v >> 32) && lauberhorn_xdr_put_u32(out, v);
+}
+
+// len bytes from buf at the cursor, zero-padded; written straight into the
+// reply words and the reply view
+static inline bool lauberhorn_xdr_put_bytes(lauberhorn_xdr_out_t *out,
+                                            const uint8_t *buf, uint32_t len) {
+  lauberhorn_rpc_call_t *call = out->call;
+  size_t padded = LAUBERHORN_XDR_PAD((size_t)len);
+  size_t done, avail;
+  uint8_t *p;
+
+  if (out->cap - out->pos < padded)
+    return false;
+
+  for (done = 0; done < padded; done += avail) {
+    size_t pos = out->pos + done;
+
+    if (pos < LAUBERHORN_ONCRPC_INLINE_BYTES) {
+      p = (uint8_t *)call->reply_args + pos;
+      avail = LAUBERHORN_ONCRPC_INLINE_BYTES - pos;
+    } else {
+      p = lauberhorn_xdr_view_at(&call->rep,
+                                 pos - LAUBERHORN_ONCRPC_INLINE_BYTES, &avail);
+    }
+    if (avail > padded - done)
+      avail = padded - done;
+
+    if (done >= len)
+      memset(p, 0, avail);
+    else if (avail > len - done) {
+      memcpy(p, buf + done, len - done);
+      memset(p + len - done, 0, avail - (len - done));
+    } else
+      memcpy(p, buf + done, avail);
+  }
+
+  out->pos += padded;
+  return true;
+}
+
+static inline uint32_t lauberhorn_xdr_f32_bits(float f) {
+  uint32_t v;
+
+  memcpy(&v, &f, sizeof(v));
+  return v;
+}
+
+static inline float lauberhorn_xdr_f32(uint32_t v) {
+  float f;
+
+  memcpy(&f, &v, sizeof(f));
+  return f;
+}
+
+static inline uint64_t lauberhorn_xdr_f64_bits(double d) {
+  uint64_t v;
+
+  memcpy(&v, &d, sizeof(v));
+  return v;
+}
+
+static inline double lauberhorn_xdr_f64(uint64_t v) {
+  double d;
+
+  memcpy(&d, &v, sizeof(d));
+  return d;
+}
+
+#endif // __LAUBERHORN_XDR_H__
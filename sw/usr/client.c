@@ -0,0 +1,305 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+#include "client.h"
+
+#include "../kmod/ioctl.h"
+
+#define NUM_PENDING LAUBERHORN_NUM_PENDING_CALLS
+
+// xid = gen * NUM_PENDING + slot; stays consistent when gen wraps
+static_assert((NUM_PENDING & (NUM_PENDING - 1)) == 0,
+              "pending call table size must be a power of two");
+
+// Slot of a cancelled call whose NIC entry may still be pending
+#define SLOT_CANCELLED ((lauberhorn_rpc_future_t *)1)
+
+// Calls issued by this thread that have a callback, until it is run
+static __thread lauberhorn_rpc_future_t *cb_head;
+
+static inline uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+int lauberhorn_clnt_register(pionic_dev_t d, lauberhorn_clnt_t *c,
+                             uint32_t prog_num, uint32_t prog_ver,
+                             uint32_t proc_num, uint32_t server_addr,
+                             uint16_t server_port, uint16_t client_port) {
+  lauberhorn_reg_clnt_t req = {
+      .func_ptr = c,
+      .prog_num = prog_num,
+      .prog_ver = prog_ver,
+      .proc_num = proc_num,
+      .server_addr = server_addr,
+      .server_port = server_port,
+      .client_port = client_port,
+  };
+
+  if (ioctl(d->fd, LAUBERHORN_IOCTL_REG_CLNT, &req) < 0) {
+    perror("register client");
+    return -1;
+  }
+
+  c->dev = d;
+  c->id = req.id;
+  return 0;
+}
+
+void lauberhorn_clnt_deregister(lauberhorn_clnt_t *c) {
+  lauberhorn_clnt_id_t id = c->id;
+
+  // calls still in flight complete as usual; later replies are dropped by the
+  // NIC
+  if (ioctl(c->dev->fd, LAUBERHORN_IOCTL_DEREG_CLNT, &id) < 0)
+    perror("deregister client");
+  c->dev = NULL;
+}
+
+// Take a free slot of the completion table for f and pick its xid
+static int slot_claim(pionic_dev_t d, lauberhorn_rpc_future_t *f) {
+  uint64_t now = 0;
+
+  for (int i = 0; i < NUM_PENDING; ++i) {
+    lauberhorn_rpc_future_t *expected;
+    uint32_t gen;
+
+    expected =
+        atomic_load_explicit(&d->clnt_pending[i].f, memory_order_acquire);
+    if (expected == SLOT_CANCELLED) {
+      // no late reply within the hold time: give the slot back
+      if (!now)
+        now = now_ns();
+      if (now < atomic_load_explicit(&d->clnt_pending[i].hold_until,
+                                     memory_order_relaxed))
+        continue;
+    } else if (expected) {
+      continue;
+    }
+
+    // the xid must be visible before the slot: receivers check it
+    f->slot = i;
+    gen = atomic_fetch_add_explicit(&d->clnt_pending[i].gen, 1,
+                                    memory_order_relaxed);
+    f->xid = (gen + 1) * NUM_PENDING + i;
+    if (atomic_compare_exchange_strong_explicit(&d->clnt_pending[i].f,
+                                                &expected, f,
+                                                memory_order_release,
+                                                memory_order_relaxed))
+      return i;
+  }
+  return -1;
+}
+
+int lauberhorn_clnt_call(pionic_thd_t t, lauberhorn_clnt_t *c,
+                         const void *args, size_t args_len,
+                         lauberhorn_rpc_future_t *f) {
+  pionic_dev_t d = t->dev;
+  pionic_pkt_desc_t desc;
+  size_t inline_len;
+
+  assert(args_len % 4 == 0 && "XDR arguments come in whole words");
+  assert(atomic_load(&f->state) == LAUBERHORN_RPC_IDLE);
+
+  // serving a call in place: the next TX slot is the reply's
+  if (t->state.tx_view_held)
+    return -EINPROGRESS;
+
+  f->dev = d;
+  atomic_store_explicit(&f->state, LAUBERHORN_RPC_PENDING,
+                        memory_order_relaxed);
+  if (slot_claim(d, f) < 0) {
+    atomic_store_explicit(&f->state, LAUBERHORN_RPC_IDLE,
+                          memory_order_relaxed);
+    return -EBUSY;
+  }
+
+  if (f->cb) {
+    f->next = cb_head;
+    cb_head = f;
+  }
+
+  // the NIC fills in the call header from the client table; the arguments
+  // start in the inlined words and continue in the payload
+  desc.payload_buf = NULL;
+  desc.payload_len = 0;
+  pionic_thd_tx_prepare_desc(t, &desc);
+  assert(args_len <= sizeof(desc.oncrpc_server.args) + desc.payload_len);
+
+  inline_len = args_len < sizeof(desc.oncrpc_server.args)
+                   ? args_len
+                   : sizeof(desc.oncrpc_server.args);
+  desc.type = TY_ONCRPC_CALL;
+  desc.oncrpc_server.func_ptr = c;
+  desc.oncrpc_server.xid = f->xid;
+  desc.oncrpc_server.tx_inline_words = inline_len / 4;
+  memcpy(desc.oncrpc_server.args, args, inline_len);
+  desc.payload_len = args_len - inline_len;
+  memcpy(desc.payload_buf, (const uint8_t *)args + inline_len,
+         desc.payload_len);
+
+  pionic_thd_tx(t, &desc);
+  return 0;
+}
+
+static void copy_reply(lauberhorn_rpc_future_t *f, const void *src,
+                       size_t len) {
+  size_t room = f->reply_cap - f->reply_len;
+
+  if (len > room) {
+    f->status = -EMSGSIZE;
+    len = room;
+  }
+  memcpy((uint8_t *)f->reply_buf + f->reply_len, src, len);
+  f->reply_len += len;
+}
+
+bool lauberhorn_clnt_complete(pionic_dev_t d, const pionic_pkt_desc_t *rep,
+                              const lauberhorn_pkt_view_t *pld) {
+  uint32_t xid = rep->oncrpc_server.xid;
+  int slot = xid % NUM_PENDING;
+  lauberhorn_rpc_future_t *f;
+
+  f = atomic_load_explicit(&d->clnt_pending[slot].f, memory_order_acquire);
+
+  if (f == SLOT_CANCELLED) {
+    // late reply to a cancelled call: the NIC dropped its entry, so can we
+    lauberhorn_rpc_future_t *expected = SLOT_CANCELLED;
+
+    if (xid == atomic_load_explicit(&d->clnt_pending[slot].gen,
+                                    memory_order_relaxed) *
+                   NUM_PENDING +
+               slot)
+      atomic_compare_exchange_strong_explicit(
+          &d->clnt_pending[slot].f, &expected, NULL, memory_order_relaxed,
+          memory_order_relaxed);
+    return false;
+  }
+
+  // a reply to a cancelled call, or one that has been answered already
+  if (!f || f->xid != xid ||
+      !atomic_compare_exchange_strong_explicit(&d->clnt_pending[slot].f, &f,
+                                               NULL, memory_order_acquire,
+                                               memory_order_relaxed))
+    return false;
+
+  // the call is ours now: nobody else can complete or cancel it
+  f->reply_len = 0;
+  f->status = 0;
+  copy_reply(f, rep->oncrpc_server.args, rep->oncrpc_server.args_len);
+  if (pld) {
+    copy_reply(f, pld->inline_buf, pld->inline_len);
+    if (pld->overflow_len)
+      copy_reply(f, pld->overflow_buf, pld->overflow_len);
+  }
+
+  atomic_store_explicit(&f->state, LAUBERHORN_RPC_DONE, memory_order_release);
+  return true;
+}
+
+static void cb_unlink(lauberhorn_rpc_future_t *f) {
+  for (lauberhorn_rpc_future_t **p = &cb_head; *p; p = &(*p)->next) {
+    if (*p == f) {
+      *p = f->next;
+      f->next = NULL;
+      return;
+    }
+  }
+}
+
+bool lauberhorn_rpc_cancel(lauberhorn_rpc_future_t *f) {
+  lauberhorn_rpc_future_t *expected = f;
+
+  if (atomic_load_explicit(&f->state, memory_order_acquire) !=
+      LAUBERHORN_RPC_PENDING)
+    return false;
+
+  // the pending call stays in the NIC until its reply: keep the slot taken
+  atomic_store_explicit(&f->dev->clnt_pending[f->slot].hold_until,
+                        now_ns() + LAUBERHORN_CLNT_CANCEL_HOLD_NS,
+                        memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(
+          &f->dev->clnt_pending[f->slot].f, &expected, SLOT_CANCELLED,
+          memory_order_release, memory_order_relaxed)) {
+    // the reply is being copied right now
+    while (!lauberhorn_rpc_ready(f))
+      ;
+    return false;
+  }
+
+  if (f->cb)
+    cb_unlink(f);
+  atomic_store_explicit(&f->state, LAUBERHORN_RPC_IDLE, memory_order_relaxed);
+  return true;
+}
+
+int lauberhorn_rpc_wait(pionic_thd_t t, lauberhorn_rpc_future_t *f,
+                        uint64_t timeout_ns) {
+  uint64_t deadline = timeout_ns ? now_ns() + timeout_ns : 0;
+
+  // polling here would ack the call being served and drop incoming calls
+  assert(!t->state.rx_view_held && !t->state.tx_view_held &&
+         "lauberhorn_rpc_wait called from a handler");
+
+  while (!lauberhorn_rpc_ready(f)) {
+    // the reply may just as well arrive on another thread
+    lauberhorn_clnt_poll(t, 1);
+    if (deadline && now_ns() > deadline && lauberhorn_rpc_cancel(f))
+      return -ETIMEDOUT;
+  }
+  return 0;
+}
+
+int lauberhorn_clnt_run_callbacks(void) {
+  lauberhorn_rpc_future_t **p = &cb_head;
+  int ran = 0;
+
+  while (*p) {
+    lauberhorn_rpc_future_t *f = *p;
+
+    if (!lauberhorn_rpc_ready(f)) {
+      p = &f->next;
+      continue;
+    }
+
+    // f belongs to the callback from here on
+    *p = f->next;
+    f->next = NULL;
+    f->cb(f, f->cb_arg);
+    ++ran;
+  }
+  return ran;
+}
+
+int lauberhorn_clnt_poll(pionic_thd_t t, int max) {
+  int got = 0;
+
+  for (; got < max; ++got) {
+    pionic_pkt_desc_t desc;
+    lauberhorn_pkt_view_t pld;
+
+    if (!pionic_thd_rx(t, &desc))
+      break;
+
+    if (desc.type != TY_ONCRPC_REPLY) {
+      pr_err("clnt_poll: dropping descriptor of type %d\n", desc.type);
+      continue;
+    }
+
+    // pionic_thd_rx copied the payload out already
+    pld.inline_buf = desc.payload_buf;
+    pld.inline_len = desc.payload_len;
+    pld.overflow_buf = NULL;
+    pld.overflow_len = 0;
+    lauberhorn_clnt_complete(t->dev, &desc, &pld);
+  }
+
+  lauberhorn_clnt_run_callbacks();
+  return got;
+}
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "client.h"
+#include "serve.h"
+
+// per-call RX / TX buffer in batched mode
+#define SERVE_BUF_SIZE LAUBERHORN_MTU
+
+static inline uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static inline int hist_bucket(uint64_t ns) {
+  int b = ns ? 64 - __builtin_clzll(ns) : 0;
+
+  return b < LAUBERHORN_SERVE_HIST_BUCKETS ? b
+                                           : LAUBERHORN_SERVE_HIST_BUCKETS - 1;
+}
+
+// Entry of func_ptr, allocated on first use; NULL if the table is full
+static lauberhorn_serve_proc_stats_t *proc_stats(lauberhorn_serve_stats_t *s,
+                                                 void *func_ptr) {
+  for (int i = 0; i < LAUBERHORN_NUM_SERVICES; ++i) {
+    lauberhorn_serve_proc_stats_t *p = &s->procs[i];
+
+    if (p->func_ptr == func_ptr)
+      return p;
+    if (!p->func_ptr) {
+      p->func_ptr = func_ptr;
+      return p;
+    }
+  }
+  return NULL;
+}
+
+static void account(lauberhorn_serve_stats_t *s, void *func_ptr, bool replied,
+                    uint64_t ns) {
+  lauberhorn_serve_proc_stats_t *p;
+
+  if (!s)
+    return;
+
+  ++s->calls;
+  if (!(p = proc_stats(s, func_ptr)))
+    return;
+
+  ++p->calls;
+  if (replied)
+    ++p->hist[hist_bucket(ns)];
+  else
+    ++p->dropped;
+}
+
+static inline bool is_call(lauberhorn_serve_stats_t *s,
+                           lauberhorn_pkt_desc_t *req) {
+  if (req->type == TY_ONCRPC_CALL && req->oncrpc_server.func_ptr)
+    return true;
+
+  pr_err("serve: unexpected descriptor type %d\n", req->type);
+  if (s)
+    ++s->errors;
+  return false;
+}
+
+// Set up call and the reply descriptor from a received call; the handler then
+// writes the reply arguments straight into rep
+static void call_init(lauberhorn_rpc_call_t *call, lauberhorn_pkt_desc_t *req,
+                      lauberhorn_pkt_desc_t *rep) {
+  rep->type = TY_ONCRPC_REPLY;
+  rep->oncrpc_server.xid = req->oncrpc_server.xid;
+  rep->oncrpc_server.func_ptr = req->oncrpc_server.func_ptr;
+
+  call->xid = req->oncrpc_server.xid;
+  call->args = req->oncrpc_server.args;
+  call->args_len = req->oncrpc_server.args_len;
+  call->reply_args = rep->oncrpc_server.args;
+  call->reply_inline_words = 0;
+  call->reply_len = 0;
+}
+
+static void reply_finish(lauberhorn_rpc_call_t *call,
+                         lauberhorn_pkt_desc_t *rep) {
+  assert(call->reply_inline_words >= 0 &&
+         call->reply_inline_words <= LAUBERHORN_ONCRPC_INLINE_ARGS);
+  assert(call->reply_len <= call->rep.inline_len + call->rep.overflow_len);
+  // the payload always follows the full inline words; see serve.h
+  assert(call->reply_len == 0 ||
+         call->reply_inline_words == LAUBERHORN_ONCRPC_INLINE_ARGS);
+
+  rep->oncrpc_server.tx_inline_words = call->reply_inline_words;
+  rep->payload_len = call->reply_len;
+}
+
+static inline int call_handler(lauberhorn_rpc_call_t *call,
+                               lauberhorn_pkt_desc_t *req,
+                               const lauberhorn_serve_opts_t *opts) {
+  lauberhorn_rpc_handler_t handler =
+      (lauberhorn_rpc_handler_t)req->oncrpc_server.func_ptr;
+
+  return handler(call, opts->handler_arg);
+}
+
+// Serve one call in place: arguments from the RX CLs, reply into the TX slot.
+// Returns the number of calls served
+static int serve_one(pionic_thd_t t, const lauberhorn_serve_opts_t *opts) {
+  lauberhorn_pkt_desc_t req, rep;
+  lauberhorn_rpc_call_t call;
+  uint64_t start;
+  int ret;
+
+  if (!core_eci_rx_view(t->base, &t->state, &req))
+    return 0;
+
+  if (req.type == TY_ONCRPC_REPLY) {
+    // reply to a nested call of this process, maybe from another thread
+    lauberhorn_clnt_complete(t->dev, &req, &req.view);
+    core_eci_rx_ack(&t->state, &req);
+    return 0;
+  }
+
+  if (!is_call(opts->stats, &req)) {
+    core_eci_rx_ack(&t->state, &req);
+    return 0;
+  }
+
+  start = now_ns();
+
+  // the caller is waiting for the reply: keep waiting for a free slot
+  while (!core_eci_tx_prepare_view(t->base, &t->state, &rep))
+    ;
+  call_init(&call, &req, &rep);
+  call.req = req.view;
+  call.rep = rep.view;
+
+  ret = call_handler(&call, &req, opts);
+  if (ret >= 0) {
+    reply_finish(&call, &rep);
+    core_eci_tx(t->base, &t->state, &rep);
+  } else {
+    // the slot was never handed to the NIC; reuse it for the next reply
+    t->state.tx_view_held = false;
+  }
+
+  // the arguments are no longer needed
+  core_eci_rx_ack(&t->state, &req);
+
+  account(opts->stats, req.oncrpc_server.func_ptr, ret >= 0, now_ns() - start);
+  return 1;
+}
+
+// Receive up to n calls in one critical section, run them and send all
+// replies with one doorbell.  bufs holds n RX buffers followed by n TX buffers
+static int serve_batch(pionic_thd_t t, const lauberhorn_serve_opts_t *opts,
+                       uint8_t *bufs, int n) {
+  lauberhorn_pkt_desc_t reqs[LAUBERHORN_SERVE_MAX_BATCH];
+  lauberhorn_pkt_desc_t reps[LAUBERHORN_SERVE_MAX_BATCH];
+  uint64_t starts[LAUBERHORN_SERVE_MAX_BATCH];
+  int got, nrep = 0, served = 0;
+  uint64_t end;
+
+  for (int i = 0; i < n; ++i) {
+    reqs[i].payload_buf = bufs + i * SERVE_BUF_SIZE;
+    reqs[i].payload_len = SERVE_BUF_SIZE;
+  }
+
+  got = core_eci_rx_burst(t->base, &t->state, reqs, n);
+
+  for (int i = 0; i < got; ++i) {
+    lauberhorn_pkt_desc_t *rep = &reps[nrep];
+    uint8_t *buf = bufs + (n + nrep) * SERVE_BUF_SIZE;
+    lauberhorn_rpc_call_t call;
+
+    if (reqs[i].type == TY_ONCRPC_REPLY) {
+      lauberhorn_pkt_view_t pld = {
+          .inline_buf = reqs[i].payload_buf,
+          .inline_len = reqs[i].payload_len,
+      };
+
+      lauberhorn_clnt_complete(t->dev, &reqs[i], &pld);
+      continue;
+    }
+
+    if (!is_call(opts->stats, &reqs[i]))
+      continue;
+    ++served;
+
+    starts[nrep] = now_ns();
+
+    call_init(&call, &reqs[i], rep);
+    call.req.inline_buf = reqs[i].payload_buf;
+    call.req.inline_len = reqs[i].payload_len;
+    call.req.overflow_buf = NULL;
+    call.req.overflow_len = 0;
+    call.rep.inline_buf = buf;
+    call.rep.inline_len = LAUBERHORN_ECI_INLINE_DATA_SIZE;
+    call.rep.overflow_buf = buf + LAUBERHORN_ECI_INLINE_DATA_SIZE;
+    call.rep.overflow_len = SERVE_BUF_SIZE - LAUBERHORN_ECI_INLINE_DATA_SIZE;
+
+    if (call_handler(&call, &reqs[i], opts) < 0) {
+      account(opts->stats, reqs[i].oncrpc_server.func_ptr, false, 0);
+      continue;
+    }
+
+    reply_finish(&call, rep);
+    rep->payload_buf = rep->payload_len ? buf : NULL;
+    ++nrep;
+  }
+
+  // replies always fit a slot: the burst only stops early while the ring is
+  // full, keep handing over the rest.  Skip a reply it rejected (logged)
+  for (int sent = 0; sent < nrep;) {
+    sent += core_eci_tx_burst(t->base, &t->state, reps + sent, nrep - sent);
+    if (sent < nrep && reps[sent].type == TY_ERROR)
+      ++sent;
+  }
+
+  // replies only leave with the doorbell at the end of the batch
+  end = now_ns();
+  for (int i = 0; i < nrep; ++i)
+    account(opts->stats, reps[i].oncrpc_server.func_ptr, true,
+            end - starts[i]);
+
+  return served;
+}
+
+int64_t lauberhorn_serve(pionic_thd_t t, const lauberhorn_serve_opts_t *opts) {
+  int batch = opts->batch;
+  uint8_t *bufs = NULL;
+  int64_t served = 0;
+
+  if (batch > LAUBERHORN_SERVE_MAX_BATCH)
+    batch = LAUBERHORN_SERVE_MAX_BATCH;
+  if (batch > 1) {
+    bufs = aligned_alloc(LAUBERHORN_ECI_CL_SIZE, 2 * batch * SERVE_BUF_SIZE);
+    if (!bufs) {
+      pr_err("Failed to allocate serve buffers\n");
+      return -1;
+    }
+  }
+
+  while (!(opts->stop && *opts->stop)) {
+    int n = batch;
+
+    if (opts->max_calls) {
+      if ((uint64_t)served >= opts->max_calls)
+        break;
+      if ((uint64_t)n > opts->max_calls - served)
+        n = opts->max_calls - served;
+    }
+
+    served += n > 1 ? serve_batch(t, opts, bufs, n) : serve_one(t, opts);
+    // nested calls issued by handlers on this thread
+    lauberhorn_clnt_run_callbacks();
+    if (opts->stats)
+      ++opts->stats->polls;
+  }
+
+  free(bufs);
+  return served;
+}
+
+uint64_t lauberhorn_serve_quantile(const lauberhorn_serve_proc_stats_t *p,
+                                   double q) {
+  uint64_t total = 0, seen = 0, target;
+
+  for (int i = 0; i < LAUBERHORN_SERVE_HIST_BUCKETS; ++i)
+    total += p->hist[i];
+  if (!total)
+    return 0;
+
+  target = q * total;
+  if (target < 1)
+    target = 1;
+  for (int i = 0; i < LAUBERHORN_SERVE_HIST_BUCKETS; ++i) {
+    seen += p->hist[i];
+    if (seen >= target)
+      return 1UL << i;
+  }
+  return 1UL << (LAUBERHORN_SERVE_HIST_BUCKETS - 1);
+}
+
+void lauberhorn_serve_dump_stats(const lauberhorn_serve_stats_t *s) {
+  printf("serve: %lu polls, %lu calls, %lu errors\n", s->polls, s->calls,
+         s->errors);
+  for (int i = 0; i < LAUBERHORN_NUM_SERVICES; ++i) {
+    const lauberhorn_serve_proc_stats_t *p = &s->procs[i];
+
+    if (!p->func_ptr)
+      continue;
+    printf("  %p: %lu calls, %lu dropped, service time p50 < %lu ns, "
+           "p99 < %lu ns, p99.9 < %lu ns\n",
+           p->func_ptr, p->calls, p->dropped,
+           lauberhorn_serve_quantile(p, 0.5), lauberhorn_serve_quantile(p, 0.99),
+           lauberhorn_serve_quantile(p, 0.999));
+  }
+}
@@ -1,48 +1,190 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-#include "core-eci.h"
 #include "pionic.h"
 
-int pionic_thd_create(pionic_dev_t d, pionic_thd *t) { return -1; }
-void pionic_thd_destroy(pionic_thd *t) {}
+#include "../kmod/ioctl.h"
+#include "cs.h"
 
-int pionic_dev_open(pionic_dev_t *d, const char *dev) { return -1; }
+// Thread served by the calling thread; used by enter_cs and exit_cs
+static __thread pionic_thd_t curr_thd;
 
-void pionic_dev_close(pionic_dev_t *d) {}
+// Define enter_cs and exit_cs for using core functions in userspace
+void enter_cs() {
+  cs_enter_with(&curr_thd->cs_stats, curr_thd->cs_spin_limit, curr_thd->cs_wfe,
+                curr_thd->base + LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET);
+}
+
+void exit_cs() {
+  cs_exit(curr_thd->base + LAUBERHORN_ECI_PREEMPT_CTRL_OFFSET);
+}
+
+static inline pionic_thd_t thd_enter(pionic_thd_t t) {
+  assert(curr_thd == t && "thread handle used from another thread");
+  return t;
+}
+
+int pionic_thd_create(pionic_dev_t d, pionic_thd *t) {
+  uint32_t parity;
+
+  memset(t, 0, sizeof(*t));
+  t->dev = d;
+  t->cs_spin_limit = d->cs_spin_limit;
+  t->cs_wfe = d->cs_wfe;
+
+  if (curr_thd) {
+    pr_err("Calling thread already serves a pionic_thd\n");
+    return -1;
+  }
+
+  // the kernel allocates a thread slot and routes it on every mmap
+  t->base = mmap(NULL, LAUBERHORN_ECI_CORE_OFFSET, PROT_READ | PROT_WRITE,
+                 MAP_SHARED, d->fd, 0);
+  if (t->base == MAP_FAILED) {
+    perror("mmap thread CL window");
+    return -1;
+  }
+
+  t->state.rx_overflow_buf = malloc(LAUBERHORN_MTU);
+  t->state.rx_overflow_buf_size = LAUBERHORN_MTU;
+  t->state.tx_overflow_buf = malloc(LAUBERHORN_MTU);
+  t->state.tx_overflow_buf_size = LAUBERHORN_MTU;
+  if (!t->state.rx_overflow_buf || !t->state.tx_overflow_buf) {
+    pr_err("Failed to allocate packet buffers\n");
+    goto fail;
+  }
+
+  // the worker core may have been used by another thread before
+  if (ioctl(d->fd, LAUBERHORN_IOCTL_THD_RX_PARITY, &parity) < 0) {
+    perror("read RX parity");
+    goto fail;
+  }
+  t->state.rx_next_cl = parity ? 1 : 0;
+
+  curr_thd = t;
+
+  // the NIC drains the TX ring before a preemption, so it starts out empty;
+  // only the consumed count has to be picked up from the status CL
+  enter_cs();
+  t->state.tx_prod = t->state.tx_cons = core_eci_tx_read_status(
+      core_eci_tx_slot(t->base, 0) + LAUBERHORN_ECI_TX_STATUS_OFFSET);
+  BARRIER;
+  exit_cs();
+
+  return 0;
+
+fail:
+  free(t->state.rx_overflow_buf);
+  free(t->state.tx_overflow_buf);
+  munmap(t->base, LAUBERHORN_ECI_CORE_OFFSET);
+  return -1;
+}
+
+void pionic_thd_destroy(pionic_thd *t) {
+  thd_enter(t);
+
+  // unmapping releases the thread slot in the kernel
+  munmap(t->base, LAUBERHORN_ECI_CORE_OFFSET);
+  free(t->state.rx_overflow_buf);
+  free(t->state.tx_overflow_buf);
 
-bool pionic_thd_rx(pionic_thd t, pionic_pkt_desc_t *desc) {
+  curr_thd = NULL;
+}
+
+int pionic_dev_open(pionic_dev_t *d, const char *dev) {
+  pionic_dev_t ret = calloc(1, sizeof(struct pionic_dev));
+  if (!ret)
+    return -1;
+
+  ret->fd = open(dev ? dev : "/dev/lauberhorn", O_RDWR | O_CLOEXEC);
+  if (ret->fd < 0) {
+    perror("open lauberhorn device");
+    free(ret);
+    return -1;
+  }
 
-  volatile bool rx_parity_ptr = false;
+  ret->cs_spin_limit = CS_DEFAULT_SPIN_LIMIT;
+  ret->cs_wfe = true;
+  cs_probe();
+
+  *d = ret;
+  return 0;
+}
 
-  bool result = core_eci_rx(thd->pionic_base, &t->rx_parity, desc);
-  assert(result);
+void pionic_dev_close(pionic_dev_t *d) {
+  // closing the device deregisters the process and all its services and
+  // clients
+  close((*d)->fd);
+  free(*d);
+  *d = NULL;
+}
 
-  return result;
+bool pionic_thd_rx(pionic_thd_t t, pionic_pkt_desc_t *desc) {
+  thd_enter(t);
+  return core_eci_rx(t->base, &t->state, desc);
 }
 
-void pionic_thd_rx_ack(pionic_thd t, pionic_pkt_desc_t *desc) {
-  core_eci_rx_ack(desc);
+void pionic_thd_rx_ack(pionic_thd_t t, pionic_pkt_desc_t *desc) {
+  thd_enter(t);
+  core_eci_rx_ack(&t->state, desc);
 }
 
-void pionic_thd_tx_prepare_desc(pionic_thd t, pionic_pkt_desc_t *desc) {
+void pionic_thd_tx_prepare_desc(pionic_thd_t t, pionic_pkt_desc_t *desc) {
+  thd_enter(t);
+  core_eci_tx_prepare_desc(desc, &t->state);
+}
 
-  core_eci_tx_prepare_desc(desc);
+void pionic_thd_tx(pionic_thd_t t, pionic_pkt_desc_t *desc) {
+  thd_enter(t);
+  // keep waiting for a free slot, in bounded rounds
+  while (!core_eci_tx_wait_slot(t->base, &t->state))
+    ;
+  core_eci_tx(t->base, &t->state, desc);
 }
-void pionic_thd_tx(pionic_thd t, pionic_pkt_desc_t *desc) {
 
-  bool result = core_eci_tx(thd->pionic_base, &t->tx_parity, desc);
-  assert(result);
+bool pionic_oncrpc_listen_port_open(pionic_dev_t d, int port) {
+  lauberhorn_port_t p = port;
 
-  return result;
+  if (ioctl(d->fd, LAUBERHORN_IOCTL_OPEN_PORT, &p) < 0) {
+    perror("open listen port");
+    return false;
+  }
+  return true;
 }
 
-bool pionic_oncrpc_listen_port_open(pionic_dev_t d, int port) { return false; }
+void pionic_oncrpc_listen_port_close(pionic_dev_t d, int port) {
+  lauberhorn_port_t p = port;
 
-void pionic_oncrpc_listen_port_close(pionic_dev_t d, int port) {}
+  // services registered on the port are dropped with it
+  if (ioctl(d->fd, LAUBERHORN_IOCTL_CLOSE_PORT, &p) < 0)
+    perror("close listen port");
+}
 
 int pionic_oncrpc_service_register(pionic_dev_t d, int prog_num, int ver,
-                                   int proc, void *func_ptr) {
-  return -1;
+                                   int proc, void *func_ptr, int port) {
+  lauberhorn_reg_srv_t req = {
+      .func_ptr = func_ptr,
+      .prog_num = prog_num,
+      .prog_ver = ver,
+      .proc_num = proc,
+      .port = port,
+  };
+
+  if (ioctl(d->fd, LAUBERHORN_IOCTL_REG_SRV, &req) < 0) {
+    perror("register service");
+    return -1;
+  }
+  return req.id;
 }
 
-void pionic_oncrpc_service_deregister(pionic_dev_t d, int idx) {}
+void pionic_oncrpc_service_deregister(pionic_dev_t d, int idx) {
+  lauberhorn_srv_id_t id = idx;
 
+  if (ioctl(d->fd, LAUBERHORN_IOCTL_DEREG_SRV, &id) < 0)
+    perror("deregister service");
+}
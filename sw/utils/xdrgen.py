@@ -0,0 +1,843 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause OR GPL-2.0-only
+
+"""XDR stub compiler for Lauberhorn ONC RPC services.
+
+Reads an rpcgen-style interface file (.x) and emits <name>_xdr.h and
+<name>_xdr.c: C types, decoders and encoders specialized for the split argument
+layout of usr-include/xdr.h, and one serving loop handler per procedure.
+
+  - Everything up to the first variable-length field is addressed by constant
+    word index; inside the inline words this is a plain load from call->args.
+  - Variable-length opaque and string fields decode to lauberhorn_xdr_view_t
+    pointing into the RX cachelines.
+  - Replies are written directly into reply_args and the reply view (the TX
+    slot, unbatched).
+
+For a procedure
+
+  program CALC { version CALC_V1 { int ADD(pair) = 1; } = 1; } = 0x20000001;
+
+the application implements
+
+  int add_1_svc(const pair *args, int32_t *res, lauberhorn_rpc_call_t *call,
+                void *arg);
+
+and registers add_1_lauberhorn (or all of them with calc_1_register).
+
+Supported: const, enum, struct, typedef, [unsigned] int / hyper, bool, float,
+double, opaque[n], opaque<n>, string<n>, fixed arrays and bounded
+variable-length arrays.  Unions, optional data (*) and quadruple are rejected.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+# --- parser ---
+
+TOKEN = re.compile(r'\s*(?:(0x[0-9a-fA-F]+|-?\d+)|([A-Za-z_]\w*)|(.))')
+
+class XdrError(Exception):
+    pass
+
+class Prim:
+    # name: (C type, words)
+    TYPES = {
+        'int': ('int32_t', 1),
+        'uint': ('uint32_t', 1),
+        'hyper': ('int64_t', 2),
+        'uhyper': ('uint64_t', 2),
+        'bool': ('bool', 1),
+        'float': ('float', 1),
+        'double': ('double', 2),
+    }
+
+    def __init__(self, kind):
+        self.kind = kind
+
+class Named:
+    def __init__(self, name):
+        self.name = name
+
+class Enum:
+    def __init__(self, name, values):
+        self.name = name
+        self.values = values
+
+class Struct:
+    def __init__(self, name, fields):
+        self.name = name
+        self.fields = fields
+
+class Typedef:
+    def __init__(self, name, target):
+        self.name = name
+        self.target = target
+
+class FixedOpaque:
+    def __init__(self, n):
+        self.n = n
+
+class VarBytes:
+    def __init__(self, max_len, string):
+        self.max_len = max_len
+        self.string = string
+
+class FixedArray:
+    def __init__(self, elem, n):
+        self.elem = elem
+        self.n = n
+
+class VarArray:
+    def __init__(self, elem, max_len):
+        self.elem = elem
+        self.max_len = max_len
+
+class Proc:
+    def __init__(self, name, num, arg, res):
+        self.name = name
+        self.num = num
+        self.arg = arg
+        self.res = res
+
+class Version:
+    def __init__(self, name, num, procs):
+        self.name = name
+        self.num = num
+        self.procs = procs
+
+class Program:
+    def __init__(self, name, num, versions):
+        self.name = name
+        self.num = num
+        self.versions = versions
+
+class Parser:
+    def __init__(self, text, path):
+        self.path = path
+        self.toks = []
+        # rpcgen pass-through lines and comments carry no declarations
+        text = re.sub(r'/\*.*?\*/', lambda m: '\n' * m.group(0).count('\n'),
+                      text, flags=re.S)
+        for lineno, line in enumerate(text.split('\n'), 1):
+            line = re.sub(r'//.*', '', line)
+            if line.lstrip().startswith('%'):
+                continue
+            for m in TOKEN.finditer(line):
+                tok = m.group(1) or m.group(2) or m.group(3)
+                if tok:
+                    self.toks.append((tok, lineno))
+        self.pos = 0
+        self.consts = {}
+        self.types = {}
+        self.decls = []
+        self.programs = []
+
+    def error(self, msg):
+        lineno = self.toks[min(self.pos, len(self.toks) - 1)][1] \
+            if self.toks else 0
+        raise XdrError(f'{self.path}:{lineno}: {msg}')
+
+    def peek(self):
+        return self.toks[self.pos][0] if self.pos < len(self.toks) else None
+
+    def next(self):
+        tok = self.peek()
+        if tok is None:
+            self.error('unexpected end of file')
+        self.pos += 1
+        return tok
+
+    def expect(self, tok):
+        got = self.next()
+        if got != tok:
+            self.pos -= 1
+            self.error(f'expected "{tok}", got "{got}"')
+
+    def ident(self):
+        tok = self.next()
+        if not re.match(r'[A-Za-z_]\w*$', tok):
+            self.pos -= 1
+            self.error(f'expected an identifier, got "{tok}"')
+        return tok
+
+    def value(self):
+        tok = self.next()
+        if re.match(r'0x[0-9a-fA-F]+$', tok):
+            return int(tok, 16)
+        if re.match(r'-?\d+$', tok):
+            return int(tok, 8 if len(tok) > 1 and tok[0] == '0' else 10)
+        if tok in self.consts:
+            return self.consts[tok]
+        self.pos -= 1
+        self.error(f'unknown constant "{tok}"')
+
+    def parse(self):
+        while self.peek() is not None:
+            kw = self.next()
+            if kw == 'const':
+                name = self.ident()
+                self.expect('=')
+                self.consts[name] = self.value()
+                self.decls.append(('const', name))
+            elif kw == 'enum':
+                self.add_type(self.enum_body(self.ident()))
+            elif kw == 'struct':
+                self.add_type(self.struct_body(self.ident()))
+            elif kw == 'typedef':
+                name, ty = self.declaration()
+                self.add_type(Typedef(name, ty))
+            elif kw == 'program':
+                self.programs.append(self.program())
+            elif kw == 'union':
+                self.error('unions are not supported')
+            else:
+                self.pos -= 1
+                self.error(f'unexpected "{kw}"')
+            self.expect(';')
+        return self
+
+    def add_type(self, ty):
+        if ty.name in self.types:
+            self.error(f'"{ty.name}" redefined')
+        self.types[ty.name] = ty
+        self.decls.append(('type', ty.name))
+
+    def enum_body(self, name):
+        values = []
+        self.expect('{')
+        while True:
+            ident = self.ident()
+            self.expect('=')
+            val = self.value()
+            self.consts[ident] = val
+            values.append((ident, val))
+            if self.next() == '}':
+                return Enum(name, values)
+            self.pos -= 1
+            self.expect(',')
+
+    def struct_body(self, name):
+        fields = []
+        self.expect('{')
+        while self.peek() != '}':
+            fields.append(self.declaration())
+            self.expect(';')
+        self.next()
+        if not fields:
+            self.error(f'struct "{name}" is empty')
+        return Struct(name, fields)
+
+    def type_specifier(self):
+        tok = self.next()
+        if tok == 'unsigned':
+            tok = self.peek()
+            if tok in ('int', 'hyper'):
+                self.next()
+                return Prim('u' + tok)
+            return Prim('uint')
+        if tok in ('int', 'hyper', 'bool', 'float', 'double'):
+            return Prim(tok)
+        if tok == 'quadruple':
+            self.pos -= 1
+            self.error('quadruple is not supported')
+        if tok in ('struct', 'enum', 'union'):
+            if self.peek() == '{':
+                self.error(f'anonymous {tok} types are not supported')
+            tok = self.ident()
+        if tok not in self.types:
+            self.pos -= 1
+            self.error(f'unknown type "{tok}"')
+        return Named(tok)
+
+    # (name, type) of one declaration; void gives (None, None)
+    def declaration(self):
+        if self.peek() == 'void':
+            self.next()
+            return None, None
+        if self.peek() in ('opaque', 'string'):
+            kind = self.next()
+            name = self.ident()
+            if self.peek() == '[' and kind == 'opaque':
+                self.next()
+                n = self.value()
+                self.expect(']')
+                return name, FixedOpaque(n)
+            return name, VarBytes(self.var_bound(), kind == 'string')
+
+        ty = self.type_specifier()
+        if self.peek() == '*':
+            self.error('optional data is not supported')
+        name = self.ident()
+        if self.peek() == '[':
+            self.next()
+            n = self.value()
+            self.expect(']')
+            return name, FixedArray(ty, n)
+        if self.peek() == '<':
+            return name, VarArray(ty, self.var_bound())
+        return name, ty
+
+    def var_bound(self):
+        self.expect('<')
+        if self.peek() == '>':
+            self.next()
+            return None
+        n = self.value()
+        self.expect('>')
+        return n
+
+    def program(self):
+        name = self.ident()
+        versions = []
+        self.expect('{')
+        while self.peek() != '}':
+            self.expect('version')
+            vname = self.ident()
+            procs = []
+            self.expect('{')
+            while self.peek() != '}':
+                res = None if self.peek() == 'void' else self.type_specifier()
+                if res is None:
+                    self.next()
+                pname = self.ident()
+                self.expect('(')
+                arg = None if self.peek() == 'void' else self.type_specifier()
+                if arg is None:
+                    self.next()
+                if self.peek() == ',':
+                    self.error('procedures take at most one argument')
+                self.expect(')')
+                self.expect('=')
+                procs.append(Proc(pname, self.value(), arg, res))
+                self.expect(';')
+            self.next()
+            self.expect('=')
+            versions.append(Version(vname, self.value(), procs))
+            self.expect(';')
+        self.next()
+        self.expect('=')
+        return Program(name, self.value(), versions)
+
+# --- code generation ---
+
+# Word offset from a base: const + sum(terms), rendered for the compiler to
+# fold.  synced: the cursor already points there
+class Off:
+    def __init__(self, terms=(), const=0, synced=False):
+        self.terms = tuple(terms)
+        self.const = const
+        self.synced = synced
+
+    def add(self, words, term=None):
+        terms = self.terms + ((term,) if term else ())
+        return Off(terms, self.const + words)
+
+    def __str__(self):
+        parts = list(self.terms)
+        if self.const or not parts:
+            parts.append(str(self.const))
+        return ' + '.join(parts)
+
+    def bytes(self):
+        s = str(self)
+        return f'({s}) * LAUBERHORN_XDR_UNIT' if ' ' in s \
+            else f'{s} * LAUBERHORN_XDR_UNIT'
+
+    # statement moving the cursor called cur here, if needed
+    def sync(self, cur):
+        return [] if self.synced else [f'{cur}->pos = {self.bytes()};']
+
+def loop_term(i, words):
+    return i if words == 1 else f'{i} * {words}'
+
+class Gen:
+    def __init__(self, spec, base):
+        self.spec = spec
+        self.base = base
+        self.guard = '__' + re.sub(r'\W', '_', base).upper() + '_XDR_H__'
+
+    def resolve(self, ty):
+        while isinstance(ty, Named):
+            ty = self.spec.types[ty.name]
+        return ty
+
+    def ctype(self, ty):
+        if isinstance(ty, Prim):
+            return Prim.TYPES[ty.kind][0]
+        if isinstance(ty, Named):
+            return ty.name
+        if isinstance(ty, (FixedOpaque, VarBytes)):
+            return 'lauberhorn_xdr_view_t'
+        raise XdrError('no C type for an anonymous aggregate')
+
+    def cdecl(self, name, ty, indent):
+        if isinstance(ty, FixedArray):
+            return f'{self.ctype(ty.elem)} {name}[{ty.n}];'
+        if isinstance(ty, VarArray):
+            if ty.max_len is None:
+                raise XdrError(f'"{name}": variable-length arrays need a bound')
+            return (f'struct {{\n{indent}  uint32_t len;\n'
+                    f'{indent}  {self.ctype(ty.elem)} val[{ty.max_len}];\n'
+                    f'{indent}}} {name};')
+        return f'{self.ctype(ty)} {name};'
+
+    # size in words if fixed, else None
+    def words(self, ty):
+        ty = self.resolve(ty)
+        if isinstance(ty, Prim):
+            return Prim.TYPES[ty.kind][1]
+        if isinstance(ty, Enum):
+            return 1
+        if isinstance(ty, Typedef):
+            return self.words(ty.target)
+        if isinstance(ty, Struct):
+            total = 0
+            for _, fty in ty.fields:
+                w = self.words(fty)
+                if w is None:
+                    return None
+                total += w
+            return total
+        if isinstance(ty, FixedOpaque):
+            return (ty.n + 3) // 4
+        if isinstance(ty, FixedArray):
+            w = self.words(ty.elem)
+            return None if w is None else w * ty.n
+        return None
+
+    # words before the first variable-length part, which the static path
+    # covers with one bounds check
+    def prefix(self, ty):
+        w = self.words(ty)
+        if w is not None:
+            return w
+        ty = self.resolve(ty)
+        if isinstance(ty, Typedef):
+            return self.prefix(ty.target)
+        if isinstance(ty, Struct):
+            total = 0
+            for _, fty in ty.fields:
+                w = self.words(fty)
+                if w is None:
+                    return total + self.prefix(fty)
+                total += w
+        return 0
+
+    # Scalar decode / encode expressions from the raw word(s)
+    def scalar_from(self, ty, raw32, raw64):
+        if isinstance(ty, Enum):
+            return f'({ty.name}){raw32}'
+        return {
+            'int': f'(int32_t){raw32}',
+            'uint': raw32,
+            'hyper': f'(int64_t){raw64}',
+            'uhyper': raw64,
+            'bool': f'{raw32} != 0',
+            'float': f'lauberhorn_xdr_f32({raw32})',
+            'double': f'lauberhorn_xdr_f64({raw64})',
+        }[ty.kind]
+
+    def scalar_to(self, ty, v):
+        if isinstance(ty, Enum):
+            return f'(uint32_t){v}'
+        return {
+            'int': f'(uint32_t){v}',
+            'uint': v,
+            'hyper': f'(uint64_t){v}',
+            'uhyper': v,
+            'bool': f'{v} ? 1 : 0',
+            'float': f'lauberhorn_xdr_f32_bits({v})',
+            'double': f'lauberhorn_xdr_f64_bits({v})',
+        }[ty.kind]
+
+    @staticmethod
+    def is64(ty):
+        return isinstance(ty, Prim) and Prim.TYPES[ty.kind][1] == 2
+
+    # Emit the decoder of ty into lv.  off is the static word offset, or None
+    # once the cursor has taken over; returns the offset after ty
+    def dec(self, out, ty, lv, off, ind, depth):
+        named = ty.name if isinstance(ty, Named) else None
+        ty = self.resolve(ty)
+        pad = '  ' * ind
+
+        if isinstance(ty, Typedef):
+            return self.dec(out, ty.target, lv, off, ind, depth)
+
+        if isinstance(ty, (Prim, Enum)):
+            if off is not None:
+                fn = 'lauberhorn_xdr_word64' if self.is64(ty) \
+                    else 'lauberhorn_xdr_word'
+                raw = f'{fn}(in->call, {off})'
+                out.append(f'{pad}{lv} = {self.scalar_from(ty, raw, raw)};')
+                return off.add(2 if self.is64(ty) else 1)
+            if self.is64(ty):
+                out.append(f'{pad}if (!lauberhorn_xdr_get_u64(in, &u64))')
+                out.append(f'{pad}  return false;')
+            else:
+                out.append(f'{pad}if (!lauberhorn_xdr_get_u32(in, &u32))')
+                out.append(f'{pad}  return false;')
+            out.append(f'{pad}{lv} = {self.scalar_from(ty, "u32", "u64")};')
+            return None
+
+        if isinstance(ty, Struct):
+            # fixed parts are flattened; named structs go through their
+            # decoder once the cursor has taken over
+            if off is None and named:
+                out.append(f'{pad}if (!lauberhorn_xdr_decode_{named}(in, '
+                           f'&{lv}))')
+                out.append(f'{pad}  return false;')
+                return None
+            for fname, fty in ty.fields:
+                off = self.dec(out, fty, f'{lv}.{fname}', off, ind, depth)
+            return off
+
+        if isinstance(ty, FixedOpaque):
+            if off is not None:
+                out += [pad + l for l in off.sync('in')]
+            out.append(f'{pad}if (!lauberhorn_xdr_get_view(in, {ty.n}, '
+                       f'&{lv}))')
+            out.append(f'{pad}  return false;')
+            return None if off is None else off.add(self.words(ty))
+
+        if isinstance(ty, FixedArray):
+            i = f'i{depth}'
+            ew = self.words(ty.elem)
+            if off is not None and ew is None:
+                out += [pad + l for l in off.sync('in')]
+                off = None
+            out.append(f'{pad}for (size_t {i} = 0; {i} < {ty.n}; ++{i}) {{')
+            eoff = None if off is None else off.add(0, loop_term(i, ew))
+            self.dec(out, ty.elem, f'{lv}[{i}]', eoff, ind + 1, depth + 1)
+            out.append(f'{pad}}}')
+            return None if off is None else off.add(ew * ty.n)
+
+        # variable length: the cursor takes over
+        if off is not None:
+            out += [pad + l for l in off.sync('in')]
+        bound = f' || u32 > {ty.max_len}' if ty.max_len is not None else ''
+        out.append(f'{pad}if (!lauberhorn_xdr_get_u32(in, &u32){bound})')
+        out.append(f'{pad}  return false;')
+        if isinstance(ty, VarBytes):
+            out.append(f'{pad}if (!lauberhorn_xdr_get_view(in, u32, &{lv}))')
+            out.append(f'{pad}  return false;')
+        else:
+            i = f'i{depth}'
+            out.append(f'{pad}{lv}.len = u32;')
+            out.append(f'{pad}for (size_t {i} = 0; {i} < {lv}.len; ++{i}) {{')
+            self.dec(out, ty.elem, f'{lv}.val[{i}]', None, ind + 1, depth + 1)
+            out.append(f'{pad}}}')
+        return None
+
+    # Encoder counterpart of dec
+    def enc(self, out, ty, v, off, ind, depth):
+        named = ty.name if isinstance(ty, Named) else None
+        ty = self.resolve(ty)
+        pad = '  ' * ind
+
+        if isinstance(ty, Typedef):
+            return self.enc(out, ty.target, v, off, ind, depth)
+
+        if isinstance(ty, (Prim, Enum)):
+            val = self.scalar_to(ty, v)
+            if off is not None:
+                fn = 'lauberhorn_xdr_put_word64' if self.is64(ty) \
+                    else 'lauberhorn_xdr_put_word'
+                out.append(f'{pad}{fn}(out->call, {off}, {val});')
+                return off.add(2 if self.is64(ty) else 1)
+            fn = 'lauberhorn_xdr_put_u64' if self.is64(ty) \
+                else 'lauberhorn_xdr_put_u32'
+            out.append(f'{pad}if (!{fn}(out, {val}))')
+            out.append(f'{pad}  return false;')
+            return None
+
+        if isinstance(ty, Struct):
+            if off is None and named:
+                out.append(f'{pad}if (!lauberhorn_xdr_encode_{named}(out, '
+                           f'&{v}))')
+                out.append(f'{pad}  return false;')
+                return None
+            for fname, fty in ty.fields:
+                off = self.enc(out, fty, f'{v}.{fname}', off, ind, depth)
+            return off
+
+        if isinstance(ty, FixedOpaque):
+            if off is not None:
+                out += [pad + l for l in off.sync('out')]
+            out.append(f'{pad}if ({v}.len != {ty.n} ||')
+            out.append(f'{pad}    !lauberhorn_xdr_put_bytes(out, {v}.buf, '
+                       f'{ty.n}))')
+            out.append(f'{pad}  return false;')
+            return None if off is None else off.add(self.words(ty))
+
+        if isinstance(ty, FixedArray):
+            i = f'i{depth}'
+            ew = self.words(ty.elem)
+            if off is not None and ew is None:
+                out += [pad + l for l in off.sync('out')]
+                off = None
+            out.append(f'{pad}for (size_t {i} = 0; {i} < {ty.n}; ++{i}) {{')
+            eoff = None if off is None else off.add(0, loop_term(i, ew))
+            self.enc(out, ty.elem, f'{v}[{i}]', eoff, ind + 1, depth + 1)
+            out.append(f'{pad}}}')
+            return None if off is None else off.add(ew * ty.n)
+
+        if off is not None:
+            out += [pad + l for l in off.sync('out')]
+        bound = f'{v}.len > {ty.max_len} || ' \
+            if ty.max_len is not None else ''
+        out.append(f'{pad}if ({bound}!lauberhorn_xdr_put_u32(out, {v}.len))')
+        out.append(f'{pad}  return false;')
+        if isinstance(ty, VarBytes):
+            out.append(f'{pad}if (!lauberhorn_xdr_put_bytes(out, {v}.buf, '
+                       f'{v}.len))')
+            out.append(f'{pad}  return false;')
+        else:
+            i = f'i{depth}'
+            out.append(f'{pad}for (size_t {i} = 0; {i} < {v}.len; ++{i}) {{')
+            self.enc(out, ty.elem, f'{v}.val[{i}]', None, ind + 1, depth + 1)
+            out.append(f'{pad}}}')
+        return None
+
+    # Body of a decoder / encoder of ty at the cursor position.  Without base,
+    # the cursor is at the start of the call: offsets are constants
+    def dec_body(self, ty, lv, base):
+        out = ['  uint32_t u32 __attribute__((unused));',
+               '  uint64_t u64 __attribute__((unused));']
+        prefix = self.prefix(ty)
+        off = Off(synced=True)
+        if base and prefix:
+            out.append('  size_t w = in->pos / LAUBERHORN_XDR_UNIT;')
+            off = Off(('w',), synced=True)
+        out.append('')
+        if prefix:
+            out.append(f'  if (in->len - in->pos < {prefix} * '
+                       'LAUBERHORN_XDR_UNIT)')
+            out.append('    return false;')
+        off = self.dec(out, ty, lv, off, 1, 0)
+        if off is not None:
+            out += ['  ' + l for l in off.sync('in')]
+        out.append('  return true;')
+        return out
+
+    def enc_body(self, ty, v, base):
+        out = []
+        prefix = self.prefix(ty)
+        off = Off(synced=True)
+        if base and prefix:
+            out.append('  size_t w = out->pos / LAUBERHORN_XDR_UNIT;')
+            out.append('')
+            off = Off(('w',), synced=True)
+        if prefix:
+            out.append(f'  if (out->cap - out->pos < {prefix} * '
+                       'LAUBERHORN_XDR_UNIT)')
+            out.append('    return false;')
+        off = self.enc(out, ty, v, off, 1, 0)
+        if off is not None:
+            out += ['  ' + l for l in off.sync('out')]
+        out.append('  return true;')
+        return out
+
+    def proc_ident(self, proc, vers):
+        return f'{proc.name.lower()}_{vers.num}'
+
+    def header(self):
+        h = [f'// Generated by utils/xdrgen.py from {self.base}.x; do not edit',
+             '', f'#ifndef {self.guard}', f'#define {self.guard}', '',
+             '#include "xdr.h"', '']
+
+        for kind, name in self.spec.decls:
+            if kind == 'const':
+                h.append(f'#define {name} {self.spec.consts[name]}')
+                continue
+            ty = self.spec.types[name]
+            if isinstance(ty, Enum):
+                h.append(f'typedef enum {name} {{')
+                for ident, val in ty.values:
+                    h.append(f'  {ident} = {val},')
+                h.append(f'}} {name};')
+            elif isinstance(ty, Struct):
+                h.append(f'typedef struct {name} {{')
+                for fname, fty in ty.fields:
+                    h.append('  ' + self.cdecl(fname, fty, '  '))
+                h.append(f'}} {name};')
+            else:
+                h.append('typedef ' + self.cdecl(name, ty.target, ''))
+            h.append('')
+
+            if isinstance(ty, Enum):
+                continue
+            h.append(f'static inline bool lauberhorn_xdr_decode_{name}('
+                     f'lauberhorn_xdr_in_t *in,')
+            h.append(f'    {name} *v) {{')
+            h += self.dec_body(Named(name), '(*v)', True)
+            h.append('}')
+            h.append('')
+            h.append(f'static inline bool lauberhorn_xdr_encode_{name}('
+                     f'lauberhorn_xdr_out_t *out,')
+            h.append(f'    const {name} *v) {{')
+            h += self.enc_body(Named(name), '(*v)', True)
+            h.append('}')
+            h.append('')
+
+        for prog in self.spec.programs:
+            h.append(f'#define {prog.name} {prog.num:#x}')
+            for vers in prog.versions:
+                h.append(f'#define {vers.name} {vers.num}')
+                for proc in vers.procs:
+                    h.append(f'#define {proc.name} {proc.num}')
+            h.append('')
+
+            for vers in prog.versions:
+                for proc in vers.procs:
+                    h += self.proc_decls(proc, vers)
+
+                ident = f'{prog.name.lower()}_{vers.num}'
+                h.append(f'#define {ident.upper()}_NUM_PROCS '
+                         f'{len(vers.procs)}')
+                h.append('')
+                h.append('// Register all procedures of the version on port, '
+                         'opened with')
+                h.append('// pionic_oncrpc_listen_port_open; idx receives the '
+                         'service indices')
+                h.append(f'int {ident}_register(pionic_dev_t d, int port, '
+                         f'int idx[{ident.upper()}_NUM_PROCS]);')
+                h.append(f'void {ident}_deregister(pionic_dev_t d, '
+                         f'const int idx[{ident.upper()}_NUM_PROCS]);')
+                h.append('')
+
+        h.append(f'#endif // {self.guard}')
+        return '\n'.join(h) + '\n'
+
+    def proc_decls(self, proc, vers):
+        ident = self.proc_ident(proc, vers)
+        h = []
+
+        # the call arguments start at word 0: constant offsets all the way
+        # through the fixed-size prefix
+        if proc.arg:
+            h.append(f'static inline bool {ident}_decode_args('
+                     'lauberhorn_xdr_in_t *in,')
+            h.append(f'    {self.ctype(proc.arg)} *v) {{')
+            h += self.dec_body(proc.arg, '(*v)', False)
+            h.append('}')
+            h.append('')
+        if proc.res:
+            h.append(f'static inline bool {ident}_encode_res('
+                     'lauberhorn_xdr_out_t *out,')
+            h.append(f'    const {self.ctype(proc.res)} *v) {{')
+            h += self.enc_body(proc.res, '(*v)', False)
+            h.append('}')
+            h.append('')
+
+        params = []
+        if proc.arg:
+            params.append(f'const {self.ctype(proc.arg)} *args')
+        if proc.res:
+            params.append(f'{self.ctype(proc.res)} *res')
+        params += ['lauberhorn_rpc_call_t *call', 'void *arg']
+        h.append('// Implemented by the application; returns 0 to reply, or '
+                 'negative to drop')
+        h.append(f'int {ident}_svc({", ".join(params)});')
+        h.append('// Handler to register with pionic_oncrpc_service_register')
+        h.append(f'int {ident}_lauberhorn(lauberhorn_rpc_call_t *call, '
+                 'void *arg);')
+        h.append('')
+        return h
+
+    def source(self):
+        c = [f'// Generated by utils/xdrgen.py from {self.base}.x; do not edit',
+             '', '#include <string.h>', '', f'#include "{self.base}_xdr.h"',
+             '',
+             '// copies of views that straddle the inline words, the inline '
+             'half-CL and',
+             '// the overflow CLs; at most one packet worth per call',
+             'static __thread uint8_t xdr_scratch[LAUBERHORN_MTU];', '']
+
+        for prog in self.spec.programs:
+            for vers in prog.versions:
+                for proc in vers.procs:
+                    c += self.handler(proc, vers)
+                c += self.register(prog, vers)
+
+        return '\n'.join(c) + '\n'
+
+    def handler(self, proc, vers):
+        ident = self.proc_ident(proc, vers)
+        args = ['call', 'arg']
+        c = [f'int {ident}_lauberhorn(lauberhorn_rpc_call_t *call, '
+             'void *arg) {',
+             '  lauberhorn_xdr_in_t in;', '  lauberhorn_xdr_out_t out;']
+        if proc.arg:
+            c.append(f'  {self.ctype(proc.arg)} a;')
+            args.insert(0, '&a')
+        if proc.res:
+            c.append(f'  {self.ctype(proc.res)} r;')
+            args.insert(1 if proc.arg else 0, '&r')
+        c += ['  int ret;', '',
+              '  if (!lauberhorn_xdr_in_init(&in, call, xdr_scratch, '
+              'sizeof(xdr_scratch)))',
+              '    return -1;']
+        if proc.arg:
+            c += [f'  if (!{ident}_decode_args(&in, &a))', '    return -1;']
+        if proc.res:
+            c.append('  memset(&r, 0, sizeof(r));')
+        c += ['',
+              f'  ret = {ident}_svc({", ".join(args)});',
+              '  if (ret < 0)', '    return ret;', '',
+              '  lauberhorn_xdr_out_init(&out, call);']
+        if proc.res:
+            c += [f'  if (!{ident}_encode_res(&out, &r))', '    return -1;']
+        c += ['  lauberhorn_xdr_out_finish(&out);', '  return 0;', '}', '']
+        return c
+
+    def register(self, prog, vers):
+        ident = f'{prog.name.lower()}_{vers.num}'
+        n = f'{ident.upper()}_NUM_PROCS'
+        c = [f'int {ident}_register(pionic_dev_t d, int port, '
+             f'int idx[{n}]) {{']
+        for i, proc in enumerate(vers.procs):
+            c += [f'  idx[{i}] = pionic_oncrpc_service_register(',
+                  f'      d, {prog.name}, {vers.name}, {proc.name},',
+                  f'      (void *){self.proc_ident(proc, vers)}_lauberhorn, '
+                  'port);',
+                  f'  if (idx[{i}] < 0)',
+                  '    goto fail;']
+        c += ['  return 0;', '', 'fail:',
+              f'  for (int i = 0; i < {n} && idx[i] >= 0; ++i)',
+              '    pionic_oncrpc_service_deregister(d, idx[i]);',
+              '  return -1;', '}', '',
+              f'void {ident}_deregister(pionic_dev_t d, '
+              f'const int idx[{n}]) {{',
+              f'  for (int i = 0; i < {n}; ++i)',
+              '    pionic_oncrpc_service_deregister(d, idx[i]);', '}', '']
+        return c
+
+def main():
+    ap = argparse.ArgumentParser(description='XDR stub compiler for Lauberhorn')
+    ap.add_argument('input', help='interface definition (.x)')
+    ap.add_argument('-o', '--output-dir', default='.',
+                    help='directory for <name>_xdr.h and <name>_xdr.c')
+    args = ap.parse_args()
+
+    base = os.path.splitext(os.path.basename(args.input))[0]
+    with open(args.input) as f:
+        text = f.read()
+
+    try:
+        gen = Gen(Parser(text, args.input).parse(), base)
+        header, source = gen.header(), gen.source()
+    except XdrError as e:
+        print(f'xdrgen: {e}', file=sys.stderr)
+        sys.exit(1)
+
+    with open(os.path.join(args.output_dir, f'{base}_xdr.h'), 'w') as f:
+        f.write(header)
+    with open(os.path.join(args.output_dir, f'{base}_xdr.c'), 'w') as f:
+        f.write(source)
+
+if __name__ == '__main__':
+    main()